@@ -23,7 +23,10 @@
 #include <assert.h>
 #include <errno.h>
 #include <gmodule.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "vdo-map.h"
 #include <vdo-channel.h>
@@ -67,34 +70,83 @@ static void releaseVdoBuffers(ImgProvider_t* provider);
  * Responsible for fetching buffers/frames from VDO and re-enqueue buffers back
  * to VDO when they are not needed by the application. The ImgProvider always
  * keeps one or several of the most recent frames available in the application.
- * There are two queues involved: deliveredFrames and processedFrames.
+ * There are two rings involved: deliveredFrames and processedFrames.
  * - deliveredFrames are frames delivered from VDO and
  *   not processed by the client.
  * - processedFrames are frames that the client has consumed and handed
  *   back to the ImgProvider.
- * The thread works roughly like this:
+ * Each ring has one thread that adds and one thread that removes frames, so
+ * no locks are needed. The thread works roughly like this:
  * 1. The thread blocks on vdo_stream_get_buffer() until VDO deliver a new
- * frame.
- * 2. The fresh frame is put at the end of the deliveredFrame queue. If the
- *    client want to fetch a frame the item at the end of deliveredFrame
- *    list is returned.
- * 3. If there are any frames in the processedFrames list one of these are
- *    enqueued back to VDO to keep the flow of buffers.
- * 4. If the processedFrames list is empty we instead check if there are
- *    frames available in the deliveredFrames list. We want to make sure
- *    there is at least numAppFrames buffers available to the client to
- *    fetch. If there are more than numAppFrames in deliveredFrames we
- *    pick the first buffer (oldest) in the list and enqueue it to VDO.
+ *    frame.
+ * 2. If deliveredFrames already holds numAppFrames frames the oldest frame
+ *    is dropped and enqueued back to VDO right away.
+ * 3. The fresh frame is added to deliveredFrames and the client is woken up
+ *    through frameEventFd. If the client fetches a frame the newest frame is
+ *    returned and the older frames are dropped.
+ * 4. All frames in the processedFrames ring are enqueued back to VDO to keep
+ *    the flow of buffers.
 
  * param data Pointer to ImgProvider owning thread.
  * return Pointer to unused return data.
  */
 static void* threadEntry(void* data);
 
+/**
+ * brief Add a buffer at the head of a ring.
+ *
+ * Only one thread may add buffers to a ring.
+ *
+ * param ring Ring to add the buffer to.
+ * param buffer Buffer to add.
+ * return False if the ring is full, otherwise true.
+ */
+static bool pushFrame(FrameRing_t* ring, VdoBuffer* buffer);
+
+/**
+ * brief Remove the oldest buffer from a ring.
+ *
+ * Only one thread may remove buffers from a ring, or the thread that adds
+ * buffers as long as it uses this function while the other thread uses
+ * popLatestFrames().
+ *
+ * param ring Ring to remove the buffer from.
+ * return The oldest buffer, or NULL if the ring is empty.
+ */
+static VdoBuffer* popOldestFrame(FrameRing_t* ring);
+
+/**
+ * brief Remove all buffers from a ring.
+ *
+ * May run at the same time as popOldestFrame() in the thread that adds
+ * buffers, the buffers that thread removes are not returned here.
+ *
+ * param ring Ring to remove the buffers from.
+ * param older Array of NUM_VDO_BUFFERS where the buffers before the newest are
+ *             written, oldest first.
+ * param numOlder Number of buffers written to older.
+ * return The newest buffer, or NULL if the ring is empty.
+ */
+static VdoBuffer* popLatestFrames(FrameRing_t* ring, VdoBuffer** older, unsigned int* numOlder);
+
+/**
+ * brief Enqueue a buffer to VDO so that it can be filled with a new frame.
+ *
+ * param provider Pointer to ImgProvider owning the stream.
+ * param buffer Buffer to enqueue.
+ */
+static void enqueueFrame(ImgProvider_t* provider, VdoBuffer* buffer);
+
 ImgProvider_t*
 createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat format) {
-    bool mtxInitialized  = false;
-    bool condInitialized = false;
+    if (numFrames < 1 || numFrames > NUM_VDO_BUFFERS / 2) {
+        syslog(LOG_ERR,
+               "%s: Number of frames to keep must be 1 to %d, not %u",
+               __func__,
+               NUM_VDO_BUFFERS / 2,
+               numFrames);
+        return NULL;
+    }
 
     ImgProvider_t* provider = calloc(1, sizeof(ImgProvider_t));
     if (!provider) {
@@ -105,30 +157,9 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
     provider->vdoFormat    = format;
     provider->numAppFrames = numFrames;
 
-    if (pthread_mutex_init(&provider->frameMutex, NULL)) {
-        syslog(LOG_ERR, "%s: Unable to initialize mutex: %s", __func__, strerror(errno));
-        goto errorExit;
-    }
-    mtxInitialized = true;
-
-    if (pthread_cond_init(&provider->frameDeliverCond, NULL)) {
-        syslog(LOG_ERR,
-               "%s: Unable to initialize condition variable: %s",
-               __func__,
-               strerror(errno));
-        goto errorExit;
-    }
-    condInitialized = true;
-
-    provider->deliveredFrames = g_queue_new();
-    if (!provider->deliveredFrames) {
-        syslog(LOG_ERR, "%s: Unable to create deliveredFrames queue!", __func__);
-        goto errorExit;
-    }
-
-    provider->processedFrames = g_queue_new();
-    if (!provider->processedFrames) {
-        syslog(LOG_ERR, "%s: Unable to create processedFrames queue!", __func__);
+    provider->frameEventFd = eventfd(0, EFD_CLOEXEC);
+    if (provider->frameEventFd < 0) {
+        syslog(LOG_ERR, "%s: Unable to create eventfd: %s", __func__, strerror(errno));
         goto errorExit;
     }
 
@@ -140,17 +171,8 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
     return provider;
 
 errorExit:
-    if (mtxInitialized) {
-        pthread_mutex_destroy(&provider->frameMutex);
-    }
-    if (condInitialized) {
-        pthread_cond_destroy(&provider->frameDeliverCond);
-    }
-    if (provider->deliveredFrames) {
-        g_queue_free(provider->deliveredFrames);
-    }
-    if (provider->processedFrames) {
-        g_queue_free(provider->processedFrames);
+    if (provider && provider->frameEventFd >= 0) {
+        close(provider->frameEventFd);
     }
 
     free(provider);
@@ -166,11 +188,7 @@ void destroyImgProvider(ImgProvider_t* provider) {
 
     releaseVdoBuffers(provider);
 
-    pthread_mutex_destroy(&provider->frameMutex);
-    pthread_cond_destroy(&provider->frameDeliverCond);
-
-    g_queue_free(provider->deliveredFrames);
-    g_queue_free(provider->processedFrames);
+    close(provider->frameEventFd);
 
     free(provider);
 }
@@ -333,6 +351,20 @@ bool createStream(ImgProvider_t* provider, unsigned int w, unsigned int h) {
         goto errorExit;
     }
 
+    VdoMap* info = vdo_stream_get_info(vdoStream, &error);
+    if (!info) {
+        syslog(LOG_ERR,
+               "%s: Failed getting stream info: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        goto errorExit;
+    }
+    // Frames in vmem buffers must be converted to a dma-buf before larod can use them
+    const char* bufferType = vdo_map_get_string(info, "buffer.type", NULL, "memfd");
+    provider->pitch        = vdo_map_get_uint32(info, "pitch", w);
+    provider->dmabuf       = g_strcmp0(bufferType, "vmem") != 0;
+    g_object_unref(info);
+
     if (!allocateVdoBuffers(provider, vdoStream)) {
         syslog(LOG_ERR, "%s: Failed setting up VDO buffers!", __func__);
         goto errorExit;
@@ -376,31 +408,112 @@ static void releaseVdoBuffers(ImgProvider_t* provider) {
     }
 }
 
-VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
-    VdoBuffer* returnBuf = NULL;
-    pthread_mutex_lock(&provider->frameMutex);
+static bool pushFrame(FrameRing_t* ring, VdoBuffer* buffer) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
 
-    while (g_queue_get_length(provider->deliveredFrames) < 1) {
-        if (pthread_cond_wait(&provider->frameDeliverCond, &provider->frameMutex)) {
-            syslog(LOG_ERR, "%s: Failed to wait on condition: %s", __func__, strerror(errno));
-            goto errorExit;
+    if (head - tail >= NUM_VDO_BUFFERS) {
+        return false;
+    }
+    atomic_store_explicit(&ring->slots[head % NUM_VDO_BUFFERS], buffer, memory_order_relaxed);
+    // Publish the buffer before the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+static VdoBuffer* popOldestFrame(FrameRing_t* ring) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    while (tail != atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        VdoBuffer* buffer =
+            atomic_load_explicit(&ring->slots[tail % NUM_VDO_BUFFERS], memory_order_relaxed);
+        // The buffer is only ours if no other thread removed it meanwhile
+        if (atomic_compare_exchange_weak_explicit(&ring->tail,
+                                                  &tail,
+                                                  tail + 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            return buffer;
         }
     }
 
-    returnBuf = g_queue_pop_tail(provider->deliveredFrames);
+    return NULL;
+}
 
-errorExit:
-    pthread_mutex_unlock(&provider->frameMutex);
+static VdoBuffer* popLatestFrames(FrameRing_t* ring, VdoBuffer** older, unsigned int* numOlder) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
 
-    return returnBuf;
+    while (true) {
+        unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head == tail) {
+            *numOlder = 0;
+            return NULL;
+        }
+
+        // Read the buffers before claiming them, a slot is not reused until
+        // tail has moved past it and then claiming fails
+        for (unsigned int i = tail; i != head - 1; i++) {
+            older[i - tail] =
+                atomic_load_explicit(&ring->slots[i % NUM_VDO_BUFFERS], memory_order_relaxed);
+        }
+        VdoBuffer* latest =
+            atomic_load_explicit(&ring->slots[(head - 1) % NUM_VDO_BUFFERS], memory_order_relaxed);
+
+        if (atomic_compare_exchange_weak_explicit(&ring->tail,
+                                                  &tail,
+                                                  head,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            *numOlder = head - 1 - tail;
+            return latest;
+        }
+    }
 }
 
-void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
-    pthread_mutex_lock(&provider->frameMutex);
+static void enqueueFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
+    GError* error = NULL;
 
-    g_queue_push_tail(provider->processedFrames, buffer);
+    if (!vdo_stream_buffer_enqueue(provider->vdoStream, buffer, &error)) {
+        // Fail but we continue anyway hoping for the best.
+        syslog(LOG_WARNING,
+               "%s: Failed enqueueing buffer to vdo: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        g_clear_error(&error);
+    }
+}
+
+VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
+    VdoBuffer* older[NUM_VDO_BUFFERS];
+    unsigned int numOlder = 0;
+    VdoBuffer* returnBuf  = NULL;
+
+    while (!(returnBuf = popLatestFrames(&provider->deliveredFrames, older, &numOlder))) {
+        // The counter may be left from frames that were already fetched, then
+        // the ring is checked again and the next read blocks
+        uint64_t numEvents = 0;
+        if (read(provider->frameEventFd, &numEvents, sizeof(numEvents)) < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "%s: Failed to wait for a frame: %s", __func__, strerror(errno));
+            return NULL;
+        }
+    }
 
-    pthread_mutex_unlock(&provider->frameMutex);
+    // The frames that were delivered before the newest frame are not needed
+    for (unsigned int i = 0; i < numOlder; i++) {
+        returnFrame(provider, older[i]);
+    }
+    atomic_fetch_add_explicit(&provider->framesDropped, numOlder, memory_order_relaxed);
+    atomic_fetch_add_explicit(&provider->framesConsumed, 1, memory_order_relaxed);
+
+    return returnBuf;
+}
+
+void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
+    // Each buffer is in at most one ring, so there is always room
+    if (!pushFrame(&provider->processedFrames, buffer)) {
+        syslog(LOG_ERR, "%s: No room to return the frame", __func__);
+    }
 }
 
 static void* threadEntry(void* data) {
@@ -420,38 +533,34 @@ static void* threadEntry(void* data) {
             g_clear_error(&error);
             continue;
         }
-        pthread_mutex_lock(&provider->frameMutex);
-
-        g_queue_push_tail(provider->deliveredFrames, newBuffer);
-
-        VdoBuffer* oldBuffer = NULL;
 
-        // First check if there are any frames returned from app
-        // processing
-        if (g_queue_get_length(provider->processedFrames) > 0) {
-            oldBuffer = g_queue_pop_head(provider->processedFrames);
-        } else {
-            // Client specifies the number-of-recent-frames it needs to collect
-            // in one chunk (numAppFrames). Thus only enqueue buffers back to
-            // VDO if we have collected more buffers than numAppFrames.
-            if (g_queue_get_length(provider->deliveredFrames) > provider->numAppFrames) {
-                oldBuffer = g_queue_pop_head(provider->deliveredFrames);
+        // Client specifies the number-of-recent-frames it needs to collect
+        // (numAppFrames). Make room by dropping the oldest frames, the client
+        // may take frames at the same time so the ring is checked again.
+        FrameRing_t* delivered = &provider->deliveredFrames;
+        while (atomic_load_explicit(&delivered->head, memory_order_relaxed) -
+                   atomic_load_explicit(&delivered->tail, memory_order_acquire) >=
+               provider->numAppFrames) {
+            VdoBuffer* oldBuffer = popOldestFrame(delivered);
+            if (oldBuffer) {
+                enqueueFrame(provider, oldBuffer);
+                atomic_fetch_add_explicit(&provider->framesDropped, 1, memory_order_relaxed);
             }
         }
+        pushFrame(delivered, newBuffer);
+        atomic_fetch_add_explicit(&provider->framesProduced, 1, memory_order_relaxed);
 
-        if (oldBuffer) {
-            if (!vdo_stream_buffer_enqueue(provider->vdoStream, oldBuffer, &error)) {
-                // Fail but we continue anyway hoping for the best.
-                syslog(LOG_WARNING,
-                       "%s: Failed enqueueing buffer to vdo: %s",
-                       __func__,
-                       (error != NULL) ? error->message : "N/A");
-                g_clear_error(&error);
-            }
+        uint64_t numEvents = 1;
+        if (write(provider->frameEventFd, &numEvents, sizeof(numEvents)) < 0) {
+            syslog(LOG_WARNING, "%s: Failed to signal frame: %s", __func__, strerror(errno));
+        }
+
+        // Enqueue the frames returned from app processing
+        VdoBuffer* oldBuffer = NULL;
+        while ((oldBuffer = popOldestFrame(&provider->processedFrames))) {
+            enqueueFrame(provider, oldBuffer);
         }
         g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
-        pthread_cond_signal(&provider->frameDeliverCond);
-        pthread_mutex_unlock(&provider->frameMutex);
     }
     return provider;
 }
@@ -479,5 +588,12 @@ bool stopFrameFetch(ImgProvider_t* provider) {
         return false;
     }
 
+    syslog(LOG_INFO,
+           "%s: Frames produced %lu, consumed %lu, dropped %lu",
+           __func__,
+           atomic_load(&provider->framesProduced),
+           atomic_load(&provider->framesConsumed),
+           atomic_load(&provider->framesDropped));
+
     return true;
 }
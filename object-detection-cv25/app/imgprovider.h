@@ -29,12 +29,26 @@
 
 #define NUM_VDO_BUFFERS (8)
 
+/**
+ * brief A ring of VDO buffers passed from one thread to another.
+ *
+ * One thread adds buffers at head and another thread removes them at tail.
+ * The indices only increase and wrap around, the slot of an index is
+ * index % NUM_VDO_BUFFERS. A buffer is in at most one ring at a time, so a ring
+ * with a slot for each VDO buffer cannot overflow.
+ */
+typedef struct FrameRing {
+    _Atomic(VdoBuffer*) slots[NUM_VDO_BUFFERS];
+    atomic_uint head;
+    atomic_uint tail;
+} FrameRing_t;
+
 /**
  * brief A type representing a provider of frames from VDO.
  *
  * Keep track of what kind of images the user wants, all the necessary
- * VDO types to setup and maintain a stream, as well as parameters to make
- * the streaming thread safe.
+ * VDO types to setup and maintain a stream, as well as the rings that pass
+ * frames between the fetcher thread and the client without locks.
  */
 typedef struct ImgProvider {
     /// Stream configuration parameters.
@@ -43,18 +57,29 @@ typedef struct ImgProvider {
     /// Vdo stream and buffers handling.
     VdoStream* vdoStream;
     VdoBuffer* vdoBuffers[NUM_VDO_BUFFERS];
-
-    /// Keeping track of frames' statuses.
-    GQueue* deliveredFrames;
-    GQueue* processedFrames;
-    /// Number of frames to keep in the deliveredFrames queue.
+    /// Bytes per row of the frames and whether the buffers are dma-bufs or
+    /// vmem, read from the stream info.
+    unsigned int pitch;
+    bool dmabuf;
+
+    /// Frames delivered from VDO that the client has not fetched, oldest first.
+    FrameRing_t deliveredFrames;
+    /// Frames that the client is done with, to be enqueued to VDO again.
+    FrameRing_t processedFrames;
+    /// Number of frames to keep in the deliveredFrames ring, when a new
+    /// frame arrives to a full ring the oldest frame is dropped.
     unsigned int numAppFrames;
 
-    /// To support fetching frames asynchonously with VDO.
-    pthread_mutex_t frameMutex;
-    pthread_cond_t frameDeliverCond;
+    /// Signaled by the fetcher thread when a frame is delivered.
+    int frameEventFd;
     pthread_t fetcherThread;
     atomic_bool shutDown;
+
+    /// Frames delivered from VDO, fetched by the client and dropped without
+    /// being fetched.
+    atomic_ulong framesProduced;
+    atomic_ulong framesConsumed;
+    atomic_ulong framesDropped;
 } ImgProvider_t;
 
 /**
@@ -84,7 +109,7 @@ bool chooseStreamResolution(unsigned int reqWidth,
  *
  * param w Requested output image width.
  * param h Requested ouput image height.
- * param numFrames Number of fetched frames to keep.
+ * param numFrames Number of fetched frames to keep, 1 to NUM_VDO_BUFFERS / 2.
  * param vdoFormat Image format to be output by stream.
  * return Pointer to new ImgProvider, or NULL if failed.
  */
@@ -117,6 +142,10 @@ bool stopFrameFetch(ImgProvider_t* provider);
 /**
  * brief Get the most recent frame the thread has fetched from VDO.
  *
+ * Blocks until a frame is delivered if there is no frame that has not been
+ * fetched already. Older frames that were not fetched are dropped. Must only
+ * be called from one thread, the same thread that calls returnFrame().
+ *
  * param provider Pointer to an ImgProvider fetching frames.
  * return Pointer to an image buffer on success, otherwise NULL.
  */
@@ -125,6 +154,8 @@ VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
 /**
  * brief Release reference to an image buffer.
  *
+ * The buffer is enqueued to VDO again by the fetcher thread.
+ *
  * param provider Pointer to an ImgProvider fetching frames.
  * param buffer Pointer to the image buffer to be released.
  */
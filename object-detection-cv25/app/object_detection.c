@@ -66,6 +66,7 @@
 #include "imgutils.h"
 #include "larod.h"
 #include "postprocessing.h"
+#include "tensorcache.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
 
@@ -455,6 +456,8 @@ int main(int argc, char** argv) {
     larodJobRequest* ppReq          = NULL;
     larodJobRequest* ppReqHD        = NULL;
     larodJobRequest* infReq         = NULL;
+    TensorCache_t ppInputCache      = {0};
+    TensorCache_t ppInputCacheHD    = {0};
     void* cropAddr                  = NULL;
     void* ppInputAddr               = MAP_FAILED;
     void* ppOutputAddr              = MAP_FAILED;
@@ -472,6 +475,8 @@ int main(int argc, char** argv) {
     int larodOutput1Fd              = -1;
     int larodOutput2Fd              = -1;
     box* boxes                      = NULL;
+    anchor* anchors                 = NULL;
+    postProcessingBuffers* postBufs = NULL;
     char** labels                   = NULL;  // This is the array of label strings. The label
                                              // entries points into the large labelFileData buffer.
     size_t numLabels    = 0;                 // Number of entries in the labels array.
@@ -496,6 +501,8 @@ int main(int argc, char** argv) {
     const int numberOfClasses    = args.numLabels;      // number of classes
     char* anchorFile             = args.anchorsFile;
     const int padding            = args.padding;
+    // max_total_detections in the config file used to train the model
+    const int maxBoxes = 100;
 
     if (strcmp(chipString, "ambarella-cvflow") != 0) {
         syslog(LOG_ERR, "This example supports only cv25 device ");
@@ -503,6 +510,19 @@ int main(int argc, char** argv) {
     }
 
     syslog(LOG_INFO, "Starting %s", argv[0]);
+
+    // The anchors are the same for every frame, so they are loaded once
+    anchors = loadAnchors(anchorFile, numberOfDetections);
+    if (!anchors) {
+        syslog(LOG_ERR, "%s: Could not load anchors from %s", __func__, anchorFile);
+        goto end;
+    }
+    // The postprocessing buffers only depend on the model, so they are also allocated once
+    postBufs = createPostProcessingBuffers(numberOfDetections, numberOfClasses, maxBoxes);
+    if (!postBufs) {
+        syslog(LOG_ERR, "%s: Could not allocate postprocessing buffers", __func__);
+        goto end;
+    }
     // Register an interrupt handler which tries to exit cleanly if invoked once
     // but exits immediately if further invoked.
     signal(SIGINT, sigintHandler);
@@ -852,6 +872,11 @@ int main(int argc, char** argv) {
         goto end;
     }
 
+    // The frames from VDO are used as input to the preprocessing jobs without
+    // being copied when the buffers have the layout the jobs expect
+    initTensorCache(&ppInputCache, conn, sdImageProvider, streamWidth, streamHeight);
+    initTensorCache(&ppInputCacheHD, conn, hdImageProvider, widthFrameHD, heightFrameHD);
+
     if (labelsFile) {
         if (!parseLabels(&labels, &labelFileData, labelsFile, &numLabels)) {
             syslog(LOG_ERR, "Failed creating parsing labels file");
@@ -873,6 +898,10 @@ int main(int argc, char** argv) {
 
     // This contains the box coordinates and class scores for each detected object.
     boxes = (box*)malloc(sizeof(box) * numberOfDetections);
+    if (!boxes) {
+        syslog(LOG_ERR, "Could not allocate the boxes");
+        goto end;
+    }
 
     while (true) {
         struct timeval startTs, endTs;
@@ -898,7 +927,15 @@ int main(int argc, char** argv) {
         // Covert image data from NV12 format to interleaved uint8_t RGB format.
         gettimeofday(&startTs, NULL);
 
-        memcpy(ppInputAddr, nv12Data, yuyvBufferSize);
+        larodTensor** ppFrameTensors = getCachedTensors(&ppInputCache, buf);
+        if (!ppFrameTensors) {
+            memcpy(ppInputAddr, nv12Data, yuyvBufferSize);
+            ppFrameTensors = ppInputTensors;
+        }
+        if (!larodSetJobRequestInputs(ppReq, ppFrameTensors, ppNumInputs, &error)) {
+            syslog(LOG_ERR, "Failed setting preprocessing input: %s", error->msg);
+            goto end;
+        }
         if (!larodRunJob(conn, ppReq, &error)) {
             syslog(LOG_ERR,
                    "Unable to run job to preprocess model: %s (%d)",
@@ -909,7 +946,15 @@ int main(int argc, char** argv) {
 
         padImageWidth(ppOutputAddr, larodInputAddr, inputWidth, inputHeight, padding);
 
-        memcpy(ppInputAddrHD, nv12Data_hq, widthFrameHD * heightFrameHD * CHANNELS / 2);
+        larodTensor** ppFrameTensorsHD = getCachedTensors(&ppInputCacheHD, buf_hq);
+        if (!ppFrameTensorsHD) {
+            memcpy(ppInputAddrHD, nv12Data_hq, widthFrameHD * heightFrameHD * CHANNELS / 2);
+            ppFrameTensorsHD = ppInputTensorsHD;
+        }
+        if (!larodSetJobRequestInputs(ppReqHD, ppFrameTensorsHD, ppNumInputsHD, &error)) {
+            syslog(LOG_ERR, "Failed setting high resolution preprocessing input: %s", error->msg);
+            goto end;
+        }
         if (!larodRunJob(conn, ppReqHD, &error)) {
             syslog(LOG_ERR,
                    "Unable to run job to preprocess model: %s (%d)",
@@ -958,33 +1003,40 @@ int main(int argc, char** argv) {
         // hyperparameters depend on the model used. For the model used in this example
         // the values come from the config file used to train the model.
         // https://github.com/tensorflow/models/blob/master/research/object_detection/samples/configs/ssd_mobilenet_v2_coco.config#L11
-        int confidenceThreshold = threshold / 100.0;
-        int iouThreshold        = 0.5;
-        int yScale              = 10;
-        int xScale              = 10;
-        int hScale              = 5;
-        int wScale              = 5;
+        float confidenceThreshold = threshold / 100.0;
+        float iouThreshold        = 0.5;
+        int yScale                = 10;
+        int xScale                = 10;
+        int hScale                = 5;
+        int wScale                = 5;
+        int numberOfBoxes         = 0;
 
         gettimeofday(&startTs, NULL);
         // postprocessing the output of the network. This will fill the boxes array.
-        postProcessing(locations,
-                       classes,
-                       numberOfDetections,
-                       anchorFile,
-                       numberOfClasses,
-                       confidenceThreshold,
-                       iouThreshold,
-                       yScale,
-                       xScale,
-                       hScale,
-                       wScale,
-                       boxes);
+        if (postProcessing(locations,
+                           classes,
+                           numberOfDetections,
+                           anchors,
+                           numberOfClasses,
+                           confidenceThreshold,
+                           iouThreshold,
+                           yScale,
+                           xScale,
+                           hScale,
+                           wScale,
+                           maxBoxes,
+                           postBufs,
+                           boxes,
+                           &numberOfBoxes)) {
+            syslog(LOG_ERR, "Unable to postprocess the output of model %s", modelFile);
+            goto end;
+        }
         gettimeofday(&endTs, NULL);
 
         elapsedMs = (unsigned int)(((endTs.tv_sec - startTs.tv_sec) * 1000) +
                                    ((endTs.tv_usec - startTs.tv_usec) / 1000));
         syslog(LOG_INFO, "Postprocesing in %u ms", elapsedMs);
-        for (int i = 0; i < numberOfDetections; i++) {
+        for (int i = 0; i < numberOfBoxes; i++) {
             float top    = boxes[i].y_min;
             float left   = boxes[i].x_min;
             float bottom = boxes[i].y_max;
@@ -1043,6 +1095,9 @@ int main(int argc, char** argv) {
     ret = true;
 
 end:
+    // The tensors refer to the VDO buffers and are tracked on the connection
+    clearTensorCache(&ppInputCache);
+    clearTensorCache(&ppInputCacheHD);
     if (sdImageProvider) {
         destroyImgProvider(sdImageProvider);
     }
@@ -1126,6 +1181,10 @@ end:
     if (boxes) {
         free(boxes);
     }
+    if (anchors) {
+        free(anchors);
+    }
+    destroyPostProcessingBuffers(postBufs);
 
 earlyend:
     syslog(LOG_INFO, "Exit %s", argv[0]);
@@ -15,147 +15,398 @@
  */
 
 #include "postprocessing.h"
+#include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
-// structure detection
-typedef struct {
-    float dy;
-    float dx;
-    float dh;
-    float dw;
-    float score;
-    int label;
-    float anchor_ymin;
-    float anchor_xmin;
-    float anchor_ymax;
-    float anchor_xmax;
-} detection;
+// NEON is used on the device and SSE2 when running on a host, other targets use
+// the scalar code only
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
 
-/*
- * This function loads the data structure reading the anchors from file, and the detections from
- * parameter. It expects detections in he format [dy,dx,dh,dw] and the anchors in the format
- * [xmin,ymin,xmax,ymax]
- *
- */
-static int loadDetectionStruct(const float* locations,
-                               float* classes,
-                               int num_of_detections,
-                               int num_of_classes,
-                               const char* anchor_file,
-                               detection* dets) {
-    // Open anchor file
-    FILE* fp;
-    fp = fopen(anchor_file, "rb");
+// The range where expApprox is valid, the result is clamped outside of it
+#define EXP_MAX_INPUT 88.0f
+#define EXP_MIN_INPUT -87.0f
+
+// Constants of the exp approximation from the Cephes library. ln(2) is split
+// in two parts so that the argument is reduced without losing precision.
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+anchor* loadAnchors(const char* anchor_file, int num_of_anchors) {
+    anchor* anchors = NULL;
+    float* corners  = NULL;
+    size_t size     = (size_t)num_of_anchors * 4 * sizeof(float);
+    struct stat st;
+
+    FILE* fp = fopen(anchor_file, "rb");
     if (fp == NULL) {
-        printf("Error opening anchor file");
-        return 1;
+        syslog(LOG_ERR, "Error opening anchor file %s: %s", anchor_file, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fileno(fp), &st) != 0) {
+        syslog(LOG_ERR, "Error reading size of anchor file: %s", strerror(errno));
+        goto end;
+    }
+    if ((size_t)st.st_size != size) {
+        syslog(LOG_ERR,
+               "Anchor file has %lld bytes, expected %zu bytes for %d anchors",
+               (long long)st.st_size,
+               size,
+               num_of_anchors);
+        goto end;
+    }
+
+    corners = (float*)malloc(size);
+    anchors = (anchor*)malloc(num_of_anchors * sizeof(anchor));
+    if (!corners || !anchors) {
+        syslog(LOG_ERR, "Could not allocate anchors");
+        goto error;
     }
+    if (fread(corners, sizeof(float), (size_t)num_of_anchors * 4, fp) !=
+        (size_t)num_of_anchors * 4) {
+        syslog(LOG_ERR, "Error when reading anchor file");
+        goto error;
+    }
+
+    // The anchors are stored as [xmin, ymin, xmax, ymax]
+    for (int i = 0; i < num_of_anchors; i++) {
+        float xmin = corners[i * 4];
+        float ymin = corners[i * 4 + 1];
+        float xmax = corners[i * 4 + 2];
+        float ymax = corners[i * 4 + 3];
+
+        anchors[i].center_x = (xmin + xmax) / 2.0;
+        anchors[i].center_y = (ymin + ymax) / 2.0;
+        anchors[i].width    = xmax - xmin;
+        anchors[i].height   = ymax - ymin;
+    }
+    goto end;
+
+error:
+    free(anchors);
+    anchors = NULL;
 
-    // Load detections and anchors in struct array
+end:
+    free(corners);
+    fclose(fp);
+    return anchors;
+}
+
+postProcessingBuffers*
+createPostProcessingBuffers(int num_of_detections, int num_of_classes, int max_boxes) {
+    postProcessingBuffers* buffers = (postProcessingBuffers*)calloc(1, sizeof(*buffers));
+    if (!buffers) {
+        syslog(LOG_ERR, "Could not allocate postprocessing buffers");
+        return NULL;
+    }
+    buffers->num_of_detections = num_of_detections;
+    buffers->num_of_classes    = num_of_classes;
+    buffers->max_boxes         = max_boxes;
+    buffers->indices           = (int*)malloc(num_of_detections * sizeof(int));
+    buffers->heap              = (int*)malloc(num_of_detections * sizeof(int));
+    buffers->class_first       = (int*)malloc(num_of_classes * sizeof(int));
+    buffers->next_kept         = (int*)malloc(max_boxes * sizeof(int));
+    buffers->kept              = (box*)malloc(max_boxes * sizeof(box));
+    if (!buffers->indices || !buffers->heap || !buffers->class_first || !buffers->next_kept ||
+        !buffers->kept) {
+        syslog(LOG_ERR, "Could not allocate postprocessing buffers");
+        destroyPostProcessingBuffers(buffers);
+        return NULL;
+    }
+    return buffers;
+}
+
+void destroyPostProcessingBuffers(postProcessingBuffers* buffers) {
+    if (!buffers) {
+        return;
+    }
+    free(buffers->indices);
+    free(buffers->heap);
+    free(buffers->class_first);
+    free(buffers->next_kept);
+    free(buffers->kept);
+    free(buffers);
+}
+
+// Approximate exp(x) with a relative error of at most 2e-7, about two float ulps.
+// x = n * ln(2) + r with |r| <= ln(2) / 2, then exp(x) = 2^n * exp(r) where
+// exp(r) is a polynomial. The vectorized versions below do the same operations
+// in the same order so that all versions give the same result, which relies on
+// the Makefile building with -ffp-contract=off.
+static float expApprox(float x) {
+    x = fminf(fmaxf(x, EXP_MIN_INPUT), EXP_MAX_INPUT);
+
+    float n = floorf(x * EXP_LOG2E + 0.5f);
+    float r = x - n * EXP_LN2_HI;
+    r       = r - n * EXP_LN2_LO;
+
+    float p = EXP_P0;
+    p       = p * r + EXP_P1;
+    p       = p * r + EXP_P2;
+    p       = p * r + EXP_P3;
+    p       = p * r + EXP_P4;
+    p       = p * r + EXP_P5;
+    p       = p * (r * r) + r + 1.0f;
+
+    union {
+        uint32_t i;
+        float f;
+    } scale = {.i = (uint32_t)((int)n + 127) << 23};
+    return p * scale.f;
+}
+
+#if defined(USE_NEON)
+static float32x4_t expApproxNeon(float32x4_t x) {
+    x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(EXP_MIN_INPUT)), vdupq_n_f32(EXP_MAX_INPUT));
+
+    float32x4_t n =
+        vrndmq_f32(vaddq_f32(vmulq_f32(x, vdupq_n_f32(EXP_LOG2E)), vdupq_n_f32(0.5f)));
+    float32x4_t r = vsubq_f32(x, vmulq_f32(n, vdupq_n_f32(EXP_LN2_HI)));
+    r             = vsubq_f32(r, vmulq_f32(n, vdupq_n_f32(EXP_LN2_LO)));
+
+    float32x4_t p = vdupq_n_f32(EXP_P0);
+    p             = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(EXP_P1));
+    p             = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(EXP_P2));
+    p             = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(EXP_P3));
+    p             = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(EXP_P4));
+    p             = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(EXP_P5));
+    p             = vaddq_f32(vaddq_f32(vmulq_f32(p, vmulq_f32(r, r)), r), vdupq_n_f32(1.0f));
+
+    int32x4_t exponent = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+    return vmulq_f32(p, vreinterpretq_f32_s32(exponent));
+}
+#elif defined(USE_SSE2)
+static __m128 expApproxSse(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP_MIN_INPUT)), _mm_set1_ps(EXP_MAX_INPUT));
+
+    // SSE2 has no floor, truncate and subtract one where that rounded up
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(EXP_LOG2E)), _mm_set1_ps(0.5f));
+    __m128 n  = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    n         = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), _mm_set1_ps(1.0f)));
+    __m128 r  = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(EXP_LN2_HI)));
+    r         = _mm_sub_ps(r, _mm_mul_ps(n, _mm_set1_ps(EXP_LN2_LO)));
+
+    __m128 p = _mm_set1_ps(EXP_P0);
+    p        = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P1));
+    p        = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P2));
+    p        = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P3));
+    p        = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P4));
+    p        = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P5));
+    p        = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), r), _mm_set1_ps(1.0f));
+
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+#endif
+
+// Get the highest class score of a detection, 0 if no score is above 0
+static float maxClassScore(const float* scores, int num_of_classes) {
+    int j = 0;
+#if defined(USE_NEON)
+    float32x4_t max_vec = vdupq_n_f32(0);
+    for (; j + 4 <= num_of_classes; j += 4) {
+        max_vec = vmaxq_f32(max_vec, vld1q_f32(scores + j));
+    }
+    float max = vmaxvq_f32(max_vec);
+#elif defined(USE_SSE2)
+    __m128 max_vec = _mm_setzero_ps();
+    for (; j + 4 <= num_of_classes; j += 4) {
+        max_vec = _mm_max_ps(max_vec, _mm_loadu_ps(scores + j));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_vec);
+    float max = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#else
+    float max = 0;
+#endif
+    for (; j < num_of_classes; j++) {
+        max = fmaxf(max, scores[j]);
+    }
+    return max;
+}
+
+/*
+ * This function selects the detections with a score of at least the threshold before they are
+ * decoded. The score of a detection is the highest class score and the label is the first class
+ * with that score. Only the scores are read for the other detections. Returns the number of
+ * candidates, their index, score and label are written to indices and boxes.
+ *
+ */
+static int selectCandidates(const float* classes,
+                            int num_of_detections,
+                            int num_of_classes,
+                            float score_threshold,
+                            int* indices,
+                            box* boxes) {
+    int num_of_candidates = 0;
     for (int i = 0; i < num_of_detections; i++) {
-        dets[i].dy    = locations[i * 4];
-        dets[i].dx    = locations[i * 4 + 1];
-        dets[i].dh    = locations[i * 4 + 2];
-        dets[i].dw    = locations[i * 4 + 3];
-        dets[i].score = 0;
-        for (int j = 0; j < num_of_classes; j++) {
-            if (classes[i * num_of_classes + j] > dets[i].score) {
-                dets[i].score = classes[i * num_of_classes + j];
-                dets[i].label = j;
-            }
-        }
-        if (fread(&dets[i].anchor_xmin, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
+        const float* scores = classes + (size_t)i * num_of_classes;
+        float score         = maxClassScore(scores, num_of_classes);
+        // Detections without any class score above 0 have no label
+        if (score < score_threshold || score <= 0) {
+            continue;
         }
-        if (fread(&dets[i].anchor_ymin, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
-        if (fread(&dets[i].anchor_xmax, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
-        }
-        if (fread(&dets[i].anchor_ymax, sizeof(float), 1, fp) != 1) {
-            syslog(LOG_ERR, "Error when reading anchor file");
-            return 1;
+        int label = 0;
+        // No score is above the highest score
+        while (scores[label] < score) {
+            label++;
         }
+        indices[num_of_candidates]     = i;
+        boxes[num_of_candidates].score = score;
+        boxes[num_of_candidates].label = label;
+        num_of_candidates++;
     }
+    return num_of_candidates;
+}
 
-    // Close anchor file
-    fclose(fp);
-    return 0;
+// Apply the anchor and the box offsets of one candidate to obtain its box
+static void applyAnchor(const float* location,
+                        const anchor* prior,
+                        box* candidate_box,
+                        float y_scale,
+                        float x_scale,
+                        float h_scale,
+                        float w_scale) {
+    // The locations are in the format [dy, dx, dh, dw]
+    float center_y = location[0] * prior->height / y_scale + prior->center_y;
+    float center_x = location[1] * prior->width / x_scale + prior->center_x;
+    float height   = expApprox(location[2] / h_scale) * prior->height;
+    float width    = expApprox(location[3] / w_scale) * prior->width;
+
+    // Limit boxes from 0 to 1
+    candidate_box->x_min = fmaxf(0, center_x - width / 2);
+    candidate_box->y_min = fmaxf(0, center_y - height / 2);
+    candidate_box->x_max = fminf(1, center_x + width / 2);
+    candidate_box->y_max = fminf(1, center_y + height / 2);
 }
 
-// Apply anchors to detections to obtain boxes
-static void applyAnchors(detection* dets,
-                         int num_of_detections,
+// Apply anchors to the candidates to obtain boxes, four candidates at a time
+static void applyAnchors(const float* locations,
+                         const anchor* anchors,
+                         const int* indices,
+                         int num_of_candidates,
                          box* boxes,
                          float y_scale,
                          float x_scale,
                          float h_scale,
                          float w_scale) {
-    float prior_center_y, prior_center_x, prior_height, prior_width;
-    float center_y, center_x, height, width;
-    for (int i = 0; i < num_of_detections; i++) {
-        prior_center_x = (dets[i].anchor_xmin + dets[i].anchor_xmax) / 2.0;
-        prior_center_y = (dets[i].anchor_ymin + dets[i].anchor_ymax) / 2.0;
-        prior_width    = dets[i].anchor_xmax - dets[i].anchor_xmin;
-        prior_height   = dets[i].anchor_ymax - dets[i].anchor_ymin;
-
-        center_x = dets[i].dx * prior_width / x_scale + prior_center_x;
-        center_y = dets[i].dy * prior_height / y_scale + prior_center_y;
-        width    = exp(dets[i].dw / w_scale) * prior_width;
-        height   = exp(dets[i].dh / h_scale) * prior_height;
-
-        boxes[i].x_min = center_x - width / 2.0;
-        boxes[i].y_min = center_y - height / 2.0;
-        boxes[i].x_max = center_x + width / 2.0;
-        boxes[i].y_max = center_y + height / 2.0;
-        boxes[i].score = dets[i].score;
-        boxes[i].label = dets[i].label;
-
-        // Limit boxes from 0 to 1
-        boxes[i].x_min = fmaxf(0, boxes[i].x_min);
-        boxes[i].y_min = fmaxf(0, boxes[i].y_min);
-        boxes[i].x_max = fminf(1, boxes[i].x_max);
-        boxes[i].y_max = fminf(1, boxes[i].y_max);
-    }
-}
+    int i = 0;
+#if defined(USE_NEON) || defined(USE_SSE2)
+    for (; i + 4 <= num_of_candidates; i += 4) {
+        float dy[4], dx[4], dh[4], dw[4];
+        float center_y[4], center_x[4], height[4], width[4];
+        float y_min[4], x_min[4], y_max[4], x_max[4];
+        for (int k = 0; k < 4; k++) {
+            const float* location = locations + (size_t)indices[i + k] * 4;
+            const anchor* prior   = &anchors[indices[i + k]];
+            dy[k]                 = location[0];
+            dx[k]                 = location[1];
+            dh[k]                 = location[2];
+            dw[k]                 = location[3];
+            center_y[k]           = prior->center_y;
+            center_x[k]           = prior->center_x;
+            height[k]             = prior->height;
+            width[k]              = prior->width;
+        }
+#if defined(USE_NEON)
+        float32x4_t prior_h = vld1q_f32(height);
+        float32x4_t prior_w = vld1q_f32(width);
+        float32x4_t cy      = vmulq_f32(vld1q_f32(dy), prior_h);
+        float32x4_t cx      = vmulq_f32(vld1q_f32(dx), prior_w);
+        cy = vaddq_f32(vdivq_f32(cy, vdupq_n_f32(y_scale)), vld1q_f32(center_y));
+        cx = vaddq_f32(vdivq_f32(cx, vdupq_n_f32(x_scale)), vld1q_f32(center_x));
 
-// Suppress low score boxes
-static void suppressLowScoreBoxes(box* boxes, int num_of_detections, float score_threshold) {
-    for (int i = 0; i < num_of_detections; i++) {
-        if (boxes[i].score < score_threshold) {
-            boxes[i].score = 0;
+        float32x4_t half_h = expApproxNeon(vdivq_f32(vld1q_f32(dh), vdupq_n_f32(h_scale)));
+        float32x4_t half_w = expApproxNeon(vdivq_f32(vld1q_f32(dw), vdupq_n_f32(w_scale)));
+        half_h             = vmulq_f32(vmulq_f32(half_h, prior_h), vdupq_n_f32(0.5f));
+        half_w             = vmulq_f32(vmulq_f32(half_w, prior_w), vdupq_n_f32(0.5f));
+
+        vst1q_f32(y_min, vmaxq_f32(vsubq_f32(cy, half_h), vdupq_n_f32(0)));
+        vst1q_f32(x_min, vmaxq_f32(vsubq_f32(cx, half_w), vdupq_n_f32(0)));
+        vst1q_f32(y_max, vminq_f32(vaddq_f32(cy, half_h), vdupq_n_f32(1)));
+        vst1q_f32(x_max, vminq_f32(vaddq_f32(cx, half_w), vdupq_n_f32(1)));
+#else
+        __m128 prior_h = _mm_loadu_ps(height);
+        __m128 prior_w = _mm_loadu_ps(width);
+        __m128 cy      = _mm_mul_ps(_mm_loadu_ps(dy), prior_h);
+        __m128 cx      = _mm_mul_ps(_mm_loadu_ps(dx), prior_w);
+        cy             = _mm_add_ps(_mm_div_ps(cy, _mm_set1_ps(y_scale)), _mm_loadu_ps(center_y));
+        cx             = _mm_add_ps(_mm_div_ps(cx, _mm_set1_ps(x_scale)), _mm_loadu_ps(center_x));
+
+        __m128 half_h = expApproxSse(_mm_div_ps(_mm_loadu_ps(dh), _mm_set1_ps(h_scale)));
+        __m128 half_w = expApproxSse(_mm_div_ps(_mm_loadu_ps(dw), _mm_set1_ps(w_scale)));
+        half_h        = _mm_mul_ps(_mm_mul_ps(half_h, prior_h), _mm_set1_ps(0.5f));
+        half_w        = _mm_mul_ps(_mm_mul_ps(half_w, prior_w), _mm_set1_ps(0.5f));
+
+        _mm_storeu_ps(y_min, _mm_max_ps(_mm_sub_ps(cy, half_h), _mm_setzero_ps()));
+        _mm_storeu_ps(x_min, _mm_max_ps(_mm_sub_ps(cx, half_w), _mm_setzero_ps()));
+        _mm_storeu_ps(y_max, _mm_min_ps(_mm_add_ps(cy, half_h), _mm_set1_ps(1)));
+        _mm_storeu_ps(x_max, _mm_min_ps(_mm_add_ps(cx, half_w), _mm_set1_ps(1)));
+#endif
+        for (int k = 0; k < 4; k++) {
+            boxes[i + k].y_min = y_min[k];
+            boxes[i + k].x_min = x_min[k];
+            boxes[i + k].y_max = y_max[k];
+            boxes[i + k].x_max = x_max[k];
         }
     }
+#endif
+
+    // The candidates that do not fill a whole vector
+    for (; i < num_of_candidates; i++) {
+        applyAnchor(locations + (size_t)indices[i] * 4,
+                    &anchors[indices[i]],
+                    &boxes[i],
+                    y_scale,
+                    x_scale,
+                    h_scale,
+                    w_scale);
+    }
+}
+
+// Whether the candidate at index a comes before the one at index b, higher scores first and
+// equal scores in the order of the detections
+static int isBefore(const box* boxes, int a, int b) {
+    return boxes[a].score > boxes[b].score || (boxes[a].score >= boxes[b].score && a < b);
 }
 
-// Sort boxes by score efficiently
-static void sortBoxesEfficient(box* boxes, int num_of_detections) {
-    box temp;
-    int i       = 0;
-    int j       = num_of_detections - 1;
-    float pivot = boxes[num_of_detections / 2].score;
-    while (i <= j) {
-        while (boxes[i].score > pivot) i++;
-        while (boxes[j].score < pivot) j--;
-        if (i <= j) {
-            temp     = boxes[i];
-            boxes[i] = boxes[j];
-            boxes[j] = temp;
-            i++;
-            j--;
+// Move the candidate at position i of the heap down until the heap is ordered again
+static void siftDown(const box* boxes, int* heap, int heap_size, int i) {
+    while (1) {
+        int first = i;
+        int left  = 2 * i + 1;
+        int right = left + 1;
+        if (left < heap_size && isBefore(boxes, heap[left], heap[first])) {
+            first = left;
         }
+        if (right < heap_size && isBefore(boxes, heap[right], heap[first])) {
+            first = right;
+        }
+        if (first == i) {
+            return;
+        }
+        int temp    = heap[i];
+        heap[i]     = heap[first];
+        heap[first] = temp;
+        i           = first;
     }
-    if (j > 0)
-        sortBoxesEfficient(boxes, j + 1);
-    if (i < num_of_detections - 1)
-        sortBoxesEfficient(boxes + i, num_of_detections - i);
 }
 
 // Calculate IOU
@@ -171,25 +422,73 @@ static float calculateIOU(box box1, box box2) {
     return intersection_area / union_area;
 }
 
-// Suppress overlapping boxes (non-maxima-suppression) return sorted boxes by score, without
-// overlapping
-static void suppressOverlappingBoxes(box* boxes, int num_of_detections, float iou_threshold) {
-    sortBoxesEfficient(boxes, num_of_detections);
-    float iou;
-    for (int i = 0; i < num_of_detections; i++) {
-        for (int j = i + 1; j < num_of_detections; j++) {
-            iou = calculateIOU(boxes[i], boxes[j]);
-            if (iou > iou_threshold && boxes[i].label == boxes[j].label) {
-                boxes[j].score = 0;
-            }
+/*
+ * This function applies non-maximum suppression to the candidates per class. The candidates are
+ * taken from a heap in order of score, so only the candidates that are needed to find max_boxes
+ * boxes are ordered. Each kept box is added to the bucket of its class and a candidate is only
+ * compared with the kept boxes of its own class. The background, class 0, is not a detection and
+ * is skipped. The kept boxes are written to the start of boxes in order of score and their number
+ * is returned. The buffers must have room for num_of_candidates candidates, num_of_classes classes
+ * and max_boxes boxes.
+ *
+ */
+static int suppressOverlappingBoxes(box* boxes,
+                                    int num_of_candidates,
+                                    int num_of_classes,
+                                    float iou_threshold,
+                                    int max_boxes,
+                                    postProcessingBuffers* buffers) {
+    if (num_of_candidates == 0 || max_boxes <= 0) {
+        return 0;
+    }
+
+    int* heap        = buffers->heap;
+    int* class_first = buffers->class_first;
+    int* next_kept   = buffers->next_kept;
+    box* kept        = buffers->kept;
+
+    for (int i = 0; i < num_of_candidates; i++) {
+        heap[i] = i;
+    }
+    for (int i = num_of_candidates / 2 - 1; i >= 0; i--) {
+        siftDown(boxes, heap, num_of_candidates, i);
+    }
+    for (int label = 0; label < num_of_classes; label++) {
+        class_first[label] = -1;
+    }
+
+    int num_of_kept = 0;
+    int heap_size   = num_of_candidates;
+    while (heap_size > 0 && num_of_kept < max_boxes) {
+        const box* candidate = &boxes[heap[0]];
+        heap[0]              = heap[--heap_size];
+        siftDown(boxes, heap, heap_size, 0);
+
+        if (candidate->label == 0) {
+            continue;
+        }
+        int suppressed = 0;
+        for (int k = class_first[candidate->label]; k >= 0 && !suppressed; k = next_kept[k]) {
+            suppressed = calculateIOU(kept[k], *candidate) > iou_threshold;
+        }
+        if (suppressed) {
+            continue;
         }
+        kept[num_of_kept]             = *candidate;
+        next_kept[num_of_kept]        = class_first[candidate->label];
+        class_first[candidate->label] = num_of_kept;
+        num_of_kept++;
     }
+    for (int i = 0; i < num_of_kept; i++) {
+        boxes[i] = kept[i];
+    }
+    return num_of_kept;
 }
 
 int postProcessing(float* locations,
                    float* classes,
                    int num_of_detections,
-                   const char* anchor_file,
+                   const anchor* anchors,
                    int num_of_classes,
                    float score_threshold,
                    float nms_threshold,
@@ -197,25 +496,45 @@ int postProcessing(float* locations,
                    float x_scale,
                    float h_scale,
                    float w_scale,
-                   box* boxes) {
-    // Load detections and anchors in struct array
-    detection* dets = (detection*)malloc(num_of_detections * sizeof(detection));
-    if (loadDetectionStruct(locations,
-                            classes,
-                            num_of_detections,
-                            num_of_classes,
-                            anchor_file,
-                            dets) != 0) {
-        printf("Error loading detection struct");
-        free(dets);
+                   int max_boxes,
+                   postProcessingBuffers* buffers,
+                   box* boxes,
+                   int* num_of_boxes) {
+    *num_of_boxes = 0;
+    if (num_of_detections > buffers->num_of_detections ||
+        num_of_classes > buffers->num_of_classes || max_boxes > buffers->max_boxes) {
+        syslog(LOG_ERR,
+               "Postprocessing buffers are for %d detections, %d classes and %d boxes",
+               buffers->num_of_detections,
+               buffers->num_of_classes,
+               buffers->max_boxes);
         return 1;
     }
+    int* indices = buffers->indices;
+
+    // Only the detections that reach the threshold are decoded
+    int num_of_candidates = selectCandidates(classes,
+                                             num_of_detections,
+                                             num_of_classes,
+                                             score_threshold,
+                                             indices,
+                                             boxes);
+    applyAnchors(locations,
+                 anchors,
+                 indices,
+                 num_of_candidates,
+                 boxes,
+                 y_scale,
+                 x_scale,
+                 h_scale,
+                 w_scale);
 
-    // Convert detections to boxes
-    applyAnchors(dets, num_of_detections, boxes, y_scale, x_scale, h_scale, w_scale);
-    free(dets);
-    suppressLowScoreBoxes(boxes, num_of_detections, score_threshold);
-    suppressOverlappingBoxes(boxes, num_of_detections, nms_threshold);
+    *num_of_boxes = suppressOverlappingBoxes(boxes,
+                                             num_of_candidates,
+                                             num_of_classes,
+                                             nms_threshold,
+                                             max_boxes,
+                                             buffers);
 
     return 0;
 }
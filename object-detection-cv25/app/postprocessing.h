@@ -28,15 +28,73 @@ typedef struct {
     int label;
 } box;
 
+// define anchor struct, the center and size of an anchor box in the form that the
+// locations are applied to
+typedef struct {
+    float center_y;
+    float center_x;
+    float height;
+    float width;
+} anchor;
+
+/**
+ * @brief load the anchors from file and precompute their centers and sizes
+ *
+ * The anchors are only loaded once at startup and are then used for every frame.
+ *
+ * @param anchor_file path to file containing the anchors in the format [xmin, ymin, xmax, ymax]
+ * @param num_of_anchors number of anchors that the file must contain, one for each detection
+ * @return array of anchors to free with free(), NULL if the file could not be read or does not
+ * contain num_of_anchors anchors
+ */
+anchor* loadAnchors(const char* anchor_file, int num_of_anchors);
+
+// define the buffers used by postProcessing, sized for a model so that they are allocated once
+typedef struct {
+    int num_of_detections;
+    int num_of_classes;
+    int max_boxes;
+    // index of each candidate in the output of the model
+    int* indices;
+    // candidates that have not been taken by the non-maximum suppression yet
+    int* heap;
+    // first kept box of each class and the next kept box of the same class
+    int* class_first;
+    int* next_kept;
+    box* kept;
+} postProcessingBuffers;
+
+/**
+ * @brief allocate the buffers that postProcessing uses for each frame
+ *
+ * @param num_of_detections number of detections of the model
+ * @param num_of_classes number of classes of the model
+ * @param max_boxes maximum number of boxes that postProcessing outputs
+ * @return buffers to free with destroyPostProcessingBuffers(), NULL if they could not be allocated
+ */
+postProcessingBuffers*
+createPostProcessingBuffers(int num_of_detections, int num_of_classes, int max_boxes);
+
+/**
+ * @brief free the buffers from createPostProcessingBuffers
+ *
+ * @param buffers buffers to free, may be NULL
+ */
+void destroyPostProcessingBuffers(postProcessingBuffers* buffers);
+
 /**
  * @brief convert output from model into detection boxes
  *
+ * The detections are first selected by their highest class score and only the selected
+ * detections are decoded. Box sizes use an exp approximation with a relative error below 2e-7.
+ * Non-maximum suppression is then applied per class and stops when max_boxes boxes are found.
+ *
  * @param locations output from the model of size num_of_detections*4 containing the location of the
  * boxes in the format [dy, dx, dh, dw]
  * @param classes output from the model of size num_of_detections*num_of_classes containing the
  * confidence for each class
  * @param num_of_detections number of detections
- * @param anchors_file path to file containing anchors
+ * @param anchors anchors from loadAnchors, one for each detection
  * @param num_of_classes number of classes
  * @param score_threshold minimum threshold for a box to be considered a detection
  * @param nms_threshold threshold for the iou non-maximum suppression
@@ -44,12 +102,19 @@ typedef struct {
  * @param x_scale scale factor for the x coordinate
  * @param h_scale scale factor for the height
  * @param w_scale scale factor for the width
- * @param boxes output array of boxes
+ * @param max_boxes maximum number of boxes to output
+ * @param buffers buffers from createPostProcessingBuffers for at least num_of_detections
+ * detections, num_of_classes classes and max_boxes boxes
+ * @param boxes output array of num_of_detections boxes, the first num_of_boxes are the boxes that
+ * were not suppressed, sorted by score
+ * @param num_of_boxes output number of boxes, at most max_boxes. Boxes of the background, class 0,
+ * are not included
+ * @return 0 on success, 1 if the buffers are too small
  */
 int postProcessing(float* locations,
                    float* classes,
                    int num_of_detections,
-                   const char* anchor_file,
+                   const anchor* anchors,
                    int num_of_classes,
                    float score_threshold,
                    float nms_threshold,
@@ -57,4 +122,7 @@ int postProcessing(float* locations,
                    float x_scale,
                    float h_scale,
                    float w_scale,
-                   box* boxes);
+                   int max_boxes,
+                   postProcessingBuffers* buffers,
+                   box* boxes,
+                   int* num_of_boxes);
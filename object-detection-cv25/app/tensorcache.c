@@ -0,0 +1,239 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles the larod tensors that are imported from VDO buffers.
+ */
+
+#include "tensorcache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+/**
+ * brief Create and track a tensor for the VDO buffer of an entry.
+ *
+ * param cache Cache the entry belongs to.
+ * param entry Entry with the fd, offset and capacity of the VDO buffer.
+ * return False if any errors occur, otherwise true.
+ */
+static bool trackTensor(TensorCache_t* cache, TensorCacheEntry_t* entry);
+
+/**
+ * brief Destroy the tensor of an entry and close its fd.
+ *
+ * param cache Cache the entry belongs to.
+ * param entry Entry to release.
+ */
+static void releaseEntry(TensorCache_t* cache, TensorCacheEntry_t* entry);
+
+void initTensorCache(TensorCache_t* cache,
+                     larodConnection* conn,
+                     const ImgProvider_t* provider,
+                     unsigned int width,
+                     unsigned int height) {
+    memset(cache, 0, sizeof(TensorCache_t));
+    cache->conn      = conn;
+    cache->width     = width;
+    cache->height    = height;
+    cache->pitch     = provider->pitch;
+    cache->frameSize = (size_t)provider->pitch * height * 3 / 2;
+    cache->dmabuf    = provider->dmabuf;
+
+    // The preprocessing job is set up for rows without padding, the same
+    // layout that the frames are copied in otherwise
+    cache->enabled = provider->pitch == width;
+    if (cache->enabled) {
+        syslog(LOG_INFO,
+               "%s: Frames of %u x %u are given to larod without copying",
+               __func__,
+               width,
+               height);
+    } else {
+        syslog(LOG_INFO,
+               "%s: Frames of %u x %u are copied, the pitch %u does not match the width",
+               __func__,
+               width,
+               height,
+               provider->pitch);
+    }
+}
+
+static bool trackTensor(TensorCache_t* cache, TensorCacheEntry_t* entry) {
+    larodError* error     = NULL;
+    larodTensor** tensors = NULL;
+    int64_t offset        = entry->offset;
+    int tensorFd          = -1;
+
+    // larod needs a dma-buf, a vmem buffer is converted to a new fd while a
+    // dma-buf fd is duplicated so that VDO can close its fd at any time
+    if (!cache->dmabuf) {
+        tensorFd = larodConvertVmemFdToDmabuf(entry->vdoFd, offset, &error);
+        if (tensorFd == LAROD_INVALID_FD) {
+            syslog(LOG_ERR, "%s: Failed to get fd from larod: %s", __func__, error->msg);
+            tensorFd = -1;
+            goto errorExit;
+        }
+        offset = 0;
+    } else {
+        tensorFd = dup(entry->vdoFd);
+        if (tensorFd < 0) {
+            syslog(LOG_ERR, "%s: Failed to dup fd: %s", __func__, strerror(errno));
+            goto errorExit;
+        }
+    }
+
+    tensors = larodCreateTensors(1, &error);
+    if (!tensors) {
+        syslog(LOG_ERR, "%s: Failed to create tensor: %s", __func__, error->msg);
+        goto errorExit;
+    }
+    if (!larodSetTensorDataType(tensors[0], LAROD_TENSOR_DATA_TYPE_UINT8, &error) ||
+        !larodSetTensorLayout(tensors[0], LAROD_TENSOR_LAYOUT_420SP, &error) ||
+        !larodBuildTensorDims(tensors[0],
+                              LAROD_TENSOR_LAYOUT_420SP,
+                              cache->width,
+                              cache->height,
+                              3,
+                              &error) ||
+        !larodBuildTensorPitches(tensors[0],
+                                 LAROD_TENSOR_LAYOUT_420SP,
+                                 cache->pitch,
+                                 cache->height,
+                                 3,
+                                 &error)) {
+        syslog(LOG_ERR, "%s: Failed to set up tensor: %s", __func__, error->msg);
+        goto errorExit;
+    }
+    if (!larodSetTensorFdProps(tensors[0], LAROD_FD_PROP_MAP | LAROD_FD_PROP_DMABUF, &error) ||
+        !larodSetTensorFd(tensors[0], tensorFd, &error) ||
+        !larodSetTensorFdOffset(tensors[0], offset, &error) ||
+        !larodSetTensorFdSize(tensors[0], entry->capacity, &error)) {
+        syslog(LOG_ERR, "%s: Failed to set fd of tensor: %s", __func__, error->msg);
+        goto errorExit;
+    }
+    if (!larodTrackTensor(cache->conn, tensors[0], &error)) {
+        syslog(LOG_ERR, "%s: Failed to track tensor: %s", __func__, error->msg);
+        goto errorExit;
+    }
+
+    entry->tensors  = tensors;
+    entry->tensorFd = tensorFd;
+
+    return true;
+
+errorExit:
+    larodClearError(&error);
+    if (tensors) {
+        larodDestroyTensors(cache->conn, &tensors, 1, NULL);
+    }
+    if (tensorFd >= 0) {
+        close(tensorFd);
+    }
+
+    return false;
+}
+
+static void releaseEntry(TensorCache_t* cache, TensorCacheEntry_t* entry) {
+    larodError* error = NULL;
+
+    // Destroying the tensor also makes larod stop tracking it
+    if (!larodDestroyTensors(cache->conn, &entry->tensors, 1, &error)) {
+        syslog(LOG_WARNING, "%s: Failed to destroy tensor: %s", __func__, error->msg);
+        larodClearError(&error);
+    }
+    if (entry->tensorFd >= 0) {
+        close(entry->tensorFd);
+    }
+    entry->tensorFd = -1;
+}
+
+larodTensor** getCachedTensors(TensorCache_t* cache, VdoBuffer* buffer) {
+    if (!cache->enabled) {
+        return NULL;
+    }
+
+    int vdoFd       = vdo_buffer_get_fd(buffer);
+    int64_t offset  = vdo_buffer_get_offset(buffer);
+    size_t capacity = vdo_buffer_get_capacity(buffer);
+
+    // A dma-buf is mapped from the offset, which must be at the start of a
+    // page, while a converted vmem buffer always starts at offset 0
+    if (vdoFd < 0 || capacity < cache->frameSize ||
+        (cache->dmabuf && offset % sysconf(_SC_PAGESIZE) != 0)) {
+        cache->fallbacks++;
+        return NULL;
+    }
+
+    cache->numLookups++;
+    for (size_t i = 0; i < cache->numEntries; i++) {
+        TensorCacheEntry_t* entry = &cache->entries[i];
+        if (entry->vdoFd == vdoFd && entry->offset == offset && entry->capacity == capacity) {
+            entry->lastUsed = cache->numLookups;
+            cache->hits++;
+            return entry->tensors;
+        }
+    }
+    cache->misses++;
+
+    // The least recently used tensor is replaced when the cache is full, the
+    // jobs are run one at a time so it is not in use
+    TensorCacheEntry_t* entry = NULL;
+    if (cache->numEntries < NUM_CACHED_TENSORS) {
+        entry = &cache->entries[cache->numEntries];
+    } else {
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->numEntries; i++) {
+            if (cache->entries[i].lastUsed < entry->lastUsed) {
+                entry = &cache->entries[i];
+            }
+        }
+        releaseEntry(cache, entry);
+        // Move the last entry to the free place, the new entry is added last
+        *entry = cache->entries[--cache->numEntries];
+        entry  = &cache->entries[cache->numEntries];
+    }
+    entry->vdoFd    = vdoFd;
+    entry->offset   = offset;
+    entry->capacity = capacity;
+    entry->lastUsed = cache->numLookups;
+    if (!trackTensor(cache, entry)) {
+        // Copy the frames from now on instead of failing on every frame
+        syslog(LOG_WARNING, "%s: Could not import the VDO buffer, copying frames", __func__);
+        cache->enabled = false;
+        cache->fallbacks++;
+        return NULL;
+    }
+    cache->numEntries++;
+
+    syslog(LOG_INFO,
+           "%s: Tracked tensor for fd %d, hits %llu misses %llu fallbacks %llu",
+           __func__,
+           vdoFd,
+           (unsigned long long)cache->hits,
+           (unsigned long long)cache->misses,
+           (unsigned long long)cache->fallbacks);
+    return entry->tensors;
+}
+
+void clearTensorCache(TensorCache_t* cache) {
+    for (size_t i = 0; i < cache->numEntries; i++) {
+        releaseEntry(cache, &cache->entries[i]);
+    }
+    cache->numEntries = 0;
+}
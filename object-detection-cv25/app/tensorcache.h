@@ -0,0 +1,115 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the larod tensors that are imported from VDO
+ * buffers, so that the frames are given to larod without being copied.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "imgprovider.h"
+#include "larod.h"
+#include "vdo-buffer.h"
+
+/// A tensor for each VDO buffer of a stream, see NUM_VDO_BUFFERS.
+#define NUM_CACHED_TENSORS NUM_VDO_BUFFERS
+
+/**
+ * brief A larod tensor that refers to the memory of a VDO buffer.
+ */
+typedef struct TensorCacheEntry {
+    /// The VDO buffer the tensor was created for.
+    int vdoFd;
+    int64_t offset;
+    size_t capacity;
+
+    larodTensor** tensors;
+    /// The fd set on the tensor, closed when the entry is removed.
+    int tensorFd;
+    uint64_t lastUsed;
+} TensorCacheEntry_t;
+
+/**
+ * brief A cache of tracked larod tensors for the VDO buffers of a stream.
+ *
+ * The tensors are used as input to a preprocessing job instead of copying
+ * each frame to the input tensor of the job. Tensors are only created for
+ * streams and buffers that have the layout the job expects, for others the
+ * frames must be copied.
+ */
+typedef struct TensorCache {
+    larodConnection* conn;
+
+    /// NV12 frames of the stream.
+    unsigned int width;
+    unsigned int height;
+    unsigned int pitch;
+    size_t frameSize;
+    bool dmabuf;
+    /// False if the frames of the stream must be copied.
+    bool enabled;
+
+    TensorCacheEntry_t entries[NUM_CACHED_TENSORS];
+    size_t numEntries;
+    uint64_t numLookups;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t fallbacks;
+} TensorCache_t;
+
+/**
+ * brief Set up an empty cache for the frames of an ImgProvider.
+ *
+ * The tensors are only used if the rows of the frames are as wide as the
+ * width, which is what the preprocessing job expects.
+ *
+ * param cache Cache to set up.
+ * param conn Larod connection the tensors are tracked on.
+ * param provider ImgProvider delivering the frames.
+ * param width Width of the frames.
+ * param height Height of the frames.
+ */
+void initTensorCache(TensorCache_t* cache,
+                     larodConnection* conn,
+                     const ImgProvider_t* provider,
+                     unsigned int width,
+                     unsigned int height);
+
+/**
+ * brief Get the tracked tensor for a VDO buffer.
+ *
+ * A new tensor is created and tracked the first time a buffer is seen.
+ *
+ * param cache Cache to look in.
+ * param buffer Buffer from VDO.
+ * return The tensors to set as input of the job, or NULL if the frame must be
+ *        copied to the input tensor instead.
+ */
+larodTensor** getCachedTensors(TensorCache_t* cache, VdoBuffer* buffer);
+
+/**
+ * brief Destroy all tensors in the cache.
+ *
+ * Must not be called while a larod job is using one of the tensors.
+ *
+ * param cache Cache to clear.
+ */
+void clearTensorCache(TensorCache_t* cache);
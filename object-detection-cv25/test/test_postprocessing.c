@@ -0,0 +1,376 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks the box decoding of the postprocessing against the decoding
+ * that the example used before, which applied the anchors to every detection
+ * with the double precision exp.
+ *
+ * The postprocessing source is included so that its static functions can be
+ * called. The vectorized decoding is used when the host has SSE2 or NEON.
+ */
+
+#include "postprocessing.c"
+
+#include <float.h>
+
+// The relative error of expApprox that postprocessing.h promises
+#define EXP_MAX_REL_ERROR 2e-7f
+
+// The model of the example, see runOptions in manifest.json.cv25
+#define NUM_DETECTIONS 1917
+#define NUM_CLASSES 91
+#define NUM_FRAMES 50
+
+#define Y_SCALE 10
+#define X_SCALE 10
+#define H_SCALE 5
+#define W_SCALE 5
+
+static const float thresholds[] = {0.0f, 0.1f, 0.3f, 0.5f, 0.7f, 0.95f};
+
+static uint32_t randomState = 2463534242u;
+
+// xorshift32, so that the frames are the same on every host
+static float randomFloat(float min, float max) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return min + (max - min) * (float)(randomState >> 8) / (float)(1 << 24);
+}
+
+/*
+ * The box of a detection the way the example decoded it before, the scores
+ * and the label are taken the same way as by loadDetectionStruct.
+ */
+static void referenceDecode(const float* locations,
+                            const float* classes,
+                            const anchor* anchors,
+                            int num_of_classes,
+                            int i,
+                            box* ref) {
+    ref->score = 0;
+    ref->label = -1;
+    for (int j = 0; j < num_of_classes; j++) {
+        if (classes[i * num_of_classes + j] > ref->score) {
+            ref->score = classes[i * num_of_classes + j];
+            ref->label = j;
+        }
+    }
+
+    float center_x = locations[i * 4 + 1] * anchors[i].width / X_SCALE + anchors[i].center_x;
+    float center_y = locations[i * 4] * anchors[i].height / Y_SCALE + anchors[i].center_y;
+    float width    = exp(locations[i * 4 + 3] / W_SCALE) * anchors[i].width;
+    float height   = exp(locations[i * 4 + 2] / H_SCALE) * anchors[i].height;
+
+    ref->x_min = fmaxf(0, center_x - width / 2.0);
+    ref->y_min = fmaxf(0, center_y - height / 2.0);
+    ref->x_max = fminf(1, center_x + width / 2.0);
+    ref->y_max = fminf(1, center_y + height / 2.0);
+}
+
+// A corner may differ by the exp error of the half box size and the rounding of the corner
+static int cornerMatches(float value, float ref, float ref_half_size) {
+    float tolerance = ref_half_size * (EXP_MAX_REL_ERROR + FLT_EPSILON) + FLT_EPSILON;
+    return fabsf(value - ref) <= tolerance;
+}
+
+/*
+ * This function decodes a frame with selectCandidates and applyAnchors and checks that the same
+ * detections are selected, with the same score and label, and that the boxes are within the
+ * error bound of the reference. Returns the number of mismatches.
+ */
+static int checkFrame(const float* locations,
+                      const float* classes,
+                      const anchor* anchors,
+                      int num_of_detections,
+                      int num_of_classes,
+                      float score_threshold,
+                      int* indices,
+                      box* boxes,
+                      float* max_corner_error) {
+    int errors            = 0;
+    int num_of_candidates = selectCandidates(classes,
+                                             num_of_detections,
+                                             num_of_classes,
+                                             score_threshold,
+                                             indices,
+                                             boxes);
+    applyAnchors(locations,
+                 anchors,
+                 indices,
+                 num_of_candidates,
+                 boxes,
+                 Y_SCALE,
+                 X_SCALE,
+                 H_SCALE,
+                 W_SCALE);
+
+    int c = 0;
+    for (int i = 0; i < num_of_detections; i++) {
+        box ref;
+        referenceDecode(locations, classes, anchors, num_of_classes, i, &ref);
+        // suppressLowScoreBoxes zeroed the score of the boxes below the threshold and detections
+        // without any class score above 0 had no label
+        if (ref.label < 0 || ref.score < score_threshold) {
+            continue;
+        }
+        if (c >= num_of_candidates || indices[c] != i) {
+            printf("Threshold %.2f: detection %d with score %f was not selected\n",
+                   score_threshold,
+                   i,
+                   ref.score);
+            return errors + 1;
+        }
+        const box* b = &boxes[c++];
+        if (b->label != ref.label || b->score < ref.score || b->score > ref.score) {
+            printf("Threshold %.2f: detection %d has label %d score %f, expected %d %f\n",
+                   score_threshold,
+                   i,
+                   b->label,
+                   b->score,
+                   ref.label,
+                   ref.score);
+            errors++;
+        }
+
+        float half_h = exp(locations[i * 4 + 2] / H_SCALE) * anchors[i].height / 2;
+        float half_w = exp(locations[i * 4 + 3] / W_SCALE) * anchors[i].width / 2;
+        if (!cornerMatches(b->y_min, ref.y_min, half_h) ||
+            !cornerMatches(b->x_min, ref.x_min, half_w) ||
+            !cornerMatches(b->y_max, ref.y_max, half_h) ||
+            !cornerMatches(b->x_max, ref.x_max, half_w)) {
+            printf("Threshold %.2f: detection %d has box [%.9f, %.9f, %.9f, %.9f], expected "
+                   "[%.9f, %.9f, %.9f, %.9f]\n",
+                   score_threshold,
+                   i,
+                   b->y_min,
+                   b->x_min,
+                   b->y_max,
+                   b->x_max,
+                   ref.y_min,
+                   ref.x_min,
+                   ref.y_max,
+                   ref.x_max);
+            errors++;
+        }
+        *max_corner_error = fmaxf(*max_corner_error, fabsf(b->y_min - ref.y_min));
+        *max_corner_error = fmaxf(*max_corner_error, fabsf(b->x_min - ref.x_min));
+        *max_corner_error = fmaxf(*max_corner_error, fabsf(b->y_max - ref.y_max));
+        *max_corner_error = fmaxf(*max_corner_error, fabsf(b->x_max - ref.x_max));
+    }
+    if (c != num_of_candidates) {
+        printf("Threshold %.2f: %d detections were selected, expected %d\n",
+               score_threshold,
+               num_of_candidates,
+               c);
+        errors++;
+    }
+    return errors;
+}
+
+// Check the relative error of expApprox and that the vectorized version gives the same values
+static int checkExp(void) {
+    int errors        = 0;
+    double max_error  = 0;
+    const int steps   = 400000;
+    const float start = -20.0f;
+    const float step  = 40.0f / steps;
+
+    for (int i = 0; i < steps; i += 4) {
+        float x[4];
+        float approx[4];
+        for (int k = 0; k < 4; k++) {
+            x[k]      = start + (i + k) * step;
+            approx[k] = expApprox(x[k]);
+            double error = fabs(approx[k] - exp(x[k])) / exp(x[k]);
+            max_error    = fmax(max_error, error);
+            if (error > EXP_MAX_REL_ERROR) {
+                printf("expApprox(%.9g) = %.9g, exp gives %.9g\n", x[k], approx[k], exp(x[k]));
+                errors++;
+            }
+        }
+#if defined(USE_NEON) || defined(USE_SSE2)
+        float vector[4];
+#if defined(USE_NEON)
+        vst1q_f32(vector, expApproxNeon(vld1q_f32(x)));
+#else
+        _mm_storeu_ps(vector, expApproxSse(_mm_loadu_ps(x)));
+#endif
+        for (int k = 0; k < 4; k++) {
+            if (memcmp(&vector[k], &approx[k], sizeof(float)) != 0) {
+                printf("Vectorized exp of %.9g is %.9g, scalar is %.9g\n",
+                       x[k],
+                       vector[k],
+                       approx[k]);
+                errors++;
+            }
+        }
+#endif
+    }
+    printf("expApprox: max relative error %.3g over [%g, %g]\n", max_error, start, -start);
+    return errors;
+}
+
+// Anchors laid out like the SSD MobileNet v2 anchor grid, six layers with 1917 anchors in total
+static void generateAnchors(anchor* anchors) {
+    const int grids[]   = {19, 10, 5, 3, 2, 1};
+    const float sizes[] = {0.1f, 0.35f, 0.5f, 0.65f, 0.8f, 0.95f};
+    const float ratios[] = {1.0f, 2.0f, 0.5f, 3.0f, 1.0f / 3.0f, 1.0f};
+    int n               = 0;
+
+    for (int layer = 0; layer < 6; layer++) {
+        int num_of_ratios = layer == 0 ? 3 : 6;
+        for (int y = 0; y < grids[layer]; y++) {
+            for (int x = 0; x < grids[layer]; x++) {
+                for (int r = 0; r < num_of_ratios; r++) {
+                    anchors[n].center_y = (y + 0.5f) / grids[layer];
+                    anchors[n].center_x = (x + 0.5f) / grids[layer];
+                    anchors[n].height   = sizes[layer] / sqrtf(ratios[r]);
+                    anchors[n].width    = sizes[layer] * sqrtf(ratios[r]);
+                    n++;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * This function fills a frame where most detections have low scores, some have one high class
+ * score, some have two classes with the same highest score and some have no score above 0.
+ */
+static void generateFrame(float* locations, float* classes) {
+    for (int i = 0; i < NUM_DETECTIONS; i++) {
+        locations[i * 4]     = randomFloat(-4.0f, 4.0f);
+        locations[i * 4 + 1] = randomFloat(-4.0f, 4.0f);
+        locations[i * 4 + 2] = randomFloat(-12.0f, 8.0f);
+        locations[i * 4 + 3] = randomFloat(-12.0f, 8.0f);
+
+        float* scores = classes + i * NUM_CLASSES;
+        float kind    = randomFloat(0, 1);
+        for (int j = 0; j < NUM_CLASSES; j++) {
+            scores[j] = kind < 0.02f ? 0 : randomFloat(0, 0.12f);
+        }
+        if (kind > 0.8f) {
+            float pick    = randomFloat(0, NUM_CLASSES);
+            int label     = (int)pick;
+            scores[label] = randomFloat(0.05f, 1.0f);
+            if (kind > 0.97f) {
+                scores[(label + 7) % NUM_CLASSES] = scores[label];
+            }
+        }
+    }
+}
+
+static float* readFloats(const char* file_name, size_t count) {
+    float* data = (float*)malloc(count * sizeof(float));
+    FILE* fp    = fopen(file_name, "rb");
+    if (!data || !fp || fread(data, sizeof(float), count, fp) != count) {
+        printf("Could not read %zu floats from %s\n", count, file_name);
+        free(data);
+        data = NULL;
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    return data;
+}
+
+/**
+ * Without arguments, generated frames are checked. A recorded frame is checked with
+ * test_postprocessing LOCATIONS_FILE CLASSES_FILE ANCHOR_FILE NUM_DETECTIONS NUM_CLASSES
+ * where the files hold the raw float output tensors of the model.
+ */
+int main(int argc, char** argv) {
+    int errors               = 0;
+    int num_of_detections    = NUM_DETECTIONS;
+    int num_of_classes       = NUM_CLASSES;
+    int num_of_frames        = NUM_FRAMES;
+    float* locations         = NULL;
+    float* classes           = NULL;
+    anchor* anchors          = NULL;
+    float max_corner_error   = 0;
+    const char* decode_paths =
+#if defined(USE_NEON)
+        "NEON";
+#elif defined(USE_SSE2)
+        "SSE2";
+#else
+        "scalar";
+#endif
+
+    if (argc != 1 && argc != 6) {
+        printf("Usage: %s [LOCATIONS_FILE CLASSES_FILE ANCHOR_FILE NUM_DETECTIONS NUM_CLASSES]\n",
+               argv[0]);
+        return 1;
+    }
+    printf("Decoding with the %s code\n", decode_paths);
+    errors += checkExp();
+
+    if (argc == 6) {
+        num_of_detections = atoi(argv[4]);
+        num_of_classes    = atoi(argv[5]);
+        num_of_frames     = 1;
+        locations         = readFloats(argv[1], (size_t)num_of_detections * 4);
+        classes           = readFloats(argv[2], (size_t)num_of_detections * num_of_classes);
+        anchors           = loadAnchors(argv[3], num_of_detections);
+    } else {
+        locations = (float*)malloc(NUM_DETECTIONS * 4 * sizeof(float));
+        classes   = (float*)malloc(NUM_DETECTIONS * NUM_CLASSES * sizeof(float));
+        anchors   = (anchor*)malloc(NUM_DETECTIONS * sizeof(anchor));
+        if (anchors) {
+            generateAnchors(anchors);
+        }
+    }
+    int* indices = (int*)malloc(num_of_detections * sizeof(int));
+    box* boxes   = (box*)malloc(num_of_detections * sizeof(box));
+    if (!locations || !classes || !anchors || !indices || !boxes) {
+        printf("Could not set up the frames\n");
+        errors++;
+        goto end;
+    }
+
+    for (int frame = 0; frame < num_of_frames; frame++) {
+        if (argc == 1) {
+            generateFrame(locations, classes);
+        }
+        for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+            errors += checkFrame(locations,
+                                 classes,
+                                 anchors,
+                                 num_of_detections,
+                                 num_of_classes,
+                                 thresholds[t],
+                                 indices,
+                                 boxes,
+                                 &max_corner_error);
+        }
+    }
+    printf("Decoded %d frames: max corner error %.3g\n", num_of_frames, max_corner_error);
+
+end:
+    free(locations);
+    free(classes);
+    free(anchors);
+    free(indices);
+    free(boxes);
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -20,10 +20,13 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 typedef struct args_t {
     char* model_file;
     char* labels_file;
     char* device_name;
+    bool newest_frame;
 } args_t;
 
 void parse_args(int argc, char** argv, args_t* args);
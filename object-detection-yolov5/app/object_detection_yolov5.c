@@ -31,29 +31,143 @@
  */
 
 #include "argparse.h"
+#include "bbox_overlay.h"
 #include "channel_util.h"
 #include "img_util.h"
 #include "labelparse.h"
 #include "model.h"
 #include "model_params.h"  //Generated at build time
 #include "panic.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+#include "stream_source.h"
 #include "vdo-error.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
+#include "yolov5_decoder.h"
+#include "yolov5_postprocessing.h"
+#include "yolov5_tracker.h"
 #include <axsdk/axparameter.h>
 #include <bbox.h>
 
-#include <math.h>
+#include <errno.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
-#include <poll.h>
 #include <unistd.h>
 
 #define APP_NAME "object_detection_yolov5"
 
+// Where the latency statistics of the stages are written
+#ifndef STAGE_STATS_FILE
+#define STAGE_STATS_FILE "/usr/local/packages/" APP_NAME "/localdata/stage_stats.json"
+#endif
+
+// The maximum number of objects that are tracked and drawn
+#define MAX_TRACKS 100
+
+// The color of the boxes as 0xRRGGBB
+#define BOX_COLOR 0xff0000
+// The number of pixels that a box can move before it is redrawn, the
+// extrapolated tracks move a little in every frame
+#define BOX_TOLERANCE 1
+
+// The tiles overlap by this part of their size, so that an object on the
+// border between two tiles is whole in at least one of them
+#define TILE_OVERLAP 0.2
+
+// The number of frames that are shared by the frame loop and the
+// postprocessing thread, one is postprocessed while the model is run on the
+// next one
+#define NBR_FRAME_JOBS 2
+// Upper limit of the threads that decode the output tensor of a tile
+#define MAX_DECODE_CHUNKS 4
+
+typedef struct frame_tile {
+    // The crop of the frame in pixels
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    // The same area normalized to the frame
+    yolov5_tile_t area;
+} frame_tile_t;
+
+// The thresholds can be changed while the application is running. Both
+// percents are published from the AXParameter callbacks to the frame loop in
+// one atomic word, so that the frame loop gets both from the same update
+// without taking a lock.
+#define CONF_PERCENT_SHIFT 8
+#define IOU_PERCENT_MASK   0xffu
+
+static atomic_uint_fast32_t threshold_percents;
+
+// The thresholds of the frame loop and the percents that they were computed from
+typedef struct thresholds {
+    uint_fast32_t percents;
+    float iou_threshold;
+    unsigned int quantized_conf_threshold;
+} thresholds_t;
+
+// A frame that is handed from the frame loop to the postprocessing thread
+typedef struct frame_job {
+    // The output tensors of each tile. They are swapped with the output
+    // tensors of the model after each tile, so the model writes the next
+    // frame to other tensors.
+    model_output_set_t** output_sets;
+    // False for the frames where the tracks are only moved
+    bool detect;
+    // Set to stop the postprocessing thread
+    bool stop;
+} frame_job_t;
+
+// The state of the postprocessing thread. The frame jobs are passed back and
+// forth in two queues, so the frame loop waits for a free job when the
+// postprocessing falls behind and there are never more frames in between.
+typedef struct postprocessing {
+    GAsyncQueue* free_jobs;
+    GAsyncQueue* ready_jobs;
+    frame_job_t jobs[NBR_FRAME_JOBS];
+    // The size of the output tensor of a tile
+    size_t output_size;
+
+    // Only used by the postprocessing thread once it has been started
+    const model_params_t* model_params;
+    const frame_tile_t* tiles;
+    int nbr_tiles;
+    yolov5_nms_mode_t nms_mode;
+    thresholds_t thresholds;
+    yolov5_decoder_t* decoder;
+    yolov5_candidates_t* candidates;
+    yolov5_detection_t* detections;
+    // NULL when the model is run on every frame, the detections are then
+    // drawn as they are
+    yolov5_tracker_t* tracker;
+    yolov5_track_t* tracks;
+    bbox_overlay_t* overlay;
+    char** labels;
+    stage_stats_t* stage_stats;
+} postprocessing_t;
+
+// The state of the inference stage, which runs the model on the tiles of the
+// frames that are analyzed and hands the frame jobs to the postprocessing
+typedef struct inference {
+    model_provider_t* model_provider;
+    const frame_tile_t* tiles;
+    int nbr_tiles;
+    int detection_interval;
+    // The number of frames left until the next frame that is analyzed
+    int frames_until_detection;
+    postprocessing_t* pp;
+    // The job of the frame that was last inferred
+    frame_job_t* job;
+} inference_t;
+
 volatile sig_atomic_t running = 1;
 
 static void shutdown(int status) {
@@ -61,74 +175,6 @@ static void shutdown(int status) {
     running = 0;
 }
 
-static int handle_vdo_failed(GError* error) {
-    // Maintenance/Installation in progress (e.g. Global-Rotation)
-    if (vdo_error_is_expected(&error)) {
-        syslog(LOG_INFO, "Expected vdo error %s", error->message);
-        return EXIT_SUCCESS;
-    } else {
-        panic("Unexpected vdo error %s", error->message);
-    }
-}
-
-static VdoStream* create_new_vdo_stream(unsigned int channel,
-                                        VdoFormat format,
-                                        VdoResolution res,
-                                        unsigned int num_buffers,
-                                        const char* image_fit,
-                                        double framerate) {
-    g_autoptr(VdoMap) vdo_settings = vdo_map_new();
-    g_autoptr(GError) error        = NULL;
-
-    if (!vdo_settings) {
-        panic("%s: Failed to create vdo_map", __func__);
-    }
-
-    vdo_map_set_uint32(vdo_settings, "channel", channel);
-    // format is the image format that is supplied from vdo
-    vdo_map_set_uint32(vdo_settings, "format", format);
-    // Set initial framerate
-    vdo_map_set_double(vdo_settings, "framerate", framerate);
-    VdoPair32u resolution = {
-        .w = res.width,
-        .h = res.height,
-    };
-    vdo_map_set_pair32u(vdo_settings, "resolution", resolution);
-    // Make it possible to change the framerate for the stream after it is started
-    vdo_map_set_boolean(vdo_settings, "dynamic.framerate", true);
-    // It is not needed to set buffer.strategy since VDO_BUFFER_STRATEGY_INFINITE is default
-    // vdo_map_set_uint32(vdo_settings, "buffer.strategy", VDO_BUFFER_STRATEGY_INFINITE);
-
-    // The number of buffers that vdo will allocate for this stream
-    // Normally two buffers are enough and using too many buffers will use
-    // more memory in the product
-    vdo_map_set_uint32(vdo_settings, "buffer.count", num_buffers);
-    // The vdo_stream_get_buffer is non blocking and will return immediately
-    // Then we need to poll instead when it is ok to get a buffer
-    vdo_map_set_boolean(vdo_settings, "socket.blocking", false);
-    vdo_map_set_string(vdo_settings, "image.fit", image_fit);
-
-    // Create a vdo stream using the vdoMap filled in above
-    g_autoptr(VdoStream) vdo_stream = vdo_stream_new(vdo_settings, NULL, &error);
-    if (!vdo_stream) {
-        panic("%s: Failed creating vdo stream: %s", __func__, error->message);
-    }
-    syslog(LOG_INFO, "Dump of vdo stream settings map =====");
-    vdo_map_dump(vdo_settings);
-
-    return g_steal_pointer(&vdo_stream);
-}
-
-typedef struct model_params {
-    int input_width;
-    int input_height;
-    float quantization_scale;
-    float quantization_zero_point;
-    int num_classes;
-    int num_detections;
-    int size_per_detection;
-} model_params_t;
-
 static int ax_parameter_get_int(AXParameter* handle, const char* name) {
     gchar* str_value = NULL;
     GError* error    = NULL;
@@ -151,6 +197,86 @@ static int ax_parameter_get_int(AXParameter* handle, const char* name) {
     return value;
 }
 
+static bool ax_parameter_get_bool(AXParameter* handle, const char* name) {
+    gchar* str_value = NULL;
+    GError* error    = NULL;
+
+    // Get the value of the parameter
+    if (!ax_parameter_get(handle, name, &str_value, &error)) {
+        panic("%s", error->message);
+    }
+
+    syslog(LOG_INFO, "Axparameter %s: %s", name, str_value);
+
+    bool value = g_strcmp0(str_value, "yes") == 0;
+    g_free(str_value);
+
+    return value;
+}
+
+// The percents must be in 0..100 to fit in their fields of the packed word
+static int clamp_threshold_percent(const char* name, int percent) {
+    int clamped = CLAMP(percent, 0, 100);
+    if (clamped != percent) {
+        syslog(LOG_WARNING, "%s %d is outside 0..100, using %d", name, percent, clamped);
+    }
+    return clamped;
+}
+
+static uint_fast32_t pack_threshold_percents(int conf_percent, int iou_percent) {
+    return ((uint_fast32_t)conf_percent << CONF_PERCENT_SHIFT) | (uint_fast32_t)iou_percent;
+}
+
+// Called from the thread of the AXParameter main loop. It must not call any
+// ax_parameter_* functions, since that would cause a deadlock.
+static void threshold_changed(const gchar* name, const gchar* value, gpointer user_data) {
+    (void)user_data;
+    int percent;
+
+    if (sscanf(value, "%d", &percent) != 1 || percent < 0 || percent > 100) {
+        syslog(LOG_WARNING, "Ignoring invalid value '%s' of %s", value, name);
+        return;
+    }
+
+    // All callbacks are called from the same thread, so there is only one
+    // writer and the other percent can not change in between
+    uint_fast32_t percents = atomic_load(&threshold_percents);
+    int conf_percent       = (int)(percents >> CONF_PERCENT_SHIFT);
+    int iou_percent        = (int)(percents & IOU_PERCENT_MASK);
+    if (g_str_has_suffix(name, ".ConfThresholdPercent")) {
+        conf_percent = percent;
+    } else {
+        iou_percent = percent;
+    }
+    atomic_store(&threshold_percents, pack_threshold_percents(conf_percent, iou_percent));
+    syslog(LOG_INFO, "%s was changed to %d", name, percent);
+}
+
+// Recompute the thresholds if they have been changed since the last frame
+static void update_thresholds(const model_params_t* model_params, thresholds_t* thresholds) {
+    uint_fast32_t percents = atomic_load(&threshold_percents);
+    if (percents == thresholds->percents) {
+        return;
+    }
+    thresholds->percents = percents;
+
+    float conf_threshold      = (int)(percents >> CONF_PERCENT_SHIFT) / 100.0;
+    thresholds->iou_threshold = (int)(percents & IOU_PERCENT_MASK) / 100.0;
+    // The decoder compares the quantized object likelihoods with the
+    // threshold, so it is converted again when it changes
+    thresholds->quantized_conf_threshold = yolov5_quantize_threshold(model_params, conf_threshold);
+    syslog(LOG_INFO,
+           "Thresholds: confidence %.2f (quantized %u), IoU %.2f",
+           conf_threshold,
+           thresholds->quantized_conf_threshold,
+           thresholds->iou_threshold);
+}
+
+static gpointer run_parameter_loop(gpointer loop) {
+    g_main_loop_run(loop);
+    return NULL;
+}
+
 static bbox_t* setup_bbox(void) {
     // Create box drawers
     bbox_t* bbox = bbox_view_new(1u);
@@ -159,159 +285,256 @@ static bbox_t* setup_bbox(void) {
     }
 
     bbox_clear(bbox);
-    const bbox_color_t red = bbox_color_from_rgb(0xff, 0x00, 0x00);
-
+    // The color is set by the overlay
     bbox_style_outline(bbox);   // Switch to outline style
     bbox_thickness_thin(bbox);  // Switch to thin lines
-    bbox_color(bbox, red);      // Switch to red
 
     return bbox;
 }
 
-static unsigned int elapsed_ms(struct timeval* start_ts, struct timeval* end_ts) {
-    return (unsigned int)(((end_ts->tv_sec - start_ts->tv_sec) * 1000) +
-                          ((end_ts->tv_usec - start_ts->tv_usec) / 1000));
+// The number of tiles that fit along a side of the frame without overlap
+static double get_tiles_in_frame(int tiles_per_side) {
+    return tiles_per_side - ((tiles_per_side - 1) * TILE_OVERLAP);
 }
 
-static float intersection_over_union(float x1,
-                                     float y1,
-                                     float w1,
-                                     float h1,
-                                     float x2,
-                                     float y2,
-                                     float w2,
-                                     float h2) {
-    float xx1 = fmax(x1 - (w1 / 2), x2 - (w2 / 2));
-    float yy1 = fmax(y1 - (h1 / 2), y2 - (h2 / 2));
-    float xx2 = fmin(x1 + (w1 / 2), x2 + (w2 / 2));
-    float yy2 = fmin(y1 + (h1 / 2), y2 + (h2 / 2));
-
-    float inter_area = fmax(0, xx2 - xx1) * fmax(0, yy2 - yy1);
-    float union_area = w1 * h1 + w2 * h2 - inter_area;
-
-    return inter_area / union_area;
+// The first tile starts at the start of the side and the last one ends at the
+// end, the rest are spread evenly in between
+static unsigned int
+get_tile_position(unsigned int frame_size, unsigned int tile_size, int index, int tiles_per_side) {
+    if (tiles_per_side == 1) {
+        return 0;
+    }
+    // Crops of NV12 images must start on an even pixel
+    return ((frame_size - tile_size) * index / (tiles_per_side - 1)) & ~1u;
 }
 
-static void non_maximum_suppression(uint8_t* tensor,
-                                    float iou_threshold,
-                                    model_params_t* model_params,
-                                    int* invalid_detections) {
-    int size_per_detection = model_params->size_per_detection;
-    int num_detections     = model_params->num_detections;
-    float qt_zero_point    = model_params->quantization_zero_point;
-    float qt_scale         = model_params->quantization_scale;
-
-    for (int i = 0; i < num_detections; i++) {
-        if (invalid_detections[i])  // Skip comparison if detection is already invalid
-            continue;
-
-        float x1                 = (tensor[size_per_detection * i + 0] - qt_zero_point) * qt_scale;
-        float y1                 = (tensor[size_per_detection * i + 1] - qt_zero_point) * qt_scale;
-        float w1                 = (tensor[size_per_detection * i + 2] - qt_zero_point) * qt_scale;
-        float h1                 = (tensor[size_per_detection * i + 3] - qt_zero_point) * qt_scale;
-        float object1_likelihood = (tensor[size_per_detection * i + 4] - qt_zero_point) * qt_scale;
-
-        for (int j = i + 1; j < num_detections; j++) {
-            if (invalid_detections[j])  // Skip comparison if detection is already invalid
-                continue;
-
-            float x2 = (tensor[size_per_detection * j + 0] - qt_zero_point) * qt_scale;
-            float y2 = (tensor[size_per_detection * j + 1] - qt_zero_point) * qt_scale;
-            float w2 = (tensor[size_per_detection * j + 2] - qt_zero_point) * qt_scale;
-            float h2 = (tensor[size_per_detection * j + 3] - qt_zero_point) * qt_scale;
-            float object2_likelihood =
-                (tensor[size_per_detection * j + 4] - qt_zero_point) * qt_scale;
-
-            if (intersection_over_union(x1, y1, w1, h1, x2, y2, w2, h2) > iou_threshold) {
-                // invalidates the detection with lowest object likelihood score
-                if (object1_likelihood > object2_likelihood) {
-                    invalid_detections[j] = 1;
-                } else {
-                    invalid_detections[i] = 1;
-                    break;
-                }
-            }
+static frame_tile_t*
+setup_tiles(unsigned int frame_width, unsigned int frame_height, int tiles_per_side) {
+    frame_tile_t* tiles = calloc((size_t)(tiles_per_side * tiles_per_side), sizeof(frame_tile_t));
+    if (!tiles) {
+        panic("%s: Unable to allocate tiles: %s", __func__, strerror(errno));
+    }
+
+    // With one tile the model is run on the whole frame
+    unsigned int tile_width  = frame_width;
+    unsigned int tile_height = frame_height;
+    if (tiles_per_side > 1) {
+        double tiles_in_frame = get_tiles_in_frame(tiles_per_side);
+        tile_width            = (unsigned int)(frame_width / tiles_in_frame) & ~1u;
+        tile_height           = (unsigned int)(frame_height / tiles_in_frame) & ~1u;
+    }
+
+    for (int row = 0; row < tiles_per_side; row++) {
+        for (int col = 0; col < tiles_per_side; col++) {
+            frame_tile_t* tile = &tiles[(row * tiles_per_side) + col];
+            tile->x            = get_tile_position(frame_width, tile_width, col, tiles_per_side);
+            tile->y            = get_tile_position(frame_height, tile_height, row, tiles_per_side);
+            tile->width        = tile_width;
+            tile->height       = tile_height;
+            tile->area.x       = (float)tile->x / frame_width;
+            tile->area.y       = (float)tile->y / frame_height;
+            tile->area.width   = (float)tile->width / frame_width;
+            tile->area.height  = (float)tile->height / frame_height;
         }
     }
+    syslog(LOG_INFO,
+           "Run the model on %d tiles of %u x %u in the frame of %u x %u",
+           tiles_per_side * tiles_per_side,
+           tile_width,
+           tile_height,
+           frame_width,
+           frame_height);
+    return tiles;
+}
+
+// Run the model on each tile of the frame and hand the output tensors over to
+// the frame job. Returns false if the inference could not be run, then the
+// frame is skipped.
+static bool detect_in_tiles(model_provider_t* model_provider,
+                            VdoBuffer* vdo_buf,
+                            const frame_tile_t* tiles,
+                            int nbr_tiles,
+                            frame_job_t* job) {
+    for (int t = 0; t < nbr_tiles; t++) {
+        // The preprocessing crops the tile and scales it to the model input
+        if (nbr_tiles > 1) {
+            model_provider_set_crop(model_provider,
+                                    tiles[t].x,
+                                    tiles[t].y,
+                                    tiles[t].width,
+                                    tiles[t].height);
+        }
+        // Run inference and preprocessing if needed
+        if (!model_run_inference(model_provider, vdo_buf)) {
+            return false;
+        }
+        model_provider_swap_output_set(model_provider, 0, job->output_sets[t]);
+    }
+    return true;
+}
+
+// Log an object and add its box to the overlay
+static void draw_detection(postprocessing_t* pp, int id, const yolov5_detection_t* detection) {
+    // Log info about object
+    syslog(LOG_INFO,
+           "Object %d: Label=%s, Object Likelihood=%.2f, Class Likelihood=%.2f, ",
+           id,
+           pp->labels[detection->label],
+           detection->score,
+           detection->class_score);
+    syslog(LOG_INFO,
+           "Bounding Box: [%.2f, %.2f, %.2f, %.2f]",
+           detection->x1,
+           detection->y1,
+           detection->x2,
+           detection->y2);
+
+    // No need to compensate for rotation since bbox will handle this
+    bbox_overlay_rectangle(pp->overlay,
+                           detection->x1,
+                           detection->y1,
+                           detection->x2,
+                           detection->y2,
+                           BOX_COLOR);
 }
 
-static void filter_detections(uint8_t* tensor,
-                              float conf_threshold,
-                              float iou_threshold,
-                              model_params_t* model_params,
-                              int* invalid_detections) {
-    // Filter boxes by confidence
-    for (int i = 0; i < model_params->num_detections; i++) {
-        float object_likelihood = (tensor[model_params->size_per_detection * i + 4] -
-                                   model_params->quantization_zero_point) *
-                                  model_params->quantization_scale;
-
-        if (object_likelihood < conf_threshold) {
-            invalid_detections[i] = 1;
-        } else {
-            invalid_detections[i] = 0;
+// Find the objects in the output tensors of a frame and update the tracks, or
+// only move the tracks if the model was not run on the frame, and draw them.
+// Without a tracker the objects of the frame are drawn directly.
+static void postprocess_frame(postprocessing_t* pp, const frame_job_t* job) {
+    uint64_t stage_ts  = stage_stats_now_ns();
+    int num_detections = 0;
+
+    if (job->detect) {
+        update_thresholds(pp->model_params, &pp->thresholds);
+
+        // Filter boxes by confidence without dequantizing the object
+        // likelihoods and decode the remaining boxes in the same pass, the
+        // output tensor of each tile is split over several threads
+        yolov5_candidates_clear(pp->candidates);
+        for (int t = 0; t < pp->nbr_tiles; t++) {
+            yolov5_decoder_decode_tile(pp->decoder,
+                                       job->output_sets[t]->outputs[0].data,
+                                       pp->thresholds.quantized_conf_threshold,
+                                       &pp->tiles[t].area,
+                                       pp->candidates);
+        }
+
+        // The duplicates of the objects in the overlap of the tiles are
+        // removed by the NMS of all tiles
+        num_detections = yolov5_non_maximum_suppression(pp->candidates,
+                                                        pp->thresholds.iou_threshold,
+                                                        pp->nms_mode,
+                                                        pp->detections);
+        if (pp->tracker) {
+            yolov5_tracker_update(pp->tracker, pp->detections, num_detections);
+        }
+    } else if (pp->tracker) {
+        // Only move the tracks to where the objects are expected to be
+        yolov5_tracker_extrapolate(pp->tracker);
+    }
+
+    bbox_overlay_begin(pp->overlay);
+
+    if (pp->tracker) {
+        yolov5_track_t* tracks = pp->tracks;
+        int num_tracks         = yolov5_tracker_get_tracks(pp->tracker, tracks);
+        for (int i = 0; i < num_tracks; i++) {
+            draw_detection(pp, tracks[i].id, &tracks[i].detection);
+        }
+    } else {
+        for (int i = 0; i < num_detections; i++) {
+            draw_detection(pp, i + 1, &pp->detections[i]);
         }
     }
+    stage_ts = stage_stats_mark(pp->stage_stats, STAGE_POSTPROCESSING, stage_ts);
 
-    non_maximum_suppression(tensor, iou_threshold, model_params, invalid_detections);
+    // Only sent to the overlay if the boxes have changed
+    if (!bbox_overlay_commit(pp->overlay)) {
+        panic("Failed to commit box drawer");
+    }
+    stage_stats_mark(pp->stage_stats, STAGE_BBOX_COMMIT, stage_ts);
 }
 
-static void determine_class_and_object_likelihood(uint8_t* tensor,
-                                                  int detection_idx,
-                                                  int size_per_detection,
-                                                  float qt_zero_point,
-                                                  float qt_scale,
-                                                  float* highest_class_likelihood,
-                                                  int* label_idx,
-                                                  float* object_likelihood) {
-    // Find what class this object is
-    for (int j = 5; j < size_per_detection; j++) {
-        float class_likelihood =
-            (tensor[size_per_detection * detection_idx + j] - qt_zero_point) * qt_scale;
-        if (class_likelihood > *highest_class_likelihood) {
-            *highest_class_likelihood = class_likelihood;
-            *label_idx                = j - 5;
+// Postprocess the frames in the order they are handed over by the frame loop
+// while the model is run on the next frame
+static gpointer run_postprocessing(gpointer data) {
+    postprocessing_t* pp = data;
+
+    while (true) {
+        frame_job_t* job = g_async_queue_pop(pp->ready_jobs);
+        if (job->stop) {
+            break;
         }
+        postprocess_frame(pp, job);
+        g_async_queue_push(pp->free_jobs, job);
     }
+    return NULL;
+}
+
+// The preprocessing is done for each tile together with the inference, so
+// there is no preprocessing stage
+static pipeline_status_t infer_tiles(void* ctx, VdoBuffer** vdo_buf) {
+    inference_t* inference = ctx;
 
-    *object_likelihood =
-        (tensor[size_per_detection * detection_idx + 4] - qt_zero_point) * qt_scale;
+    // Waits for a free job when the postprocessing falls behind
+    frame_job_t* job = g_async_queue_pop(inference->pp->free_jobs);
+    if (inference->frames_until_detection > 0) {
+        inference->frames_until_detection--;
+        job->detect = false;
+    } else {
+        if (!detect_in_tiles(inference->model_provider,
+                             *vdo_buf,
+                             inference->tiles,
+                             inference->nbr_tiles,
+                             job)) {
+            // No power for larod, the frame is given back to vdo and a later
+            // frame is tried
+            g_async_queue_push(inference->pp->free_jobs, job);
+            return PIPELINE_SKIP;
+        }
+        inference->frames_until_detection = inference->detection_interval - 1;
+        job->detect                       = true;
+    }
+    inference->job = job;
+    return PIPELINE_CONTINUE;
 }
 
-static void
-find_corners(float x, float y, float w, float h, float* x1, float* y1, float* x2, float* y2) {
-    *x1 = fmax(0.0, x - (w / 2));
-    *y1 = fmax(0.0, y - (h / 2));
-    *x2 = fmin(1.0, x + (w / 2));
-    *y2 = fmin(1.0, y + (h / 2));
+static void clear_input_cache(void* ctx) {
+    inference_t* inference = ctx;
+
+    model_provider_clear_input_cache(inference->model_provider);
 }
 
-static void determine_bbox_coordinates(uint8_t* tensor,
-                                       int detection_idx,
-                                       int size_per_detection,
-                                       float qt_zero_point,
-                                       float qt_scale,
-                                       float* x1,
-                                       float* y1,
-                                       float* x2,
-                                       float* y2) {
-    // Get coordinates for the object
-    float x = (tensor[size_per_detection * detection_idx + 0] - qt_zero_point) * qt_scale;
-    float y = (tensor[size_per_detection * detection_idx + 1] - qt_zero_point) * qt_scale;
-    float w = (tensor[size_per_detection * detection_idx + 2] - qt_zero_point) * qt_scale;
-    float h = (tensor[size_per_detection * detection_idx + 3] - qt_zero_point) * qt_scale;
-    find_corners(x, y, w, h, x1, y1, x2, y2);
+// The frame is postprocessed by the postprocessing thread while the model is
+// run on the next frame, so the postprocessing only limits the framerate when
+// it takes longer than the inference and there is no free job
+static void hand_over_job(void* ctx, VdoBuffer* vdo_buf) {
+    (void)vdo_buf;
+    inference_t* inference = ctx;
+
+    g_async_queue_push(inference->pp->ready_jobs, inference->job);
 }
 
+static const pipeline_infer_ops_t infer_ops = {
+    .run   = infer_tiles,
+    .reset = clear_input_cache,
+};
+
+static const pipeline_postprocess_ops_t postprocess_ops = {
+    .run = hand_over_job,
+};
+
 int main(int argc, char** argv) {
-    bbox_t* bbox                          = NULL;
-    g_autoptr(GError) vdo_error           = NULL;
-    model_provider_t* model_provider      = NULL;
-    model_tensor_output_t* tensor_outputs = NULL;
-    img_info_t model_metadata             = {0};
-    img_framerate_t image_framerate       = {0};
-    g_autoptr(VdoStream) vdo_stream       = NULL;
-    g_autoptr(VdoMap) vdo_stream_info     = NULL;
+    bbox_t* bbox                      = NULL;
+    bbox_overlay_t* overlay           = NULL;
+    g_autoptr(GError) vdo_error       = NULL;
+    model_provider_t* model_provider  = NULL;
+    stage_stats_t* stage_stats        = NULL;
+    img_info_t model_metadata         = {0};
+    stream_source_t source            = {0};
+    g_autoptr(VdoStream) vdo_stream   = NULL;
+    g_autoptr(VdoMap) vdo_stream_info = NULL;
 
     // Stop main loop at signal
     signal(SIGTERM, shutdown);
@@ -335,6 +558,7 @@ int main(int argc, char** argv) {
     model_params->size_per_detection =
         5 + NUM_CLASSES;  // Each detection consists of [x, y, w, h, object_likelihood,
                           // class1_likelihood, class2_likelihood, class3_likelihood, ... ]
+    yolov5_fill_dequantization_table(model_params);
 
     syslog(LOG_INFO,
            "Model input size w/h: %d x %d",
@@ -345,8 +569,6 @@ int main(int argc, char** argv) {
     syslog(LOG_INFO, "Number of classes: %d", model_params->num_classes);
     syslog(LOG_INFO, "Number of detections: %d", model_params->num_detections);
 
-    int invalid_detections[model_params->num_detections];
-
     // Create a new axparameter instance
     GError* axparameter_error       = NULL;
     AXParameter* axparameter_handle = ax_parameter_new(APP_NAME, &axparameter_error);
@@ -354,23 +576,133 @@ int main(int argc, char** argv) {
         panic("%s", axparameter_error->message);
     }
 
-    float conf_threshold = ax_parameter_get_int(axparameter_handle, "ConfThresholdPercent") / 100.0;
-    float iou_threshold  = ax_parameter_get_int(axparameter_handle, "IouThresholdPercent") / 100.0;
+    int conf_percent = clamp_threshold_percent(
+        "ConfThresholdPercent",
+        ax_parameter_get_int(axparameter_handle, "ConfThresholdPercent"));
+    int iou_percent = clamp_threshold_percent(
+        "IouThresholdPercent",
+        ax_parameter_get_int(axparameter_handle, "IouThresholdPercent"));
+    atomic_init(&threshold_percents, pack_threshold_percents(conf_percent, iou_percent));
+
+    // The thresholds are applied on the next frame when they are changed,
+    // the callbacks are called from a main loop in its own thread
+    GMainLoop* parameter_loop = g_main_loop_new(NULL, FALSE);
+    if (!ax_parameter_register_callback(axparameter_handle,
+                                        "ConfThresholdPercent",
+                                        threshold_changed,
+                                        NULL,
+                                        &axparameter_error) ||
+        !ax_parameter_register_callback(axparameter_handle,
+                                        "IouThresholdPercent",
+                                        threshold_changed,
+                                        NULL,
+                                        &axparameter_error)) {
+        panic("%s", axparameter_error->message);
+    }
+    GThread* parameter_thread = g_thread_new("axparameter", run_parameter_loop, parameter_loop);
+
+    // Let overlapping detections of different classes suppress each other
+    // unless the non maximum suppression is made per class
+    yolov5_nms_mode_t nms_mode = YOLOV5_NMS_CLASS_AGNOSTIC;
+    if (ax_parameter_get_bool(axparameter_handle, "NmsPerClass")) {
+        nms_mode = YOLOV5_NMS_PER_CLASS;
+    }
 
-    ax_parameter_free(axparameter_handle);
+    // Only run the model on every Nth frame, the frames in between only
+    // move the tracks
+    int detection_interval = ax_parameter_get_int(axparameter_handle, "DetectionInterval");
+    if (detection_interval < 1) {
+        detection_interval = 1;
+    }
+
+    // Split the frame into tiles_per_side x tiles_per_side tiles that the
+    // model is run on one by one, to find objects that are too small to be
+    // found when the whole frame is scaled to the input size of the model
+    int tiles_per_side = ax_parameter_get_int(axparameter_handle, "TilesPerSide");
+    if (tiles_per_side < 1) {
+        tiles_per_side = 1;
+    }
+    int nbr_tiles = tiles_per_side * tiles_per_side;
+
+    // The frames are postprocessed in a thread of their own, so that the
+    // model can be run on the next frame in the meantime
+    postprocessing_t pp = {0};
+    pp.model_params     = model_params;
+    pp.nbr_tiles        = nbr_tiles;
+    pp.nms_mode         = nms_mode;
+    pp.output_size      = (size_t)model_params->num_detections * model_params->size_per_detection;
+    pp.free_jobs        = g_async_queue_new();
+    pp.ready_jobs       = g_async_queue_new();
+
+    // The output tensor is split into chunks that are decoded on all cores
+    guint nbr_decode_chunks = MIN(g_get_num_processors(), MAX_DECODE_CHUNKS);
+    pp.decoder              = yolov5_decoder_new(model_params, (int)nbr_decode_chunks);
+
+    // The detections that pass the confidence threshold and the ones that
+    // are kept by the non maximum suppression, reused for every frame
+    pp.candidates = yolov5_candidates_new(model_params->num_detections * nbr_tiles);
+    pp.detections =
+        calloc((size_t)model_params->num_detections * nbr_tiles, sizeof(yolov5_detection_t));
+    if (!pp.detections) {
+        panic("%s: Unable to allocate detections: %s", __func__, strerror(errno));
+    }
+    // The tracks give the objects the same id in all frames and are moved
+    // with their velocity in the frames that are not analyzed. When the model
+    // is run on every frame, the detections are drawn without tracking.
+    if (detection_interval > 1) {
+        pp.tracker = yolov5_tracker_new(MAX_TRACKS);
+        pp.tracks  = calloc(MAX_TRACKS, sizeof(yolov5_track_t));
+        if (!pp.tracks) {
+            panic("%s: Unable to allocate tracks: %s", __func__, strerror(errno));
+        }
+    }
+
+    // The percents are never this value, so the thresholds are computed
+    // before the first frame
+    pp.thresholds.percents = UINT_FAST32_MAX;
+    update_thresholds(model_params, &pp.thresholds);
 
     // Start by loading the model and get the model metadata
     size_t number_output_tensors = 0;
-    model_provider = model_provider_new(args.model_file, args.device_name, &number_output_tensors);
+    model_provider = model_provider_new(args.model_file,
+                                        args.device_name,
+                                        "object_detection",
+                                        &number_output_tensors);
     if (!model_provider) {
         panic("%s: Could not create model provider", __func__);
     }
+    if (number_output_tensors != NUM_OUTPUT_TENSORS) {
+        panic("%s: The model has %zu output tensors but model_params.h was generated for %d",
+              __func__,
+              number_output_tensors,
+              NUM_OUTPUT_TENSORS);
+    }
 
-    tensor_outputs = calloc(number_output_tensors, sizeof(model_tensor_output_t));
-    if (!tensor_outputs) {
-        panic("%s: Could not allocate tensor outputs", __func__);
+    // Each frame job has its own output tensors for every tile, so the outputs
+    // of a frame are kept without a copy while the model is run on the next
+    for (int i = 0; i < NBR_FRAME_JOBS; i++) {
+        pp.jobs[i].output_sets = calloc(nbr_tiles, sizeof(model_output_set_t*));
+        if (!pp.jobs[i].output_sets) {
+            panic("%s: Unable to allocate frame outputs: %s", __func__, strerror(errno));
+        }
+        for (int t = 0; t < nbr_tiles; t++) {
+            pp.jobs[i].output_sets[t] = model_provider_new_output_set(model_provider, 0);
+            if (pp.jobs[i].output_sets[t]->outputs[0].size < pp.output_size) {
+                panic("%s: The output tensor has %zu bytes but the model parameters need %zu",
+                      __func__,
+                      pp.jobs[i].output_sets[t]->outputs[0].size,
+                      pp.output_size);
+            }
+        }
+        g_async_queue_push(pp.free_jobs, &pp.jobs[i]);
     }
 
+    // The latency percentiles of each stage are logged every 10 seconds and
+    // written to the localdata directory of the application
+    stage_stats = stage_stats_new(STAGE_STATS_FILE, 10);
+    model_provider_set_stage_stats(model_provider, stage_stats);
+    pp.stage_stats = stage_stats;
+
     // Get the model format and model input dimension and pitches
     model_metadata = model_provider_get_model_metadata(model_provider);
 
@@ -382,8 +714,9 @@ int main(int argc, char** argv) {
     unsigned int vdo_channel = 1;
 
     // The buffer count will affect memory consumption so keep it as low
-    // as possible
-    unsigned int vdo_stream_buffer_count = 2;
+    // as possible. When only the newest frame is analyzed vdo needs free
+    // buffers to fill with new frames while a frame is analyzed.
+    unsigned int vdo_stream_buffer_count = args.newest_frame ? 4 : 2;
 
     // Set to false if e.g a view area is wanted instead of the whole sensor
     bool fetch_from_whole_sensor = true;
@@ -403,7 +736,11 @@ int main(int argc, char** argv) {
            channel_ar.w,
            channel_ar.h);
 
-    VdoResolution req_res    = {model_metadata.width, model_metadata.height};
+    // With tiles the stream has to be large enough for each tile to have about
+    // the input size of the model
+    double tiles_in_frame    = get_tiles_in_frame(tiles_per_side);
+    VdoResolution req_res    = {(unsigned int)(model_metadata.width * tiles_in_frame),
+                                (unsigned int)(model_metadata.height * tiles_in_frame)};
     VdoResolution chosen_req = req_res;
 
     // Get the a resolution with the same aspect ratio as the channel aspect ratio
@@ -411,200 +748,124 @@ int main(int argc, char** argv) {
                                                req_res,
                                                &chosen_req,
                                                rotation,
-                                               &model_metadata.format)) {
+                                               &model_metadata.format,
+                                               CHANNEL_RESOLUTION_SMALLEST_NATIVE_FIT)) {
         panic("%s: Could not chose a resolution", __func__);
     }
     // In this case use default image.fit crop because the resolution
     // fetched from choose function have the same aspect ratio as the
     // channel aspect ratio
-    vdo_stream = create_new_vdo_stream(vdo_channel,
-                                       model_metadata.format,
-                                       chosen_req,
-                                       vdo_stream_buffer_count,
-                                       "crop",
-                                       vdo_stream_framerate);
+    vdo_stream = img_util_create_stream(vdo_channel,
+                                        model_metadata.format,
+                                        chosen_req,
+                                        vdo_stream_buffer_count,
+                                        "crop",
+                                        vdo_stream_framerate);
     if (!vdo_stream) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     vdo_stream_info = vdo_stream_get_info(vdo_stream, &vdo_error);
     if (!vdo_stream_info) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     VdoPair32u aspect_ratio_def = {.w = 0u, .h = 0u};
     VdoPair32u stream_ar = vdo_map_get_pair32u(vdo_stream_info, "aspect_ratio", aspect_ratio_def);
     syslog(LOG_INFO, "Stream aspect ratio is %u:%u", stream_ar.w, stream_ar.h);
 
-    image_framerate.wanted_framerate = vdo_stream_framerate;
-    double info_framerate = vdo_map_get_double(vdo_stream_info, "framerate", vdo_stream_framerate);
-    image_framerate.frametime = (unsigned int)((1.0 / info_framerate) * 1000.0);
-
-    int fd = vdo_stream_get_fd(vdo_stream, &vdo_error);
-    if (fd < 0) {
-        return handle_vdo_failed(vdo_error);
+    if (!stream_source_init(&source,
+                            vdo_stream,
+                            vdo_stream_info,
+                            vdo_stream_framerate,
+                            args.newest_frame,
+                            stage_stats,
+                            &vdo_error)) {
+        return img_util_handle_vdo_failed(vdo_error);
     }
-    struct pollfd fds = {
-        .fd     = fd,
-        .events = POLL_IN,
-    };
 
     char** labels = NULL;          // This is the array of label strings. The label
                                    // entries points into the large label_file_data buffer.
     size_t num_labels;             // Number of entries in the labels array.
     char* label_file_data = NULL;  // Buffer holding the complete collection of label strings.
 
-    parse_labels(&labels, &label_file_data, args.labels_file, &num_labels);
+    parse_labels(&labels, &label_file_data, args.labels_file, &num_labels, true);
 
-    bbox = setup_bbox();
+    bbox       = setup_bbox();
+    overlay    = bbox_overlay_new(bbox, chosen_req.width, chosen_req.height, BOX_TOLERANCE);
+    pp.overlay = overlay;
+    pp.labels  = labels;
 
     if (!vdo_stream_start(vdo_stream, &vdo_error)) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     syslog(LOG_INFO, "Start fetching video frames from VDO");
 
     // Use the vdo info map to update the model metadata
     model_provider_update_image_metadata(model_provider, vdo_stream_info);
 
-    int size_per_detection = model_params->size_per_detection;
-    float qt_zero_point    = model_params->quantization_zero_point;
-    float qt_scale         = model_params->quantization_scale;
-
-    while (running) {
-        struct timeval start_ts, end_ts;
-        unsigned int inference_ms       = 0;
-        unsigned int post_processing_ms = 0;
-        unsigned int total_elapsed_ms   = 0;
-
-        int status = 0;
-        do {
-            // If poll returns -1 then errno is set
-            // if the errno is set to EINTR then just
-            // continue this loop
-            status = poll(&fds, 1, -1);
-        } while (status == -1 && errno == EINTR);
-
-        if (status < 0) {
-            panic("Failed to poll with status %d", status);
-        }
+    frame_tile_t* tiles = setup_tiles(vdo_map_get_uint32(vdo_stream_info, "width", 0),
+                                      vdo_map_get_uint32(vdo_stream_info, "height", 0),
+                                      tiles_per_side);
+    pp.tiles = tiles;
 
-        g_autoptr(VdoBuffer) vdo_buf = vdo_stream_get_buffer(vdo_stream, &vdo_error);
-        if (!vdo_buf && g_error_matches(vdo_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
-            g_clear_error(&vdo_error);
-            continue;
-        }
-        if (!vdo_buf) {
-            return handle_vdo_failed(vdo_error);
-        }
-        gettimeofday(&start_ts, NULL);
-        // Run inference and preprocessing if needed
-        if (!model_run_inference(model_provider, vdo_buf)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-            continue;
-        }
-        gettimeofday(&end_ts, NULL);
-        inference_ms = elapsed_ms(&start_ts, &end_ts);
+    GThread* postprocessing_thread = g_thread_new("postprocessing", run_postprocessing, &pp);
 
-        total_elapsed_ms = inference_ms;
-
-        for (size_t i = 0; i < number_output_tensors; i++) {
-            if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
-                panic("Failed to get output tensor info for %zu", i);
-            }
-        }
-
-        uint8_t* tensor_data = tensor_outputs[0].data;
-        // Parse the output
-        gettimeofday(&start_ts, NULL);
-        filter_detections(tensor_data,
-                          conf_threshold,
-                          iou_threshold,
-                          model_params,
-                          invalid_detections);
-        gettimeofday(&end_ts, NULL);
-        post_processing_ms = elapsed_ms(&start_ts, &end_ts);
-        syslog(LOG_INFO, "Ran parsing for %u ms", post_processing_ms);
-        total_elapsed_ms += post_processing_ms;
-
-        bbox_clear(bbox);
-
-        int valid_detection_count = 0;
-
-        for (int i = 0; i < model_params->num_detections; i++) {
-            if (invalid_detections[i] == 1) {
-                continue;
-            }
-
-            valid_detection_count++;
-
-            float highest_class_likelihood = 0.0;
-            int label_idx                  = 0;
-            float object_likelihood        = 0.0;
-
-            determine_class_and_object_likelihood(tensor_data,
-                                                  i,
-                                                  size_per_detection,
-                                                  qt_zero_point,
-                                                  qt_scale,
-                                                  &highest_class_likelihood,
-                                                  &label_idx,
-                                                  &object_likelihood);
-            // Log info about object
-            syslog(LOG_INFO,
-                   "Object %d: Label=%s, Object Likelihood=%.2f, Class Likelihood=%.2f, ",
-                   valid_detection_count,
-                   labels[label_idx],
-                   object_likelihood,
-                   highest_class_likelihood);
-
-            float x1, y1, x2, y2;
-            determine_bbox_coordinates(tensor_data,
-                                       i,
-                                       size_per_detection,
-                                       qt_zero_point,
-                                       qt_scale,
-                                       &x1,
-                                       &y1,
-                                       &x2,
-                                       &y2);
-            syslog(LOG_INFO, "Bounding Box: [%.2f, %.2f, %.2f, %.2f]", x1, y1, x2, y2);
-
-            // No need to compensate for rotation since bbox will handle this
-            bbox_coordinates_frame_normalized(bbox);
-            bbox_rectangle(bbox, x1, y1, x2, y2);
-        }
-
-        if (!bbox_commit(bbox, 0u)) {
-            panic("Failed to commit box drawer");
-        }
-
-        // Check if the framerate from vdo should be changed
-        if (img_util_update_framerate(vdo_stream, &image_framerate, total_elapsed_ms)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-        } else {
-            // This will allow vdo to fill this buffer with data again
-            if (!vdo_stream_buffer_unref(vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpected error: %s", __func__, vdo_error->message);
-                }
-                g_clear_error(&vdo_error);
-            }
+    inference_t inference = {
+        .model_provider     = model_provider,
+        .tiles              = tiles,
+        .nbr_tiles          = nbr_tiles,
+        .detection_interval = detection_interval,
+        .pp                 = &pp,
+    };
+    // The frame loop returns on errors, so that the postprocessing thread is
+    // always stopped and joined below. The boxes are drawn by the
+    // postprocessing thread, so there is no sink stage.
+    pipeline_t pipeline = {
+        .source          = &stream_source_ops,
+        .source_ctx      = &source,
+        .infer           = &infer_ops,
+        .infer_ctx       = &inference,
+        .postprocess     = &postprocess_ops,
+        .postprocess_ctx = &inference,
+        .stage_stats     = stage_stats,
+    };
+    int exit_status = pipeline_run(&pipeline, &running);
+
+    // Cleanup, the postprocessing thread stops when it gets to the stop job
+    // after the frames that it has not postprocessed yet
+    frame_job_t* stop_job = g_async_queue_pop(pp.free_jobs);
+    stop_job->stop        = true;
+    g_async_queue_push(pp.ready_jobs, stop_job);
+    g_thread_join(postprocessing_thread);
+    for (int i = 0; i < NBR_FRAME_JOBS; i++) {
+        for (int t = 0; t < nbr_tiles; t++) {
+            model_provider_destroy_output_set(model_provider, 0, pp.jobs[i].output_sets[t]);
         }
+        free(pp.jobs[i].output_sets);
     }
+    g_async_queue_unref(pp.free_jobs);
+    g_async_queue_unref(pp.ready_jobs);
+    yolov5_decoder_destroy(pp.decoder);
 
-    // Cleanup
+    g_main_loop_quit(parameter_loop);
+    g_thread_join(parameter_thread);
+    g_main_loop_unref(parameter_loop);
+    ax_parameter_free(axparameter_handle);
+    yolov5_candidates_destroy(pp.candidates);
+    free(pp.detections);
+    yolov5_tracker_destroy(pp.tracker);
+    free(pp.tracks);
+    free(tiles);
     free(model_params);
     if (model_provider) {
         model_provider_destroy(model_provider);
     }
-    free(tensor_outputs);
+    stage_stats_destroy(stage_stats);
     free(labels);
     free(label_file_data);
+    bbox_overlay_destroy(overlay);
     bbox_destroy(bbox);
 
     syslog(LOG_INFO, "Exit %s", argv[0]);
 
-    return 0;
+    return exit_status;
 }
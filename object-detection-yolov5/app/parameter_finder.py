@@ -48,6 +48,7 @@ with open(output_file, "w") as f:
     f.write(f"#define MODEL_PARAMS_H\n\n")
     f.write(f"#define MODEL_INPUT_HEIGHT {model_input_height}\n")
     f.write(f"#define MODEL_INPUT_WIDTH {model_input_width}\n\n")
+    f.write(f"#define NUM_OUTPUT_TENSORS {len(output_details)}\n\n")
     f.write(f"#define QUANTIZATION_SCALE {quantization_scale}f\n")
     f.write(f"#define QUANTIZATION_ZERO_POINT {quantization_zero_point}\n\n")
     f.write(f"#define NUM_CLASSES {num_classes}\n")
@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yolov5_decoder.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+// Splitting fewer detections than this costs more in handing over the work
+// than it saves
+#define MIN_CHUNK_DETECTIONS 2048
+// The chunks start at a multiple of this so that the detections are scanned
+// in whole blocks
+#define CHUNK_ALIGNMENT 64
+
+static void decode_chunk(yolov5_decoder_chunk_t* chunk) {
+    yolov5_decoder_t* decoder = chunk->decoder;
+
+    yolov5_candidates_clear(chunk->candidates);
+    yolov5_decode_tile_range(decoder->tensor,
+                             decoder->model_params,
+                             decoder->quantized_threshold,
+                             decoder->tile,
+                             chunk->first_detection,
+                             chunk->nbr_detections,
+                             chunk->candidates);
+}
+
+static void run_chunk(gpointer data, gpointer user_data) {
+    yolov5_decoder_chunk_t* chunk = data;
+    yolov5_decoder_t* decoder     = user_data;
+
+    decode_chunk(chunk);
+
+    g_mutex_lock(&decoder->mutex);
+    if (--decoder->nbr_pending == 0) {
+        g_cond_signal(&decoder->done);
+    }
+    g_mutex_unlock(&decoder->mutex);
+}
+
+yolov5_decoder_t* yolov5_decoder_new(const model_params_t* model_params, int max_chunks) {
+    yolov5_decoder_t* decoder = calloc(1, sizeof(yolov5_decoder_t));
+    if (!decoder) {
+        panic("%s: Unable to allocate decoder: %s", __func__, strerror(errno));
+    }
+
+    int nbr_chunks = model_params->num_detections / MIN_CHUNK_DETECTIONS;
+    if (nbr_chunks > max_chunks) {
+        nbr_chunks = max_chunks;
+    }
+    if (nbr_chunks < 1) {
+        nbr_chunks = 1;
+    }
+    decoder->model_params = model_params;
+    decoder->nbr_chunks   = nbr_chunks;
+    decoder->chunks       = calloc((size_t)nbr_chunks, sizeof(yolov5_decoder_chunk_t));
+    if (!decoder->chunks) {
+        panic("%s: Unable to allocate chunks: %s", __func__, strerror(errno));
+    }
+    g_mutex_init(&decoder->mutex);
+    g_cond_init(&decoder->done);
+
+    int chunk_size = (model_params->num_detections + nbr_chunks - 1) / nbr_chunks;
+    chunk_size     = (chunk_size + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+    int first      = 0;
+    for (int i = 0; i < nbr_chunks; i++) {
+        yolov5_decoder_chunk_t* chunk = &decoder->chunks[i];
+        int remaining                 = model_params->num_detections - first;
+
+        chunk->decoder         = decoder;
+        chunk->first_detection = first;
+        chunk->nbr_detections  = remaining < chunk_size ? remaining : chunk_size;
+        chunk->candidates      = yolov5_candidates_new(chunk->nbr_detections);
+        first += chunk->nbr_detections;
+    }
+
+    if (nbr_chunks > 1) {
+        GError* error = NULL;
+        decoder->pool = g_thread_pool_new(run_chunk, decoder, nbr_chunks - 1, TRUE, &error);
+        if (!decoder->pool) {
+            panic("%s: Unable to create decode threads: %s", __func__, error->message);
+        }
+    }
+    syslog(LOG_INFO,
+           "Decode the output tensor in %d chunks of up to %d detections",
+           nbr_chunks,
+           chunk_size);
+    return decoder;
+}
+
+void yolov5_decoder_destroy(yolov5_decoder_t* decoder) {
+    if (!decoder) {
+        return;
+    }
+    if (decoder->pool) {
+        // Wait for the chunks that are running
+        g_thread_pool_free(decoder->pool, FALSE, TRUE);
+    }
+    for (int i = 0; i < decoder->nbr_chunks; i++) {
+        yolov5_candidates_destroy(decoder->chunks[i].candidates);
+    }
+    free(decoder->chunks);
+    g_mutex_clear(&decoder->mutex);
+    g_cond_clear(&decoder->done);
+    free(decoder);
+}
+
+int yolov5_decoder_decode_tile(yolov5_decoder_t* decoder,
+                               const uint8_t* tensor,
+                               unsigned int quantized_threshold,
+                               const yolov5_tile_t* tile,
+                               yolov5_candidates_t* candidates) {
+    if (decoder->nbr_chunks == 1) {
+        return yolov5_decode_tile_candidates(tensor,
+                                             decoder->model_params,
+                                             quantized_threshold,
+                                             tile,
+                                             candidates);
+    }
+
+    decoder->tensor              = tensor;
+    decoder->quantized_threshold = quantized_threshold;
+    decoder->tile                = tile;
+    decoder->nbr_pending         = decoder->nbr_chunks - 1;
+    for (int i = 1; i < decoder->nbr_chunks; i++) {
+        if (!g_thread_pool_push(decoder->pool, &decoder->chunks[i], NULL)) {
+            panic("%s: Unable to start decoding chunk %d", __func__, i);
+        }
+    }
+    decode_chunk(&decoder->chunks[0]);
+
+    g_mutex_lock(&decoder->mutex);
+    while (decoder->nbr_pending > 0) {
+        g_cond_wait(&decoder->done, &decoder->mutex);
+    }
+    g_mutex_unlock(&decoder->mutex);
+
+    // The chunks are appended in order, which gives the same order as when
+    // the whole tensor is decoded at once
+    int first = candidates->count;
+    for (int i = 0; i < decoder->nbr_chunks; i++) {
+        yolov5_candidates_append(candidates, decoder->chunks[i].candidates);
+    }
+    return candidates->count - first;
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the decoding of the YOLOv5 output tensor in parts
+ * on several threads.
+ */
+
+#pragma once
+
+#include "yolov5_postprocessing.h"
+
+#include <glib.h>
+#include <stdint.h>
+
+struct yolov5_decoder;
+
+// A part of the detections of the output tensor, decoded by one thread
+typedef struct yolov5_decoder_chunk {
+    struct yolov5_decoder* decoder;
+    int first_detection;
+    int nbr_detections;
+    yolov5_candidates_t* candidates;
+} yolov5_decoder_chunk_t;
+
+typedef struct yolov5_decoder {
+    const model_params_t* model_params;
+    int nbr_chunks;
+    yolov5_decoder_chunk_t* chunks;
+    // Decodes all chunks but the first, which is decoded by the calling thread
+    GThreadPool* pool;
+
+    // The tile that is decoded
+    const uint8_t* tensor;
+    unsigned int quantized_threshold;
+    const yolov5_tile_t* tile;
+
+    // The number of chunks that the pool has not decoded yet
+    int nbr_pending;
+    GMutex mutex;
+    GCond done;
+} yolov5_decoder_t;
+
+/**
+ * @brief Create a decoder that splits the output tensor into chunks
+ *
+ * @param model_params  The model parameters, must outlive the decoder
+ * @param max_chunks    The largest number of chunks that the output tensor is
+ *                      split into, fewer are used for small output tensors
+ *
+ * @return The decoder
+ */
+yolov5_decoder_t* yolov5_decoder_new(const model_params_t* model_params, int max_chunks);
+
+/**
+ * @brief Stop the threads and free the decoder
+ *
+ * @param decoder  The decoder, may be NULL
+ */
+void yolov5_decoder_destroy(yolov5_decoder_t* decoder);
+
+/**
+ * @brief Find and decode the detections of one tile on all threads
+ *
+ * Gives the same candidates in the same order as
+ * yolov5_decode_tile_candidates.
+ *
+ * @param decoder              The decoder
+ * @param tensor               The output tensor of the model for the tile
+ * @param quantized_threshold  Threshold from yolov5_quantize_threshold
+ * @param tile                 The area of the frame that the model was run on
+ * @param candidates           The detections that reach the threshold are added here
+ *
+ * @return The number of candidates of the tile
+ */
+int yolov5_decoder_decode_tile(yolov5_decoder_t* decoder,
+                               const uint8_t* tensor,
+                               unsigned int quantized_threshold,
+                               const yolov5_tile_t* tile,
+                               yolov5_candidates_t* candidates);
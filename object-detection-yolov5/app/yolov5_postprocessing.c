@@ -0,0 +1,511 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yolov5_postprocessing.h"
+#include "model_params.h"  //Generated at build time
+#include "panic.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NEON is used on the device and SSE2 when running on a host, other
+// targets use the scalar code only
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// Each detection consists of [x, y, w, h, object_likelihood, class1_likelihood, ...]
+#define OBJECT_LIKELIHOOD_OFFSET 4
+#define CLASS_LIKELIHOOD_OFFSET  5
+
+// The size of a detection of the model in model_params.h, the decoding is
+// specialized for it so that the loops over the classes have a fixed length
+#define MODEL_SIZE_PER_DETECTION (CLASS_LIKELIHOOD_OFFSET + NUM_CLASSES)
+
+// Number of detections that are compared at once
+#define SCAN_BLOCK_SIZE 16
+
+// The non maximum suppression only compares the candidates that share a cell
+// of a NMS_GRID_SIZE x NMS_GRID_SIZE grid when there are at least
+// NMS_GRID_MIN_CANDIDATES candidates, fewer are compared with each other
+#define NMS_GRID_SIZE           16
+#define NMS_GRID_MIN_CANDIDATES 128
+
+void yolov5_fill_dequantization_table(model_params_t* model_params) {
+    float qt_zero_point = model_params->quantization_zero_point;
+    float qt_scale      = model_params->quantization_scale;
+
+    for (unsigned int value = 0; value <= UINT8_MAX; value++) {
+        model_params->dequantization_table[value] = (value - qt_zero_point) * qt_scale;
+    }
+}
+
+unsigned int yolov5_quantize_threshold(const model_params_t* model_params, float threshold) {
+    // The dequantized value grows with the quantized value since the scale is
+    // positive
+    for (unsigned int value = 0; value <= UINT8_MAX; value++) {
+        if (model_params->dequantization_table[value] >= threshold) {
+            return value;
+        }
+    }
+    return UINT8_MAX + 1;
+}
+
+static void* alloc_array(size_t nbr_elements, size_t element_size) {
+    void* array = calloc(nbr_elements, element_size);
+    if (!array) {
+        panic("%s: Unable to allocate candidate array: %s", __func__, strerror(errno));
+    }
+    return array;
+}
+
+yolov5_candidates_t* yolov5_candidates_new(int capacity) {
+    yolov5_candidates_t* candidates = alloc_array(1, sizeof(yolov5_candidates_t));
+    size_t size                     = (size_t)capacity;
+
+    candidates->capacity    = capacity;
+    candidates->x1          = alloc_array(size, sizeof(float));
+    candidates->y1          = alloc_array(size, sizeof(float));
+    candidates->x2          = alloc_array(size, sizeof(float));
+    candidates->y2          = alloc_array(size, sizeof(float));
+    candidates->area        = alloc_array(size, sizeof(float));
+    candidates->score       = alloc_array(size, sizeof(float));
+    candidates->class_score = alloc_array(size, sizeof(float));
+    candidates->label       = alloc_array(size, sizeof(int));
+    candidates->sorted      = alloc_array(size, sizeof(yolov5_sort_entry_t));
+    candidates->rank        = alloc_array(size, sizeof(int));
+    candidates->suppressed  = alloc_array(size, sizeof(uint8_t));
+    candidates->cell_start  = alloc_array((NMS_GRID_SIZE * NMS_GRID_SIZE) + 1, sizeof(int));
+    candidates->cell_fill   = alloc_array(NMS_GRID_SIZE * NMS_GRID_SIZE, sizeof(int));
+    return candidates;
+}
+
+void yolov5_candidates_destroy(yolov5_candidates_t* candidates) {
+    if (!candidates) {
+        return;
+    }
+    free(candidates->x1);
+    free(candidates->y1);
+    free(candidates->x2);
+    free(candidates->y2);
+    free(candidates->area);
+    free(candidates->score);
+    free(candidates->class_score);
+    free(candidates->label);
+    free(candidates->sorted);
+    free(candidates->rank);
+    free(candidates->suppressed);
+    free(candidates->cell_start);
+    free(candidates->cell_fill);
+    free(candidates->cell_entries);
+    free(candidates);
+}
+
+// Find the class with the highest likelihood, the first one if several have
+// the same likelihood. The maximum is found first since that loop has no
+// branches and can be vectorized when the number of classes is known.
+__attribute__((always_inline)) static inline int
+class_argmax(const uint8_t* class_likelihoods, int num_classes, uint8_t* best) {
+    uint8_t max = 0;
+    for (int j = 0; j < num_classes; j++) {
+        max = class_likelihoods[j] > max ? class_likelihoods[j] : max;
+    }
+    const uint8_t* first = memchr(class_likelihoods, max, (size_t)num_classes);
+    *best                = max;
+    return (int)(first - class_likelihoods);
+}
+
+// Dequantize the box, score and class of a detection that has passed the
+// threshold and add it to the candidates
+__attribute__((always_inline)) static inline void
+decode_candidate(const uint8_t* tensor,
+                 const model_params_t* model_params,
+                 int size_per_detection,
+                 int detection_idx,
+                 yolov5_candidates_t* candidates) {
+    const float* dequantize  = model_params->dequantization_table;
+    const uint8_t* detection = tensor + ((size_t)size_per_detection * detection_idx);
+
+    float x = dequantize[detection[0]];
+    float y = dequantize[detection[1]];
+    float w = dequantize[detection[2]];
+    float h = dequantize[detection[3]];
+
+    // The class with the highest likelihood is the same in the quantized
+    // domain, so only that likelihood is dequantized
+    uint8_t best;
+    const uint8_t* class_likelihoods = detection + CLASS_LIKELIHOOD_OFFSET;
+    int num_classes                  = size_per_detection - CLASS_LIKELIHOOD_OFFSET;
+    int label                        = class_argmax(class_likelihoods, num_classes, &best);
+    float class_score                = dequantize[best];
+    // No class is chosen if no class has a likelihood above zero
+    if (class_score <= 0.0f) {
+        label       = 0;
+        class_score = 0.0f;
+    }
+
+    int c                      = candidates->count++;
+    candidates->x1[c]          = x - (w / 2);
+    candidates->y1[c]          = y - (h / 2);
+    candidates->x2[c]          = x + (w / 2);
+    candidates->y2[c]          = y + (h / 2);
+    candidates->area[c]        = w * h;
+    candidates->score[c]       = dequantize[detection[4]];
+    candidates->class_score[c] = class_score;
+    candidates->label[c]       = label;
+}
+
+#if defined(USE_NEON) || defined(USE_SSE2)
+// The object likelihoods are one detection apart in the tensor, collect them
+// so that they can be loaded into one vector
+__attribute__((always_inline)) static inline void
+gather_block(const uint8_t* likelihoods, size_t stride, uint8_t* block) {
+    for (size_t j = 0; j < SCAN_BLOCK_SIZE; j++) {
+        block[j] = likelihoods[j * stride];
+    }
+}
+#endif
+
+// Decode the detections that reach the threshold. This is inlined in
+// decode_candidates with both the size of the detections of model_params.h
+// and the size of the model parameters, so that the compiler can unroll and
+// vectorize the first one for the model that was built with.
+__attribute__((always_inline)) static inline void
+scan_candidates(const uint8_t* tensor,
+                const model_params_t* model_params,
+                int size_per_detection,
+                int num_detections,
+                uint8_t threshold,
+                yolov5_candidates_t* candidates) {
+    size_t stride              = (size_t)size_per_detection;
+    const uint8_t* likelihoods = tensor + OBJECT_LIKELIHOOD_OFFSET;
+    int i                      = 0;
+
+#if defined(USE_NEON)
+    uint8x16_t threshold_vec = vdupq_n_u8(threshold);
+    for (; i + SCAN_BLOCK_SIZE <= num_detections; i += SCAN_BLOCK_SIZE) {
+        uint8_t block[SCAN_BLOCK_SIZE];
+        gather_block(likelihoods + ((size_t)i * stride), stride, block);
+        uint8x16_t passed = vcgeq_u8(vld1q_u8(block), threshold_vec);
+        // Almost all blocks are rejected here by a single compare
+        if (vmaxvq_u8(passed) == 0) {
+            continue;
+        }
+        for (int j = 0; j < SCAN_BLOCK_SIZE; j++) {
+            if (block[j] >= threshold) {
+                decode_candidate(tensor, model_params, size_per_detection, i + j, candidates);
+            }
+        }
+    }
+#elif defined(USE_SSE2)
+    __m128i threshold_vec = _mm_set1_epi8((char)threshold);
+    for (; i + SCAN_BLOCK_SIZE <= num_detections; i += SCAN_BLOCK_SIZE) {
+        uint8_t block[SCAN_BLOCK_SIZE];
+        gather_block(likelihoods + ((size_t)i * stride), stride, block);
+        __m128i values = _mm_loadu_si128((const __m128i*)block);
+        // There is no unsigned compare in SSE2, a value is at least the
+        // threshold if it is the maximum of the value and the threshold
+        __m128i passed    = _mm_cmpeq_epi8(_mm_max_epu8(values, threshold_vec), values);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(passed);
+        while (mask) {
+            decode_candidate(tensor,
+                             model_params,
+                             size_per_detection,
+                             i + __builtin_ctz(mask),
+                             candidates);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // The detections that do not fill a whole block
+    for (; i < num_detections; i++) {
+        if (likelihoods[(size_t)i * stride] >= threshold) {
+            decode_candidate(tensor, model_params, size_per_detection, i, candidates);
+        }
+    }
+}
+
+// Add the detections from first_detection that reach the threshold to the
+// candidates
+static void decode_candidates(const uint8_t* tensor,
+                              const model_params_t* model_params,
+                              unsigned int quantized_threshold,
+                              int first_detection,
+                              int nbr_detections,
+                              yolov5_candidates_t* candidates) {
+    if (quantized_threshold > UINT8_MAX) {
+        return;
+    }
+    uint8_t threshold = (uint8_t)quantized_threshold;
+
+    // The positions of the detections are relative to the first detection
+    // while they are scanned
+    if (model_params->size_per_detection == MODEL_SIZE_PER_DETECTION) {
+        scan_candidates(tensor + ((size_t)MODEL_SIZE_PER_DETECTION * first_detection),
+                        model_params,
+                        MODEL_SIZE_PER_DETECTION,
+                        nbr_detections,
+                        threshold,
+                        candidates);
+    } else {
+        // Models with other parameters than model_params.h use the same code
+        // without the fixed sizes
+        scan_candidates(tensor + ((size_t)model_params->size_per_detection * first_detection),
+                        model_params,
+                        model_params->size_per_detection,
+                        nbr_detections,
+                        threshold,
+                        candidates);
+    }
+}
+
+int yolov5_decode_candidates(const uint8_t* tensor,
+                             const model_params_t* model_params,
+                             unsigned int quantized_threshold,
+                             yolov5_candidates_t* candidates) {
+    yolov5_candidates_clear(candidates);
+    decode_candidates(tensor,
+                      model_params,
+                      quantized_threshold,
+                      0,
+                      model_params->num_detections,
+                      candidates);
+    return candidates->count;
+}
+
+void yolov5_candidates_clear(yolov5_candidates_t* candidates) {
+    candidates->count = 0;
+}
+
+int yolov5_decode_tile_candidates(const uint8_t* tensor,
+                                  const model_params_t* model_params,
+                                  unsigned int quantized_threshold,
+                                  const yolov5_tile_t* tile,
+                                  yolov5_candidates_t* candidates) {
+    return yolov5_decode_tile_range(tensor,
+                                    model_params,
+                                    quantized_threshold,
+                                    tile,
+                                    0,
+                                    model_params->num_detections,
+                                    candidates);
+}
+
+int yolov5_decode_tile_range(const uint8_t* tensor,
+                             const model_params_t* model_params,
+                             unsigned int quantized_threshold,
+                             const yolov5_tile_t* tile,
+                             int first_detection,
+                             int nbr_detections,
+                             yolov5_candidates_t* candidates) {
+    int first = candidates->count;
+
+    decode_candidates(tensor,
+                      model_params,
+                      quantized_threshold,
+                      first_detection,
+                      nbr_detections,
+                      candidates);
+    for (int c = first; c < candidates->count; c++) {
+        candidates->x1[c] = tile->x + (candidates->x1[c] * tile->width);
+        candidates->y1[c] = tile->y + (candidates->y1[c] * tile->height);
+        candidates->x2[c] = tile->x + (candidates->x2[c] * tile->width);
+        candidates->y2[c] = tile->y + (candidates->y2[c] * tile->height);
+        candidates->area[c] *= tile->width * tile->height;
+    }
+    return candidates->count - first;
+}
+
+void yolov5_candidates_append(yolov5_candidates_t* candidates, const yolov5_candidates_t* other) {
+    if (candidates->count + other->count > candidates->capacity) {
+        panic("%s: No room for %d more candidates", __func__, other->count);
+    }
+    size_t first = (size_t)candidates->count;
+    size_t count = (size_t)other->count;
+
+    memcpy(candidates->x1 + first, other->x1, count * sizeof(float));
+    memcpy(candidates->y1 + first, other->y1, count * sizeof(float));
+    memcpy(candidates->x2 + first, other->x2, count * sizeof(float));
+    memcpy(candidates->y2 + first, other->y2, count * sizeof(float));
+    memcpy(candidates->area + first, other->area, count * sizeof(float));
+    memcpy(candidates->score + first, other->score, count * sizeof(float));
+    memcpy(candidates->class_score + first, other->class_score, count * sizeof(float));
+    memcpy(candidates->label + first, other->label, count * sizeof(int));
+    candidates->count += other->count;
+}
+
+// Higher scores first and the lower position first for equal scores so that
+// the order does not depend on the sort implementation
+static int compare_sort_entries(const void* a, const void* b) {
+    const yolov5_sort_entry_t* entry_a = a;
+    const yolov5_sort_entry_t* entry_b = b;
+    if (entry_a->score > entry_b->score) {
+        return -1;
+    }
+    if (entry_a->score < entry_b->score) {
+        return 1;
+    }
+    return entry_a->pos - entry_b->pos;
+}
+
+static float intersection_over_union(const yolov5_candidates_t* candidates, int a, int b) {
+    float xx1 = fmaxf(candidates->x1[a], candidates->x1[b]);
+    float yy1 = fmaxf(candidates->y1[a], candidates->y1[b]);
+    float xx2 = fminf(candidates->x2[a], candidates->x2[b]);
+    float yy2 = fminf(candidates->y2[a], candidates->y2[b]);
+
+    float inter_area = fmaxf(0.0f, xx2 - xx1) * fmaxf(0.0f, yy2 - yy1);
+    float union_area = candidates->area[a] + candidates->area[b] - inter_area;
+
+    return inter_area / union_area;
+}
+
+// Suppress candidate b if it has a lower score than the kept candidate a and
+// overlaps it too much
+static void suppress_if_overlapping(yolov5_candidates_t* candidates,
+                                    int a,
+                                    int b,
+                                    float iou_threshold,
+                                    yolov5_nms_mode_t mode) {
+    if (candidates->suppressed[b] || candidates->rank[b] <= candidates->rank[a]) {
+        return;
+    }
+    if (mode == YOLOV5_NMS_PER_CLASS && candidates->label[a] != candidates->label[b]) {
+        return;
+    }
+    if (intersection_over_union(candidates, a, b) > iou_threshold) {
+        candidates->suppressed[b] = 1;
+    }
+}
+
+static int grid_cell(float value) {
+    if (value <= 0.0f) {
+        return 0;
+    }
+    if (value >= 1.0f) {
+        return NMS_GRID_SIZE - 1;
+    }
+    return (int)(value * NMS_GRID_SIZE);
+}
+
+// Register each candidate in all grid cells that its box overlaps, in order
+// of decreasing score
+static void build_grid(yolov5_candidates_t* candidates) {
+    int* cell_start = candidates->cell_start;
+    int* cell_fill  = candidates->cell_fill;
+
+    memset(cell_start, 0, sizeof(int) * ((NMS_GRID_SIZE * NMS_GRID_SIZE) + 1));
+    for (int c = 0; c < candidates->count; c++) {
+        for (int cy = grid_cell(candidates->y1[c]); cy <= grid_cell(candidates->y2[c]); cy++) {
+            for (int cx = grid_cell(candidates->x1[c]); cx <= grid_cell(candidates->x2[c]); cx++) {
+                cell_start[(cy * NMS_GRID_SIZE) + cx + 1]++;
+            }
+        }
+    }
+    for (int cell = 0; cell < NMS_GRID_SIZE * NMS_GRID_SIZE; cell++) {
+        cell_start[cell + 1] += cell_start[cell];
+        cell_fill[cell] = cell_start[cell];
+    }
+
+    size_t nbr_entries = (size_t)cell_start[NMS_GRID_SIZE * NMS_GRID_SIZE];
+    if (nbr_entries > candidates->cell_entries_capacity) {
+        free(candidates->cell_entries);
+        candidates->cell_entries          = alloc_array(nbr_entries, sizeof(int));
+        candidates->cell_entries_capacity = nbr_entries;
+    }
+    for (int r = 0; r < candidates->count; r++) {
+        int c = candidates->sorted[r].pos;
+        for (int cy = grid_cell(candidates->y1[c]); cy <= grid_cell(candidates->y2[c]); cy++) {
+            for (int cx = grid_cell(candidates->x1[c]); cx <= grid_cell(candidates->x2[c]); cx++) {
+                candidates->cell_entries[cell_fill[(cy * NMS_GRID_SIZE) + cx]++] = c;
+            }
+        }
+    }
+}
+
+int yolov5_non_maximum_suppression(yolov5_candidates_t* candidates,
+                                   float iou_threshold,
+                                   yolov5_nms_mode_t mode,
+                                   yolov5_detection_t* detections) {
+    int count          = candidates->count;
+    int num_detections = 0;
+
+    for (int c = 0; c < count; c++) {
+        candidates->sorted[c].score = candidates->score[c];
+        candidates->sorted[c].pos   = c;
+        candidates->suppressed[c]   = 0;
+    }
+    qsort(candidates->sorted, (size_t)count, sizeof(yolov5_sort_entry_t), compare_sort_entries);
+    for (int r = 0; r < count; r++) {
+        candidates->rank[candidates->sorted[r].pos] = r;
+    }
+
+    // Boxes that overlap share at least one cell, so only the candidates in
+    // the cells of a kept box can be suppressed by it
+    bool use_grid = count >= NMS_GRID_MIN_CANDIDATES;
+    if (use_grid) {
+        build_grid(candidates);
+    }
+
+    for (int r = 0; r < count; r++) {
+        int a = candidates->sorted[r].pos;
+        if (candidates->suppressed[a]) {
+            continue;
+        }
+        yolov5_detection_t* detection = &detections[num_detections++];
+        detection->x1                 = fmaxf(0.0f, candidates->x1[a]);
+        detection->y1                 = fmaxf(0.0f, candidates->y1[a]);
+        detection->x2                 = fminf(1.0f, candidates->x2[a]);
+        detection->y2                 = fminf(1.0f, candidates->y2[a]);
+        detection->score              = candidates->score[a];
+        detection->class_score        = candidates->class_score[a];
+        detection->label              = candidates->label[a];
+
+        if (!use_grid) {
+            for (int s = r + 1; s < count; s++) {
+                suppress_if_overlapping(candidates,
+                                        a,
+                                        candidates->sorted[s].pos,
+                                        iou_threshold,
+                                        mode);
+            }
+            continue;
+        }
+        for (int cy = grid_cell(candidates->y1[a]); cy <= grid_cell(candidates->y2[a]); cy++) {
+            for (int cx = grid_cell(candidates->x1[a]); cx <= grid_cell(candidates->x2[a]); cx++) {
+                int cell = (cy * NMS_GRID_SIZE) + cx;
+                for (int e = candidates->cell_start[cell]; e < candidates->cell_start[cell + 1];
+                     e++) {
+                    suppress_if_overlapping(candidates,
+                                            a,
+                                            candidates->cell_entries[e],
+                                            iou_threshold,
+                                            mode);
+                }
+            }
+        }
+    }
+    return num_detections;
+}
@@ -0,0 +1,260 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the parsing of the YOLOv5 output tensor.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct model_params {
+    int input_width;
+    int input_height;
+    float quantization_scale;
+    float quantization_zero_point;
+    int num_classes;
+    int num_detections;
+    int size_per_detection;
+    // The dequantized value of each quantized value of the output tensor,
+    // filled by yolov5_fill_dequantization_table
+    float dequantization_table[UINT8_MAX + 1];
+} model_params_t;
+
+/**
+ * @brief Fill the dequantization table of the model parameters
+ *
+ * The output tensor only holds 256 different values, so they are dequantized
+ * once at startup and looked up instead of being shifted and scaled for each
+ * element that is parsed.
+ *
+ * @param model_params  The model parameters with the quantization
+ */
+void yolov5_fill_dequantization_table(model_params_t* model_params);
+
+/**
+ * @brief Convert a threshold to the quantized domain of the output tensor
+ *
+ * Comparing the quantized values with the returned threshold gives the same
+ * result as comparing the dequantized values with the threshold, so the
+ * values do not have to be dequantized.
+ *
+ * @param model_params  The model parameters with the dequantization table
+ * @param threshold     The threshold for the dequantized values
+ *
+ * @return The smallest quantized value that is at least the threshold when
+ * dequantized, 256 if no quantized value reaches the threshold
+ */
+unsigned int yolov5_quantize_threshold(const model_params_t* model_params, float threshold);
+
+typedef enum yolov5_nms_mode {
+    // Only detections of the same class suppress each other
+    YOLOV5_NMS_PER_CLASS,
+    // Overlapping detections suppress each other whatever their class is
+    YOLOV5_NMS_CLASS_AGNOSTIC,
+} yolov5_nms_mode_t;
+
+/**
+ * @brief A detection that is left after the non maximum suppression
+ */
+typedef struct yolov5_detection {
+    // The corners of the box, normalized and clamped to the image
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+    // The object likelihood
+    float score;
+    // The likelihood of the class
+    float class_score;
+    int label;
+} yolov5_detection_t;
+
+typedef struct yolov5_sort_entry {
+    float score;
+    int pos;
+} yolov5_sort_entry_t;
+
+/**
+ * @brief An area of the frame that the model is run on, normalized to the frame
+ */
+typedef struct yolov5_tile {
+    float x;
+    float y;
+    float width;
+    float height;
+} yolov5_tile_t;
+
+/**
+ * @brief The candidates of a frame, dequantized once with one array per value
+ *
+ * The arrays have room for a fixed number of candidates and are reused for
+ * every frame.
+ */
+typedef struct yolov5_candidates {
+    int capacity;
+    int count;
+
+    // The corners of the box, not clamped to the image
+    float* x1;
+    float* y1;
+    float* x2;
+    float* y2;
+    float* area;
+    // The object likelihood
+    float* score;
+    float* class_score;
+    int* label;
+
+    // Used by the non maximum suppression, the candidates sorted by score,
+    // the position of each candidate in the sorted order and if it has been
+    // suppressed
+    yolov5_sort_entry_t* sorted;
+    int* rank;
+    uint8_t* suppressed;
+    // Used when there are many candidates, the candidates that overlap each
+    // cell of a uniform grid over the image
+    int* cell_start;
+    int* cell_fill;
+    int* cell_entries;
+    size_t cell_entries_capacity;
+} yolov5_candidates_t;
+
+/**
+ * @brief Create the candidates
+ *
+ * Every detection that is decoded may be a candidate, so the capacity is the
+ * number of detections that are decoded into the candidates, e.g. the number
+ * of detections of the model times the number of tiles of a frame.
+ *
+ * @param capacity  The maximum number of candidates
+ *
+ * @return The candidates
+ */
+yolov5_candidates_t* yolov5_candidates_new(int capacity);
+
+/**
+ * @brief Free the candidates
+ *
+ * @param candidates  The candidates, may be NULL
+ */
+void yolov5_candidates_destroy(yolov5_candidates_t* candidates);
+
+/**
+ * @brief Find and decode the detections with an object likelihood of at least the threshold
+ *
+ * The object likelihoods are compared with the threshold without being
+ * dequantized. The box, score and class of each detection that reaches the
+ * threshold are dequantized in the same pass, so each detection is read once.
+ *
+ * @param tensor               The output tensor of the model
+ * @param model_params         The model parameters
+ * @param quantized_threshold  Threshold from yolov5_quantize_threshold
+ * @param candidates           Filled with the detections that reach the threshold
+ *
+ * @return The number of candidates
+ */
+int yolov5_decode_candidates(const uint8_t* tensor,
+                             const model_params_t* model_params,
+                             unsigned int quantized_threshold,
+                             yolov5_candidates_t* candidates);
+
+/**
+ * @brief Remove all candidates before the tiles of a new frame are decoded
+ *
+ * @param candidates  The candidates
+ */
+void yolov5_candidates_clear(yolov5_candidates_t* candidates);
+
+/**
+ * @brief Find and decode the detections of one tile of the frame
+ *
+ * Works like yolov5_decode_candidates, but the candidates are added to the
+ * candidates that are already there and the boxes are moved from the tile to
+ * the frame. The non maximum suppression of all candidates then removes the
+ * duplicates of the objects in the overlap of the tiles.
+ *
+ * @param tensor               The output tensor of the model for the tile
+ * @param model_params         The model parameters
+ * @param quantized_threshold  Threshold from yolov5_quantize_threshold
+ * @param tile                 The area of the frame that the model was run on
+ * @param candidates           The detections that reach the threshold are added here
+ *
+ * @return The number of candidates of the tile
+ */
+int yolov5_decode_tile_candidates(const uint8_t* tensor,
+                                  const model_params_t* model_params,
+                                  unsigned int quantized_threshold,
+                                  const yolov5_tile_t* tile,
+                                  yolov5_candidates_t* candidates);
+
+/**
+ * @brief Find and decode the detections of a part of the output tensor of one tile
+ *
+ * Works like yolov5_decode_tile_candidates for the detections from
+ * first_detection, so that the output tensor can be decoded in parts by
+ * several threads. Decoding all parts into their own candidates and appending
+ * them in order with yolov5_candidates_append gives the same candidates as
+ * decoding the whole output tensor.
+ *
+ * @param tensor               The output tensor of the model for the tile
+ * @param model_params         The model parameters
+ * @param quantized_threshold  Threshold from yolov5_quantize_threshold
+ * @param tile                 The area of the frame that the model was run on
+ * @param first_detection      The first detection of the part
+ * @param nbr_detections       The number of detections of the part
+ * @param candidates           The detections that reach the threshold are added here
+ *
+ * @return The number of candidates of the part
+ */
+int yolov5_decode_tile_range(const uint8_t* tensor,
+                             const model_params_t* model_params,
+                             unsigned int quantized_threshold,
+                             const yolov5_tile_t* tile,
+                             int first_detection,
+                             int nbr_detections,
+                             yolov5_candidates_t* candidates);
+
+/**
+ * @brief Add candidates after the candidates that are already there
+ *
+ * @param candidates  The candidates that are added to
+ * @param other       The candidates to add, only the decoded values are copied
+ */
+void yolov5_candidates_append(yolov5_candidates_t* candidates, const yolov5_candidates_t* other);
+
+/**
+ * @brief Get the candidates that do not overlap a candidate with a higher score
+ *
+ * The candidates are visited in order of decreasing score and a candidate is
+ * kept if it does not overlap a kept candidate with an IoU of more than the
+ * threshold. With many candidates only the candidates that share a cell of a
+ * grid over the image are compared, which gives the same result.
+ *
+ * @param candidates     The candidates from yolov5_decode_candidates
+ * @param iou_threshold  Candidates that overlap more than this are suppressed
+ * @param mode           If only candidates of the same class suppress each other
+ * @param detections     Filled with the kept candidates in order of decreasing
+ *                       score, must have room for all candidates
+ *
+ * @return The number of detections
+ */
+int yolov5_non_maximum_suppression(yolov5_candidates_t* candidates,
+                                   float iou_threshold,
+                                   yolov5_nms_mode_t mode,
+                                   yolov5_detection_t* detections);
@@ -0,0 +1,273 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yolov5_tracker.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A detection is only matched to a track that it overlaps at least this much
+#define TRACKER_IOU_THRESHOLD 0.3f
+// A track is shown when it has been matched to this many detections
+#define TRACKER_MIN_HITS 2
+// A track is removed when it has not been matched in this many detection
+// frames in a row, until then it is shown where it is predicted to be
+#define TRACKER_MAX_MISSES 2
+
+// The uncertainty of the position and the velocity relative to the size of
+// the box, the same weights as in DeepSORT
+#define STD_WEIGHT_POSITION (1.0f / 20)
+#define STD_WEIGHT_VELOCITY (1.0f / 160)
+// Keeps the uncertainty above zero for boxes that are very small
+#define MIN_BOX_SIZE 0.01f
+
+static void* alloc_array(size_t nbr_elements, size_t element_size) {
+    void* array = calloc(nbr_elements, element_size);
+    if (!array) {
+        panic("%s: Unable to allocate tracker array: %s", __func__, strerror(errno));
+    }
+    return array;
+}
+
+yolov5_tracker_t* yolov5_tracker_new(int max_tracks) {
+    yolov5_tracker_t* tracker = alloc_array(1, sizeof(yolov5_tracker_t));
+    size_t capacity           = (size_t)max_tracks;
+
+    tracker->max_tracks        = max_tracks;
+    tracker->next_id           = 1;
+    tracker->tracks            = alloc_array(capacity, sizeof(yolov5_track_t));
+    tracker->matches           = alloc_array(capacity * capacity, sizeof(yolov5_track_match_t));
+    tracker->track_matched     = alloc_array(capacity, sizeof(bool));
+    tracker->detection_matched = alloc_array(capacity, sizeof(bool));
+    return tracker;
+}
+
+void yolov5_tracker_destroy(yolov5_tracker_t* tracker) {
+    if (!tracker) {
+        return;
+    }
+    free(tracker->tracks);
+    free(tracker->matches);
+    free(tracker->track_matched);
+    free(tracker->detection_matched);
+    free(tracker);
+}
+
+static void state_init(yolov5_track_state_t* state, float position, float size) {
+    float std_position = 2 * STD_WEIGHT_POSITION * fmaxf(size, MIN_BOX_SIZE);
+    float std_velocity = 10 * STD_WEIGHT_VELOCITY * fmaxf(size, MIN_BOX_SIZE);
+
+    state->position = position;
+    state->velocity = 0.0f;
+    state->p00      = std_position * std_position;
+    state->p01      = 0.0f;
+    state->p11      = std_velocity * std_velocity;
+}
+
+// Move the position one frame with the velocity and increase the uncertainty
+static void state_predict(yolov5_track_state_t* state, float size) {
+    float std_position = STD_WEIGHT_POSITION * fmaxf(size, MIN_BOX_SIZE);
+    float std_velocity = STD_WEIGHT_VELOCITY * fmaxf(size, MIN_BOX_SIZE);
+
+    state->position += state->velocity;
+    state->p00 += (2 * state->p01) + state->p11 + (std_position * std_position);
+    state->p01 += state->p11;
+    state->p11 += std_velocity * std_velocity;
+}
+
+// Correct the position and the velocity with a measured position
+static void state_update(yolov5_track_state_t* state, float measurement, float size) {
+    float std_measurement = STD_WEIGHT_POSITION * fmaxf(size, MIN_BOX_SIZE);
+    float innovation      = measurement - state->position;
+    float covariance      = state->p00 + (std_measurement * std_measurement);
+    float gain_position   = state->p00 / covariance;
+    float gain_velocity   = state->p01 / covariance;
+
+    state->position += gain_position * innovation;
+    state->velocity += gain_velocity * innovation;
+    state->p11 -= gain_velocity * state->p01;
+    state->p01 -= gain_position * state->p01;
+    state->p00 -= gain_position * state->p00;
+}
+
+// Set the box of the track from the filtered center and size
+static void update_box(yolov5_track_t* track) {
+    float half_w = fmaxf(0.0f, track->w.position) / 2;
+    float half_h = fmaxf(0.0f, track->h.position) / 2;
+
+    track->detection.x1 = fmaxf(0.0f, track->cx.position - half_w);
+    track->detection.y1 = fmaxf(0.0f, track->cy.position - half_h);
+    track->detection.x2 = fminf(1.0f, track->cx.position + half_w);
+    track->detection.y2 = fminf(1.0f, track->cy.position + half_h);
+}
+
+static void track_init(yolov5_track_t* track, int id, const yolov5_detection_t* detection) {
+    float w = detection->x2 - detection->x1;
+    float h = detection->y2 - detection->y1;
+
+    track->id        = id;
+    track->detection = *detection;
+    track->hits      = 1;
+    track->misses    = 0;
+    state_init(&track->cx, detection->x1 + (w / 2), w);
+    state_init(&track->cy, detection->y1 + (h / 2), h);
+    state_init(&track->w, w, w);
+    state_init(&track->h, h, h);
+}
+
+static void track_predict(yolov5_track_t* track) {
+    float w = track->w.position;
+    float h = track->h.position;
+
+    state_predict(&track->cx, w);
+    state_predict(&track->cy, h);
+    state_predict(&track->w, w);
+    state_predict(&track->h, h);
+    update_box(track);
+}
+
+static void track_update(yolov5_track_t* track, const yolov5_detection_t* detection) {
+    float w = detection->x2 - detection->x1;
+    float h = detection->y2 - detection->y1;
+
+    state_update(&track->cx, detection->x1 + (w / 2), w);
+    state_update(&track->cy, detection->y1 + (h / 2), h);
+    state_update(&track->w, w, w);
+    state_update(&track->h, h, h);
+
+    track->detection.score       = detection->score;
+    track->detection.class_score = detection->class_score;
+    track->detection.label       = detection->label;
+    track->hits++;
+    track->misses = 0;
+    update_box(track);
+}
+
+static float intersection_over_union(const yolov5_detection_t* a, const yolov5_detection_t* b) {
+    float xx1 = fmaxf(a->x1, b->x1);
+    float yy1 = fmaxf(a->y1, b->y1);
+    float xx2 = fminf(a->x2, b->x2);
+    float yy2 = fminf(a->y2, b->y2);
+
+    float inter_area = fmaxf(0.0f, xx2 - xx1) * fmaxf(0.0f, yy2 - yy1);
+    float union_area = ((a->x2 - a->x1) * (a->y2 - a->y1)) + ((b->x2 - b->x1) * (b->y2 - b->y1)) -
+                       inter_area;
+
+    if (union_area <= 0.0f) {
+        return 0.0f;
+    }
+    return inter_area / union_area;
+}
+
+// Higher IoU first, then the older track and the detection with the higher
+// score so that the order does not depend on the sort implementation
+static int compare_matches(const void* a, const void* b) {
+    const yolov5_track_match_t* match_a = a;
+    const yolov5_track_match_t* match_b = b;
+    if (match_a->iou > match_b->iou) {
+        return -1;
+    }
+    if (match_a->iou < match_b->iou) {
+        return 1;
+    }
+    if (match_a->track != match_b->track) {
+        return match_a->track - match_b->track;
+    }
+    return match_a->detection - match_b->detection;
+}
+
+void yolov5_tracker_extrapolate(yolov5_tracker_t* tracker) {
+    for (int t = 0; t < tracker->num_tracks; t++) {
+        track_predict(&tracker->tracks[t]);
+    }
+}
+
+void yolov5_tracker_update(yolov5_tracker_t* tracker,
+                           const yolov5_detection_t* detections,
+                           int num_detections) {
+    yolov5_tracker_extrapolate(tracker);
+
+    // The detections are sorted by score, so the ones with the lowest score
+    // are left out if there are more than there is room for
+    if (num_detections > tracker->max_tracks) {
+        num_detections = tracker->max_tracks;
+    }
+
+    // Match the pairs that overlap the most first. There are few tracks and
+    // detections, so all pairs are compared.
+    int num_matches = 0;
+    for (int t = 0; t < tracker->num_tracks; t++) {
+        const yolov5_track_t* track = &tracker->tracks[t];
+        for (int d = 0; d < num_detections; d++) {
+            if (detections[d].label != track->detection.label) {
+                continue;
+            }
+            float iou = intersection_over_union(&track->detection, &detections[d]);
+            if (iou >= TRACKER_IOU_THRESHOLD) {
+                yolov5_track_match_t* match = &tracker->matches[num_matches++];
+                match->iou                  = iou;
+                match->track                = t;
+                match->detection            = d;
+            }
+        }
+    }
+    qsort(tracker->matches, (size_t)num_matches, sizeof(yolov5_track_match_t), compare_matches);
+
+    memset(tracker->track_matched, 0, sizeof(bool) * (size_t)tracker->max_tracks);
+    memset(tracker->detection_matched, 0, sizeof(bool) * (size_t)tracker->max_tracks);
+    for (int m = 0; m < num_matches; m++) {
+        const yolov5_track_match_t* match = &tracker->matches[m];
+        if (tracker->track_matched[match->track] || tracker->detection_matched[match->detection]) {
+            continue;
+        }
+        tracker->track_matched[match->track]         = true;
+        tracker->detection_matched[match->detection] = true;
+        track_update(&tracker->tracks[match->track], &detections[match->detection]);
+    }
+
+    // Remove the tracks that have been lost, the order of the rest is kept
+    int num_tracks = 0;
+    for (int t = 0; t < tracker->num_tracks; t++) {
+        yolov5_track_t* track = &tracker->tracks[t];
+        if (!tracker->track_matched[t]) {
+            track->misses++;
+        }
+        if (track->misses <= TRACKER_MAX_MISSES) {
+            tracker->tracks[num_tracks++] = *track;
+        }
+    }
+    tracker->num_tracks = num_tracks;
+
+    // Start new tracks for the detections that did not match a track
+    for (int d = 0; d < num_detections && tracker->num_tracks < tracker->max_tracks; d++) {
+        if (!tracker->detection_matched[d]) {
+            track_init(&tracker->tracks[tracker->num_tracks++], tracker->next_id++, &detections[d]);
+        }
+    }
+}
+
+int yolov5_tracker_get_tracks(const yolov5_tracker_t* tracker, yolov5_track_t* tracks) {
+    int num_tracks = 0;
+    for (int t = 0; t < tracker->num_tracks; t++) {
+        if (tracker->tracks[t].hits >= TRACKER_MIN_HITS) {
+            tracks[num_tracks++] = tracker->tracks[t];
+        }
+    }
+    return num_tracks;
+}
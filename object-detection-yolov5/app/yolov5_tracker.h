@@ -0,0 +1,131 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the tracking of the YOLOv5 detections between
+ * frames.
+ */
+
+#pragma once
+
+#include "yolov5_postprocessing.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief The position and the velocity of one coordinate of a track
+ *
+ * Each coordinate of the box is followed by its own Kalman filter with a
+ * constant velocity, the velocity is in normalized coordinates per frame.
+ */
+typedef struct yolov5_track_state {
+    float position;
+    float velocity;
+    // The covariance of the position and the velocity
+    float p00;
+    float p01;
+    float p11;
+} yolov5_track_state_t;
+
+typedef struct yolov5_track {
+    // Unique for the lifetime of the tracker, can be used to count objects
+    int id;
+    // The box, likelihoods and class of the last detection of the track with
+    // the box moved to where the track is predicted to be in this frame
+    yolov5_detection_t detection;
+
+    // The center, width and height of the box
+    yolov5_track_state_t cx;
+    yolov5_track_state_t cy;
+    yolov5_track_state_t w;
+    yolov5_track_state_t h;
+    // The number of detections that have been matched to the track
+    int hits;
+    // The number of detection frames in a row where the track had no match
+    int misses;
+} yolov5_track_t;
+
+typedef struct yolov5_track_match {
+    float iou;
+    int track;
+    int detection;
+} yolov5_track_match_t;
+
+typedef struct yolov5_tracker {
+    int max_tracks;
+    int num_tracks;
+    int next_id;
+    yolov5_track_t* tracks;
+
+    // Used when matching, the overlapping pairs of tracks and detections and
+    // which tracks and detections have been matched
+    yolov5_track_match_t* matches;
+    bool* track_matched;
+    bool* detection_matched;
+} yolov5_tracker_t;
+
+/**
+ * @brief Create a tracker
+ *
+ * @param max_tracks  The maximum number of tracks, only this many of the
+ *                    detections with the highest score are tracked
+ *
+ * @return The tracker
+ */
+yolov5_tracker_t* yolov5_tracker_new(int max_tracks);
+
+/**
+ * @brief Free the tracker
+ *
+ * @param tracker  The tracker, may be NULL
+ */
+void yolov5_tracker_destroy(yolov5_tracker_t* tracker);
+
+/**
+ * @brief Update the tracks with the detections of a new frame
+ *
+ * The tracks are moved to where they are predicted to be in the new frame
+ * and each detection is matched to the track of the same class that it
+ * overlaps the most. Detections without a track start new tracks and tracks
+ * that have not been matched for a few detection frames are removed.
+ *
+ * @param tracker         The tracker
+ * @param detections      The detections from yolov5_non_maximum_suppression,
+ *                        sorted by decreasing score
+ * @param num_detections  The number of detections
+ */
+void yolov5_tracker_update(yolov5_tracker_t* tracker,
+                           const yolov5_detection_t* detections,
+                           int num_detections);
+
+/**
+ * @brief Move the tracks to where they are predicted to be in a new frame
+ *
+ * Used for the frames that are not analyzed by the model.
+ *
+ * @param tracker  The tracker
+ */
+void yolov5_tracker_extrapolate(yolov5_tracker_t* tracker);
+
+/**
+ * @brief Get the tracks that have been matched to enough detections to be shown
+ *
+ * @param tracker  The tracker
+ * @param tracks   Filled with the tracks, must have room for max_tracks tracks
+ *
+ * @return The number of tracks
+ */
+int yolov5_tracker_get_tracks(const yolov5_tracker_t* tracker, yolov5_track_t* tracks);
@@ -0,0 +1,19 @@
+#ifndef MODEL_PARAMS_H
+#define MODEL_PARAMS_H
+
+// Stands in for the header that parameter_finder.py generates from the model,
+// with the output of the COCO models of the example. The host replay in
+// vision-pipeline/replay is also built with it by default.
+
+#define MODEL_INPUT_HEIGHT 640
+#define MODEL_INPUT_WIDTH 640
+
+#define NUM_OUTPUT_TENSORS 1
+
+#define QUANTIZATION_SCALE 0.0039215689f
+#define QUANTIZATION_ZERO_POINT 0
+
+#define NUM_CLASSES 80
+#define NUM_DETECTIONS 25200
+
+#endif // MODEL_PARAMS_H
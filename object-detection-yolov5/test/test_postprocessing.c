@@ -0,0 +1,221 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks that the decoding that is compiled with the sizes of
+ * model_params.h gives the same candidates as the decoding with the sizes of
+ * the model parameters, and as a plain decoding of every detection. The time
+ * of both decodings is measured on generated 25200x85 output tensors with more
+ * and more detections above the threshold.
+ *
+ * The postprocessing source is included so that the decoding without the
+ * fixed sizes can be called. The vector scan is used when the host has SSE2
+ * or NEON.
+ */
+
+#include "yolov5_postprocessing.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define CONF_THRESHOLD 0.25f
+#define NBR_ROUNDS 200
+
+// The share of the detections that reach the threshold, in per mille
+static const unsigned int passed_per_mille[] = {0, 2, 20, 120};
+
+static uint32_t random_state = 2463534242u;
+
+// xorshift32, so that the output tensors are the same on every host
+static uint32_t random_uint(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// The decoding with the size of a detection from the model parameters, which
+// is what models with other parameters than model_params.h get
+__attribute__((noinline)) static int decode_generic(const uint8_t* tensor,
+                                                    const model_params_t* model_params,
+                                                    uint8_t threshold,
+                                                    yolov5_candidates_t* candidates) {
+    yolov5_candidates_clear(candidates);
+    scan_candidates(tensor,
+                    model_params,
+                    model_params->size_per_detection,
+                    model_params->num_detections,
+                    threshold,
+                    candidates);
+    return candidates->count;
+}
+
+// Every detection is dequantized and the first class with the highest
+// likelihood is taken, like the example did before the quantized compare
+static int decode_reference(const uint8_t* tensor,
+                            const model_params_t* model_params,
+                            yolov5_candidates_t* candidates) {
+    const float* dequantize = model_params->dequantization_table;
+
+    yolov5_candidates_clear(candidates);
+    for (int i = 0; i < model_params->num_detections; i++) {
+        const uint8_t* detection = tensor + ((size_t)model_params->size_per_detection * i);
+        float score              = dequantize[detection[4]];
+        if (score < CONF_THRESHOLD) {
+            continue;
+        }
+        int label         = 0;
+        float class_score = 0.0f;
+        for (int j = 0; j < model_params->num_classes; j++) {
+            if (dequantize[detection[5 + j]] > class_score) {
+                class_score = dequantize[detection[5 + j]];
+                label       = j;
+            }
+        }
+        float w                    = dequantize[detection[2]];
+        float h                    = dequantize[detection[3]];
+        int c                      = candidates->count++;
+        candidates->x1[c]          = dequantize[detection[0]] - (w / 2);
+        candidates->y1[c]          = dequantize[detection[1]] - (h / 2);
+        candidates->x2[c]          = dequantize[detection[0]] + (w / 2);
+        candidates->y2[c]          = dequantize[detection[1]] + (h / 2);
+        candidates->area[c]        = w * h;
+        candidates->score[c]       = score;
+        candidates->class_score[c] = class_score;
+        candidates->label[c]       = label;
+    }
+    return candidates->count;
+}
+
+// The candidates must be bit identical, since the same values are dequantized
+static int expect_same(const yolov5_candidates_t* candidates,
+                       const yolov5_candidates_t* expected,
+                       const char* what,
+                       unsigned int per_mille) {
+    if (candidates->count != expected->count) {
+        printf("%u per mille: %s gives %d candidates, expected %d\n",
+               per_mille,
+               what,
+               candidates->count,
+               expected->count);
+        return 1;
+    }
+    size_t count = (size_t)expected->count;
+    if (memcmp(candidates->x1, expected->x1, count * sizeof(float)) != 0 ||
+        memcmp(candidates->y1, expected->y1, count * sizeof(float)) != 0 ||
+        memcmp(candidates->x2, expected->x2, count * sizeof(float)) != 0 ||
+        memcmp(candidates->y2, expected->y2, count * sizeof(float)) != 0 ||
+        memcmp(candidates->area, expected->area, count * sizeof(float)) != 0 ||
+        memcmp(candidates->score, expected->score, count * sizeof(float)) != 0 ||
+        memcmp(candidates->class_score, expected->class_score, count * sizeof(float)) != 0 ||
+        memcmp(candidates->label, expected->label, count * sizeof(int)) != 0) {
+        printf("%u per mille: %s gives other candidates than expected\n", per_mille, what);
+        return 1;
+    }
+    return 0;
+}
+
+// Most object likelihoods are below the threshold like in a real frame, the
+// class likelihoods are random so that several classes often share the highest
+static void fill_tensor(uint8_t* tensor,
+                        const model_params_t* model_params,
+                        uint8_t threshold,
+                        unsigned int per_mille) {
+    for (int i = 0; i < model_params->num_detections; i++) {
+        uint8_t* detection = tensor + ((size_t)model_params->size_per_detection * i);
+        for (int j = 0; j < model_params->size_per_detection; j++) {
+            detection[j] = (uint8_t)random_uint();
+        }
+        if (random_uint() % 1000 < per_mille) {
+            detection[4] = threshold + (uint8_t)(random_uint() % (UINT8_MAX - threshold + 1u));
+        } else {
+            detection[4] = (uint8_t)(random_uint() % threshold);
+        }
+    }
+}
+
+int main(void) {
+    model_params_t model_params = {
+        .input_width             = MODEL_INPUT_WIDTH,
+        .input_height            = MODEL_INPUT_HEIGHT,
+        .quantization_scale      = QUANTIZATION_SCALE,
+        .quantization_zero_point = QUANTIZATION_ZERO_POINT,
+        .num_classes             = NUM_CLASSES,
+        .num_detections          = NUM_DETECTIONS,
+        .size_per_detection      = MODEL_SIZE_PER_DETECTION,
+    };
+    int errors = 0;
+
+    yolov5_fill_dequantization_table(&model_params);
+    unsigned int quantized_threshold = yolov5_quantize_threshold(&model_params, CONF_THRESHOLD);
+    uint8_t threshold                = (uint8_t)quantized_threshold;
+
+    uint8_t* tensor = malloc((size_t)NUM_DETECTIONS * MODEL_SIZE_PER_DETECTION);
+    if (!tensor) {
+        printf("Could not allocate the output tensor\n");
+        return 1;
+    }
+    yolov5_candidates_t* specialized = yolov5_candidates_new(NUM_DETECTIONS);
+    yolov5_candidates_t* generic     = yolov5_candidates_new(NUM_DETECTIONS);
+    yolov5_candidates_t* reference   = yolov5_candidates_new(NUM_DETECTIONS);
+
+    printf("candidates  specialized  generic\n");
+    for (size_t i = 0; i < sizeof(passed_per_mille) / sizeof(passed_per_mille[0]); i++) {
+        unsigned int per_mille = passed_per_mille[i];
+        fill_tensor(tensor, &model_params, threshold, per_mille);
+
+        decode_reference(tensor, &model_params, reference);
+        yolov5_decode_candidates(tensor, &model_params, quantized_threshold, specialized);
+        decode_generic(tensor, &model_params, threshold, generic);
+        errors += expect_same(specialized, reference, "The specialized decoding", per_mille);
+        errors += expect_same(generic, reference, "The generic decoding", per_mille);
+
+        uint64_t start = now_ns();
+        for (int round = 0; round < NBR_ROUNDS; round++) {
+            yolov5_decode_candidates(tensor, &model_params, quantized_threshold, specialized);
+        }
+        uint64_t specialized_ns = now_ns() - start;
+
+        start = now_ns();
+        for (int round = 0; round < NBR_ROUNDS; round++) {
+            decode_generic(tensor, &model_params, threshold, generic);
+        }
+        uint64_t generic_ns = now_ns() - start;
+
+        printf("%10d  %8.3f ms  %7.3f ms\n",
+               reference->count,
+               (double)specialized_ns / NBR_ROUNDS / 1e6,
+               (double)generic_ns / NBR_ROUNDS / 1e6);
+    }
+
+    yolov5_candidates_destroy(specialized);
+    yolov5_candidates_destroy(generic);
+    yolov5_candidates_destroy(reference);
+    free(tensor);
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
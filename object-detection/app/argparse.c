@@ -37,6 +37,13 @@ const struct argp_option opts[] = {
      0,
      "Could be axis-a8-dlpu-tflite, a9-dlpu-tflite, google-edge-tpu-tflite or cpu-tflite",
      0},
+    {"newest-frame",
+     'n',
+     NULL,
+     0,
+     "Only analyze the newest frame, older frames that are waiting are dropped. "
+     "Lowers the latency when the analysis is slower than the stream.",
+     0},
     {"help", 'h', NULL, 0, "Print this help text and exit.", 0},
     {"usage", KEY_USAGE, NULL, 0, "Print short usage message and exit.", 0},
     {0}};
@@ -70,6 +77,9 @@ int parse_opt(int key, char* arg, struct argp_state* state) {
         case 'd':
             args->device_name = arg;
             break;
+        case 'n':
+            args->newest_frame = true;
+            break;
         case 'h':
             argp_state_help(state, stdout, ARGP_HELP_STD_HELP);
             break;
@@ -93,10 +103,11 @@ int parse_opt(int key, char* arg, struct argp_state* state) {
             }
             break;
         case ARGP_KEY_INIT:
-            args->threshold   = 0;
-            args->device_name = NULL;
-            args->model_file  = NULL;
-            args->labels_file = NULL;
+            args->threshold    = 0;
+            args->device_name  = NULL;
+            args->model_file   = NULL;
+            args->labels_file  = NULL;
+            args->newest_frame = false;
             break;
         case ARGP_KEY_END:
             if (state->arg_num < 1 || state->arg_num > 3) {
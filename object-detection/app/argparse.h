@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "larod.h"
@@ -29,6 +30,7 @@ typedef struct args_t {
     char* labels_file;
     unsigned threshold;
     char* device_name;
+    bool newest_frame;
 } args_t;
 
 void parse_args(int argc, char** argv, args_t* args);
@@ -42,26 +42,33 @@
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <syslog.h>
 #include <unistd.h>
 
 #include "argparse.h"
+#include "bbox_overlay.h"
 #include "channel_util.h"
 #include "img_util.h"
 #include "labelparse.h"
 #include "model.h"
 #include "panic.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+#include "stream_source.h"
 #include "vdo-error.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
 #include <bbox.h>
 
 #include <math.h>
-#include <poll.h>
 #include <unistd.h>
 
+// The color of the boxes as 0xRRGGBB
+#define BOX_COLOR 0xff0000
+// The number of pixels that a box can move before it is redrawn
+#define BOX_TOLERANCE 1
+
 volatile sig_atomic_t running = 1;
 
 // define box struct
@@ -74,69 +81,22 @@ typedef struct {
     int label;
 } box;
 
+// The state of the postprocessing and the sink stages
+typedef struct postprocessing {
+    model_provider_t* model_provider;
+    model_tensor_output_t* tensor_outputs;
+    size_t number_output_tensors;
+    float confidence_threshold;
+    char** labels;
+    bbox_overlay_t* overlay;
+    stage_stats_t* stage_stats;
+} postprocessing_t;
+
 static void shutdown(int status) {
     (void)status;
     running = 0;
 }
 
-static int handle_vdo_failed(GError* error) {
-    // Maintenance/Installation in progress (e.g. Global-Rotation)
-    if (vdo_error_is_expected(&error)) {
-        syslog(LOG_INFO, "Expected vdo error %s", error->message);
-        return EXIT_SUCCESS;
-    } else {
-        panic("Unexpected vdo error %s", error->message);
-    }
-}
-
-static VdoStream* create_new_vdo_stream(unsigned int channel,
-                                        VdoFormat format,
-                                        VdoResolution res,
-                                        unsigned int num_buffers,
-                                        const char* image_fit,
-                                        double framerate) {
-    g_autoptr(VdoMap) vdo_settings = vdo_map_new();
-    g_autoptr(GError) error        = NULL;
-
-    if (!vdo_settings) {
-        panic("%s: Failed to create vdo_map", __func__);
-    }
-
-    vdo_map_set_uint32(vdo_settings, "channel", channel);
-    // format is the image format that is supplied from vdo
-    vdo_map_set_uint32(vdo_settings, "format", format);
-    // Set initial framerate
-    vdo_map_set_double(vdo_settings, "framerate", framerate);
-    VdoPair32u resolution = {
-        .w = res.width,
-        .h = res.height,
-    };
-    vdo_map_set_pair32u(vdo_settings, "resolution", resolution);
-    // Make it possible to change the framerate for the stream after it is started
-    vdo_map_set_boolean(vdo_settings, "dynamic.framerate", true);
-    // It is not needed to set buffer.strategy since VDO_BUFFER_STRATEGY_INFINITE is default
-    // vdo_map_set_uint32(vdo_settings, "buffer.strategy", VDO_BUFFER_STRATEGY_INFINITE);
-
-    // The number of buffers that vdo will allocate for this stream
-    // Normally two buffers are enough and using too many buffers will use
-    // more memory in the product
-    vdo_map_set_uint32(vdo_settings, "buffer.count", num_buffers);
-    // The vdo_stream_get_buffer is non blocking and will return immediately
-    // Then we need to poll instead when it is ok to get a buffer
-    vdo_map_set_boolean(vdo_settings, "socket.blocking", false);
-    vdo_map_set_string(vdo_settings, "image.fit", image_fit);
-
-    // Create a vdo stream using the vdoMap filled in above
-    g_autoptr(VdoStream) vdo_stream = vdo_stream_new(vdo_settings, NULL, &error);
-    if (!vdo_stream) {
-        panic("%s: Failed creating vdo stream: %s", __func__, error->message);
-    }
-    syslog(LOG_INFO, "Dump of vdo stream settings map =====");
-    vdo_map_dump(vdo_settings);
-
-    return g_steal_pointer(&vdo_stream);
-}
-
 static bbox_t* setup_bbox(uint32_t channel) {
     // Create box drawer for channel
     bbox_t* bbox = bbox_view_new(channel);
@@ -145,37 +105,31 @@ static bbox_t* setup_bbox(uint32_t channel) {
     }
 
     bbox_clear(bbox);
-    const bbox_color_t red = bbox_color_from_rgb(0xff, 0x00, 0x00);
-
+    // The color is set by the overlay
     bbox_style_outline(bbox);   // Switch to outline style
     bbox_thickness_thin(bbox);  // Switch to thin lines
-    bbox_color(bbox, red);      // Switch to red
 
     return bbox;
 }
 
-static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
+static bool parse_and_postprocess_output_tensors(bbox_overlay_t* overlay,
                                                  model_tensor_output_t* tensor_outputs,
                                                  float confidence_threshold,
-                                                 char** labels,
-                                                 unsigned int* post_processing_ms) {
+                                                 char** labels) {
     box* boxes = NULL;
-    struct timeval start_ts, end_ts;
 
     // From here this is different dependent on model
     float* locations = (float*)tensor_outputs[0].data;
     float* classes   = (float*)tensor_outputs[1].data;
 
-    bbox_clear(bbox);
-
-    gettimeofday(&start_ts, NULL);
+    // The boxes on the overlay are kept until they are committed
+    bbox_overlay_begin(overlay);
 
     float* scores            = (float*)tensor_outputs[2].data;
     float* nbr_detections    = (float*)tensor_outputs[3].data;
     int number_of_detections = (int)nbr_detections[0];
     if (number_of_detections == 0) {
         syslog(LOG_INFO, "No object is detected");
-        return true;
     }
     boxes = (box*)malloc(sizeof(box) * number_of_detections);
     for (int i = 0; i < number_of_detections; i++) {
@@ -186,13 +140,6 @@ static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
         boxes[i].score = scores[i];
         boxes[i].label = classes[i];
     }
-    gettimeofday(&end_ts, NULL);
-
-    *post_processing_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                         ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
-    if (*post_processing_ms != 0) {
-        syslog(LOG_INFO, "Postprocessing in %u ms", *post_processing_ms);
-    }
 
     for (int i = 0; i < number_of_detections; i++) {
         if (boxes[i].score >= confidence_threshold) {
@@ -210,30 +157,65 @@ static bool parse_and_postprocess_output_tensors(bbox_t* bbox,
                    top,
                    right,
                    bottom);
-            bbox_coordinates_frame_normalized(bbox);
-            bbox_rectangle(bbox, left, top, right, bottom);
+            bbox_overlay_rectangle(overlay, left, top, right, bottom, BOX_COLOR);
         }
     }
 
-    if (!bbox_commit(bbox, 0u)) {
-        panic("Failed to commit box drawer");
-    }
     if (boxes) {
         free(boxes);
     }
     return true;
 }
 
+static void postprocess(void* ctx, VdoBuffer* vdo_buf) {
+    (void)vdo_buf;
+    postprocessing_t* pp = ctx;
+    uint64_t stage_ts    = stage_stats_now_ns();
+
+    for (size_t i = 0; i < pp->number_output_tensors; i++) {
+        if (!model_get_tensor_output_info(pp->model_provider, i, &pp->tensor_outputs[i])) {
+            panic("Failed to get output tensor info for %zu", i);
+        }
+    }
+    parse_and_postprocess_output_tensors(pp->overlay,
+                                         pp->tensor_outputs,
+                                         pp->confidence_threshold,
+                                         pp->labels);
+    stage_stats_mark(pp->stage_stats, STAGE_POSTPROCESSING, stage_ts);
+}
+
+static void commit_boxes(void* ctx) {
+    postprocessing_t* pp = ctx;
+    uint64_t stage_ts    = stage_stats_now_ns();
+
+    // Only sent to the overlay if the boxes have changed, an empty frame
+    // removes the boxes of the previous frame
+    if (!bbox_overlay_commit(pp->overlay)) {
+        panic("Failed to commit box drawer");
+    }
+    stage_stats_mark(pp->stage_stats, STAGE_BBOX_COMMIT, stage_ts);
+}
+
+static const pipeline_postprocess_ops_t postprocess_ops = {
+    .run = postprocess,
+};
+
+static const pipeline_sink_ops_t sink_ops = {
+    .run = commit_boxes,
+};
+
 /**
  * @brief Main function that starts a stream with different options.
  */
 int main(int argc, char** argv) {
     bbox_t* bbox                          = NULL;
+    bbox_overlay_t* overlay               = NULL;
     g_autoptr(GError) vdo_error           = NULL;
     model_provider_t* model_provider      = NULL;
     model_tensor_output_t* tensor_outputs = NULL;
+    stage_stats_t* stage_stats            = NULL;
     img_info_t model_metadata             = {0};
-    img_framerate_t image_framerate       = {0};
+    stream_source_t source                = {0};
     g_autoptr(VdoStream) vdo_stream       = NULL;
     g_autoptr(VdoMap) vdo_stream_info     = NULL;
 
@@ -248,22 +230,32 @@ int main(int argc, char** argv) {
     char* model_file         = args.model_file;
     const char* labels_file  = args.labels_file;
     const int threshold      = args.threshold;
+    const bool newest_frame  = args.newest_frame;
     size_t number_of_classes = 0;
     bool parse_tensors       = true;
 
     // Start by loading the model and get the model metadata
     size_t number_output_tensors = 0;
-    model_provider =
-        model_provider_new(model_file, device_name, labels_file, &number_output_tensors);
+    model_provider = model_provider_new(model_file,
+                                        device_name,
+                                        "Object detection model",
+                                        &number_output_tensors);
     if (!model_provider) {
         panic("%s: Could not create model provider", __func__);
     }
+    syslog(LOG_INFO, "Using label file %s", labels_file);
 
     tensor_outputs = calloc(number_output_tensors, sizeof(model_tensor_output_t));
     if (!tensor_outputs) {
         panic("%s: Could not allocate tensor outputs", __func__);
     }
 
+    // The latency percentiles of each stage are logged every 10 seconds and
+    // written to the localdata directory of the application
+    stage_stats =
+        stage_stats_new("/usr/local/packages/object_detection/localdata/stage_stats.json", 10);
+    model_provider_set_stage_stats(model_provider, stage_stats);
+
     // Get the model format and model input dimension and pitches
     model_metadata = model_provider_get_model_metadata(model_provider);
 
@@ -275,8 +267,9 @@ int main(int argc, char** argv) {
     unsigned int vdo_channel = 1;
 
     // The buffer count will affect memory consumption so keep it as low
-    // as possible
-    unsigned int vdo_stream_buffer_count = 2;
+    // as possible. When only the newest frame is analyzed vdo needs free
+    // buffers to fill with new frames while a frame is analyzed.
+    unsigned int vdo_stream_buffer_count = newest_frame ? 4 : 2;
 
     // Set to false if e.g a view area is wanted instead of the whole sensor
     bool fetch_from_whole_sensor = true;
@@ -304,41 +297,39 @@ int main(int argc, char** argv) {
                                                req_res,
                                                &chosen_req,
                                                rotation,
-                                               &model_metadata.format)) {
+                                               &model_metadata.format,
+                                               CHANNEL_RESOLUTION_SMALLEST_NATIVE_FIT)) {
         panic("%s: Could not chose a resolution", __func__);
     }
     // In this case use default image.fit crop because the resolution
     // fetched from choose function have the same aspect ratio as the
     // channel aspect ratio
-    vdo_stream = create_new_vdo_stream(vdo_channel,
-                                       model_metadata.format,
-                                       chosen_req,
-                                       vdo_stream_buffer_count,
-                                       "crop",
-                                       vdo_stream_framerate);
+    vdo_stream = img_util_create_stream(vdo_channel,
+                                        model_metadata.format,
+                                        chosen_req,
+                                        vdo_stream_buffer_count,
+                                        "crop",
+                                        vdo_stream_framerate);
     if (!vdo_stream) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     vdo_stream_info = vdo_stream_get_info(vdo_stream, &vdo_error);
     if (!vdo_stream_info) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     VdoPair32u aspect_ratio_def = {.w = 0u, .h = 0u};
     VdoPair32u stream_ar = vdo_map_get_pair32u(vdo_stream_info, "aspect_ratio", aspect_ratio_def);
     syslog(LOG_INFO, "Stream aspect ratio is %u:%u", stream_ar.w, stream_ar.h);
 
-    image_framerate.wanted_framerate = vdo_stream_framerate;
-    double info_framerate = vdo_map_get_double(vdo_stream_info, "framerate", vdo_stream_framerate);
-    image_framerate.frametime = (unsigned int)((1.0 / info_framerate) * 1000.0);
-
-    int fd = vdo_stream_get_fd(vdo_stream, &vdo_error);
-    if (fd < 0) {
-        return handle_vdo_failed(vdo_error);
+    if (!stream_source_init(&source,
+                            vdo_stream,
+                            vdo_stream_info,
+                            vdo_stream_framerate,
+                            newest_frame,
+                            stage_stats,
+                            &vdo_error)) {
+        return img_util_handle_vdo_failed(vdo_error);
     }
-    struct pollfd fds = {
-        .fd     = fd,
-        .events = POLL_IN,
-    };
 
     if (labels_file == NULL) {
         parse_tensors = false;
@@ -349,93 +340,48 @@ int main(int argc, char** argv) {
     char* label_file_data = NULL;  // Buffer holding the complete collection of label strings.
 
     if (parse_tensors) {
-        parse_labels(&labels, &label_file_data, labels_file, &number_of_classes);
-        bbox = setup_bbox(vdo_channel);
+        parse_labels(&labels, &label_file_data, labels_file, &number_of_classes, false);
+        bbox    = setup_bbox(vdo_channel);
+        overlay = bbox_overlay_new(bbox, chosen_req.width, chosen_req.height, BOX_TOLERANCE);
     }
 
     if (!vdo_stream_start(vdo_stream, &vdo_error)) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     syslog(LOG_INFO, "Start fetching video frames from VDO");
 
     // Use the vdo info map to update the model metadata
     model_provider_update_image_metadata(model_provider, vdo_stream_info);
 
-    while (running) {
-        struct timeval start_ts, end_ts;
-        unsigned int inference_ms     = 0;
-        unsigned int total_elapsed_ms = 0;
-
-        int status = 0;
-        do {
-            // If poll returns -1 then errno is set
-            // if the errno is set to EINTR then just
-            // continue this loop
-            status = poll(&fds, 1, -1);
-        } while (status == -1 && errno == EINTR);
-
-        if (status < 0) {
-            panic("Failed to poll with status %d", status);
-        }
-
-        g_autoptr(VdoBuffer) vdo_buf = vdo_stream_get_buffer(vdo_stream, &vdo_error);
-        if (!vdo_buf && g_error_matches(vdo_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
-            g_clear_error(&vdo_error);
-            continue;
-        }
-        if (!vdo_buf) {
-            return handle_vdo_failed(vdo_error);
-        }
-        gettimeofday(&start_ts, NULL);
-        // Run inference and preprocessing if needed
-        if (!model_run_inference(model_provider, vdo_buf)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-            continue;
-        }
-        gettimeofday(&end_ts, NULL);
-        inference_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                      ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
-        syslog(LOG_INFO, "Ran inference for %u ms", inference_ms);
-
-        for (size_t i = 0; i < number_output_tensors; i++) {
-            if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
-                panic("Failed to get output tensor info for %zu", i);
-            }
-        }
-        total_elapsed_ms = inference_ms;
-
-        if (parse_tensors) {
-            unsigned int post_processing_ms = 0;
-            float confidence_threshold      = (float)(threshold / 100.0);
-            parse_and_postprocess_output_tensors(bbox,
-                                                 tensor_outputs,
-                                                 confidence_threshold,
-                                                 labels,
-                                                 &post_processing_ms);
-            total_elapsed_ms += post_processing_ms;
-        }
-
-        // Check if the framerate from vdo should be changed
-        if (img_util_update_framerate(vdo_stream, &image_framerate, total_elapsed_ms)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-        } else {
-            // This will allow vdo to fill this buffer with data again
-            if (!vdo_stream_buffer_unref(vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpected error: %s", __func__, vdo_error->message);
-                }
-                g_clear_error(&vdo_error);
-            }
-        }
-    }
+    postprocessing_t pp = {
+        .model_provider        = model_provider,
+        .tensor_outputs        = tensor_outputs,
+        .number_output_tensors = number_output_tensors,
+        .confidence_threshold  = (float)(threshold / 100.0),
+        .labels                = labels,
+        .overlay               = overlay,
+        .stage_stats           = stage_stats,
+    };
+    // Without a label file the model is only run on the frames
+    pipeline_t pipeline = {
+        .source          = &stream_source_ops,
+        .source_ctx      = &source,
+        .preprocess      = &model_preprocess_ops,
+        .preprocess_ctx  = model_provider,
+        .infer           = &model_infer_ops,
+        .infer_ctx       = model_provider,
+        .postprocess     = parse_tensors ? &postprocess_ops : NULL,
+        .postprocess_ctx = &pp,
+        .sink            = parse_tensors ? &sink_ops : NULL,
+        .sink_ctx        = &pp,
+        .stage_stats     = stage_stats,
+    };
+    int exit_status = pipeline_run(&pipeline, &running);
 
     if (model_provider) {
         model_provider_destroy(model_provider);
     }
+    stage_stats_destroy(stage_stats);
     free(tensor_outputs);
 
     if (labels) {
@@ -445,9 +391,10 @@ int main(int argc, char** argv) {
         free(label_file_data);
     }
     if (parse_tensors) {
+        bbox_overlay_destroy(overlay);
         bbox_destroy(bbox);
     }
 
     syslog(LOG_INFO, "Exit %s", argv[0]);
-    return 0;
+    return exit_status;
 }
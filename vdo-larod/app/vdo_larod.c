@@ -20,14 +20,17 @@
  * This application loads a larod model which takes an image as input and
  * outputs values corresponding to either person or car.
  *
- * The application expects four arguments on the command line in the
- * following order: DEVICENAME MODEL.
+ * The application expects at least three arguments on the command line in the
+ * following order: DEVICENAME MODEL IMAGEFIT [MODEL...].
  *
  * First argument, DEVICENAME, is a string that is the larod device name
  *
  * Second argument, MODEL, is a string describing path to the model.
  *
  * THIRD argument, IMAGEFIT, is a string describing how to fit the image, scale or crop.
+ *
+ * The optional arguments after IMAGEFIT are paths to more models that are run
+ * on the same frames.
  */
 
 #include <errno.h>
@@ -39,7 +42,6 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <syslog.h>
 
@@ -47,13 +49,20 @@
 #include "img_util.h"
 #include "model.h"
 #include "panic.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+#include "stream_source.h"
 #include "vdo-error.h"
 #include "vdo-frame.h"
 #include "vdo-types.h"
 
-#include <poll.h>
 #include <unistd.h>
 
+// Where the latency statistics of the stages are written
+#ifndef STAGE_STATS_FILE
+#define STAGE_STATS_FILE "/usr/local/packages/vdo_larod/localdata/stage_stats.json"
+#endif
+
 volatile sig_atomic_t running = 1;
 
 static void shutdown(int status) {
@@ -61,78 +70,133 @@ static void shutdown(int status) {
     running = 0;
 }
 
-static int handle_vdo_failed(GError* error) {
-    // Maintenance/Installation in progress (e.g. Global-Rotation)
-    if (vdo_error_is_expected(&error)) {
-        syslog(LOG_INFO, "Expected vdo error %s", error->message);
-        return EXIT_SUCCESS;
-    } else {
-        panic("Unexpected vdo error %s", error->message);
+// The state of the postprocessing stage
+typedef struct postprocessing {
+    model_provider_t* model_provider;
+    const char* device_name;
+    model_tensor_output_t* tensor_outputs;
+    const size_t* number_output_tensors;
+    size_t number_models;
+    stage_stats_t* stage_stats;
+} postprocessing_t;
+
+// The outputs of the extra models are not known, so only the largest value of
+// each output is logged
+static void log_model_outputs(model_provider_t* model_provider,
+                              size_t model_index,
+                              size_t nbr_outputs) {
+    for (size_t i = 0; i < nbr_outputs; i++) {
+        model_tensor_output_t output = {0};
+        if (!model_get_model_output_info(model_provider, model_index, i, &output)) {
+            panic("Failed to get output tensor info for model %zu output %zu", model_index, i);
+        }
+        size_t max_index = 0;
+        double max_value = 0.0;
+        if (output.datatype == LAROD_TENSOR_DATA_TYPE_UINT8) {
+            const uint8_t* values = output.data;
+            for (size_t j = 0; j < output.size; j++) {
+                if (values[j] > values[max_index]) {
+                    max_index = j;
+                }
+            }
+            max_value = values[max_index];
+        } else if (output.datatype == LAROD_TENSOR_DATA_TYPE_FLOAT32) {
+            const float* values = output.data;
+            for (size_t j = 0; j < output.size / sizeof(float); j++) {
+                if (values[j] > values[max_index]) {
+                    max_index = j;
+                }
+            }
+            max_value = values[max_index];
+        } else {
+            syslog(LOG_INFO,
+                   "Model %zu output %zu has %zu bytes of data type %d",
+                   model_index,
+                   i,
+                   output.size,
+                   output.datatype);
+            continue;
+        }
+        syslog(LOG_INFO,
+               "Model %zu output %zu has the largest value %.3f at index %zu",
+               model_index,
+               i,
+               max_value,
+               max_index);
     }
 }
 
-static VdoStream* create_new_vdo_stream(unsigned int channel,
-                                        VdoFormat format,
-                                        VdoResolution res,
-                                        unsigned int num_buffers,
-                                        const char* image_fit,
-                                        double framerate) {
-    g_autoptr(VdoMap) vdo_settings = vdo_map_new();
-    g_autoptr(GError) error        = NULL;
-
-    if (!vdo_settings) {
-        panic("%s: Failed to create vdo_map", __func__);
+static void postprocess(void* ctx, VdoBuffer* vdo_buf) {
+    (void)vdo_buf;
+    postprocessing_t* pp                  = ctx;
+    model_tensor_output_t* tensor_outputs = pp->tensor_outputs;
+
+    if (pp->number_output_tensors[0] == 2) {
+        uint64_t stage_ts = stage_stats_now_ns();
+        // Only parse if the number outputs are == 2
+        //  When a model with a different amount of output tensors is used, we don't want the
+        //  application to crash during parsing.
+        for (size_t i = 0; i < pp->number_output_tensors[0]; i++) {
+            if (!model_get_tensor_output_info(pp->model_provider, i, &tensor_outputs[i])) {
+                panic("Failed to get output tensor info for %zu", i);
+            }
+        }
+        // The tensor_outputs contains
+        // data -  The tensor data
+        // size -  Tensor data size
+        // datatype -  Datatype of the tensor
+        // timestamp - The timestamp of the VDO frame used for inference
+
+        // Parse the data.
+        // Model output differs between the CV25 model and the other models.
+        // The CV25 model has car data at output 0 and person data at output 1.
+        // Also, the CV25 model directly outputs float32 data, while the other models' outputs
+        // are uint8 quantized.
+        if (strcmp(pp->device_name, "ambarella-cvflow") == 0) {
+            float* car_pred    = (float*)tensor_outputs[0].data;
+            float* person_pred = (float*)tensor_outputs[1].data;
+
+            syslog(LOG_INFO,
+                   "Person detected: %.2f%% - Car detected: %.2f%%",
+                   *person_pred * 100,
+                   *car_pred * 100);
+        } else {
+            uint8_t* person_pred = (uint8_t*)tensor_outputs[0].data;
+            uint8_t* car_pred    = (uint8_t*)tensor_outputs[1].data;
+            syslog(LOG_INFO,
+                   "Person detected: %.2f%% - Car detected: %.2f%%",
+                   (float)*person_pred / 2.55f,
+                   (float)*car_pred / 2.55f);
+        }
+        stage_stats_mark(pp->stage_stats, STAGE_POSTPROCESSING, stage_ts);
     }
-
-    vdo_map_set_uint32(vdo_settings, "channel", channel);
-    // format is the image format that is supplied from vdo
-    vdo_map_set_uint32(vdo_settings, "format", format);
-    // Set initial framerate
-    vdo_map_set_double(vdo_settings, "framerate", framerate);
-    VdoPair32u resolution = {
-        .w = res.width,
-        .h = res.height,
-    };
-    vdo_map_set_pair32u(vdo_settings, "resolution", resolution);
-    // Make it possible to change the framerate for the stream after it is started
-    vdo_map_set_boolean(vdo_settings, "dynamic.framerate", true);
-    // It is not needed to set buffer.strategy since VDO_BUFFER_STRATEGY_INFINITE is default
-    // vdo_map_set_uint32(vdo_settings, "buffer.strategy", VDO_BUFFER_STRATEGY_INFINITE);
-
-    // The number of buffers that vdo will allocate for this stream
-    // Normally two buffers are enough and using too many buffers will use
-    // more memory in the product
-    vdo_map_set_uint32(vdo_settings, "buffer.count", num_buffers);
-    // The vdo_stream_get_buffer is non blocking and will return immediately
-    // Then we need to poll instead when it is ok to get a buffer
-    vdo_map_set_boolean(vdo_settings, "socket.blocking", false);
-    vdo_map_set_string(vdo_settings, "image.fit", image_fit);
-
-    // Create a vdo stream using the vdoMap filled in above
-    g_autoptr(VdoStream) vdo_stream = vdo_stream_new(vdo_settings, NULL, &error);
-    if (!vdo_stream) {
-        panic("%s: Failed creating vdo stream: %s", __func__, error->message);
+    for (size_t i = 1; i < pp->number_models; i++) {
+        log_model_outputs(pp->model_provider, i, pp->number_output_tensors[i]);
     }
-    syslog(LOG_INFO, "Dump of vdo stream settings map =====");
-    vdo_map_dump(vdo_settings);
-
-    return g_steal_pointer(&vdo_stream);
 }
 
+static const pipeline_postprocess_ops_t postprocess_ops = {
+    .run = postprocess,
+};
+
 /**
  * @brief Main function that starts a stream with different options.
  */
 int main(int argc, char** argv) {
-    char* device_name                     = argv[1];
-    char* model_file                      = argv[2];
-    char* image_fit                       = argv[3];
-    g_autoptr(GError) vdo_error           = NULL;
-    model_provider_t* model_provider      = NULL;
-    model_tensor_output_t* tensor_outputs = NULL;
-    img_info_t model_metadata             = {0};
-    img_framerate_t image_framerate       = {0};
-    g_autoptr(VdoStream) vdo_stream       = NULL;
-    g_autoptr(VdoMap) vdo_stream_info     = NULL;
+    char* device_name                            = argv[1];
+    char* model_file                             = argv[2];
+    char* image_fit                              = argv[3];
+    g_autoptr(GError) vdo_error                  = NULL;
+    model_provider_t* model_provider             = NULL;
+    model_tensor_output_t* tensor_outputs        = NULL;
+    stage_stats_t* stage_stats                   = NULL;
+    img_info_t model_metadata                    = {0};
+    stream_source_t source                       = {0};
+    g_autoptr(VdoStream) vdo_stream              = NULL;
+    g_autoptr(VdoMap) vdo_stream_info            = NULL;
+    size_t number_output_tensors[MAX_NBR_MODELS] = {0};
+    size_t number_models                         = 1;
+    int exit_status                              = EXIT_SUCCESS;
 
     // Stop main loop at signal
     signal(SIGTERM, shutdown);
@@ -140,25 +204,36 @@ int main(int argc, char** argv) {
 
     syslog(LOG_INFO, "Starting %s", argv[0]);
 
-    if (argc != 4) {
+    if (argc < 4 || argc > 3 + MAX_NBR_MODELS) {
         syslog(LOG_ERR,
                "Invalid number of arguments. Required arguments are: "
-               "DEVICENAME MODEL_PATH IMAGEFIT");
+               "DEVICENAME MODEL_PATH IMAGEFIT [MODEL_PATH...]");
         goto end;
     }
 
     // Start by loading the model and get the model metadata
-    size_t number_output_tensors = 0;
-    model_provider = model_provider_new(model_file, device_name, &number_output_tensors);
+    model_provider =
+        model_provider_new(model_file, device_name, "Vdo larod model", &number_output_tensors[0]);
     if (!model_provider) {
         panic("%s: Could not create model provider", __func__);
     }
+    // The extra models are run on the same frames. A model with another input
+    // size than the first model gets its own preprocessing.
+    for (int i = 4; i < argc; i++) {
+        model_provider_add_model(model_provider, argv[i], &number_output_tensors[number_models]);
+        number_models++;
+    }
 
-    tensor_outputs = calloc(number_output_tensors, sizeof(model_tensor_output_t));
+    tensor_outputs = calloc(number_output_tensors[0], sizeof(model_tensor_output_t));
     if (!tensor_outputs) {
         panic("%s: Could not allocate tensor outputs", __func__);
     }
 
+    // The latency percentiles of each stage are logged every 10 seconds and
+    // written to the localdata directory of the application
+    stage_stats = stage_stats_new(STAGE_STATS_FILE, 10);
+    model_provider_set_stage_stats(model_provider, stage_stats);
+
     // Get the model format and model input dimension and pitches
     model_metadata = model_provider_get_model_metadata(model_provider);
 
@@ -169,9 +244,15 @@ int main(int argc, char** argv) {
     // to the channel number here.
     unsigned int vdo_channel = 1;
 
+    // The number of frames that can be preprocessed and inferred at the same
+    // time. While one frame is in inference the next one can be preprocessed.
+    // Set to 1 to run preprocessing and inference in sequence for each frame.
+    unsigned int nbr_inference_slots = 2;
+
     // The buffer count will affect memory consumption so keep it as low
-    // as possible
-    unsigned int vdo_stream_buffer_count = 2;
+    // as possible. One buffer for each frame in the inference pipeline and
+    // one buffer that vdo can fill with the next frame.
+    unsigned int vdo_stream_buffer_count = nbr_inference_slots + 1;
 
     // Set to false if e.g a view area is wanted instead of the whole sensor
     bool fetch_from_whole_sensor = true;
@@ -200,143 +281,74 @@ int main(int argc, char** argv) {
                                                req_res,
                                                &chosen_req,
                                                rotation,
-                                               &model_metadata.format)) {
+                                               &model_metadata.format,
+                                               CHANNEL_RESOLUTION_REQUESTED)) {
         panic("%s: Could not chose a resolution", __func__);
     }
-    vdo_stream = create_new_vdo_stream(vdo_channel,
-                                       model_metadata.format,
-                                       chosen_req,
-                                       vdo_stream_buffer_count,
-                                       image_fit,
-                                       vdo_stream_framerate);
+    vdo_stream = img_util_create_stream(vdo_channel,
+                                        model_metadata.format,
+                                        chosen_req,
+                                        vdo_stream_buffer_count,
+                                        image_fit,
+                                        vdo_stream_framerate);
     if (!vdo_stream) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     vdo_stream_info = vdo_stream_get_info(vdo_stream, &vdo_error);
     if (!vdo_stream_info) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     VdoPair32u aspect_ratio_def = {.w = 0u, .h = 0u};
     VdoPair32u stream_ar = vdo_map_get_pair32u(vdo_stream_info, "aspect_ratio", aspect_ratio_def);
     syslog(LOG_INFO, "Stream aspect ratio is %u:%u", stream_ar.w, stream_ar.h);
 
-    image_framerate.wanted_framerate = vdo_stream_framerate;
-    double info_framerate = vdo_map_get_double(vdo_stream_info, "framerate", vdo_stream_framerate);
-    image_framerate.frametime = (unsigned int)((1.0 / info_framerate) * 1000.0);
-
-    int fd = vdo_stream_get_fd(vdo_stream, &vdo_error);
-    if (fd < 0) {
-        return handle_vdo_failed(vdo_error);
+    if (!stream_source_init(&source,
+                            vdo_stream,
+                            vdo_stream_info,
+                            vdo_stream_framerate,
+                            false,
+                            stage_stats,
+                            &vdo_error)) {
+        return img_util_handle_vdo_failed(vdo_error);
     }
-    struct pollfd fds = {
-        .fd     = fd,
-        .events = POLL_IN,
-    };
 
     if (!vdo_stream_start(vdo_stream, &vdo_error)) {
-        return handle_vdo_failed(vdo_error);
+        return img_util_handle_vdo_failed(vdo_error);
     }
     syslog(LOG_INFO, "Start fetching video frames from VDO");
 
+    // The inference slots must be set before the model metadata is updated
+    model_provider_set_inference_slots(model_provider, nbr_inference_slots);
     // Use the vdo info map to update the model metadata
     model_provider_update_image_metadata(model_provider, vdo_stream_info);
 
-    while (running) {
-        struct timeval start_ts, end_ts;
-        unsigned int inference_ms = 0;
-
-        int status = 0;
-        do {
-            // If poll returns -1 then errno is set
-            // if the errno is set to EINTR then just
-            // continue this loop
-            status = poll(&fds, 1, -1);
-        } while (status == -1 && errno == EINTR);
-
-        if (status < 0) {
-            panic("Failed to poll with status %d", status);
-        }
-
-        g_autoptr(VdoBuffer) vdo_buf = vdo_stream_get_buffer(vdo_stream, &vdo_error);
-        if (!vdo_buf && g_error_matches(vdo_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
-            g_clear_error(&vdo_error);
-            continue;
-        }
-        if (!vdo_buf) {
-            return handle_vdo_failed(vdo_error);
-        }
-        gettimeofday(&start_ts, NULL);
-        // Run inference and preprocessing if needed
-        if (!model_run_inference(model_provider, vdo_buf)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-            continue;
-        }
-        gettimeofday(&end_ts, NULL);
-        inference_ms = (unsigned int)(((end_ts.tv_sec - start_ts.tv_sec) * 1000) +
-                                      ((end_ts.tv_usec - start_ts.tv_usec) / 1000));
-        syslog(LOG_INFO, "Ran inference for %u ms", inference_ms);
-
-        if (number_output_tensors == 2) {
-            // Only parse if the number outputs are == 2
-            //  When a model with a different amount of output tensors is used, we don't want the
-            //  application to crash during parsing.
-            for (size_t i = 0; i < number_output_tensors; i++) {
-                if (!model_get_tensor_output_info(model_provider, i, &tensor_outputs[i])) {
-                    panic("Failed to get output tensor info for %zu", i);
-                }
-            }
-            // The tensor_outputs contains
-            // data -  The tensor data
-            // size -  Tensor data size
-            // datatype -  Datatype of the tensor
-            // timestamp - The timestamp of the VDO frame used for inference
-
-            // Parse the data.
-            // Model output differs between the CV25 model and the other models.
-            // The CV25 model has car data at output 0 and person data at output 1.
-            // Also, the CV25 model directly outputs float32 data, while the other models' outputs
-            // are uint8 quantized.
-            if (strcmp(device_name, "ambarella-cvflow") == 0) {
-                float* car_pred    = (float*)tensor_outputs[0].data;
-                float* person_pred = (float*)tensor_outputs[1].data;
-
-                syslog(LOG_INFO,
-                       "Person detected: %.2f%% - Car detected: %.2f%%",
-                       *person_pred * 100,
-                       *car_pred * 100);
-            } else {
-                uint8_t* person_pred = (uint8_t*)tensor_outputs[0].data;
-                uint8_t* car_pred    = (uint8_t*)tensor_outputs[1].data;
-                syslog(LOG_INFO,
-                       "Person detected: %.2f%% - Car detected: %.2f%%",
-                       (float)*person_pred / 2.55f,
-                       (float)*car_pred / 2.55f);
-            }
-        }
-
-        // Check if the framerate from vdo should be changed
-        if (img_util_update_framerate(vdo_stream, &image_framerate, inference_ms)) {
-            if (!img_util_flush(vdo_stream, &vdo_buf, &vdo_error)) {
-                return handle_vdo_failed(vdo_error);
-            }
-        } else {
-            // This will allow vdo to fill this buffer with data again
-            if (!vdo_stream_buffer_unref(vdo_stream, &vdo_buf, &vdo_error)) {
-                if (!vdo_error_is_expected(&vdo_error)) {
-                    panic("%s: Unexpected error: %s", __func__, vdo_error->message);
-                }
-                g_clear_error(&vdo_error);
-            }
-        }
-    }
+    postprocessing_t pp = {
+        .model_provider        = model_provider,
+        .device_name           = device_name,
+        .tensor_outputs        = tensor_outputs,
+        .number_output_tensors = number_output_tensors,
+        .number_models         = number_models,
+        .stage_stats           = stage_stats,
+    };
+    // The next frames are preprocessed and inferred while the output of a
+    // frame is postprocessed, so there is no preprocessing stage
+    pipeline_t pipeline = {
+        .source          = &stream_source_ops,
+        .source_ctx      = &source,
+        .infer           = &model_infer_async_ops,
+        .infer_ctx       = model_provider,
+        .postprocess     = &postprocess_ops,
+        .postprocess_ctx = &pp,
+        .stage_stats     = stage_stats,
+    };
+    exit_status = pipeline_run(&pipeline, &running);
 end:
     if (model_provider) {
         model_provider_destroy(model_provider);
     }
+    stage_stats_destroy(stage_stats);
     free(tensor_outputs);
 
     syslog(LOG_INFO, "Exit %s", argv[0]);
-    return 0;
+    return exit_status;
 }
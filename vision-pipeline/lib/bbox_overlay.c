@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bbox_overlay.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The number of boxes there is room for at first, the arrays grow when needed
+#define INITIAL_CAPACITY 16
+
+bbox_overlay_t* bbox_overlay_new(bbox_t* bbox,
+                                 unsigned int width,
+                                 unsigned int height,
+                                 int tolerance) {
+    bbox_overlay_t* overlay = calloc(1, sizeof(bbox_overlay_t));
+    if (!overlay) {
+        panic("%s: Unable to allocate overlay: %s", __func__, strerror(errno));
+    }
+    overlay->bbox      = bbox;
+    overlay->width     = width;
+    overlay->height    = height;
+    overlay->tolerance = tolerance;
+    return overlay;
+}
+
+void bbox_overlay_destroy(bbox_overlay_t* overlay) {
+    if (!overlay) {
+        return;
+    }
+    free(overlay->committed);
+    free(overlay->pending);
+    free(overlay->matched);
+    free(overlay);
+}
+
+static void* resize_array(void* array, size_t nbr_elements, size_t element_size) {
+    array = realloc(array, nbr_elements * element_size);
+    if (!array) {
+        panic("%s: Unable to allocate overlay array: %s", __func__, strerror(errno));
+    }
+    return array;
+}
+
+static void grow(bbox_overlay_t* overlay) {
+    int capacity = overlay->capacity ? 2 * overlay->capacity : INITIAL_CAPACITY;
+    size_t size  = (size_t)capacity;
+
+    overlay->committed = resize_array(overlay->committed, size, sizeof(bbox_overlay_box_t));
+    overlay->pending   = resize_array(overlay->pending, size, sizeof(bbox_overlay_box_t));
+    overlay->matched   = resize_array(overlay->matched, size, sizeof(bool));
+    overlay->capacity  = capacity;
+}
+
+void bbox_overlay_begin(bbox_overlay_t* overlay) {
+    overlay->nbr_pending = 0;
+}
+
+static int to_pixels(float coordinate, unsigned int size) {
+    return (int)lroundf(coordinate * (float)size);
+}
+
+void bbox_overlay_rectangle(bbox_overlay_t* overlay,
+                            float x1,
+                            float y1,
+                            float x2,
+                            float y2,
+                            uint32_t color) {
+    if (overlay->nbr_pending == overlay->capacity) {
+        grow(overlay);
+    }
+    bbox_overlay_box_t* box = &overlay->pending[overlay->nbr_pending++];
+    box->x1                 = to_pixels(x1, overlay->width);
+    box->y1                 = to_pixels(y1, overlay->height);
+    box->x2                 = to_pixels(x2, overlay->width);
+    box->y2                 = to_pixels(y2, overlay->height);
+    box->color              = color;
+}
+
+static bool is_same_box(const bbox_overlay_box_t* a, const bbox_overlay_box_t* b, int tolerance) {
+    return a->color == b->color && abs(a->x1 - b->x1) <= tolerance &&
+           abs(a->y1 - b->y1) <= tolerance && abs(a->x2 - b->x2) <= tolerance &&
+           abs(a->y2 - b->y2) <= tolerance;
+}
+
+// Each pending box must have its own committed box, the boxes are few so all
+// pairs are compared
+static bool has_changed(bbox_overlay_t* overlay) {
+    if (overlay->nbr_pending != overlay->nbr_committed) {
+        return true;
+    }
+    memset(overlay->matched, 0, sizeof(bool) * (size_t)overlay->nbr_committed);
+    for (int p = 0; p < overlay->nbr_pending; p++) {
+        bool found = false;
+        for (int c = 0; c < overlay->nbr_committed && !found; c++) {
+            if (!overlay->matched[c] &&
+                is_same_box(&overlay->pending[p], &overlay->committed[c], overlay->tolerance)) {
+                overlay->matched[c] = true;
+                found               = true;
+            }
+        }
+        if (!found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_colors(const void* a, const void* b) {
+    const bbox_overlay_box_t* box_a = a;
+    const bbox_overlay_box_t* box_b = b;
+    if (box_a->color != box_b->color) {
+        return box_a->color < box_b->color ? -1 : 1;
+    }
+    return 0;
+}
+
+static void set_color(bbox_overlay_t* overlay, uint32_t color) {
+    if (overlay->has_color && overlay->current_color == color) {
+        return;
+    }
+    bbox_color(overlay->bbox,
+               bbox_color_from_rgb((uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color));
+    overlay->current_color = color;
+    overlay->has_color     = true;
+}
+
+bool bbox_overlay_commit(bbox_overlay_t* overlay) {
+    if (!has_changed(overlay)) {
+        return true;
+    }
+
+    // Draw the boxes of each color together so that the color is set once
+    qsort(overlay->pending,
+          (size_t)overlay->nbr_pending,
+          sizeof(bbox_overlay_box_t),
+          compare_colors);
+
+    float width  = (float)overlay->width;
+    float height = (float)overlay->height;
+    bbox_clear(overlay->bbox);
+    bbox_coordinates_frame_normalized(overlay->bbox);
+    for (int i = 0; i < overlay->nbr_pending; i++) {
+        const bbox_overlay_box_t* box = &overlay->pending[i];
+        set_color(overlay, box->color);
+        bbox_rectangle(overlay->bbox,
+                       (float)box->x1 / width,
+                       (float)box->y1 / height,
+                       (float)box->x2 / width,
+                       (float)box->y2 / height);
+    }
+    if (!bbox_commit(overlay->bbox, 0u)) {
+        return false;
+    }
+
+    // The pending boxes are what is on the overlay now
+    bbox_overlay_box_t* committed = overlay->committed;
+    overlay->committed            = overlay->pending;
+    overlay->nbr_committed        = overlay->nbr_pending;
+    overlay->pending              = committed;
+    overlay->nbr_pending          = 0;
+    return true;
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the bounding boxes that are drawn on the overlay.
+ * The boxes of each frame are compared with the boxes that were last sent to
+ * the overlay and they are only sent again when they have changed.
+ */
+
+#pragma once
+
+#include <bbox.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief A box in pixels of the overlay resolution
+ */
+typedef struct bbox_overlay_box {
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    // The color as 0xRRGGBB
+    uint32_t color;
+} bbox_overlay_box_t;
+
+typedef struct bbox_overlay {
+    bbox_t* bbox;
+    unsigned int width;
+    unsigned int height;
+    // The number of pixels that a corner can move without the box being sent again
+    int tolerance;
+
+    // The boxes that were last sent to the overlay
+    bbox_overlay_box_t* committed;
+    int nbr_committed;
+    // The boxes of the current frame
+    bbox_overlay_box_t* pending;
+    int nbr_pending;
+    int capacity;
+
+    // Used when comparing, which of the committed boxes have a pending box
+    bool* matched;
+    // The color that the bbox is set to, colors are only set when they change
+    uint32_t current_color;
+    bool has_color;
+} bbox_overlay_t;
+
+/**
+ * @brief Create an overlay for a bbox
+ *
+ * The coordinates of the boxes are rounded to the resolution of the overlay,
+ * changes that are smaller than a pixel cannot be seen. Use the resolution of
+ * the analyzed stream, the boxes cannot be more exact than that.
+ *
+ * @param bbox       The bbox to draw with, owned by the caller
+ * @param width      The width of the overlay in pixels
+ * @param height     The height of the overlay in pixels
+ * @param tolerance  The number of pixels that a corner can move before the box is
+ *                   sent again, 0 sends every change of a pixel
+ *
+ * @return The overlay
+ */
+bbox_overlay_t* bbox_overlay_new(bbox_t* bbox,
+                                 unsigned int width,
+                                 unsigned int height,
+                                 int tolerance);
+
+/**
+ * @brief Free the overlay, the bbox is not destroyed
+ *
+ * @param overlay  The overlay, may be NULL
+ */
+void bbox_overlay_destroy(bbox_overlay_t* overlay);
+
+/**
+ * @brief Remove the boxes of the previous frame before the boxes of a new frame are added
+ *
+ * The boxes on the overlay are kept until bbox_overlay_commit is called.
+ *
+ * @param overlay  The overlay
+ */
+void bbox_overlay_begin(bbox_overlay_t* overlay);
+
+/**
+ * @brief Add a box to the current frame
+ *
+ * @param overlay  The overlay
+ * @param x1       The left edge, normalized to the frame
+ * @param y1       The top edge, normalized to the frame
+ * @param x2       The right edge, normalized to the frame
+ * @param y2       The bottom edge, normalized to the frame
+ * @param color    The color as 0xRRGGBB
+ */
+void bbox_overlay_rectangle(bbox_overlay_t* overlay,
+                            float x1,
+                            float y1,
+                            float x2,
+                            float y2,
+                            uint32_t color);
+
+/**
+ * @brief Send the boxes of the current frame to the overlay if they have changed
+ *
+ * Nothing is sent if each box of the frame has a box that was sent before with
+ * the same color and corners within the tolerance, in any order. Otherwise the
+ * bbox is cleared and all boxes are drawn, grouped by color so that the color
+ * is only changed once per color.
+ *
+ * @param overlay  The overlay
+ *
+ * @return False if the boxes could not be sent, see bbox_commit
+ */
+bool bbox_overlay_commit(bbox_overlay_t* overlay);
@@ -39,7 +39,8 @@ bool channel_util_choose_stream_resolution(unsigned int channel_id,
                                            VdoResolution req_res,
                                            VdoResolution* chosen_req,
                                            unsigned int rotation,
-                                           VdoFormat* chosen_format) {
+                                           VdoFormat* chosen_format,
+                                           channel_resolution_mode_t mode) {
     g_autoptr(VdoResolutionSet) set     = NULL;
     g_autoptr(VdoChannel) channel       = NULL;
     g_autoptr(GError) error             = NULL;
@@ -67,8 +68,15 @@ bool channel_util_choose_stream_resolution(unsigned int channel_id,
     // Start to see if the supplied image format is available on this
     // product. If not default to yuv
     vdo_map_set_uint32(resolution_filter, "format", *chosen_format);
-    vdo_map_set_string(resolution_filter, "select", "all");
-    vdo_map_set_string(resolution_filter, "aspect_ratio", "native");
+    if (mode == CHANNEL_RESOLUTION_REQUESTED) {
+        // select can have different values, minmax, all
+        vdo_map_set_string(resolution_filter, "select", "minmax");
+    } else {
+        vdo_map_set_string(resolution_filter, "select", "all");
+        // Only resolutions that have the same aspect ratio as the selected
+        // capture mode are returned
+        vdo_map_set_string(resolution_filter, "aspect_ratio", "native");
+    }
 
     set = vdo_channel_get_resolutions(channel, resolution_filter, &error);
     if (!set || set->count == 0) {
@@ -91,31 +99,53 @@ bool channel_util_choose_stream_resolution(unsigned int channel_id,
         }
     }
 
-    // Find smallest VDO stream resolution that fits the requested size.
-    ssize_t best_resolution_idx       = -1;
-    unsigned int best_resolution_area = UINT_MAX;
-    for (ssize_t i = 0; i < (ssize_t)set->count; ++i) {
-        VdoResolution* res = &set->resolutions[i];
-        if ((res->width >= chosen_req->width) && (res->height >= chosen_req->height)) {
-            unsigned int area = res->width * res->height;
-            if (area < best_resolution_area) {
-                best_resolution_idx  = i;
-                best_resolution_area = area;
+    if (mode == CHANNEL_RESOLUTION_REQUESTED) {
+        // Check the requested width and height towards max resolution
+        if (chosen_req->width > set->resolutions[1].width ||
+            chosen_req->height > set->resolutions[1].height) {
+            panic("%s: Requested width or height larger than max resolution %ux%u",
+                  __func__,
+                  set->resolutions[1].width,
+                  set->resolutions[1].height);
+        }
+        // Check the requested width and height towards min resolution
+        if (chosen_req->width < set->resolutions[0].width ||
+            chosen_req->height < set->resolutions[0].height) {
+            // It is likely that the requested resolution will work but print so if
+            // vdo_stream_new fails this could be the reason.
+            syslog(LOG_INFO,
+                   "%s: Requested width or height smaller than min resolution %ux%u",
+                   __func__,
+                   set->resolutions[0].width,
+                   set->resolutions[0].height);
+        }
+    } else {
+        // Find smallest VDO stream resolution that fits the requested size.
+        ssize_t best_resolution_idx       = -1;
+        unsigned int best_resolution_area = UINT_MAX;
+        for (ssize_t i = 0; i < (ssize_t)set->count; ++i) {
+            VdoResolution* res = &set->resolutions[i];
+            if ((res->width >= chosen_req->width) && (res->height >= chosen_req->height)) {
+                unsigned int area = res->width * res->height;
+                if (area < best_resolution_area) {
+                    best_resolution_idx  = i;
+                    best_resolution_area = area;
+                }
             }
         }
-    }
 
-    // If we got a reasonable w/h from the VDO channel info we use that
-    // for creating the stream. If that info for some reason was empty we
-    // fall back to trying to create a stream with client-supplied w/h.
-    if (best_resolution_idx >= 0) {
-        chosen_req->width  = set->resolutions[best_resolution_idx].width;
-        chosen_req->height = set->resolutions[best_resolution_idx].height;
-    } else {
-        syslog(LOG_WARNING,
-               "%s: VDO channel info contains no reslution info. Fallback "
-               "to client-requested stream resolution.",
-               __func__);
+        // If we got a reasonable w/h from the VDO channel info we use that
+        // for creating the stream. If that info for some reason was empty we
+        // fall back to trying to create a stream with client-supplied w/h.
+        if (best_resolution_idx >= 0) {
+            chosen_req->width  = set->resolutions[best_resolution_idx].width;
+            chosen_req->height = set->resolutions[best_resolution_idx].height;
+        } else {
+            syslog(LOG_WARNING,
+                   "%s: VDO channel info contains no reslution info. Fallback "
+                   "to client-requested stream resolution.",
+                   __func__);
+        }
     }
     const char* format_str = "rgb interleaved";
     switch (*chosen_format) {
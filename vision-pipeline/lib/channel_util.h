@@ -27,11 +27,21 @@
 #include "vdo-stream.h"
 #include "vdo-types.h"
 
+typedef enum channel_resolution_mode {
+    // Use the requested resolution, it is only checked against the smallest
+    // and largest resolution of the channel
+    CHANNEL_RESOLUTION_REQUESTED,
+    // Use the smallest resolution with the aspect ratio of the capture mode
+    // that the requested resolution fits in
+    CHANNEL_RESOLUTION_SMALLEST_NATIVE_FIT,
+} channel_resolution_mode_t;
+
 bool channel_util_choose_stream_resolution(unsigned int channel,
                                            VdoResolution req_res,
                                            VdoResolution* chosen_req,
                                            unsigned int rotation,
-                                           VdoFormat* chosen_format);
+                                           VdoFormat* chosen_format,
+                                           channel_resolution_mode_t mode);
 
 unsigned int channel_util_get_image_rotation(unsigned int input_channel);
 unsigned int channel_util_get_first_input_channel(void);
@@ -0,0 +1,360 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file handles the vdo stream and the framerate calculation part of the
+ * application.
+ */
+
+#include "img_util.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <glib-object.h>
+#include <gmodule.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "panic.h"
+#include "vdo-map.h"
+#include "vdo-stream.h"
+#include <vdo-error.h>
+
+#define IMG_PROVIDER_ANALYSIS_MAX (10)
+// Weight of a new analysis time in the moving average
+#define IMG_FRAMERATE_EWMA_WEIGHT (0.1)
+// The time between frames is set this much longer than the analysis time
+#define IMG_FRAMERATE_HEADROOM (1.1)
+// The framerate is only raised if it can be raised by at least this factor
+#define IMG_FRAMERATE_RAISE_FACTOR (1.2)
+
+/**
+ * @brief Calculate a new img provider framerate based on inference time
+ *
+ * @param img_framerate   Struct for the framerate calculations
+ * @param analysis_time   Time in ms for the analysis
+ *
+ */
+static void calculate_new_framerate(img_framerate_t* img_framerate, unsigned int analysis_time) {
+    if (analysis_time > 201) {
+        img_framerate->framerate = 1.0;
+        img_framerate->frametime = 1001;
+        return;
+    }
+    if (analysis_time < 34) {
+        img_framerate->framerate = 30.0;
+        img_framerate->frametime = 34;
+    } else if (analysis_time < 41) {
+        img_framerate->framerate = 25.0;
+        img_framerate->frametime = 41;
+    } else if (analysis_time < 51) {
+        img_framerate->framerate = 20.0;
+        img_framerate->frametime = 51;
+    } else if (analysis_time < 67) {
+        img_framerate->framerate = 15.0;
+        img_framerate->frametime = 67;
+    } else if (analysis_time < 101) {
+        img_framerate->framerate = 10.0;
+        img_framerate->frametime = 101;
+    } else if (analysis_time < 201) {
+        img_framerate->framerate = 5.0;
+        img_framerate->frametime = 201;
+    }
+    if (img_framerate->framerate > img_framerate->wanted_framerate) {
+        img_framerate->framerate = img_framerate->wanted_framerate;
+    }
+}
+
+static bool
+update_framerate(VdoStream* stream, img_framerate_t* img_framerate, unsigned analysis_time) {
+    g_autoptr(GError) error    = NULL;
+    unsigned int old_frametime = img_framerate->frametime;
+
+    calculate_new_framerate(img_framerate, analysis_time);
+    if (old_frametime != img_framerate->frametime) {
+        if (!vdo_stream_set_framerate(stream, img_framerate->framerate, &error)) {
+            panic("%s: Failed to change framerate: %s", __func__, error->message);
+        }
+        syslog(LOG_INFO,
+               "Change VDO stream framerate to %f because of the mean analysis time %u ms",
+               img_framerate->framerate,
+               analysis_time);
+        return true;
+    }
+    return false;
+}
+
+// The highest offered framerate that is at most the given framerate, or the
+// lowest offered framerate if all are higher
+static double snap_framerate(img_framerate_t* img_framerate, double framerate) {
+    if (img_framerate->nbr_framerates == 0) {
+        return img_framerate->framerate;
+    }
+    for (unsigned int i = 0; i < img_framerate->nbr_framerates; i++) {
+        if (img_framerate->framerates[i] <= framerate) {
+            return img_framerate->framerates[i];
+        }
+    }
+    return img_framerate->framerates[img_framerate->nbr_framerates - 1];
+}
+
+// A framerate that the stream rejected is not offered again. The current
+// framerate is always kept, so the list is never empty.
+static void remove_framerate(img_framerate_t* img_framerate, double framerate) {
+    unsigned int nbr_kept = 0;
+    for (unsigned int i = 0; i < img_framerate->nbr_framerates; i++) {
+        if (fabs(img_framerate->framerates[i] - framerate) > 0.001 ||
+            fabs(img_framerate->framerates[i] - img_framerate->framerate) <= 0.001) {
+            img_framerate->framerates[nbr_kept++] = img_framerate->framerates[i];
+        }
+    }
+    if (nbr_kept == 0) {
+        img_framerate->framerates[nbr_kept++] = img_framerate->framerate;
+    }
+    img_framerate->nbr_framerates = nbr_kept;
+}
+
+/**
+ * @brief Follow a moving average of the analysis time with the framerate
+ *
+ * The framerate is lowered as soon as the analysis can not keep up with the
+ * frames from vdo but only raised when there is a clear margin so that it
+ * does not switch back and forth. Only framerates that the stream offers are
+ * chosen. vdo_stream_set_framerate does not need a flush of the stream.
+ *
+ * @param stream         The VdoStream to change framerate for
+ * @param img_framerate  Struct for the framerate calculations
+ * @param analysis_time  Time in ms for the analysis
+ */
+static void
+control_framerate(VdoStream* stream, img_framerate_t* img_framerate, unsigned analysis_time) {
+    g_autoptr(GError) error = NULL;
+
+    if (img_framerate->ewma_analysis_time <= 0.0) {
+        img_framerate->ewma_analysis_time = analysis_time;
+    } else {
+        img_framerate->ewma_analysis_time +=
+            IMG_FRAMERATE_EWMA_WEIGHT * (analysis_time - img_framerate->ewma_analysis_time);
+    }
+    if (img_framerate->framerate <= 0.0) {
+        img_framerate->framerate = 1000.0 / img_framerate->frametime;
+    }
+    // Let the average settle after a change
+    img_framerate->frames_since_change++;
+    if (img_framerate->frames_since_change < IMG_PROVIDER_ANALYSIS_MAX) {
+        return;
+    }
+
+    double mean_analysis_time = fmax(img_framerate->ewma_analysis_time, 1.0);
+    double max_framerate      = fmin(1000.0 / (mean_analysis_time * IMG_FRAMERATE_HEADROOM),
+                                img_framerate->wanted_framerate);
+    double new_framerate      = snap_framerate(img_framerate, max_framerate);
+
+    if (new_framerate < img_framerate->framerate) {
+        if (mean_analysis_time <= 1000.0 / img_framerate->framerate) {
+            return;
+        }
+    } else {
+        // Raise to an offered framerate that leaves a margin to the analysis
+        // time, or to the wanted framerate when the analysis keeps up with it
+        if (max_framerate < img_framerate->wanted_framerate) {
+            new_framerate = snap_framerate(img_framerate, max_framerate / IMG_FRAMERATE_RAISE_FACTOR);
+        }
+        if (new_framerate <= img_framerate->framerate) {
+            return;
+        }
+    }
+
+    if (!vdo_stream_set_framerate(stream, new_framerate, &error)) {
+        // Keep the current framerate and let the average settle again
+        syslog(LOG_WARNING,
+               "The stream did not accept the framerate %.2f, keeping %.2f: %s",
+               new_framerate,
+               img_framerate->framerate,
+               error->message);
+        remove_framerate(img_framerate, new_framerate);
+        img_framerate->frames_since_change = 0;
+        return;
+    }
+    syslog(LOG_INFO,
+           "Change VDO stream framerate to %.2f because of the mean analysis time %.1f ms",
+           new_framerate,
+           mean_analysis_time);
+    double frametime                   = ceil(1000.0 / new_framerate);
+    img_framerate->framerate           = new_framerate;
+    img_framerate->frametime           = (unsigned int)frametime;
+    img_framerate->frames_since_change = 0;
+}
+
+VdoStream* img_util_create_stream(unsigned int channel,
+                                  VdoFormat format,
+                                  VdoResolution res,
+                                  unsigned int num_buffers,
+                                  const char* image_fit,
+                                  double framerate) {
+    g_autoptr(VdoMap) vdo_settings = vdo_map_new();
+    g_autoptr(GError) error        = NULL;
+
+    if (!vdo_settings) {
+        panic("%s: Failed to create vdo_map", __func__);
+    }
+
+    vdo_map_set_uint32(vdo_settings, "channel", channel);
+    // format is the image format that is supplied from vdo
+    vdo_map_set_uint32(vdo_settings, "format", format);
+    // Set initial framerate
+    vdo_map_set_double(vdo_settings, "framerate", framerate);
+    VdoPair32u resolution = {
+        .w = res.width,
+        .h = res.height,
+    };
+    vdo_map_set_pair32u(vdo_settings, "resolution", resolution);
+    // Make it possible to change the framerate for the stream after it is started
+    vdo_map_set_boolean(vdo_settings, "dynamic.framerate", true);
+    // It is not needed to set buffer.strategy since VDO_BUFFER_STRATEGY_INFINITE is default
+    // vdo_map_set_uint32(vdo_settings, "buffer.strategy", VDO_BUFFER_STRATEGY_INFINITE);
+
+    // The number of buffers that vdo will allocate for this stream
+    // Normally two buffers are enough and using too many buffers will use
+    // more memory in the product
+    vdo_map_set_uint32(vdo_settings, "buffer.count", num_buffers);
+    // The vdo_stream_get_buffer is non blocking and will return immediately
+    // Then we need to poll instead when it is ok to get a buffer
+    vdo_map_set_boolean(vdo_settings, "socket.blocking", false);
+    vdo_map_set_string(vdo_settings, "image.fit", image_fit);
+
+    // Create a vdo stream using the vdoMap filled in above
+    g_autoptr(VdoStream) vdo_stream = vdo_stream_new(vdo_settings, NULL, &error);
+    if (!vdo_stream) {
+        panic("%s: Failed creating vdo stream: %s", __func__, error->message);
+    }
+    syslog(LOG_INFO, "Dump of vdo stream settings map =====");
+    vdo_map_dump(vdo_settings);
+
+    return g_steal_pointer(&vdo_stream);
+}
+
+void img_util_init_framerate(img_framerate_t* img_framerate,
+                             img_framerate_mode_t mode,
+                             VdoMap* stream_info,
+                             double wanted_framerate) {
+    double framerate = vdo_map_get_double(stream_info, "framerate", wanted_framerate);
+
+    memset(img_framerate, 0, sizeof(img_framerate_t));
+    img_framerate->mode             = mode;
+    img_framerate->wanted_framerate = wanted_framerate;
+    img_framerate->framerate        = framerate;
+    img_framerate->frametime        = (unsigned int)((1.0 / framerate) * 1000.0);
+
+    // The frames are taken from the capture at the highest framerate, so the
+    // stream offers that framerate divided by a whole number
+    while (img_framerate->nbr_framerates < MAX_NBR_IMG_FRAMERATES) {
+        double offered_framerate = framerate / (img_framerate->nbr_framerates + 1);
+        if (offered_framerate < 1.0 && img_framerate->nbr_framerates > 0) {
+            break;
+        }
+        img_framerate->framerates[img_framerate->nbr_framerates++] = offered_framerate;
+    }
+}
+
+int img_util_handle_vdo_failed(GError* error) {
+    // Maintenance/Installation in progress (e.g. Global-Rotation)
+    if (vdo_error_is_expected(&error)) {
+        syslog(LOG_INFO, "Expected vdo error %s", error->message);
+        return EXIT_SUCCESS;
+    } else {
+        panic("Unexpected vdo error %s", error->message);
+    }
+}
+
+bool img_util_update_framerate(VdoStream* stream,
+                               img_framerate_t* img_framerate,
+                               unsigned analysis_time) {
+    bool ret = false;
+    assert(stream);
+
+    if (img_framerate->mode == IMG_FRAMERATE_MODE_CONTROLLER) {
+        control_framerate(stream, img_framerate, analysis_time);
+        return false;
+    }
+
+    img_framerate->analysis_frame_count++;
+    img_framerate->tot_analysis_time += analysis_time;
+    if (img_framerate->analysis_frame_count == IMG_PROVIDER_ANALYSIS_MAX) {
+        img_framerate->mean_analysis_time =
+            img_framerate->tot_analysis_time / img_framerate->analysis_frame_count;
+
+        // If the analysis time is higher or lower than the time between frames from
+        // vdo change the framerate so the latest frame will be fetched from vdo
+        if (img_framerate->frametime < img_framerate->mean_analysis_time &&
+            img_framerate->frametime < 201) {
+            ret = update_framerate(stream, img_framerate, img_framerate->mean_analysis_time);
+        } else if (img_framerate->frametime > img_framerate->mean_analysis_time) {
+            ret = update_framerate(stream, img_framerate, img_framerate->mean_analysis_time);
+        }
+        img_framerate->mean_analysis_time   = 0;
+        img_framerate->analysis_frame_count = 0;
+        img_framerate->tot_analysis_time    = 0;
+    }
+
+    return ret;
+}
+
+bool img_util_flush(VdoStream* stream, VdoBuffer** buf, GError** error) {
+    // Flush the imaging pipeline
+    vdo_stream_stop(stream);
+    // Return the buffer
+    if (!vdo_stream_buffer_unref(stream, buf, error)) {
+        if (!vdo_error_is_expected(error)) {
+            panic("%s: Unexpected error: %s", __func__, (*error)->message);
+        }
+        g_clear_error(error);
+    }
+    if (!vdo_stream_start(stream, error)) {
+        return false;
+    }
+    return true;
+}
+
+bool img_util_get_newest_buffer(VdoStream* stream,
+                                VdoBuffer** buf,
+                                unsigned int* nbr_dropped,
+                                GError** error) {
+    *nbr_dropped = 0;
+    while (true) {
+        VdoBuffer* newer_buf = vdo_stream_get_buffer(stream, error);
+        if (!newer_buf) {
+            if (g_error_matches(*error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
+                // No newer buffer is available
+                g_clear_error(error);
+                return true;
+            }
+            return false;
+        }
+        // Give the older buffer back so that vdo can fill it with data again
+        if (!vdo_stream_buffer_unref(stream, buf, error)) {
+            if (!vdo_error_is_expected(error)) {
+                panic("%s: Unexpected error: %s", __func__, (*error)->message);
+            }
+            g_clear_error(error);
+        }
+        *buf = newer_buf;
+        (*nbr_dropped)++;
+    }
+}
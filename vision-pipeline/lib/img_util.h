@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the vdo part of the application.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vdo-error.h"
+#include "vdo-map.h"
+#include "vdo-stream.h"
+#include "vdo-types.h"
+
+// This is a limitation from vdo
+#define MAX_NBR_IMG_PROVIDER_BUFFERS 5
+
+// Upper limit of the framerates that a stream offers
+#define MAX_NBR_IMG_FRAMERATES 32
+
+/**
+ * @brief A type representing the buffers from vdo
+ *
+ * Contains information needed by larod to be able to set correct
+ * properties on the input tensors.
+ */
+typedef struct img_info {
+    VdoFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pitch;
+
+    unsigned int nbr_buffers;
+    bool dmabuf;
+} img_info_t;
+
+typedef enum img_framerate_mode {
+    // Choose from a fixed set of framerates every 10 frames. The stream must
+    // be flushed after a change.
+    IMG_FRAMERATE_MODE_STEPS,
+    // Follow a moving average of the analysis time and choose any framerate
+    // up to the wanted framerate. The stream does not need to be flushed.
+    IMG_FRAMERATE_MODE_CONTROLLER,
+} img_framerate_mode_t;
+
+typedef struct img_framerate {
+    img_framerate_mode_t mode;
+    unsigned int frametime;
+    unsigned int mean_analysis_time;
+    unsigned int analysis_frame_count;
+    unsigned int tot_analysis_time;
+    double wanted_framerate;
+    double framerate;
+    // Used by IMG_FRAMERATE_MODE_CONTROLLER
+    double ewma_analysis_time;
+    unsigned int frames_since_change;
+    // The framerates that the stream offers, from the highest to the lowest
+    double framerates[MAX_NBR_IMG_FRAMERATES];
+    unsigned int nbr_framerates;
+} img_framerate_t;
+
+/**
+ * @brief Create a vdo stream that the framerate can be changed for
+ *
+ * @param channel      The vdo channel to take the frames from
+ * @param format       The image format of the frames
+ * @param res          The resolution of the frames
+ * @param num_buffers  The number of buffers that vdo allocates for the stream
+ * @param image_fit    How the image is fitted to the resolution, scale or crop
+ * @param framerate    The initial framerate
+ *
+ * @return The stream, it is not started
+ */
+VdoStream* img_util_create_stream(unsigned int channel,
+                                  VdoFormat format,
+                                  VdoResolution res,
+                                  unsigned int num_buffers,
+                                  const char* image_fit,
+                                  double framerate);
+
+/**
+ * @brief Handle an error from vdo
+ *
+ * Expected errors, e.g. when the global rotation is changed, end the
+ * application without an error. Other errors panic.
+ *
+ * @param error  The error from vdo
+ *
+ * @return The exit status of the application
+ */
+int img_util_handle_vdo_failed(GError* error);
+
+/**
+ * @brief Set up the framerate calculations for a started stream
+ *
+ * The framerate of the stream info is the highest framerate. The stream
+ * offers that framerate divided by a whole number, down to 1 fps.
+ *
+ * @param img_framerate     The struct for the framerate calculations
+ * @param mode              How the framerate follows the analysis time
+ * @param stream_info       The info map of the stream
+ * @param wanted_framerate  The framerate to use when the analysis keeps up
+ */
+void img_util_init_framerate(img_framerate_t* img_framerate,
+                             img_framerate_mode_t mode,
+                             VdoMap* stream_info,
+                             double wanted_framerate);
+
+/**
+ * @brief Update framerate for a VdoStream
+ *
+ * @param stream         The VdoStream to change framerate for
+ * @param img_framerate  A struct containing all needed for framerate calculation
+ * @param analysis_time  The analysis time to be used for
+ * framerate calculation
+ *
+ * @return true if framerate was set and the buffers need to be flushed with
+ * img_util_flush, always false with IMG_FRAMERATE_MODE_CONTROLLER
+ */
+bool img_util_update_framerate(VdoStream* stream,
+                               img_framerate_t* img_framerate,
+                               unsigned int analysis_time);
+
+/**
+ * @brief Flush all buffers
+ *
+ * @param stream         The VdoStream to vlush buffers
+ * @param buf            The VdoBuffer to return
+ * @param error          If function fails this will be set
+ *
+ * @return true if flush was successful
+ */
+bool img_util_flush(VdoStream* stream, VdoBuffer** buf, GError** error);
+
+/**
+ * @brief Replace a buffer with the newest buffer that is available
+ *
+ * Fetches buffers from the stream until no more are available and gives all
+ * but the newest back to vdo. Use it when the analysis is slower than the
+ * stream to not analyze a frame when a newer one is already waiting.
+ *
+ * @param stream       The VdoStream to get buffers from
+ * @param buf          The VdoBuffer to replace, is set to the newest buffer
+ * @param nbr_dropped  Set to the number of buffers that were given back to vdo
+ * @param error        If function fails this will be set
+ *
+ * @return true if successful, buf is then the newest buffer
+ */
+bool img_util_get_newest_buffer(VdoStream* stream,
+                                VdoBuffer** buf,
+                                unsigned int* nbr_dropped,
+                                GError** error);
@@ -28,7 +28,8 @@
 void parse_labels(char*** labels_ptr,
                   char** label_file_buffer,
                   const char* labels_path,
-                  size_t* num_labels_ptr) {
+                  size_t* num_labels_ptr,
+                  bool skip_unavailable) {
     // We cut off every row at 60 characters.
     const size_t LINE_MAX_LEN = 60;
     char* labels_data         = NULL;  // Buffer containing the label file contents.
@@ -124,11 +125,14 @@ void parse_labels(char*** labels_ptr,
     }
 
     // Filter out "n/a" entries by compacting the array.
-    size_t valid_label_count = 0;
-    for (size_t i = 0; i < num_lines; i++) {
-        if (strcmp(label_array[i], "n/a") != 0) {
-            label_array[valid_label_count] = label_array[i];
-            valid_label_count++;
+    size_t valid_label_count = num_lines;
+    if (skip_unavailable) {
+        valid_label_count = 0;
+        for (size_t i = 0; i < num_lines; i++) {
+            if (strcmp(label_array[i], "n/a") != 0) {
+                label_array[valid_label_count] = label_array[i];
+                valid_label_count++;
+            }
         }
     }
 
@@ -137,4 +141,4 @@ void parse_labels(char*** labels_ptr,
     *label_file_buffer = labels_data;
 
     close(labels_fd);
-}
\ No newline at end of file
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * @brief Read a label file with one label per line
+ *
+ * @param labels_ptr         Set to an array with a pointer to each label
+ * @param label_file_buffer  Set to the buffer that the labels point into
+ * @param labels_path        The label file
+ * @param num_labels_ptr     Set to the number of labels
+ * @param skip_unavailable   Leave out the "n/a" labels, set it when the class
+ *                           indices of the model do not count them
+ */
+void parse_labels(char*** labels_ptr,
+                  char** label_file_buffer,
+                  const char* labels_path,
+                  size_t* num_labels_ptr,
+                  bool skip_unavailable);
\ No newline at end of file
@@ -0,0 +1,1192 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model.h"
+#include "model_preprocessing.h"
+
+#include "larod.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NBR_POWER_RETRIES 50
+
+bool model_get_model_output_info(model_provider_t* provider,
+                                 size_t model_index,
+                                 unsigned int tensor_output_index,
+                                 model_tensor_output_t* tensor_output) {
+    if (model_index >= provider->nbr_models) {
+        panic("%s: Invalid model index %zu", __func__, model_index);
+    }
+    if (tensor_output_index >= provider->num_outputs[model_index]) {
+        panic("%s: Invalid output index %u", __func__, tensor_output_index);
+    }
+    model_slot_t* slot = &provider->slots[provider->ready_slot];
+    *tensor_output     = slot->model_output_tensors[model_index][tensor_output_index];
+    return true;
+}
+
+bool model_get_tensor_output_info(model_provider_t* provider,
+                                  unsigned int tensor_output_index,
+                                  model_tensor_output_t* tensor_output) {
+    return model_get_model_output_info(provider, 0, tensor_output_index, tensor_output);
+}
+
+static uint64_t get_monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+// The time without power is recorded as it passes, so that the statistics
+// also show it while there is still no power
+static void record_no_power_time(model_provider_t* provider, uint64_t now_ms) {
+    stage_stats_add_no_power_time(provider->stage_stats,
+                                  (now_ms - provider->no_power_recorded_ms) * 1000000);
+    provider->no_power_recorded_ms = now_ms;
+}
+
+static void model_job_handle_no_power(model_provider_t* provider) {
+    // Currently this will only happen when there is no power
+    syslog(LOG_INFO,
+           "No power available when running larod job, try nbr %u",
+           provider->nbr_power_retries);
+    uint64_t now_ms = get_monotonic_ms();
+    if (provider->nbr_power_retries == 0) {
+        provider->no_power_since_ms    = now_ms;
+        provider->no_power_recorded_ms = now_ms;
+        provider->nbr_skipped_frames   = 0;
+    }
+    record_no_power_time(provider, now_ms);
+    provider->nbr_power_retries++;
+    // Instead of sleeping here, frames are skipped until the deadline so that
+    // the buffers are returned to vdo and the stream keeps running. The wait
+    // grows with each retry and then stays at the longest wait until there
+    // is power again.
+    int nbr_steps               = MIN(provider->nbr_power_retries, MAX_NBR_POWER_RETRIES);
+    provider->power_deadline_ms = now_ms + (250 * (uint64_t)nbr_steps);
+}
+
+static bool model_skip_for_no_power(model_provider_t* provider) {
+    uint64_t now_ms = get_monotonic_ms();
+    if (provider->nbr_power_retries == 0 || now_ms >= provider->power_deadline_ms) {
+        return false;
+    }
+    provider->nbr_skipped_frames++;
+    stage_stats_add_skipped_frames(provider->stage_stats, 1);
+    record_no_power_time(provider, now_ms);
+    return true;
+}
+
+static void model_power_available(model_provider_t* provider) {
+    if (provider->nbr_power_retries == 0) {
+        return;
+    }
+    uint64_t now_ms = get_monotonic_ms();
+    record_no_power_time(provider, now_ms);
+    provider->nbr_power_retries = 0;
+    syslog(LOG_INFO,
+           "Power available again after %llu ms, %llu frames skipped",
+           (unsigned long long)(now_ms - provider->no_power_since_ms),
+           (unsigned long long)provider->nbr_skipped_frames);
+}
+
+static void
+setup_job_requests(model_provider_t* provider, model_slot_t* slot, larodTensor** input_tensors) {
+    larodError* error = NULL;
+
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        model_input_t* input = &provider->inputs[i];
+        if (!input->use_preprocessing) {
+            continue;
+        }
+        if (!slot->pp_req[i]) {
+            slot->pp_req[i] = larodCreateJobRequest(input->pp_model,
+                                                    input_tensors,
+                                                    1,
+                                                    slot->pp_output_tensors[i],
+                                                    input->pp_num_outputs,
+                                                    provider->crop_map,
+                                                    &error);
+            if (!slot->pp_req[i]) {
+                panic("%s: Failed to create input job request: %s", __func__, error->msg);
+            }
+        } else if (!larodSetJobRequestInputs(slot->pp_req[i], input_tensors, 1, &error)) {
+            panic("%s: Failed to set input job request: %s", __func__, error->msg);
+        }
+    }
+
+    // Each model takes either the preprocessing output of its input or the
+    // image from vdo
+    for (size_t i = 0; i < provider->nbr_models; i++) {
+        size_t input_index   = provider->model_inputs[i];
+        model_input_t* input = &provider->inputs[input_index];
+        if (input->use_preprocessing) {
+            if (slot->inf_req[i]) {
+                continue;
+            }
+            slot->inf_req[i] = larodCreateJobRequest(provider->models[i],
+                                                     slot->pp_output_tensors[input_index],
+                                                     input->pp_num_outputs,
+                                                     slot->output_tensors[i],
+                                                     provider->num_outputs[i],
+                                                     NULL,
+                                                     &error);
+        } else if (!slot->inf_req[i]) {
+            slot->inf_req[i] = larodCreateJobRequest(provider->models[i],
+                                                     input_tensors,
+                                                     1,
+                                                     slot->output_tensors[i],
+                                                     provider->num_outputs[i],
+                                                     provider->crop_map,
+                                                     &error);
+        } else if (!larodSetJobRequestInputs(slot->inf_req[i], input_tensors, 1, &error)) {
+            panic("%s: Failed to set input job request: %s", __func__, error->msg);
+        }
+        if (!slot->inf_req[i]) {
+            panic("%s: Failed creating inference job request: %s", __func__, error->msg);
+        }
+    }
+}
+
+static void report_first_inference(model_provider_t* provider) {
+    struct timespec now;
+
+    if (provider->has_inferred) {
+        return;
+    }
+    provider->has_inferred = true;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned int elapsed_ms =
+        (unsigned int)(((now.tv_sec - provider->created_ts.tv_sec) * 1000) +
+                       ((now.tv_nsec - provider->created_ts.tv_nsec) / 1000000));
+    syslog(LOG_INFO,
+           "Time to first inference %u ms, %zu of %zu models were already loaded",
+           elapsed_ms,
+           provider->cached_models,
+           provider->nbr_models);
+}
+
+// Collect the preprocessing job requests of the slot, returns the number of jobs
+static size_t get_pp_job_requests(model_provider_t* provider,
+                                  model_slot_t* slot,
+                                  larodJobRequest** pp_reqs) {
+    size_t nbr_jobs = 0;
+
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        if (provider->inputs[i].use_preprocessing) {
+            pp_reqs[nbr_jobs++] = slot->pp_req[i];
+        }
+    }
+    return nbr_jobs;
+}
+
+static void set_output_timestamps(model_provider_t* provider, model_slot_t* slot) {
+    for (size_t i = 0; i < provider->nbr_models; i++) {
+        for (size_t j = 0; j < provider->num_outputs[i]; j++) {
+            slot->model_output_tensors[i][j].timestamp = slot->timestamp;
+        }
+    }
+}
+
+// Set up the jobs of slot 0 for the frame and run the preprocessing jobs,
+// returns false when larod has no power
+static bool run_preprocessing_jobs(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    larodError* error  = NULL;
+    model_slot_t* slot = &provider->slots[0];
+    larodJobRequest* pp_reqs[MAX_NBR_MODELS];
+
+    if (model_skip_for_no_power(provider)) {
+        return false;
+    }
+
+    larodTensor** input_tensors = model_tensor_cache_get(&provider->input_cache, vdo_buf);
+    setup_job_requests(provider, slot, input_tensors);
+
+    uint64_t stage_ts  = stage_stats_now_ns();
+    size_t nbr_pp_jobs = get_pp_job_requests(provider, slot, pp_reqs);
+    for (size_t i = 0; i < nbr_pp_jobs; i++) {
+        if (!larodRunJob(provider->conn, pp_reqs[i], &error)) {
+            if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+                panic("%s: Unable to run preprocessing job: %s (%d)",
+                      __func__,
+                      error->msg,
+                      error->code);
+            }
+            larodClearError(&error);
+            model_job_handle_no_power(provider);
+            return false;
+        }
+    }
+    if (nbr_pp_jobs > 0) {
+        stage_stats_mark(provider->stage_stats, STAGE_PREPROCESSING, stage_ts);
+    }
+    return true;
+}
+
+// Run the inference jobs of slot 0 on the preprocessed frame, returns false
+// when larod has no power
+static bool run_inference_jobs(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    larodError* error  = NULL;
+    model_slot_t* slot = &provider->slots[0];
+    uint64_t stage_ts  = stage_stats_now_ns();
+
+    for (size_t i = 0; i < provider->nbr_models; i++) {
+        if (!larodRunJob(provider->conn, slot->inf_req[i], &error)) {
+            if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+                panic("%s: Unable to run inference on model %zu: %s (%d)",
+                      __func__,
+                      i,
+                      error->msg,
+                      error->code);
+            }
+            larodClearError(&error);
+            model_job_handle_no_power(provider);
+            return false;
+        }
+    }
+    stage_stats_mark(provider->stage_stats, STAGE_INFERENCE, stage_ts);
+    VdoFrame* frame = vdo_buffer_get_frame(vdo_buf);
+    slot->timestamp = vdo_frame_get_timestamp(frame);
+    // Update the tensor outputs with the timestamp
+    set_output_timestamps(provider, slot);
+    report_first_inference(provider);
+    provider->ready_slot = 0;
+    model_power_available(provider);
+    return true;
+}
+
+bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    return run_preprocessing_jobs(provider, vdo_buf) && run_inference_jobs(provider, vdo_buf);
+}
+
+// Called from a larod thread when a job of the slot has finished. The slot
+// changes state when all of its jobs have finished.
+static void slot_job_done(model_slot_t* slot, larodError* error, model_slot_state_t done_state) {
+    model_provider_t* provider = slot->provider;
+
+    g_mutex_lock(&provider->slot_mutex);
+    if (error) {
+        if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            syslog(LOG_ERR, "Larod job failed: %s (%d)", error->msg, error->code);
+        }
+        slot->error_code = error->code;
+    }
+    slot->nbr_pending_jobs--;
+    if (slot->nbr_pending_jobs == 0) {
+        slot->state = slot->error_code == LAROD_ERROR_NONE ? done_state : MODEL_SLOT_FAILED;
+        if (slot->state == done_state) {
+            // Recording is lock free so it can be done from the larod thread
+            stage_stats_mark(provider->stage_stats,
+                             done_state == MODEL_SLOT_PREPROCESSED ? STAGE_PREPROCESSING
+                                                                   : STAGE_INFERENCE,
+                             slot->jobs_started_ns);
+        }
+        g_cond_broadcast(&provider->slot_cond);
+    }
+    g_mutex_unlock(&provider->slot_mutex);
+}
+
+static void preprocessing_done(void* user_data, larodError* error) {
+    slot_job_done(user_data, error, MODEL_SLOT_PREPROCESSED);
+}
+
+static void inference_done(void* user_data, larodError* error) {
+    slot_job_done(user_data, error, MODEL_SLOT_DONE);
+}
+
+static bool run_slot_jobs_async(model_provider_t* provider,
+                                model_slot_t* slot,
+                                larodJobRequest** job_reqs,
+                                size_t nbr_jobs,
+                                larodRunJobCallback job_done,
+                                model_slot_state_t running_state) {
+    larodError* error = NULL;
+
+    // Set the state before the jobs are started since the callback can be
+    // called before larodRunJobAsync returns
+    g_mutex_lock(&provider->slot_mutex);
+    slot->state            = running_state;
+    slot->error_code       = LAROD_ERROR_NONE;
+    slot->nbr_pending_jobs = nbr_jobs;
+    slot->jobs_started_ns  = stage_stats_now_ns();
+    g_mutex_unlock(&provider->slot_mutex);
+
+    for (size_t i = 0; i < nbr_jobs; i++) {
+        if (larodRunJobAsync(provider->conn, job_reqs[i], job_done, slot, &error)) {
+            continue;
+        }
+        if (error->code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+            panic("%s: Unable to run job: %s (%d)", __func__, error->msg, error->code);
+        }
+        larodClearError(&error);
+        // The jobs that were started will still call the callback
+        g_mutex_lock(&provider->slot_mutex);
+        slot->error_code = LAROD_ERROR_POWER_NOT_AVAILABLE;
+        slot->nbr_pending_jobs -= nbr_jobs - i;
+        if (slot->nbr_pending_jobs == 0) {
+            slot->state = MODEL_SLOT_FAILED;
+            g_cond_broadcast(&provider->slot_cond);
+        }
+        g_mutex_unlock(&provider->slot_mutex);
+        return false;
+    }
+    return true;
+}
+
+// Larod functions are not called from the larod callbacks, instead the
+// inference job of a preprocessed slot is started from here
+static void start_preprocessed_slots(model_provider_t* provider) {
+    for (size_t i = 0; i < provider->nbr_in_flight; i++) {
+        model_slot_t* slot = &provider->slots[(provider->oldest_slot + i) % provider->nbr_slots];
+
+        g_mutex_lock(&provider->slot_mutex);
+        model_slot_state_t state = slot->state;
+        g_mutex_unlock(&provider->slot_mutex);
+
+        if (state == MODEL_SLOT_PREPROCESSED) {
+            run_slot_jobs_async(provider,
+                                slot,
+                                slot->inf_req,
+                                provider->nbr_models,
+                                inference_done,
+                                MODEL_SLOT_INFERRING);
+        }
+    }
+}
+
+// Must be called with the slot mutex held
+static bool has_preprocessed_slot(model_provider_t* provider) {
+    for (size_t i = 0; i < provider->nbr_in_flight; i++) {
+        model_slot_t* slot = &provider->slots[(provider->oldest_slot + i) % provider->nbr_slots];
+        if (slot->state == MODEL_SLOT_PREPROCESSED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool model_has_free_slot(model_provider_t* provider) {
+    return provider->nbr_in_flight < provider->nbr_slots;
+}
+
+bool model_has_pending_inference(model_provider_t* provider) {
+    return provider->nbr_in_flight > 0;
+}
+
+model_inference_status_t model_run_inference_async(model_provider_t* provider, VdoBuffer* vdo_buf) {
+    if (!model_has_free_slot(provider)) {
+        panic("%s: No free inference slot, wait for an inference first", __func__);
+    }
+    if (model_skip_for_no_power(provider)) {
+        return MODEL_INFERENCE_SKIPPED;
+    }
+    model_slot_t* slot = &provider->slots[provider->next_slot];
+    larodJobRequest* pp_reqs[MAX_NBR_MODELS];
+
+    larodTensor** input_tensors = model_tensor_cache_get(&provider->input_cache, vdo_buf);
+    setup_job_requests(provider, slot, input_tensors);
+
+    slot->vdo_buf   = vdo_buf;
+    slot->timestamp = vdo_frame_get_timestamp(vdo_buffer_get_frame(vdo_buf));
+
+    // The inference jobs are started when all preprocessing jobs are done
+    bool started       = false;
+    size_t nbr_pp_jobs = get_pp_job_requests(provider, slot, pp_reqs);
+    if (nbr_pp_jobs > 0) {
+        started = run_slot_jobs_async(provider,
+                                      slot,
+                                      pp_reqs,
+                                      nbr_pp_jobs,
+                                      preprocessing_done,
+                                      MODEL_SLOT_PREPROCESSING);
+    } else {
+        started = run_slot_jobs_async(provider,
+                                      slot,
+                                      slot->inf_req,
+                                      provider->nbr_models,
+                                      inference_done,
+                                      MODEL_SLOT_INFERRING);
+    }
+    if (!started) {
+        // Let the jobs that were started finish before the slot is reused
+        g_mutex_lock(&provider->slot_mutex);
+        while (slot->state != MODEL_SLOT_FAILED) {
+            g_cond_wait(&provider->slot_cond, &provider->slot_mutex);
+        }
+        slot->state = MODEL_SLOT_FREE;
+        g_mutex_unlock(&provider->slot_mutex);
+        slot->vdo_buf = NULL;
+        model_job_handle_no_power(provider);
+        return MODEL_INFERENCE_NO_POWER;
+    }
+    provider->next_slot = (provider->next_slot + 1) % provider->nbr_slots;
+    provider->nbr_in_flight++;
+
+    start_preprocessed_slots(provider);
+    return MODEL_INFERENCE_STARTED;
+}
+
+// Wait for the oldest slot and free it, returns the state it finished in
+static model_slot_state_t wait_oldest_slot(model_provider_t* provider, VdoBuffer** done_buf) {
+    if (provider->nbr_in_flight == 0) {
+        panic("%s: No inference has been started", __func__);
+    }
+    model_slot_t* slot = &provider->slots[provider->oldest_slot];
+
+    g_mutex_lock(&provider->slot_mutex);
+    while (slot->state != MODEL_SLOT_DONE && slot->state != MODEL_SLOT_FAILED) {
+        if (has_preprocessed_slot(provider)) {
+            g_mutex_unlock(&provider->slot_mutex);
+            start_preprocessed_slots(provider);
+            g_mutex_lock(&provider->slot_mutex);
+            continue;
+        }
+        g_cond_wait(&provider->slot_cond, &provider->slot_mutex);
+    }
+    model_slot_state_t state  = slot->state;
+    larodErrorCode error_code = slot->error_code;
+    slot->state               = MODEL_SLOT_FREE;
+    g_mutex_unlock(&provider->slot_mutex);
+
+    provider->oldest_slot = (provider->oldest_slot + 1) % provider->nbr_slots;
+    provider->nbr_in_flight--;
+    *done_buf     = slot->vdo_buf;
+    slot->vdo_buf = NULL;
+
+    if (state == MODEL_SLOT_FAILED && error_code != LAROD_ERROR_POWER_NOT_AVAILABLE) {
+        panic("%s: Unable to run larod job (%d)", __func__, error_code);
+    }
+    return state;
+}
+
+bool model_wait_inference(model_provider_t* provider, VdoBuffer** done_buf) {
+    size_t slot_id = provider->oldest_slot;
+
+    if (wait_oldest_slot(provider, done_buf) == MODEL_SLOT_FAILED) {
+        model_job_handle_no_power(provider);
+        return false;
+    }
+    // The outputs of the slot are valid until the slot is reused by the next
+    // call to model_run_inference_async
+    set_output_timestamps(provider, &provider->slots[slot_id]);
+    report_first_inference(provider);
+    provider->ready_slot = slot_id;
+    model_power_available(provider);
+    return true;
+}
+
+// The frames are dropped, e.g. after a job failed since there was no power, so
+// the result does not change the power state that decides what to skip
+void model_discard_inference(model_provider_t* provider, VdoBuffer** done_buf) {
+    wait_oldest_slot(provider, done_buf);
+}
+
+static pipeline_status_t model_preprocess_run(void* ctx, VdoBuffer* vdo_buf) {
+    return run_preprocessing_jobs(ctx, vdo_buf) ? PIPELINE_CONTINUE : PIPELINE_SKIP;
+}
+
+static void model_reset(void* ctx) {
+    model_provider_clear_input_cache(ctx);
+}
+
+static pipeline_status_t model_infer_run(void* ctx, VdoBuffer** vdo_buf) {
+    return run_inference_jobs(ctx, *vdo_buf) ? PIPELINE_CONTINUE : PIPELINE_SKIP;
+}
+
+static pipeline_status_t model_infer_async_run(void* ctx, VdoBuffer** vdo_buf) {
+    model_provider_t* provider = ctx;
+
+    // The buffer is owned by the model provider until it is handed back by
+    // model_wait_inference
+    model_inference_status_t inference_status = model_run_inference_async(provider, *vdo_buf);
+    if (inference_status == MODEL_INFERENCE_SKIPPED) {
+        // Larod had no power a moment ago, only this frame is given back and
+        // the frames in inference are left to finish
+        return PIPELINE_SKIP;
+    }
+    if (inference_status == MODEL_INFERENCE_NO_POWER) {
+        return PIPELINE_SKIP_ALL;
+    }
+    *vdo_buf = NULL;
+    // Fetch a new frame as long as there is a free inference slot
+    if (model_has_free_slot(provider)) {
+        return PIPELINE_PENDING;
+    }
+    // Wait for the oldest frame in inference
+    if (!model_wait_inference(provider, vdo_buf)) {
+        // The frame failed since there was no power, the frames after it
+        // were started at the same time and are dropped as well
+        return PIPELINE_SKIP_ALL;
+    }
+    return PIPELINE_CONTINUE;
+}
+
+static bool model_infer_async_drain(void* ctx, VdoBuffer** vdo_buf) {
+    model_provider_t* provider = ctx;
+
+    if (!model_has_pending_inference(provider)) {
+        return false;
+    }
+    model_discard_inference(provider, vdo_buf);
+    return true;
+}
+
+const pipeline_preprocess_ops_t model_preprocess_ops = {
+    .run   = model_preprocess_run,
+    .reset = model_reset,
+};
+
+const pipeline_infer_ops_t model_infer_ops = {
+    .run = model_infer_run,
+};
+
+const pipeline_infer_ops_t model_infer_async_ops = {
+    .run   = model_infer_async_run,
+    .drain = model_infer_async_drain,
+    .reset = model_reset,
+};
+
+// Allocate output tensors of a model and map them
+static void alloc_output_tensors(model_provider_t* provider,
+                                 size_t model_index,
+                                 larodTensor*** tensors,
+                                 model_tensor_output_t** outputs) {
+    larodError* error  = NULL;
+    size_t num_outputs = 0;
+
+    *tensors = larodAllocModelOutputs(provider->conn,
+                                      provider->models[model_index],
+                                      LAROD_FD_PROP_READWRITE | LAROD_FD_PROP_MAP,
+                                      &num_outputs,
+                                      NULL,
+                                      &error);
+    if (!*tensors) {
+        panic("%s: Failed retrieving output tensors: %s", __func__, error->msg);
+    }
+    provider->num_outputs[model_index] = num_outputs;
+
+    model_tensor_output_t* model_output_tensors =
+        calloc(num_outputs, sizeof(model_tensor_output_t));
+    if (!model_output_tensors) {
+        panic("%s: Unable to allocate model outputs: %s", __func__, strerror(errno));
+    }
+    larodTensor** output_tensors = *tensors;
+    // To be able to get the data from the output tensors get the fd and mmap the memory
+    for (size_t i = 0; i < num_outputs; i++) {
+        int fd = larodGetTensorFd(output_tensors[i], &error);
+        if (fd == LAROD_INVALID_FD) {
+            panic("%s: Could not get tensor fd: %s", __func__, error->msg);
+        }
+        size_t output_size           = 0;
+        void* data                   = NULL;
+        larodTensorDataType datatype = LAROD_TENSOR_DATA_TYPE_INVALID;
+
+        model_output_tensors[i].fd = fd;
+        if (!larodGetTensorFdSize(output_tensors[i], &output_size, &error)) {
+            panic("%s: Could not get byte size of tensor: %s", __func__, error->msg);
+        }
+        model_output_tensors[i].size = output_size;
+        data = mmap(NULL, output_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            panic("%s: Could not map inference output tensors fd: %s", __func__, strerror(errno));
+        }
+        model_output_tensors[i].data = data;
+        datatype = larodGetTensorDataType(output_tensors[i], &error);
+        if (datatype == LAROD_TENSOR_DATA_TYPE_INVALID) {
+            panic("%s: Could not get output tensor data type: %s", __func__, error->msg);
+        }
+        model_output_tensors[i].datatype = datatype;
+        syslog(LOG_INFO, "Created mmaped model output %zu with size %zu", i, output_size);
+    }
+    *outputs = model_output_tensors;
+}
+
+static void free_output_tensors(model_provider_t* provider,
+                                size_t model_index,
+                                larodTensor*** tensors,
+                                model_tensor_output_t** outputs) {
+    larodError* error                           = NULL;
+    model_tensor_output_t* model_output_tensors = *outputs;
+
+    for (size_t j = 0; model_output_tensors && j < provider->num_outputs[model_index]; j++) {
+        if (model_output_tensors[j].data != MAP_FAILED) {
+            munmap(model_output_tensors[j].data, model_output_tensors[j].size);
+        }
+
+        if (model_output_tensors[j].fd >= 0) {
+            close(model_output_tensors[j].fd);
+        }
+    }
+    free(model_output_tensors);
+    *outputs = NULL;
+
+    larodDestroyTensors(provider->conn, tensors, provider->num_outputs[model_index], &error);
+}
+
+static void
+setup_slot_output_tensors(model_provider_t* provider, model_slot_t* slot, size_t model_index) {
+    slot->provider = provider;
+    alloc_output_tensors(provider,
+                         model_index,
+                         &slot->output_tensors[model_index],
+                         &slot->model_output_tensors[model_index]);
+}
+
+static void destroy_slot(model_provider_t* provider, model_slot_t* slot) {
+    larodError* error = NULL;
+
+    for (size_t i = 0; i < provider->nbr_models; i++) {
+        free_output_tensors(provider,
+                            i,
+                            &slot->output_tensors[i],
+                            &slot->model_output_tensors[i]);
+        larodDestroyJobRequest(&slot->inf_req[i]);
+    }
+
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        larodDestroyTensors(provider->conn,
+                            &slot->pp_output_tensors[i],
+                            provider->inputs[i].pp_num_outputs,
+                            &error);
+        larodDestroyJobRequest(&slot->pp_req[i]);
+    }
+}
+
+// Returns the sha256 of the model file as a hex string, free with g_free()
+static gchar* get_model_file_hash(int fd, const char* model_file) {
+    g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    guchar buf[64 * 1024];
+    off_t offset     = 0;
+    ssize_t nbr_read = 0;
+
+    // pread does not move the file offset used by larodLoadModel
+    while ((nbr_read = pread(fd, buf, sizeof(buf), offset)) > 0) {
+        g_checksum_update(checksum, buf, nbr_read);
+        offset += nbr_read;
+    }
+    if (nbr_read < 0) {
+        panic("%s: Unable to read model file %s: %s", __func__, model_file, strerror(errno));
+    }
+    return g_strdup(g_checksum_get_string(checksum));
+}
+
+// Look for a public model that has been loaded by an earlier run of the
+// application. Public models with the same name prefix but an other hash are
+// from an older model file and are deleted to free memory in larod.
+static larodModel* find_cached_model(model_provider_t* provider,
+                                     const char* cache_name,
+                                     const char* cache_prefix,
+                                     const char* device_name) {
+    larodError* error   = NULL;
+    larodModel* model   = NULL;
+    size_t num_models   = 0;
+    bool found_model    = false;
+    uint64_t cached_id  = 0;
+    larodModel** models = larodGetModels(provider->conn, &num_models, &error);
+    if (!models) {
+        syslog(LOG_WARNING, "Unable to list loaded models: %s", error->msg);
+        larodClearError(&error);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num_models; i++) {
+        const char* name          = larodGetModelName(models[i], NULL);
+        const larodDevice* device = larodGetModelDevice(models[i], NULL);
+        if (!name || !device || !g_str_has_prefix(name, cache_prefix) ||
+            g_strcmp0(larodGetDeviceName(device, NULL), device_name)) {
+            continue;
+        }
+        if (!g_strcmp0(name, cache_name)) {
+            cached_id   = larodGetModelId(models[i], NULL);
+            found_model = true;
+        } else if (!larodDeleteModel(provider->conn, models[i], &error)) {
+            syslog(LOG_WARNING, "Unable to delete old cached model %s: %s", name, error->msg);
+            larodClearError(&error);
+        } else {
+            syslog(LOG_INFO, "Deleted old cached model %s", name);
+        }
+    }
+    larodDestroyModels(&models, num_models);
+
+    if (found_model) {
+        model = larodGetModel(provider->conn, cached_id, &error);
+        if (!model) {
+            syslog(LOG_WARNING, "Unable to get cached model %s: %s", cache_name, error->msg);
+            larodClearError(&error);
+        }
+    }
+    return model;
+}
+
+// Load the model and retry as long as there is not enough power
+static larodModel* load_model(model_provider_t* provider,
+                              int model_fd,
+                              const larodDevice* device,
+                              larodAccess access,
+                              const char* name,
+                              larodError** error) {
+    larodModel* model = larodLoadModel(provider->conn, model_fd, device, access, name, NULL, error);
+    uint8_t nbr_power_retries = 1;
+    // Retry if there is not enough power to load the model
+    while (!model && (*error)->code == LAROD_ERROR_POWER_NOT_AVAILABLE) {
+        larodClearError(error);
+        model = larodLoadModel(provider->conn, model_fd, device, access, name, NULL, error);
+        // Sleep between retries
+        usleep(250 * 1000 * nbr_power_retries);
+        nbr_power_retries++;
+        if (nbr_power_retries == MAX_NBR_POWER_RETRIES) {
+            panic(
+                "%s: Still no power available "
+                "when trying to load model %u, giving up",
+                __func__,
+                nbr_power_retries);
+        }
+    }
+    return model;
+}
+
+static larodModel* create_inference_model(model_provider_t* provider,
+                                          size_t model_index,
+                                          char* model_file,
+                                          const char* device_name) {
+    larodError* error = NULL;
+
+    // Create larod models
+    provider->larod_model_fds[model_index] = open(model_file, O_RDONLY);
+    if (provider->larod_model_fds[model_index] < 0) {
+        panic("%s: Unable to open model file %s: %s", __func__, model_file, strerror(errno));
+    }
+
+    bool found_device  = false;
+    size_t num_devices = 0;
+    const larodDevice** devices;
+    devices = larodListDevices(provider->conn, &num_devices, &error);
+    if (num_devices == 0) {
+        panic("%s: Unable to list devices: %s", __func__, error->msg);
+    }
+
+    const char* device_str = NULL;
+    // Check for the supplied device name in all devices supported
+    for (size_t i = 0; i < num_devices; ++i) {
+        device_str = larodGetDeviceName(devices[i], &error);
+        if (!g_strcmp0(device_str, device_name)) {
+            found_device = true;
+            break;
+        }
+    }
+
+    if (!found_device) {
+        panic("%s: No device found for %s", __func__, device_name);
+    }
+    provider->device_name = device_name;
+
+    syslog(LOG_INFO,
+           "Setting up larod connection with chip %s and model file %s",
+           device_name,
+           model_file);
+    const larodDevice* device = larodGetDevice(provider->conn, device_name, 0, &error);
+
+    // The model is loaded with public access and a name made from the hash
+    // of the model file. Then the loaded model can be reused when the
+    // application is restarted instead of loading the model again.
+    int model_fd                   = provider->larod_model_fds[model_index];
+    g_autofree gchar* model_hash   = get_model_file_hash(model_fd, model_file);
+    g_autofree gchar* cache_prefix = g_strdup_printf("%s %zu ", provider->model_name, model_index);
+    g_autofree gchar* cache_name   = g_strdup_printf("%s%.16s", cache_prefix, model_hash);
+
+    larodModel* model = find_cached_model(provider, cache_name, cache_prefix, device_name);
+    if (model) {
+        syslog(LOG_INFO, "Using already loaded model %s", cache_name);
+        provider->cached_models++;
+        return model;
+    }
+
+    syslog(LOG_INFO,
+           "Loading the model... This might take up to 5 minutes depending on your device model.");
+    model = load_model(provider, model_fd, device, LAROD_ACCESS_PUBLIC, cache_name, &error);
+    if (!model) {
+        // Fall back to a model that is only available to this session
+        syslog(LOG_WARNING, "Unable to load public model, loading private model: %s", error->msg);
+        larodClearError(&error);
+        model = load_model(provider,
+                           model_fd,
+                           device,
+                           LAROD_ACCESS_PRIVATE,
+                           provider->model_name,
+                           &error);
+    }
+    if (!model) {
+        panic("%s: Unable to load model with device %s: %s", __func__, device_str, error->msg);
+    }
+    syslog(LOG_INFO, "Model loaded successfully");
+
+    return model;
+}
+
+void model_provider_destroy(model_provider_t* provider) {
+    if (!provider) {
+        panic("%s: Invalid pointer to model_provider_t", __func__);
+    }
+
+    // Let jobs still running in larod finish before their tensors are destroyed
+    g_mutex_lock(&provider->slot_mutex);
+    for (size_t i = 0; i < provider->nbr_slots; i++) {
+        while (provider->slots[i].state == MODEL_SLOT_PREPROCESSING ||
+               provider->slots[i].state == MODEL_SLOT_INFERRING) {
+            g_cond_wait(&provider->slot_cond, &provider->slot_mutex);
+        }
+    }
+    g_mutex_unlock(&provider->slot_mutex);
+
+    larodDestroyMap(&provider->crop_map);
+
+    for (size_t i = 0; i < MAX_NBR_INFERENCE_SLOTS; i++) {
+        destroy_slot(provider, &provider->slots[i]);
+    }
+    for (size_t i = 0; i < provider->nbr_models; i++) {
+        larodDestroyModel(&provider->models[i]);
+        if (provider->larod_model_fds[i] >= 0) {
+            close(provider->larod_model_fds[i]);
+        }
+    }
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        larodDestroyModel(&provider->inputs[i].pp_model);
+    }
+    model_tensor_cache_clear(&provider->input_cache);
+
+    // Only the model handles are released above. We count on larod service to
+    // release the privately loaded models when the session is disconnected in
+    // larodDisconnect(). Public models are kept loaded by larod so that they
+    // can be reused the next time the application is started.
+    larodDisconnect(&(provider->conn), NULL);
+
+    g_cond_clear(&provider->slot_cond);
+    g_mutex_clear(&provider->slot_mutex);
+
+    free(provider);
+}
+
+// Get the format, input resolution and pitch of a model
+static void
+get_model_input_info(model_provider_t* provider, larodModel* model, img_info_t* img_info) {
+    larodError* error = NULL;
+
+    // setup a temporary input tensor to be able to
+    // get the model information
+    larodTensor** input_tensors = NULL;
+    size_t num_inputs           = 0;
+    input_tensors = larodAllocModelInputs(provider->conn, model, 0, &num_inputs, NULL, &error);
+    if (!input_tensors) {
+        panic("%s: Failed retrieving input tensors: %s", __func__, error->msg);
+    }
+    if (num_inputs > 1) {
+        panic("%s: Currently only 1 input tensor is supported but %zu was received",
+              __func__,
+              num_inputs);
+    }
+
+    const larodTensorDims* input_dims = larodGetTensorDims(input_tensors[0], &error);
+    if (!input_dims) {
+        panic("%s: Failed retrieving dim for input tensor: %s", __func__, error->msg);
+    }
+    if (input_dims->len != 4) {
+        panic("%s: Only input dim = 4 supported %zu", __func__, input_dims->len);
+    }
+    const char* model_format_str = "RGB";
+    if (g_strcmp0(provider->device_name, "ambarella-cvflow") == 0) {
+        model_format_str = "PLANAR RGB";
+        img_info->format = VDO_FORMAT_PLANAR_RGB;
+        img_info->width  = input_dims->dims[3];
+        img_info->height = input_dims->dims[2];
+    } else {
+        img_info->format = VDO_FORMAT_RGB;
+        img_info->width  = input_dims->dims[2];
+        img_info->height = input_dims->dims[1];
+    }
+    syslog(LOG_INFO,
+           "Detected model format %s and input resolution %ux%u",
+           model_format_str,
+           img_info->width,
+           img_info->height);
+    const larodTensorPitches* input_pitches = larodGetTensorPitches(input_tensors[0], &error);
+    if (!input_pitches) {
+        panic("%s: Failed retrieving pitches for input tensor: %s", __func__, error->msg);
+    }
+
+    if (img_info->format == VDO_FORMAT_RGB) {
+        img_info->pitch = input_pitches->pitches[2];
+    } else if (img_info->format == VDO_FORMAT_PLANAR_RGB) {
+        img_info->pitch = input_pitches->pitches[3];
+    } else {
+        panic("%s: Invalid model format %u", __func__, img_info->format);
+    }
+    larodDestroyTensors(provider->conn, &input_tensors, num_inputs, &error);
+}
+
+model_provider_t* model_provider_new(char* model_file,
+                                     char* device_name,
+                                     const char* model_name,
+                                     size_t* num_output_tensors) {
+    model_provider_t* provider = calloc(1, sizeof(model_provider_t));
+    if (!provider) {
+        panic("%s: Unable to allocate model_provider_t: %s", __func__, strerror(errno));
+    }
+
+    larodError* error = NULL;
+
+    if (!larodConnect(&provider->conn, &error)) {
+        panic("%s: Could not connect to larod: %s", __func__, error->msg);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &provider->created_ts);
+    provider->model_name = model_name;
+    provider->crop_map   = NULL;
+    g_mutex_init(&provider->slot_mutex);
+    g_cond_init(&provider->slot_cond);
+    // Run with a single slot until model_provider_set_inference_slots is called
+    provider->nbr_slots = 1;
+    provider->models[0]  = create_inference_model(provider, 0, model_file, device_name);
+    provider->nbr_models = 1;
+    get_model_input_info(provider, provider->models[0], &provider->inputs[0].img_info);
+    provider->model_inputs[0] = 0;
+    provider->nbr_inputs      = 1;
+
+    // The output tensors will be used for the inference job request
+    setup_slot_output_tensors(provider, &provider->slots[0], 0);
+    *num_output_tensors = provider->num_outputs[0];
+
+    return provider;
+}
+
+size_t model_provider_add_model(model_provider_t* provider,
+                                char* model_file,
+                                size_t* num_output_tensors) {
+    img_info_t img_info = {0};
+    size_t model_index  = provider->nbr_models;
+
+    if (model_index == MAX_NBR_MODELS) {
+        panic("%s: Can not add more than %d models", __func__, MAX_NBR_MODELS);
+    }
+    // The job requests and preprocessing are set up from the image metadata
+    if (provider->input_cache.conn) {
+        panic("%s: Models must be added before the image metadata", __func__);
+    }
+    larodModel* model =
+        create_inference_model(provider, model_index, model_file, provider->device_name);
+    // Models with the same input share the preprocessed frames
+    get_model_input_info(provider, model, &img_info);
+    size_t input_index = 0;
+    while (input_index < provider->nbr_inputs) {
+        img_info_t* input_info = &provider->inputs[input_index].img_info;
+        if (img_info.format == input_info->format && img_info.width == input_info->width &&
+            img_info.height == input_info->height && img_info.pitch == input_info->pitch) {
+            break;
+        }
+        input_index++;
+    }
+    if (input_index == provider->nbr_inputs) {
+        syslog(LOG_INFO, "Model %s gets its own preprocessing", model_file);
+        provider->inputs[input_index].img_info = img_info;
+        provider->nbr_inputs++;
+    }
+    provider->models[model_index]       = model;
+    provider->model_inputs[model_index] = input_index;
+    provider->nbr_models++;
+
+    for (size_t i = 0; i < provider->nbr_slots; i++) {
+        setup_slot_output_tensors(provider, &provider->slots[i], model_index);
+    }
+    *num_output_tensors = provider->num_outputs[model_index];
+
+    return model_index;
+}
+
+bool model_provider_set_inference_slots(model_provider_t* provider, size_t nbr_slots) {
+    if (nbr_slots < 1 || nbr_slots > MAX_NBR_INFERENCE_SLOTS) {
+        panic("%s: Invalid number of inference slots %zu", __func__, nbr_slots);
+    }
+    // The preprocessing tensors of every slot are set up from the image metadata
+    if (provider->input_cache.conn) {
+        panic("%s: Inference slots must be set before the image metadata", __func__);
+    }
+    for (size_t i = 0; i < nbr_slots; i++) {
+        for (size_t j = 0; j < provider->nbr_models; j++) {
+            if (!provider->slots[i].output_tensors[j]) {
+                setup_slot_output_tensors(provider, &provider->slots[i], j);
+            }
+        }
+    }
+    provider->nbr_slots = nbr_slots;
+    syslog(LOG_INFO, "Using %zu inference slots", nbr_slots);
+    return true;
+}
+
+model_output_set_t* model_provider_new_output_set(model_provider_t* provider, size_t model_index) {
+    if (model_index >= provider->nbr_models) {
+        panic("%s: Invalid model index %zu", __func__, model_index);
+    }
+    model_output_set_t* output_set = calloc(1, sizeof(model_output_set_t));
+    if (!output_set) {
+        panic("%s: Unable to allocate output set: %s", __func__, strerror(errno));
+    }
+    alloc_output_tensors(provider, model_index, &output_set->tensors, &output_set->outputs);
+    return output_set;
+}
+
+void model_provider_swap_output_set(model_provider_t* provider,
+                                    size_t model_index,
+                                    model_output_set_t* output_set) {
+    larodError* error  = NULL;
+    model_slot_t* slot = &provider->slots[0];
+
+    if (model_index >= provider->nbr_models) {
+        panic("%s: Invalid model index %zu", __func__, model_index);
+    }
+    larodTensor** tensors          = slot->output_tensors[model_index];
+    model_tensor_output_t* outputs = slot->model_output_tensors[model_index];
+
+    slot->output_tensors[model_index]       = output_set->tensors;
+    slot->model_output_tensors[model_index] = output_set->outputs;
+    output_set->tensors                     = tensors;
+    output_set->outputs                     = outputs;
+
+    // The job request is created with the first tensors
+    if (slot->inf_req[model_index] &&
+        !larodSetJobRequestOutputs(slot->inf_req[model_index],
+                                   slot->output_tensors[model_index],
+                                   provider->num_outputs[model_index],
+                                   &error)) {
+        panic("%s: Failed to set output job request: %s", __func__, error->msg);
+    }
+}
+
+void model_provider_destroy_output_set(model_provider_t* provider,
+                                       size_t model_index,
+                                       model_output_set_t* output_set) {
+    if (!output_set) {
+        return;
+    }
+    free_output_tensors(provider, model_index, &output_set->tensors, &output_set->outputs);
+    free(output_set);
+}
+
+img_info_t model_provider_get_model_metadata(model_provider_t* provider) {
+    return provider->inputs[0].img_info;
+}
+
+bool model_provider_update_image_metadata(model_provider_t* provider, VdoMap* image_map) {
+    img_info_t img_info = {0};
+
+    const char* buffer_type = vdo_map_get_string(image_map, "buffer.type", NULL, "memfd");
+    img_info.format         = vdo_map_get_uint32(image_map, "format", 0);
+    img_info.width          = vdo_map_get_uint32(image_map, "width", 0);
+    img_info.height         = vdo_map_get_uint32(image_map, "height", 0);
+    img_info.pitch          = vdo_map_get_uint32(image_map, "pitch", 0);
+    img_info.nbr_buffers    = vdo_map_get_uint32(image_map, "buffer.count", 0);
+    img_info.dmabuf         = true;
+    if (!g_strcmp0(buffer_type, "vmem")) {
+        img_info.dmabuf = false;
+    }
+
+    larodTensorLayout tensor_layout = LAROD_TENSOR_LAYOUT_UNSPECIFIED;
+    if (img_info.format == VDO_FORMAT_RGB) {
+        tensor_layout = LAROD_TENSOR_LAYOUT_NHWC;
+    } else if (img_info.format == VDO_FORMAT_PLANAR_RGB) {
+        tensor_layout = LAROD_TENSOR_LAYOUT_NCHW;
+    } else if (img_info.format == VDO_FORMAT_YUV) {
+        tensor_layout = LAROD_TENSOR_LAYOUT_420SP;
+    }
+    if (tensor_layout == LAROD_TENSOR_LAYOUT_UNSPECIFIED) {
+        panic("%s: Tensor layout unspecified for format %u", __func__, img_info.format);
+    }
+
+    // The frames are preprocessed for each input that they do not fit
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        model_input_t* input     = &provider->inputs[i];
+        input->use_preprocessing = img_info.format != input->img_info.format ||
+                                   img_info.width != input->img_info.width ||
+                                   img_info.height != input->img_info.height;
+        if (!input->use_preprocessing) {
+            if (input->img_info.pitch != img_info.pitch) {
+                panic("%s: Incorrect stream pitch %u != %u",
+                      __func__,
+                      img_info.pitch,
+                      input->img_info.pitch);
+            }
+        } else if (!model_preprocessing_setup(provider, i, &img_info)) {
+            panic("%s: Failed to setup preprocessing", __func__);
+        }
+    }
+    // The input tensors for the images from vdo are created when a buffer is
+    // used for the first time
+    model_tensor_cache_init(&provider->input_cache, provider->conn, tensor_layout, &img_info);
+
+    return true;
+}
+
+void model_provider_clear_input_cache(model_provider_t* provider) {
+    // The buffers from vdo may have been reallocated
+    model_tensor_cache_clear(&provider->input_cache);
+}
+
+bool model_provider_set_crop(model_provider_t* provider,
+                             unsigned int x,
+                             unsigned int y,
+                             unsigned int width,
+                             unsigned int height) {
+    larodError* error = NULL;
+
+    // The crop is made by the preprocessing job, which then scales the
+    // cropped area to the input size of the model
+    for (size_t i = 0; i < provider->nbr_inputs; i++) {
+        if (!provider->inputs[i].use_preprocessing) {
+            panic("%s: Cropping is only supported when the image is preprocessed", __func__);
+        }
+    }
+    if (!provider->crop_map) {
+        provider->crop_map = larodCreateMap(&error);
+        if (!provider->crop_map) {
+            panic("%s: Could not create crop larodMap %s", __func__, error->msg);
+        }
+    }
+    if (!larodMapSetIntArr4(provider->crop_map, "image.input.crop", x, y, width, height, &error)) {
+        panic("%s: Failed setting crop parameters: %s", __func__, error->msg);
+    }
+    // The job requests that have not been created yet get the crop map when
+    // they are created
+    for (size_t i = 0; i < provider->nbr_slots; i++) {
+        for (size_t j = 0; j < provider->nbr_inputs; j++) {
+            larodJobRequest* pp_req = provider->slots[i].pp_req[j];
+            if (pp_req && !larodSetJobRequestParams(pp_req, provider->crop_map, &error)) {
+                panic("%s: Failed to set crop of job request: %s", __func__, error->msg);
+            }
+        }
+    }
+    return true;
+}
+
+void model_provider_set_stage_stats(model_provider_t* provider, stage_stats_t* stage_stats) {
+    provider->stage_stats = stage_stats;
+}
@@ -0,0 +1,235 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <time.h>
+
+#include "img_util.h"
+#include "model_tensor_cache.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+#include "larod.h"
+#include "vdo-buffer.h"
+#include "vdo-error.h"
+#include "vdo-frame.h"
+#include "vdo-types.h"
+
+typedef struct model_tensor_output {
+    int fd;
+    void* data;
+    size_t size;
+    larodTensorDataType datatype;
+    uint64_t timestamp;
+} model_tensor_output_t;
+
+// Output tensors of a model that are not used by any slot. They can be swapped
+// with the output tensors of slot 0 to keep the output of a frame while the
+// model is run on the next frame.
+typedef struct model_output_set {
+    larodTensor** tensors;
+    model_tensor_output_t* outputs;
+} model_output_set_t;
+
+// Upper limit of models that can be run on the same preprocessed frames
+#define MAX_NBR_MODELS 4
+
+// Upper limit of frames that can be processed by larod at the same time
+#define MAX_NBR_INFERENCE_SLOTS 4
+
+typedef enum model_slot_state {
+    MODEL_SLOT_FREE,
+    MODEL_SLOT_PREPROCESSING,
+    MODEL_SLOT_PREPROCESSED,
+    MODEL_SLOT_INFERRING,
+    MODEL_SLOT_DONE,
+    MODEL_SLOT_FAILED,
+} model_slot_state_t;
+
+typedef enum model_inference_status {
+    // The jobs for the frame were started
+    MODEL_INFERENCE_STARTED,
+    // The frame was skipped since larod had no power a moment ago
+    MODEL_INFERENCE_SKIPPED,
+    // A job could not be started since larod has no power
+    MODEL_INFERENCE_NO_POWER,
+} model_inference_status_t;
+
+// The input of one or more models. Models with the same input share it, so a
+// frame is only preprocessed once for them.
+typedef struct model_input {
+    img_info_t img_info;
+    // Set when the frames from vdo do not fit the input and are preprocessed
+    bool use_preprocessing;
+    size_t pp_num_outputs;
+    larodModel* pp_model;
+} model_input_t;
+
+struct model_provider;
+
+// One frame in flight. Each slot has its own preprocessing output and
+// inference output tensors so that several frames can be processed at once.
+// The inference variables are indexed by model and the preprocessing
+// variables by model input.
+typedef struct model_slot {
+    struct model_provider* provider;
+
+    larodTensor** output_tensors[MAX_NBR_MODELS];
+    model_tensor_output_t* model_output_tensors[MAX_NBR_MODELS];
+    larodJobRequest* inf_req[MAX_NBR_MODELS];
+
+    larodTensor** pp_output_tensors[MAX_NBR_MODELS];
+    larodJobRequest* pp_req[MAX_NBR_MODELS];
+
+    VdoBuffer* vdo_buf;
+    uint64_t timestamp;
+    model_slot_state_t state;
+    larodErrorCode error_code;
+    // Number of started larod jobs that have not finished yet
+    size_t nbr_pending_jobs;
+    // When the running jobs were started, from stage_stats_now_ns
+    uint64_t jobs_started_ns;
+} model_slot_t;
+
+typedef struct model_provider {
+    larodConnection* conn;
+    const char* device_name;
+    // Prefix of the names that the models are loaded with in larod
+    const char* model_name;
+
+    // Inference variables, one entry for each model. All models are run on
+    // the same frames, each on the preprocessed frame of its input.
+    size_t nbr_models;
+    size_t num_outputs[MAX_NBR_MODELS];
+    larodModel* models[MAX_NBR_MODELS];
+    int larod_model_fds[MAX_NBR_MODELS];
+    // Index in inputs of the input of each model
+    size_t model_inputs[MAX_NBR_MODELS];
+    // Number of models that were already loaded in larod
+    size_t cached_models;
+    // Used to measure the time to the first inference
+    struct timespec created_ts;
+    bool has_inferred;
+
+    // Preprocessing variables, one entry for each distinct model input. The
+    // first input is the one of the first model.
+    size_t nbr_inputs;
+    model_input_t inputs[MAX_NBR_MODELS];
+    larodMap* crop_map;
+
+    // Tracked input tensors for the buffers from vdo
+    model_tensor_cache_t input_cache;
+    // Latency of the preprocessing and inference, NULL if not measured
+    stage_stats_t* stage_stats;
+
+    // Slot 0 is used by model_run_inference(). All slots are used in turn by
+    // model_run_inference_async() and are handed back in the same order by
+    // model_wait_inference().
+    model_slot_t slots[MAX_NBR_INFERENCE_SLOTS];
+    size_t nbr_slots;
+    size_t next_slot;
+    size_t oldest_slot;
+    size_t nbr_in_flight;
+    size_t ready_slot;
+    // When there is no power for larod, frames are skipped until the deadline
+    int nbr_power_retries;
+    uint64_t power_deadline_ms;
+    uint64_t no_power_since_ms;
+    // Until when the time without power has been added to the stage statistics
+    uint64_t no_power_recorded_ms;
+    uint64_t nbr_skipped_frames;
+    // Protects the slot states which are updated from larod callbacks
+    GMutex slot_mutex;
+    GCond slot_cond;
+} model_provider_t;
+
+bool model_run_inference(model_provider_t* provider, VdoBuffer* vdo_buf);
+
+model_inference_status_t model_run_inference_async(model_provider_t* provider, VdoBuffer* vdo_buf);
+
+bool model_has_free_slot(model_provider_t* provider);
+
+bool model_has_pending_inference(model_provider_t* provider);
+
+bool model_wait_inference(model_provider_t* provider, VdoBuffer** done_buf);
+
+void model_discard_inference(model_provider_t* provider, VdoBuffer** done_buf);
+
+// The preprocessing and inference stages of the pipeline, the context is the
+// model provider. model_infer_ops runs the models on the frame that
+// model_preprocess_ops has preprocessed, like model_run_inference().
+extern const pipeline_preprocess_ops_t model_preprocess_ops;
+extern const pipeline_infer_ops_t model_infer_ops;
+// Preprocesses and runs the models on as many frames at the same time as
+// there are inference slots, like model_run_inference_async(). Used without
+// a preprocessing stage.
+extern const pipeline_infer_ops_t model_infer_async_ops;
+
+bool model_get_tensor_output_info(model_provider_t* provider,
+                                  unsigned int tensor_output_index,
+                                  model_tensor_output_t* tensor_output);
+
+bool model_get_model_output_info(model_provider_t* provider,
+                                 size_t model_index,
+                                 unsigned int tensor_output_index,
+                                 model_tensor_output_t* tensor_output);
+
+img_info_t model_provider_get_model_metadata(model_provider_t* provider);
+
+model_output_set_t* model_provider_new_output_set(model_provider_t* provider, size_t model_index);
+
+// Give the output tensors of slot 0 that model_run_inference() has filled to
+// the set, and let the model write to the tensors of the set instead. Must
+// not be called while there are jobs in flight.
+void model_provider_swap_output_set(model_provider_t* provider,
+                                    size_t model_index,
+                                    model_output_set_t* output_set);
+
+void model_provider_destroy_output_set(model_provider_t* provider,
+                                       size_t model_index,
+                                       model_output_set_t* output_set);
+
+// Add a model that is run on the same frames as the first model and return its
+// index. A model with another input than the earlier models gets its own
+// preprocessing. Must be called before the image metadata is updated.
+size_t model_provider_add_model(model_provider_t* provider,
+                                char* model_file,
+                                size_t* num_output_tensors);
+
+bool model_provider_set_inference_slots(model_provider_t* provider, size_t nbr_slots);
+
+bool model_provider_update_image_metadata(model_provider_t* provider, VdoMap* image_map);
+
+void model_provider_clear_input_cache(model_provider_t* provider);
+
+// Only run the model on an area of the image, which is scaled to the input
+// size of the model. Only possible when the image is preprocessed and must
+// not be called while there are jobs in flight.
+bool model_provider_set_crop(model_provider_t* provider,
+                             unsigned int x,
+                             unsigned int y,
+                             unsigned int width,
+                             unsigned int height);
+
+void model_provider_set_stage_stats(model_provider_t* provider, stage_stats_t* stage_stats);
+
+model_provider_t* model_provider_new(char* model_file,
+                                     char* device_name,
+                                     const char* model_name,
+                                     size_t* num_output_tensors);
+
+void model_provider_destroy(model_provider_t* provider);
@@ -18,7 +18,9 @@
 #include "panic.h"
 #include <syslog.h>
 
-static larodModel* create_preprocessing_model(model_provider_t* provider, img_info_t* img_info) {
+static larodModel* create_preprocessing_model(model_provider_t* provider,
+                                              img_info_t* output_info,
+                                              img_info_t* img_info) {
     larodError* error = NULL;
     char* input_format_str;
     char* output_format_str;
@@ -36,7 +38,7 @@ static larodModel* create_preprocessing_model(model_provider_t* provider, img_in
         default:
             panic("%s: Invalid input format %u", __func__, img_info->format);
     }
-    switch (provider->img_info->format) {
+    switch (output_info->format) {
         case VDO_FORMAT_YUV:
             output_format_str = "nv12";
             break;
@@ -47,7 +49,7 @@ static larodModel* create_preprocessing_model(model_provider_t* provider, img_in
             output_format_str = "rgb-planar";
             break;
         default:
-            panic("%s: Invalid output format %u", __func__, provider->img_info->format);
+            panic("%s: Invalid output format %u", __func__, output_info->format);
     }
     syslog(LOG_INFO,
            "Use preprocessing with input format %s and output format %s",
@@ -70,14 +72,14 @@ static larodModel* create_preprocessing_model(model_provider_t* provider, img_in
     if (!larodMapSetStr(map, "image.output.format", output_format_str, &error)) {
         panic("%s: Failed setting preprocessing parameters: %s", __func__, error->msg);
     }
-    if (!larodMapSetInt(map, "image.output.row-pitch", provider->img_info->pitch, &error)) {
+    if (!larodMapSetInt(map, "image.output.row-pitch", output_info->pitch, &error)) {
         panic("%s: Failed setting preprocessing parameters: %s", __func__, error->msg);
     }
 
     if (!larodMapSetIntArr2(map,
                             "image.output.size",
-                            provider->img_info->width,
-                            provider->img_info->height,
+                            output_info->width,
+                            output_info->height,
                             &error)) {
         panic("%s: Failed setting preprocessing parameters: %s", __func__, error->msg);
     }
@@ -85,8 +87,8 @@ static larodModel* create_preprocessing_model(model_provider_t* provider, img_in
            "Use preprocessing with input size %ux%u and output size %ux%u",
            img_info->width,
            img_info->height,
-           provider->img_info->width,
-           provider->img_info->height);
+           output_info->width,
+           output_info->height);
 
     // Use libyuv as image preprocessing backend
     const larodDevice* pp_device = larodGetDevice(provider->conn, "cpu-proc", 0, &error);
@@ -104,26 +106,33 @@ static larodModel* create_preprocessing_model(model_provider_t* provider, img_in
     return model;
 }
 
-bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info) {
-    larodError* error  = NULL;
-    provider->pp_model = create_preprocessing_model(provider, img_info);
-    // Create the output tensors for the preprocessing
-    provider->pp_output_tensors =
-        larodAllocModelOutputs(provider->conn,
-                               provider->pp_model,
-                               LAROD_FD_PROP_READWRITE | LAROD_FD_PROP_MAP,
-                               &provider->pp_num_outputs,
-                               NULL,
-                               &error);
-    if (!provider->pp_output_tensors) {
-        panic("%s: Failed retrieving output tensors: %s", __func__, error->msg);
-    }
-    if (provider->pp_num_outputs > 1) {
+bool model_preprocessing_setup(model_provider_t* provider,
+                               size_t input_index,
+                               img_info_t* img_info) {
+    larodError* error    = NULL;
+    model_input_t* input = &provider->inputs[input_index];
+    input->pp_model      = create_preprocessing_model(provider, &input->img_info, img_info);
+    // Create the output tensors for the preprocessing, one set for each
+    // inference slot since they are also the input of the inference
+    for (size_t i = 0; i < provider->nbr_slots; i++) {
+        provider->slots[i].pp_output_tensors[input_index] =
+            larodAllocModelOutputs(provider->conn,
+                                   input->pp_model,
+                                   LAROD_FD_PROP_READWRITE | LAROD_FD_PROP_MAP,
+                                   &input->pp_num_outputs,
+                                   NULL,
+                                   &error);
+        if (!provider->slots[i].pp_output_tensors[input_index]) {
+            panic("%s: Failed retrieving output tensors: %s", __func__, error->msg);
+        }
+    }
+    larodTensor** pp_output_tensors = provider->slots[0].pp_output_tensors[input_index];
+    if (input->pp_num_outputs > 1) {
         panic("%s: Currently only 1 pp output tensor is supported but %zu was received",
               __func__,
-              provider->pp_num_outputs);
+              input->pp_num_outputs);
     }
-    const larodTensorDims* output_dims = larodGetTensorDims(provider->pp_output_tensors[0], &error);
+    const larodTensorDims* output_dims = larodGetTensorDims(pp_output_tensors[0], &error);
     if (!output_dims) {
         panic("%s: Failed retrieving dims for pp output tensor: %s", __func__, error->msg);
     }
@@ -131,8 +140,7 @@ bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info)
         panic("%s: Only output dim = 4 supported %zu", __func__, output_dims->len);
     }
 
-    const larodTensorPitches* output_pitches =
-        larodGetTensorPitches(provider->pp_output_tensors[0], &error);
+    const larodTensorPitches* output_pitches = larodGetTensorPitches(pp_output_tensors[0], &error);
     if (!output_pitches) {
         panic("%s: Failed retrieving pitches for pp output tensor: %s", __func__, error->msg);
     }
@@ -140,8 +148,8 @@ bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info)
         panic("%s: Only output pitches = 4 supported %zu", __func__, output_pitches->len);
     }
     size_t rgb_buffer_size = 0;
-    size_t expected_size   = 3 * provider->img_info->width * provider->img_info->height;
-    if (!larodGetTensorByteSize(provider->pp_output_tensors[0], &rgb_buffer_size, &error)) {
+    size_t expected_size   = 3 * input->img_info.width * input->img_info.height;
+    if (!larodGetTensorByteSize(pp_output_tensors[0], &rgb_buffer_size, &error)) {
         panic("%s: Could not get byte size for pp output tensor: %s", __func__, error->msg);
     }
     if (expected_size != rgb_buffer_size) {
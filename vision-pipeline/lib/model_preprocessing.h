@@ -21,4 +21,8 @@
 #include "larod.h"
 #include "model.h"
 
-bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info);
+// Set up the preprocessing of the frames from vdo, described by img_info, to
+// the model input with index input_index
+bool model_preprocessing_setup(model_provider_t* provider,
+                               size_t input_index,
+                               img_info_t* img_info);
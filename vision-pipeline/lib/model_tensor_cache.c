@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "model_tensor_cache.h"
+#include "panic.h"
+
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+void model_tensor_cache_init(model_tensor_cache_t* cache,
+                             larodConnection* conn,
+                             larodTensorLayout layout,
+                             const img_info_t* img_info) {
+    memset(cache, 0, sizeof(model_tensor_cache_t));
+    cache->conn   = conn;
+    cache->layout = layout;
+    cache->width  = img_info->width;
+    cache->height = img_info->height;
+    cache->pitch  = img_info->pitch;
+    cache->dmabuf = img_info->dmabuf;
+}
+
+// The input tensor is used either
+// 1. as input to preprocssing
+// 2. as input to the inference if preprocessing is not needed
+static larodTensor** create_input_tensor(model_tensor_cache_t* cache) {
+    larodError* error = NULL;
+
+    larodTensor** input_tensors = larodCreateTensors(1, &error);
+    if (!input_tensors) {
+        panic("%s: Failed to create model input %s", __func__, error->msg);
+    }
+    if (!larodSetTensorDataType(input_tensors[0], LAROD_TENSOR_DATA_TYPE_UINT8, &error)) {
+        panic("%s: Failed to set data type %s", __func__, error->msg);
+    }
+    if (!larodSetTensorLayout(input_tensors[0], cache->layout, &error)) {
+        panic("%s: Failed to set tensor layout %s", __func__, error->msg);
+    }
+    if (!larodBuildTensorDims(input_tensors[0],
+                              cache->layout,
+                              cache->width,
+                              cache->height,
+                              3,
+                              &error)) {
+        panic("%s: Failed to build tensor dims %s", __func__, error->msg);
+    }
+    if (!larodBuildTensorPitches(input_tensors[0],
+                                 cache->layout,
+                                 cache->pitch,
+                                 cache->height,
+                                 3,
+                                 &error)) {
+        panic("%s: Failed to build tensor pitches %s", __func__, error->msg);
+    }
+    if (!larodSetTensorFdProps(input_tensors[0],
+                               LAROD_FD_PROP_MAP | LAROD_FD_PROP_DMABUF,
+                               &error)) {
+        panic("%s: Failed to set fd props %s", __func__, error->msg);
+    }
+    return input_tensors;
+}
+
+static void track_input_tensor(model_tensor_cache_t* cache, model_tensor_cache_entry_t* entry) {
+    larodError* error = NULL;
+    int64_t offset    = entry->offset;
+    int tensor_fd     = -1;
+
+    // larod needs a dma-buf, a vmem buffer is converted to a new fd while a
+    // dma-buf fd is duplicated so that vdo can close its fd at any time
+    if (!cache->dmabuf) {
+        tensor_fd = larodConvertVmemFdToDmabuf(entry->fd, offset, &error);
+        if (tensor_fd == LAROD_INVALID_FD) {
+            panic("%s: Failed to get fd from larod: %s", __func__, error->msg);
+        }
+        offset = 0;
+    } else {
+        tensor_fd = dup(entry->fd);
+        if (tensor_fd < 0) {
+            panic("%s: Failed to dup fd", __func__);
+        }
+    }
+    larodTensor** tensors = create_input_tensor(cache);
+    if (!larodSetTensorFd(tensors[0], tensor_fd, &error)) {
+        panic("%s: Failed to set fd for tensor: %s", __func__, error->msg);
+    }
+    if (!larodSetTensorFdOffset(tensors[0], offset, &error)) {
+        panic("%s: Failed to set offset for tensor: %s", __func__, error->msg);
+    }
+    if (!larodSetTensorFdSize(tensors[0], entry->capacity, &error)) {
+        panic("%s: Failed to set size for tensor: %s", __func__, error->msg);
+    }
+    if (!larodTrackTensor(cache->conn, tensors[0], &error)) {
+        panic("%s: Failed to track tensor: %s", __func__, error->msg);
+    }
+    entry->tensors   = tensors;
+    entry->tensor_fd = tensor_fd;
+}
+
+static void release_entry(model_tensor_cache_t* cache, model_tensor_cache_entry_t* entry) {
+    larodError* error = NULL;
+
+    // Destroying the tensor also makes larod stop tracking it
+    if (!larodDestroyTensors(cache->conn, &entry->tensors, 1, &error)) {
+        syslog(LOG_WARNING, "Failed to destroy input tensor: %s", error->msg);
+        larodClearError(&error);
+    }
+    if (entry->tensor_fd >= 0) {
+        close(entry->tensor_fd);
+    }
+    entry->tensor_fd = -1;
+}
+
+larodTensor** model_tensor_cache_get(model_tensor_cache_t* cache, VdoBuffer* vdo_buf) {
+    int fd = vdo_buffer_get_fd(vdo_buf);
+    if (fd < 0) {
+        panic("%s: fd from vdo_buffer_get_fd is negative", __func__);
+    }
+    int64_t offset  = vdo_buffer_get_offset(vdo_buf);
+    size_t capacity = vdo_buffer_get_capacity(vdo_buf);
+
+    cache->nbr_lookups++;
+    for (size_t i = 0; i < cache->nbr_entries; i++) {
+        model_tensor_cache_entry_t* entry = &cache->entries[i];
+        if (entry->fd == fd && entry->offset == offset && entry->capacity == capacity) {
+            entry->last_used = cache->nbr_lookups;
+            cache->hits++;
+            return entry->tensors;
+        }
+    }
+    cache->misses++;
+
+    model_tensor_cache_entry_t* entry = NULL;
+    if (cache->nbr_entries < MAX_NBR_CACHED_TENSORS) {
+        entry = &cache->entries[cache->nbr_entries++];
+    } else {
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->nbr_entries; i++) {
+            if (cache->entries[i].last_used < entry->last_used) {
+                entry = &cache->entries[i];
+            }
+        }
+        release_entry(cache, entry);
+        cache->evictions++;
+    }
+    entry->fd        = fd;
+    entry->offset    = offset;
+    entry->capacity  = capacity;
+    entry->last_used = cache->nbr_lookups;
+    track_input_tensor(cache, entry);
+
+    syslog(LOG_INFO,
+           "Tracked input tensor for fd %d, cache hits %llu misses %llu evictions %llu",
+           fd,
+           (unsigned long long)cache->hits,
+           (unsigned long long)cache->misses,
+           (unsigned long long)cache->evictions);
+    return entry->tensors;
+}
+
+void model_tensor_cache_clear(model_tensor_cache_t* cache) {
+    for (size_t i = 0; i < cache->nbr_entries; i++) {
+        release_entry(cache, &cache->entries[i]);
+    }
+    cache->nbr_entries = 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles the larod input tensors for the buffers from vdo.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "img_util.h"
+#include "larod.h"
+#include "vdo-buffer.h"
+
+// The least recently used tensor is destroyed when the cache is full. Keep
+// this larger than the number of frames that can be in larod at the same time
+// so that a tensor is never destroyed while a job is using it.
+#define MAX_NBR_CACHED_TENSORS 8
+
+typedef struct model_tensor_cache_entry {
+    // The vdo buffer the tensor was created for
+    int fd;
+    int64_t offset;
+    size_t capacity;
+
+    larodTensor** tensors;
+    // The fd set on the tensor, closed when the entry is evicted
+    int tensor_fd;
+    uint64_t last_used;
+} model_tensor_cache_entry_t;
+
+typedef struct model_tensor_cache {
+    larodConnection* conn;
+
+    // Properties of the input tensors that are created
+    larodTensorLayout layout;
+    unsigned int width;
+    unsigned int height;
+    unsigned int pitch;
+    bool dmabuf;
+
+    model_tensor_cache_entry_t entries[MAX_NBR_CACHED_TENSORS];
+    size_t nbr_entries;
+    uint64_t nbr_lookups;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} model_tensor_cache_t;
+
+/**
+ * @brief Set up an empty cache
+ *
+ * @param cache     The cache to set up
+ * @param conn      The larod connection the tensors are tracked on
+ * @param layout    The layout of the images from vdo
+ * @param img_info  The format of the images from vdo
+ */
+void model_tensor_cache_init(model_tensor_cache_t* cache,
+                             larodConnection* conn,
+                             larodTensorLayout layout,
+                             const img_info_t* img_info);
+
+/**
+ * @brief Get the tracked input tensor for a vdo buffer
+ *
+ * A new tensor is created and tracked the first time a buffer is seen.
+ *
+ * @param cache    The cache to look in
+ * @param vdo_buf  The buffer from vdo
+ *
+ * @return The input tensors for the buffer
+ */
+larodTensor** model_tensor_cache_get(model_tensor_cache_t* cache, VdoBuffer* vdo_buf);
+
+/**
+ * @brief Destroy all tensors in the cache
+ *
+ * Must not be called while a larod job is using one of the tensors.
+ *
+ * @param cache  The cache to clear
+ */
+void model_tensor_cache_clear(model_tensor_cache_t* cache);
@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "pipeline.h"
+
+// Give back all frames that the inference keeps
+static void drain_inference(const pipeline_t* pipeline) {
+    if (!pipeline->infer || !pipeline->infer->drain) {
+        return;
+    }
+    VdoBuffer* buffer = NULL;
+    while (pipeline->infer->drain(pipeline->infer_ctx, &buffer)) {
+        pipeline->source->release(pipeline->source_ctx, &buffer);
+    }
+}
+
+// Returns true if the frame goes on to the next stage, otherwise the frame has
+// been given back to the source or is kept by the stage
+static bool pass_on(const pipeline_t* pipeline, pipeline_status_t status, VdoBuffer** buffer) {
+    switch (status) {
+        case PIPELINE_PENDING:
+            return false;
+        case PIPELINE_SKIP:
+            pipeline->source->release(pipeline->source_ctx, buffer);
+            return false;
+        case PIPELINE_SKIP_ALL:
+            pipeline->source->release(pipeline->source_ctx, buffer);
+            drain_inference(pipeline);
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void reset_stages(const pipeline_t* pipeline) {
+    if (pipeline->preprocess && pipeline->preprocess->reset) {
+        pipeline->preprocess->reset(pipeline->preprocess_ctx);
+    }
+    if (pipeline->infer && pipeline->infer->reset) {
+        pipeline->infer->reset(pipeline->infer_ctx);
+    }
+}
+
+int pipeline_run(const pipeline_t* pipeline, volatile sig_atomic_t* running) {
+    const pipeline_source_ops_t* source = pipeline->source;
+    stage_stats_t* stage_stats          = pipeline->stage_stats;
+    int exit_status                     = EXIT_SUCCESS;
+
+    uint64_t result_ts = stage_stats_now_ns();
+    // Time spent waiting for frames since the last result
+    uint64_t idle_ns = 0;
+    while (*running) {
+        uint64_t stage_ts = stage_stats_now_ns();
+        uint64_t wait_ts  = stage_ts;
+
+        source->wait(pipeline->source_ctx);
+        stage_ts = stage_stats_mark(stage_stats, STAGE_POLL_WAIT, stage_ts);
+        idle_ns += stage_ts - wait_ts;
+
+        VdoBuffer* buffer        = NULL;
+        pipeline_status_t status = source->fetch(pipeline->source_ctx, &buffer, &exit_status);
+        stage_stats_mark(stage_stats, STAGE_BUFFER_FETCH, stage_ts);
+        if (status == PIPELINE_STOP) {
+            break;
+        }
+        if (status != PIPELINE_CONTINUE) {
+            continue;
+        }
+
+        if (pipeline->preprocess) {
+            status = pipeline->preprocess->run(pipeline->preprocess_ctx, buffer);
+            if (!pass_on(pipeline, status, &buffer)) {
+                continue;
+            }
+        }
+        // With several frames in inference, the frame that comes out is an
+        // earlier frame than the one that went in
+        if (pipeline->infer) {
+            status = pipeline->infer->run(pipeline->infer_ctx, &buffer);
+            if (!pass_on(pipeline, status, &buffer)) {
+                continue;
+            }
+        }
+        if (pipeline->postprocess) {
+            pipeline->postprocess->run(pipeline->postprocess_ctx, buffer);
+        }
+        if (pipeline->sink) {
+            pipeline->sink->run(pipeline->sink_ctx);
+        }
+
+        // The time waiting for the source is not counted so that the
+        // framerate can be raised when the stages are faster
+        uint64_t now_ts          = stage_stats_now_ns();
+        unsigned int analysis_ms = (unsigned int)((now_ts - result_ts - idle_ns) / 1000000);
+        result_ts                = now_ts;
+        idle_ns                  = 0;
+
+        // Check if the framerate of the source should be changed
+        if (source->update_framerate(pipeline->source_ctx, analysis_ms)) {
+            drain_inference(pipeline);
+            if (source->flush(pipeline->source_ctx, &buffer, &exit_status) == PIPELINE_STOP) {
+                break;
+            }
+            // The buffers may have changed after the flush
+            reset_stages(pipeline);
+        } else {
+            stage_ts = stage_stats_now_ns();
+            source->release(pipeline->source_ctx, &buffer);
+            stage_stats_mark(stage_stats, STAGE_BUFFER_UNREF, stage_ts);
+        }
+        stage_stats_report_if_due(stage_stats);
+    }
+    drain_inference(pipeline);
+    return exit_status;
+}
@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file runs the frame loop of an application as a pipeline of
+ * stages. The source fetches the frames, the preprocessing and the inference
+ * run the model on them, the postprocessing parses the output of the model
+ * and the sink shows the result.
+ *
+ * Each stage is an ops table and a context that is passed to the ops. The
+ * library has the source in stream_source.h and the preprocessing and
+ * inference in model.h, the postprocessing and the sink depend on the model
+ * and are done by the application.
+ */
+
+#pragma once
+
+#include <signal.h>
+#include <stdbool.h>
+
+#include "stage_stats.h"
+#include "vdo-buffer.h"
+
+typedef enum pipeline_status {
+    // The frame goes on to the next stage
+    PIPELINE_CONTINUE,
+    // There is no frame for the next stage yet, the next frame is fetched
+    PIPELINE_PENDING,
+    // The frame is given back to the source and the next frame is fetched,
+    // e.g. when larod has no power
+    PIPELINE_SKIP,
+    // Like PIPELINE_SKIP, and the frames that the inference keeps are given
+    // back as well
+    PIPELINE_SKIP_ALL,
+    // The frame loop is stopped
+    PIPELINE_STOP,
+} pipeline_status_t;
+
+typedef struct pipeline_source_ops {
+    // Wait until a frame can be fetched
+    void (*wait)(void* source);
+    // Fetch the next frame. PIPELINE_PENDING when there was no frame after
+    // all, PIPELINE_STOP with the exit status of the application set when the
+    // stream has stopped.
+    pipeline_status_t (*fetch)(void* source, VdoBuffer** buffer, int* exit_status);
+    // Follow the analysis time of a frame with the framerate, returns true
+    // when the stream must be flushed
+    bool (*update_framerate)(void* source, unsigned int analysis_ms);
+    // Give the frame back and drop the frames of the old framerate, same
+    // return values as fetch
+    pipeline_status_t (*flush)(void* source, VdoBuffer** buffer, int* exit_status);
+    // Give a frame back to the source
+    void (*release)(void* source, VdoBuffer** buffer);
+} pipeline_source_ops_t;
+
+typedef struct pipeline_preprocess_ops {
+    // Prepare the input of the model from the frame, returns
+    // PIPELINE_CONTINUE or PIPELINE_SKIP
+    pipeline_status_t (*run)(void* preprocess, VdoBuffer* buffer);
+    // Called when the buffers of the source have changed after a flush, may
+    // be NULL
+    void (*reset)(void* preprocess);
+} pipeline_preprocess_ops_t;
+
+typedef struct pipeline_infer_ops {
+    // Run the model on the frame, returns PIPELINE_CONTINUE, PIPELINE_SKIP or
+    // PIPELINE_SKIP_ALL. A stage that runs several frames at the same time
+    // keeps the frame and returns PIPELINE_PENDING, or sets buffer to the
+    // oldest frame that has its output ready.
+    pipeline_status_t (*run)(void* infer, VdoBuffer** buffer);
+    // Give back a frame that the stage keeps without its output, returns
+    // false when it keeps no frames. May be NULL when frames are not kept.
+    bool (*drain)(void* infer, VdoBuffer** buffer);
+    // Same as the reset of the preprocessing, for an inference that also
+    // preprocesses the frames. May be NULL.
+    void (*reset)(void* infer);
+} pipeline_infer_ops_t;
+
+typedef struct pipeline_postprocess_ops {
+    // Parse the output of the model for the frame
+    void (*run)(void* postprocess, VdoBuffer* buffer);
+} pipeline_postprocess_ops_t;
+
+typedef struct pipeline_sink_ops {
+    // Show the result of the last postprocessed frame
+    void (*run)(void* sink);
+} pipeline_sink_ops_t;
+
+/**
+ * @brief The stages of the pipeline
+ *
+ * The source is required, the other stages are left out when they are NULL.
+ * The latency of the source is recorded by the pipeline, the other stages
+ * record their own latency since they may finish on other threads.
+ */
+typedef struct pipeline {
+    const pipeline_source_ops_t* source;
+    void* source_ctx;
+    const pipeline_preprocess_ops_t* preprocess;
+    void* preprocess_ctx;
+    const pipeline_infer_ops_t* infer;
+    void* infer_ctx;
+    const pipeline_postprocess_ops_t* postprocess;
+    void* postprocess_ctx;
+    const pipeline_sink_ops_t* sink;
+    void* sink_ctx;
+    // NULL if not measured
+    stage_stats_t* stage_stats;
+} pipeline_t;
+
+/**
+ * @brief Run the frame loop until it is stopped
+ *
+ * The analysis time that the framerate follows is the time between two
+ * results, without the time waiting for the source. When the inference runs
+ * several frames at the same time, that is what limits the framerate.
+ *
+ * @param pipeline  The stages
+ * @param running   The loop stops when this is cleared, e.g. from a signal handler
+ *
+ * @return The exit status of the application
+ */
+int pipeline_run(const pipeline_t* pipeline, volatile sig_atomic_t* running);
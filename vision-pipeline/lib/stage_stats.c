@@ -0,0 +1,318 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stage_stats.h"
+#include "panic.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+static const char* stage_names[NBR_STAGES] = {
+    [STAGE_POLL_WAIT]      = "poll_wait",
+    [STAGE_BUFFER_FETCH]   = "buffer_fetch",
+    [STAGE_PREPROCESSING]  = "preprocessing",
+    [STAGE_INFERENCE]      = "inference",
+    [STAGE_POSTPROCESSING] = "postprocessing",
+    [STAGE_BBOX_COMMIT]    = "bbox_commit",
+    [STAGE_BUFFER_UNREF]   = "buffer_unref",
+};
+
+uint64_t stage_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+// Small values get a bucket each, larger values are grouped by the position
+// of the highest set bit and then split by the following bits
+static size_t bucket_index(uint64_t value) {
+    if (value < STAGE_HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= STAGE_HISTOGRAM_MAX_BITS) {
+        return STAGE_HISTOGRAM_NBR_BUCKETS - 1;
+    }
+    int shift  = msb - STAGE_HISTOGRAM_SUB_BITS;
+    size_t sub = (size_t)(value >> shift) & (STAGE_HISTOGRAM_SUB_BUCKETS - 1);
+    return ((size_t)(shift + 1) * STAGE_HISTOGRAM_SUB_BUCKETS) + sub;
+}
+
+static uint64_t bucket_upper_limit(size_t index) {
+    if (index < STAGE_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    size_t shift = (index / STAGE_HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = index % STAGE_HISTOGRAM_SUB_BUCKETS;
+    return ((STAGE_HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+stage_stats_t* stage_stats_new(const char* dump_file, unsigned int report_interval_s) {
+    stage_stats_t* stats = calloc(1, sizeof(stage_stats_t));
+    if (!stats) {
+        panic("%s: Unable to allocate stage statistics: %s", __func__, strerror(errno));
+    }
+    for (size_t i = 0; i < NBR_STAGES; i++) {
+        stage_histogram_t* histogram = &stats->stages[i];
+        for (size_t j = 0; j < STAGE_HISTOGRAM_NBR_BUCKETS; j++) {
+            atomic_init(&histogram->buckets[j], 0);
+        }
+        atomic_init(&histogram->count, 0);
+        atomic_init(&histogram->sum_ns, 0);
+        atomic_init(&histogram->max_ns, 0);
+    }
+    atomic_init(&stats->dropped_frames, 0);
+    atomic_init(&stats->skipped_frames, 0);
+    atomic_init(&stats->no_power_ns, 0);
+    if (dump_file) {
+        stats->dump_file = strdup(dump_file);
+        if (!stats->dump_file) {
+            panic("%s: Unable to allocate dump file name: %s", __func__, strerror(errno));
+        }
+    }
+    stats->report_interval_ns = (uint64_t)report_interval_s * 1000000000;
+    stats->started_ns         = stage_stats_now_ns();
+    stats->last_report_ns     = stats->started_ns;
+    return stats;
+}
+
+void stage_stats_destroy(stage_stats_t* stats) {
+    if (!stats) {
+        return;
+    }
+    stage_stats_report(stats);
+    free(stats->dump_file);
+    free(stats);
+}
+
+void stage_stats_record(stage_stats_t* stats, stage_t stage, uint64_t elapsed_ns) {
+    if (!stats) {
+        return;
+    }
+    stage_histogram_t* histogram = &stats->stages[stage];
+
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_index(elapsed_ns)],
+                              1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, elapsed_ns, memory_order_relaxed);
+
+    uint_fast64_t max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+    while (elapsed_ns > max_ns &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max_ns,
+                                                  &max_ns,
+                                                  elapsed_ns,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+uint64_t stage_stats_mark(stage_stats_t* stats, stage_t stage, uint64_t start_ns) {
+    uint64_t now_ns = stage_stats_now_ns();
+    stage_stats_record(stats, stage, now_ns - start_ns);
+    return now_ns;
+}
+
+void stage_stats_add_dropped_frames(stage_stats_t* stats, unsigned int nbr_frames) {
+    if (!stats || nbr_frames == 0) {
+        return;
+    }
+    atomic_fetch_add_explicit(&stats->dropped_frames, nbr_frames, memory_order_relaxed);
+}
+
+void stage_stats_add_skipped_frames(stage_stats_t* stats, unsigned int nbr_frames) {
+    if (!stats || nbr_frames == 0) {
+        return;
+    }
+    atomic_fetch_add_explicit(&stats->skipped_frames, nbr_frames, memory_order_relaxed);
+}
+
+void stage_stats_add_no_power_time(stage_stats_t* stats, uint64_t no_power_ns) {
+    if (!stats) {
+        return;
+    }
+    atomic_fetch_add_explicit(&stats->no_power_ns, no_power_ns, memory_order_relaxed);
+}
+
+uint64_t stage_stats_percentile(stage_stats_t* stats, stage_t stage, double percentile) {
+    stage_histogram_t* histogram = &stats->stages[stage];
+
+    uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+    // The rank of the sample that the percentile corresponds to
+    double exact_rank = ceil((percentile / 100.0) * (double)count);
+    uint64_t rank     = (uint64_t)exact_rank;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STAGE_HISTOGRAM_NBR_BUCKETS; i++) {
+        seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        // The last bucket has no upper limit
+        if (seen >= rank && i < STAGE_HISTOGRAM_NBR_BUCKETS - 1) {
+            uint64_t upper_ns = bucket_upper_limit(i);
+            return upper_ns < max_ns ? upper_ns : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+static double ns_to_ms(uint64_t value_ns) {
+    return (double)value_ns / 1000000.0;
+}
+
+static void log_summary(stage_stats_t* stats) {
+    for (size_t i = 0; i < NBR_STAGES; i++) {
+        stage_histogram_t* histogram = &stats->stages[i];
+
+        uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        uint64_t p50_ns = stage_stats_percentile(stats, i, 50.0);
+        uint64_t p90_ns = stage_stats_percentile(stats, i, 90.0);
+        uint64_t p99_ns = stage_stats_percentile(stats, i, 99.0);
+        uint64_t max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+        syslog(LOG_INFO,
+               "Stage %s: %llu samples, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms",
+               stage_names[i],
+               (unsigned long long)count,
+               ns_to_ms(p50_ns),
+               ns_to_ms(p90_ns),
+               ns_to_ms(p99_ns),
+               ns_to_ms(max_ns));
+    }
+    uint64_t dropped_frames = atomic_load_explicit(&stats->dropped_frames, memory_order_relaxed);
+    if (dropped_frames > 0) {
+        syslog(LOG_INFO,
+               "Dropped %llu frames since newer frames were available",
+               (unsigned long long)dropped_frames);
+    }
+    uint64_t skipped_frames = atomic_load_explicit(&stats->skipped_frames, memory_order_relaxed);
+    uint64_t no_power_ns    = atomic_load_explicit(&stats->no_power_ns, memory_order_relaxed);
+    if (skipped_frames > 0 || no_power_ns > 0) {
+        syslog(LOG_INFO,
+               "Skipped %llu frames since larod had no power for %.3f ms",
+               (unsigned long long)skipped_frames,
+               ns_to_ms(no_power_ns));
+    }
+}
+
+static void write_histogram(FILE* file, stage_stats_t* stats, stage_t stage) {
+    stage_histogram_t* histogram = &stats->stages[stage];
+
+    uint64_t count  = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    uint64_t sum_ns = atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed);
+    uint64_t max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+
+    fprintf(file,
+            "\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+            "\"p99_ns\":%llu,\"max_ns\":%llu,\"buckets\":[",
+            stage_names[stage],
+            (unsigned long long)count,
+            (unsigned long long)sum_ns,
+            (unsigned long long)stage_stats_percentile(stats, stage, 50.0),
+            (unsigned long long)stage_stats_percentile(stats, stage, 90.0),
+            (unsigned long long)stage_stats_percentile(stats, stage, 99.0),
+            (unsigned long long)max_ns);
+    // Only the buckets with samples are written as [upper limit in ns, count]
+    bool first = true;
+    for (size_t i = 0; i < STAGE_HISTOGRAM_NBR_BUCKETS; i++) {
+        uint64_t bucket_count = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (bucket_count == 0) {
+            continue;
+        }
+        fprintf(file,
+                "%s[%llu,%llu]",
+                first ? "" : ",",
+                (unsigned long long)bucket_upper_limit(i),
+                (unsigned long long)bucket_count);
+        first = false;
+    }
+    fprintf(file, "]}");
+}
+
+// The statistics are written to a temporary file which then replaces the dump
+// file so that a reader never sees a partially written file
+static void write_dump(stage_stats_t* stats, uint64_t now_ns) {
+    char tmp_file[PATH_MAX];
+
+    if (snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", stats->dump_file) >=
+        (int)sizeof(tmp_file)) {
+        syslog(LOG_WARNING, "Stage statistics file name %s is too long", stats->dump_file);
+        return;
+    }
+    FILE* file = fopen(tmp_file, "w");
+    if (!file) {
+        syslog(LOG_WARNING, "Unable to open %s: %s", tmp_file, strerror(errno));
+        return;
+    }
+    uint64_t dropped_frames = atomic_load_explicit(&stats->dropped_frames, memory_order_relaxed);
+    uint64_t skipped_frames = atomic_load_explicit(&stats->skipped_frames, memory_order_relaxed);
+    uint64_t no_power_ns    = atomic_load_explicit(&stats->no_power_ns, memory_order_relaxed);
+    fprintf(file,
+            "{\"uptime_ns\":%llu,\"dropped_frames\":%llu,\"skipped_frames\":%llu,"
+            "\"no_power_ns\":%llu,\"stages\":{",
+            (unsigned long long)(now_ns - stats->started_ns),
+            (unsigned long long)dropped_frames,
+            (unsigned long long)skipped_frames,
+            (unsigned long long)no_power_ns);
+    for (size_t i = 0; i < NBR_STAGES; i++) {
+        if (i > 0) {
+            fprintf(file, ",");
+        }
+        write_histogram(file, stats, i);
+    }
+    fprintf(file, "}}\n");
+    if (fclose(file) != 0) {
+        syslog(LOG_WARNING, "Unable to write %s: %s", tmp_file, strerror(errno));
+        return;
+    }
+    if (rename(tmp_file, stats->dump_file) != 0) {
+        syslog(LOG_WARNING, "Unable to rename %s: %s", tmp_file, strerror(errno));
+    }
+}
+
+void stage_stats_report(stage_stats_t* stats) {
+    uint64_t now_ns       = stage_stats_now_ns();
+    stats->last_report_ns = now_ns;
+
+    log_summary(stats);
+    if (stats->dump_file) {
+        write_dump(stats, now_ns);
+    }
+}
+
+bool stage_stats_report_if_due(stage_stats_t* stats) {
+    if (!stats) {
+        return false;
+    }
+    uint64_t now_ns = stage_stats_now_ns();
+    if (now_ns - stats->last_report_ns < stats->report_interval_ns) {
+        return false;
+    }
+    stage_stats_report(stats);
+    return true;
+}
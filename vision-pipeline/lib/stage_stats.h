@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file handles latency statistics for the stages of the frame loop.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum stage {
+    STAGE_POLL_WAIT,
+    STAGE_BUFFER_FETCH,
+    STAGE_PREPROCESSING,
+    STAGE_INFERENCE,
+    STAGE_POSTPROCESSING,
+    STAGE_BBOX_COMMIT,
+    STAGE_BUFFER_UNREF,
+    NBR_STAGES
+} stage_t;
+
+// The histogram has 8 linear buckets per power of two which gives an error
+// of at most 12.5%. Values of 2^40 ns (about 18 minutes) or more end up in
+// the last bucket.
+#define STAGE_HISTOGRAM_SUB_BITS    3
+#define STAGE_HISTOGRAM_SUB_BUCKETS (1 << STAGE_HISTOGRAM_SUB_BITS)
+#define STAGE_HISTOGRAM_MAX_BITS    40
+#define STAGE_HISTOGRAM_NBR_BUCKETS \
+    ((STAGE_HISTOGRAM_MAX_BITS - STAGE_HISTOGRAM_SUB_BITS + 1) * STAGE_HISTOGRAM_SUB_BUCKETS)
+
+// The counters are atomic so that samples can be recorded from any thread,
+// e.g. the larod callbacks, without taking a lock
+typedef struct stage_histogram {
+    atomic_uint_fast64_t buckets[STAGE_HISTOGRAM_NBR_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum_ns;
+    atomic_uint_fast64_t max_ns;
+} stage_histogram_t;
+
+typedef struct stage_stats {
+    stage_histogram_t stages[NBR_STAGES];
+    // Frames that were given back to vdo without being analyzed since a
+    // newer frame was available
+    atomic_uint_fast64_t dropped_frames;
+    // Frames that were given back to vdo without being analyzed since larod
+    // had no power, and the total time without power
+    atomic_uint_fast64_t skipped_frames;
+    atomic_uint_fast64_t no_power_ns;
+
+    uint64_t started_ns;
+    uint64_t last_report_ns;
+    uint64_t report_interval_ns;
+    // Where the machine readable statistics are written, may be NULL
+    char* dump_file;
+} stage_stats_t;
+
+/**
+ * @brief Get the current time in ns from the monotonic clock
+ */
+uint64_t stage_stats_now_ns(void);
+
+/**
+ * @brief Create the statistics for all stages
+ *
+ * @param dump_file          File that the statistics are written to as JSON in each report,
+ *                           NULL if only a summary should be logged
+ * @param report_interval_s  Seconds between the reports from stage_stats_report_if_due
+ *
+ * @return The statistics
+ */
+stage_stats_t* stage_stats_new(const char* dump_file, unsigned int report_interval_s);
+
+/**
+ * @brief Report the statistics a last time and free them
+ *
+ * @param stats  The statistics, may be NULL
+ */
+void stage_stats_destroy(stage_stats_t* stats);
+
+/**
+ * @brief Add a sample to a stage
+ *
+ * @param stats       The statistics, nothing is recorded if NULL
+ * @param stage       The stage that the sample belongs to
+ * @param elapsed_ns  Time spent in the stage
+ */
+void stage_stats_record(stage_stats_t* stats, stage_t stage, uint64_t elapsed_ns);
+
+/**
+ * @brief Add the time since start_ns to a stage
+ *
+ * Useful when the stages follow each other since the returned time can be
+ * used as the start of the next stage.
+ *
+ * @param stats     The statistics, nothing is recorded if NULL
+ * @param stage     The stage that has finished
+ * @param start_ns  When the stage was started, from stage_stats_now_ns
+ *
+ * @return The current time in ns
+ */
+uint64_t stage_stats_mark(stage_stats_t* stats, stage_t stage, uint64_t start_ns);
+
+/**
+ * @brief Add frames that were dropped without being analyzed
+ *
+ * @param stats       The statistics, nothing is recorded if NULL
+ * @param nbr_frames  Number of dropped frames
+ */
+void stage_stats_add_dropped_frames(stage_stats_t* stats, unsigned int nbr_frames);
+
+/**
+ * @brief Add frames that were skipped since larod had no power
+ *
+ * @param stats       The statistics, nothing is recorded if NULL
+ * @param nbr_frames  Number of skipped frames
+ */
+void stage_stats_add_skipped_frames(stage_stats_t* stats, unsigned int nbr_frames);
+
+/**
+ * @brief Add time that larod has had no power
+ *
+ * @param stats        The statistics, nothing is recorded if NULL
+ * @param no_power_ns  Time without power
+ */
+void stage_stats_add_no_power_time(stage_stats_t* stats, uint64_t no_power_ns);
+
+/**
+ * @brief Get a percentile of a stage
+ *
+ * The value is the upper limit of the histogram bucket that the percentile
+ * falls in but never more than the largest sample.
+ *
+ * @param stats       The statistics
+ * @param stage       The stage
+ * @param percentile  The percentile, between 0 and 100
+ *
+ * @return The percentile in ns, 0 if there are no samples
+ */
+uint64_t stage_stats_percentile(stage_stats_t* stats, stage_t stage, double percentile);
+
+/**
+ * @brief Log a summary of all stages and write the statistics to the dump file
+ *
+ * @param stats  The statistics
+ */
+void stage_stats_report(stage_stats_t* stats);
+
+/**
+ * @brief Report the statistics if the report interval has passed
+ *
+ * @param stats  The statistics, may be NULL
+ *
+ * @return True if a report was made
+ */
+bool stage_stats_report_if_due(stage_stats_t* stats);
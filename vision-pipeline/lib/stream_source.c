@@ -0,0 +1,127 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <poll.h>
+
+#include "panic.h"
+#include "stream_source.h"
+#include "vdo-error.h"
+
+static void stream_source_wait(void* ctx) {
+    stream_source_t* source = ctx;
+
+    struct pollfd fds = {
+        .fd     = source->fd,
+        .events = POLL_IN,
+    };
+    int status = 0;
+    do {
+        // If poll returns -1 then errno is set
+        // if the errno is set to EINTR then just
+        // continue this loop
+        status = poll(&fds, 1, -1);
+    } while (status == -1 && errno == EINTR);
+
+    if (status < 0) {
+        panic("Failed to poll with status %d", status);
+    }
+}
+
+static pipeline_status_t stream_source_fetch(void* ctx, VdoBuffer** buffer, int* exit_status) {
+    stream_source_t* source     = ctx;
+    g_autoptr(GError) vdo_error = NULL;
+
+    *buffer = vdo_stream_get_buffer(source->stream, &vdo_error);
+    if (*buffer && source->newest_frame) {
+        // Analyze the newest frame instead of one that is already outdated
+        unsigned int nbr_dropped = 0;
+        if (!img_util_get_newest_buffer(source->stream, buffer, &nbr_dropped, &vdo_error)) {
+            *exit_status = img_util_handle_vdo_failed(vdo_error);
+            return PIPELINE_STOP;
+        }
+        stage_stats_add_dropped_frames(source->stage_stats, nbr_dropped);
+    }
+    if (!*buffer && g_error_matches(vdo_error, VDO_ERROR, VDO_ERROR_NO_DATA)) {
+        return PIPELINE_PENDING;
+    }
+    if (!*buffer) {
+        *exit_status = img_util_handle_vdo_failed(vdo_error);
+        return PIPELINE_STOP;
+    }
+    return PIPELINE_CONTINUE;
+}
+
+static bool stream_source_update_framerate(void* ctx, unsigned int analysis_ms) {
+    stream_source_t* source = ctx;
+
+    return img_util_update_framerate(source->stream, &source->framerate, analysis_ms);
+}
+
+static pipeline_status_t stream_source_flush(void* ctx, VdoBuffer** buffer, int* exit_status) {
+    stream_source_t* source     = ctx;
+    g_autoptr(GError) vdo_error = NULL;
+
+    if (!img_util_flush(source->stream, buffer, &vdo_error)) {
+        *exit_status = img_util_handle_vdo_failed(vdo_error);
+        return PIPELINE_STOP;
+    }
+    return PIPELINE_CONTINUE;
+}
+
+static void stream_source_release(void* ctx, VdoBuffer** buffer) {
+    stream_source_t* source     = ctx;
+    g_autoptr(GError) vdo_error = NULL;
+
+    // This will allow vdo to fill this buffer with data again
+    if (!vdo_stream_buffer_unref(source->stream, buffer, &vdo_error)) {
+        if (!vdo_error_is_expected(&vdo_error)) {
+            panic("%s: Unexpected error: %s", __func__, vdo_error->message);
+        }
+    }
+}
+
+const pipeline_source_ops_t stream_source_ops = {
+    .wait             = stream_source_wait,
+    .fetch            = stream_source_fetch,
+    .update_framerate = stream_source_update_framerate,
+    .flush            = stream_source_flush,
+    .release          = stream_source_release,
+};
+
+bool stream_source_init(stream_source_t* source,
+                        VdoStream* stream,
+                        VdoMap* stream_info,
+                        double wanted_framerate,
+                        bool newest_frame,
+                        stage_stats_t* stage_stats,
+                        GError** error) {
+    source->stream       = stream;
+    source->newest_frame = newest_frame;
+    source->stage_stats  = stage_stats;
+
+    source->fd = vdo_stream_get_fd(stream, error);
+    if (source->fd < 0) {
+        return false;
+    }
+    // Follow the analysis time with the framerate without flushing the stream,
+    // use IMG_FRAMERATE_MODE_STEPS for the fixed set of framerates
+    img_util_init_framerate(&source->framerate,
+                            IMG_FRAMERATE_MODE_CONTROLLER,
+                            stream_info,
+                            wanted_framerate);
+    return true;
+}
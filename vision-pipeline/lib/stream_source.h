@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This header file is the source stage of the pipeline, which fetches the
+ * frames of a vdo stream and adjusts the framerate of the stream to the
+ * analysis time.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+
+#include "img_util.h"
+#include "pipeline.h"
+#include "stage_stats.h"
+#include "vdo-stream.h"
+
+typedef struct stream_source {
+    VdoStream* stream;
+    int fd;
+    img_framerate_t framerate;
+    // Replace each frame with the newest frame that is available
+    bool newest_frame;
+    // The dropped frames are counted here, NULL if not measured
+    stage_stats_t* stage_stats;
+} stream_source_t;
+
+extern const pipeline_source_ops_t stream_source_ops;
+
+/**
+ * @brief Set up the source for a stream that is started
+ *
+ * The framerate follows the analysis time with IMG_FRAMERATE_MODE_CONTROLLER,
+ * which never flushes the stream.
+ *
+ * @param source            The source
+ * @param stream            The stream, owned by the caller
+ * @param stream_info       The info map of the stream
+ * @param wanted_framerate  The framerate to use when the analysis keeps up
+ * @param newest_frame      Analyze the newest frame instead of the next one
+ * @param stage_stats       Where the dropped frames are counted, may be NULL
+ * @param error             Set if the file descriptor of the stream could not be fetched
+ *
+ * @return False on error
+ */
+bool stream_source_init(stream_source_t* source,
+                        VdoStream* stream,
+                        VdoMap* stream_info,
+                        double wanted_framerate,
+                        bool newest_frame,
+                        stage_stats_t* stage_stats,
+                        GError** error);
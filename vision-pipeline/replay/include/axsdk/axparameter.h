@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Stand-in for the AXParameter API that the object detection applications
+ * use. The values are given on the host, see replay_axparameter.c.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct _AXParameter AXParameter;
+
+typedef void (*AXParameterCallback)(const gchar* name, const gchar* value, gpointer user_data);
+
+AXParameter* ax_parameter_new(const gchar* app_name, GError** error);
+void ax_parameter_free(AXParameter* handle);
+
+gboolean ax_parameter_get(AXParameter* handle, const gchar* name, gchar** value, GError** error);
+
+gboolean ax_parameter_register_callback(AXParameter* handle,
+                                        const gchar* name,
+                                        AXParameterCallback callback,
+                                        gpointer user_data,
+                                        GError** error);
@@ -15,7 +15,8 @@
  */
 
 /**
- * This header file handles the vdo part of the application.
+ * Stand-in for the bbox API that the object detection applications use. The
+ * boxes are counted instead of drawn.
  */
 
 #pragma once
@@ -23,16 +24,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#include "vdo-error.h"
-#include "vdo-stream.h"
-#include "vdo-types.h"
+typedef struct bbox bbox_t;
+typedef uint32_t bbox_color_t;
 
-bool channel_util_choose_stream_resolution(unsigned int channel,
-                                           VdoResolution req_res,
-                                           VdoResolution* chosen_req,
-                                           unsigned int rotation,
-                                           VdoFormat* chosen_format);
+bbox_t* bbox_view_new(uint32_t view);
+void bbox_destroy(bbox_t* self);
 
-unsigned int channel_util_get_image_rotation(unsigned int input_channel);
-unsigned int channel_util_get_first_input_channel(void);
-VdoPair32u channel_util_get_aspect_ratio(unsigned int channel_id);
+bool bbox_clear(bbox_t* self);
+bool bbox_style_outline(bbox_t* self);
+bool bbox_thickness_thin(bbox_t* self);
+bool bbox_color(bbox_t* self, bbox_color_t color);
+bbox_color_t bbox_color_from_rgb(uint8_t r, uint8_t g, uint8_t b);
+bool bbox_coordinates_frame_normalized(bbox_t* self);
+bool bbox_rectangle(bbox_t* self, float x1, float y1, float x2, float y2);
+bool bbox_commit(bbox_t* self, int64_t when_us);
@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Stand-in for the larod API that the vdo-larod application uses. The jobs
+ * run on the host CPU, TensorFlow Lite models on the device cpu-tflite and
+ * image conversion on the device cpu-proc.
+ */
+
+#pragma once
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LAROD_TENSOR_MAX_LEN 12
+#define LAROD_INVALID_FD     INT_MIN
+
+#define LAROD_FD_PROP_READWRITE (1UL << 0)
+#define LAROD_FD_PROP_MAP       (1UL << 1)
+#define LAROD_FD_PROP_DMABUF    (1UL << 2)
+
+typedef enum {
+    LAROD_ERROR_NONE                = 0,
+    LAROD_ERROR_JOB                 = -1,
+    LAROD_ERROR_LOAD_MODEL          = -2,
+    LAROD_ERROR_FD                  = -3,
+    LAROD_ERROR_MODEL_NOT_FOUND     = -4,
+    LAROD_ERROR_PERMISSION          = -5,
+    LAROD_ERROR_CONNECTION          = -6,
+    LAROD_ERROR_CREATE_SESSION      = -7,
+    LAROD_ERROR_KILL_SESSION        = -8,
+    LAROD_ERROR_INVALID_CHIP_ID     = -9,
+    LAROD_ERROR_INVALID_ACCESS      = -10,
+    LAROD_ERROR_DELETE_MODEL        = -11,
+    LAROD_ERROR_TENSOR_MISMATCH     = -12,
+    LAROD_ERROR_VERSION_MISMATCH    = -13,
+    LAROD_ERROR_ALLOC               = -14,
+    LAROD_ERROR_POWER_NOT_AVAILABLE = -15,
+    LAROD_ERROR_MAX_ERRNO           = 1024,
+} larodErrorCode;
+
+typedef struct {
+    larodErrorCode code;
+    const char* msg;
+} larodError;
+
+typedef enum {
+    LAROD_ACCESS_INVALID,
+    LAROD_ACCESS_PRIVATE,
+    LAROD_ACCESS_PUBLIC,
+} larodAccess;
+
+typedef enum {
+    LAROD_TENSOR_DATA_TYPE_INVALID,
+    LAROD_TENSOR_DATA_TYPE_UNSPECIFIED,
+    LAROD_TENSOR_DATA_TYPE_BOOL,
+    LAROD_TENSOR_DATA_TYPE_UINT8,
+    LAROD_TENSOR_DATA_TYPE_INT8,
+    LAROD_TENSOR_DATA_TYPE_UINT16,
+    LAROD_TENSOR_DATA_TYPE_INT16,
+    LAROD_TENSOR_DATA_TYPE_UINT32,
+    LAROD_TENSOR_DATA_TYPE_INT32,
+    LAROD_TENSOR_DATA_TYPE_UINT64,
+    LAROD_TENSOR_DATA_TYPE_INT64,
+    LAROD_TENSOR_DATA_TYPE_FLOAT16,
+    LAROD_TENSOR_DATA_TYPE_FLOAT32,
+    LAROD_TENSOR_DATA_TYPE_FLOAT64,
+} larodTensorDataType;
+
+typedef enum {
+    LAROD_TENSOR_LAYOUT_INVALID,
+    LAROD_TENSOR_LAYOUT_UNSPECIFIED,
+    LAROD_TENSOR_LAYOUT_NHWC,
+    LAROD_TENSOR_LAYOUT_NCHW,
+    LAROD_TENSOR_LAYOUT_420SP,
+} larodTensorLayout;
+
+typedef struct {
+    size_t dims[LAROD_TENSOR_MAX_LEN];
+    size_t len;
+} larodTensorDims;
+
+typedef struct {
+    size_t pitches[LAROD_TENSOR_MAX_LEN];
+    size_t len;
+} larodTensorPitches;
+
+typedef struct larodConnection larodConnection;
+typedef struct larodDevice larodDevice;
+typedef struct larodModel larodModel;
+typedef struct larodTensor larodTensor;
+typedef struct larodJobRequest larodJobRequest;
+typedef struct larodMap larodMap;
+
+typedef void (*larodRunJobCallback)(void* userData, larodError* error);
+
+void larodClearError(larodError** error);
+
+bool larodConnect(larodConnection** conn, larodError** error);
+bool larodDisconnect(larodConnection** conn, larodError** error);
+
+const larodDevice** larodListDevices(larodConnection* conn, size_t* numDevices, larodError** error);
+const larodDevice* larodGetDevice(const larodConnection* conn,
+                                  const char* name,
+                                  const uint32_t instance,
+                                  larodError** error);
+const char* larodGetDeviceName(const larodDevice* dev, larodError** error);
+
+larodModel* larodLoadModel(larodConnection* conn,
+                           const int fd,
+                           const larodDevice* dev,
+                           const larodAccess access,
+                           const char* name,
+                           const larodMap* params,
+                           larodError** error);
+larodModel* larodGetModel(larodConnection* conn, const uint64_t modelId, larodError** error);
+larodModel** larodGetModels(larodConnection* conn, size_t* numModels, larodError** error);
+bool larodDeleteModel(larodConnection* conn, larodModel* model, larodError** error);
+void larodDestroyModel(larodModel** model);
+void larodDestroyModels(larodModel*** models, size_t numModels);
+uint64_t larodGetModelId(const larodModel* model, larodError** error);
+const char* larodGetModelName(const larodModel* model, larodError** error);
+const larodDevice* larodGetModelDevice(const larodModel* model, larodError** error);
+
+larodTensor** larodAllocModelInputs(larodConnection* conn,
+                                    const larodModel* model,
+                                    const uint32_t fdPropFlags,
+                                    size_t* numTensors,
+                                    larodMap* params,
+                                    larodError** error);
+larodTensor** larodAllocModelOutputs(larodConnection* conn,
+                                     const larodModel* model,
+                                     const uint32_t fdPropFlags,
+                                     size_t* numTensors,
+                                     larodMap* params,
+                                     larodError** error);
+larodTensor** larodCreateTensors(const size_t numTensors, larodError** error);
+bool larodDestroyTensors(larodConnection* conn,
+                         larodTensor*** tensors,
+                         const size_t numTensors,
+                         larodError** error);
+bool larodTrackTensor(larodConnection* conn, larodTensor* tensor, larodError** error);
+
+const larodTensorDims* larodGetTensorDims(const larodTensor* tensor, larodError** error);
+const larodTensorPitches* larodGetTensorPitches(const larodTensor* tensor, larodError** error);
+larodTensorDataType larodGetTensorDataType(const larodTensor* tensor, larodError** error);
+bool larodGetTensorByteSize(const larodTensor* tensor, size_t* byteSize, larodError** error);
+int larodGetTensorFd(const larodTensor* tensor, larodError** error);
+bool larodGetTensorFdSize(const larodTensor* tensor, size_t* size, larodError** error);
+
+bool larodSetTensorDataType(larodTensor* tensor,
+                            const larodTensorDataType dataType,
+                            larodError** error);
+bool larodSetTensorLayout(larodTensor* tensor, const larodTensorLayout layout, larodError** error);
+bool larodBuildTensorDims(larodTensor* tensor,
+                          larodTensorLayout layout,
+                          size_t width,
+                          size_t height,
+                          size_t channels,
+                          larodError** error);
+bool larodBuildTensorPitches(larodTensor* tensor,
+                             larodTensorLayout layout,
+                             size_t rowPitch,
+                             size_t height,
+                             size_t channels,
+                             larodError** error);
+bool larodSetTensorFd(larodTensor* tensor, const int fd, larodError** error);
+bool larodSetTensorFdSize(larodTensor* tensor, const size_t size, larodError** error);
+bool larodSetTensorFdOffset(larodTensor* tensor, const int64_t offset, larodError** error);
+bool larodSetTensorFdProps(larodTensor* tensor, const uint32_t fdPropFlags, larodError** error);
+
+// Vmem buffers do not exist on a host, the fd is only duplicated
+int larodConvertVmemFdToDmabuf(int fd, int64_t offset, larodError** error);
+
+larodMap* larodCreateMap(larodError** error);
+void larodDestroyMap(larodMap** map);
+bool larodMapSetStr(larodMap* map, const char* key, const char* value, larodError** error);
+bool larodMapSetInt(larodMap* map, const char* key, const int64_t value, larodError** error);
+bool larodMapSetIntArr2(larodMap* map,
+                        const char* key,
+                        const int64_t value0,
+                        const int64_t value1,
+                        larodError** error);
+bool larodMapSetIntArr4(larodMap* map,
+                        const char* key,
+                        const int64_t value0,
+                        const int64_t value1,
+                        const int64_t value2,
+                        const int64_t value3,
+                        larodError** error);
+
+larodJobRequest* larodCreateJobRequest(const larodModel* model,
+                                       larodTensor** inputTensors,
+                                       size_t numInputs,
+                                       larodTensor** outputTensors,
+                                       size_t numOutputs,
+                                       larodMap* params,
+                                       larodError** error);
+void larodDestroyJobRequest(larodJobRequest** jobReq);
+bool larodSetJobRequestInputs(larodJobRequest* jobReq,
+                              larodTensor** tensors,
+                              const size_t numTensors,
+                              larodError** error);
+bool larodSetJobRequestOutputs(larodJobRequest* jobReq,
+                               larodTensor** tensors,
+                               const size_t numTensors,
+                               larodError** error);
+bool larodSetJobRequestParams(larodJobRequest* jobReq, const larodMap* params, larodError** error);
+bool larodRunJob(larodConnection* conn, const larodJobRequest* jobReq, larodError** error);
+bool larodRunJobAsync(larodConnection* conn,
+                      const larodJobRequest* jobReq,
+                      larodRunJobCallback callback,
+                      void* userData,
+                      larodError** error);
@@ -16,9 +16,10 @@
 
 #pragma once
 
-#include <stdlib.h>
+#include "vdo-types.h"
 
-void parse_labels(char*** labels_ptr,
-                  char** label_file_buffer,
-                  const char* labels_path,
-                  size_t* num_labels_ptr);
\ No newline at end of file
+gint vdo_buffer_get_fd(VdoBuffer* buffer);
+gint64 vdo_buffer_get_offset(VdoBuffer* buffer);
+gsize vdo_buffer_get_capacity(VdoBuffer* buffer);
+gpointer vdo_buffer_get_data(VdoBuffer* buffer);
+VdoFrame* vdo_buffer_get_frame(VdoBuffer* buffer);
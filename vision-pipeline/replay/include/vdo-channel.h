@@ -16,9 +16,12 @@
 
 #pragma once
 
-#include <stdlib.h>
+#include "vdo-map.h"
 
-void parse_labels(char*** labels_ptr,
-                  char** label_file_buffer,
-                  const char* labels_path,
-                  size_t* num_labels_ptr);
\ No newline at end of file
+// There is a single channel which has the resolution and format of the
+// replayed frames
+VdoChannel* vdo_channel_get(guint channel_nbr, GError** error);
+VdoChannel* vdo_channel_get_ex(VdoMap* desc, GError** error);
+VdoMap* vdo_channel_get_info(VdoChannel* channel, GError** error);
+VdoResolutionSet*
+vdo_channel_get_resolutions(VdoChannel* channel, VdoMap* filter, GError** error);
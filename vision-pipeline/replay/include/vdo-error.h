@@ -1,4 +1,3 @@
-
 /**
  * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
  *
@@ -17,8 +16,19 @@
 
 #pragma once
 
-#include "img_util.h"
-#include "larod.h"
-#include "model.h"
+#include "vdo-types.h"
+
+#define VDO_ERROR (vdo_error_quark())
+
+typedef enum {
+    VDO_ERROR_NOT_FOUND = 1,
+    VDO_ERROR_INVALID_ARGUMENT,
+    VDO_ERROR_NOT_SUPPORTED,
+    VDO_ERROR_IO,
+    VDO_ERROR_NO_DATA,
+} VdoError;
+
+GQuark vdo_error_quark(void);
 
-bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info);
+// There is no maintenance on a host so no error is expected
+gboolean vdo_error_is_expected(GError** error);
@@ -16,7 +16,8 @@
 
 #pragma once
 
-#include <stdarg.h>
+#include "vdo-buffer.h"
 
-// Function declaration for panic
-__attribute__((noreturn)) __attribute__((format(printf, 1, 2))) void panic(const char* format, ...);
+guint64 vdo_frame_get_timestamp(VdoFrame* frame);
+guint vdo_frame_get_sequence_nbr(VdoFrame* frame);
+gsize vdo_frame_get_size(VdoFrame* frame);
@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "vdo-types.h"
+
+VdoMap* vdo_map_new(void);
+
+gboolean vdo_map_contains(const VdoMap* map, const gchar* name);
+
+void vdo_map_set_uint32(VdoMap* map, const gchar* name, guint32 value);
+guint32 vdo_map_get_uint32(const VdoMap* map, const gchar* name, guint32 def);
+
+void vdo_map_set_double(VdoMap* map, const gchar* name, gdouble value);
+gdouble vdo_map_get_double(const VdoMap* map, const gchar* name, gdouble def);
+
+void vdo_map_set_boolean(VdoMap* map, const gchar* name, gboolean value);
+gboolean vdo_map_get_boolean(const VdoMap* map, const gchar* name, gboolean def);
+
+void vdo_map_set_string(VdoMap* map, const gchar* name, const gchar* value);
+const gchar*
+vdo_map_get_string(const VdoMap* map, const gchar* name, gsize* size, const gchar* def);
+
+void vdo_map_set_pair32u(VdoMap* map, const gchar* name, VdoPair32u value);
+VdoPair32u vdo_map_get_pair32u(const VdoMap* map, const gchar* name, VdoPair32u def);
+
+void vdo_map_dump(const VdoMap* map);
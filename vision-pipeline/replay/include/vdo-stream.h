@@ -1,4 +1,3 @@
-
 /**
  * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
  *
@@ -17,8 +16,17 @@
 
 #pragma once
 
-#include "img_util.h"
-#include "larod.h"
-#include "model.h"
+#include "vdo-buffer.h"
+#include "vdo-map.h"
+
+VdoStream* vdo_stream_new(VdoMap* settings, gpointer reserved, GError** error);
+VdoMap* vdo_stream_get_info(VdoStream* stream, GError** error);
+gint vdo_stream_get_fd(VdoStream* stream, GError** error);
+
+gboolean vdo_stream_start(VdoStream* stream, GError** error);
+void vdo_stream_stop(VdoStream* stream);
+
+VdoBuffer* vdo_stream_get_buffer(VdoStream* stream, GError** error);
+gboolean vdo_stream_buffer_unref(VdoStream* stream, VdoBuffer** buffer, GError** error);
 
-bool model_preprocessing_setup(model_provider_t* provider, img_info_t* img_info);
+gboolean vdo_stream_set_framerate(VdoStream* stream, gdouble framerate, GError** error);
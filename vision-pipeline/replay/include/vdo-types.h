@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Stand-in for the vdo types that the vdo-larod application uses. Only the
+ * subset needed to run the application on a host is declared.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef enum {
+    VDO_FORMAT_NONE = -1,
+    VDO_FORMAT_H264 = 0,
+    VDO_FORMAT_H265,
+    VDO_FORMAT_JPEG,
+    VDO_FORMAT_YUV,
+    VDO_FORMAT_BAYER,
+    VDO_FORMAT_IVS,
+    VDO_FORMAT_RAW,
+    VDO_FORMAT_RGBA,
+    VDO_FORMAT_RGB,
+    VDO_FORMAT_PLANAR_RGB,
+} VdoFormat;
+
+typedef enum {
+    VDO_BUFFER_STRATEGY_NONE,
+    VDO_BUFFER_STRATEGY_EXPLICIT,
+    VDO_BUFFER_STRATEGY_INFINITE,
+} VdoBufferStrategy;
+
+typedef struct {
+    guint32 w;
+    guint32 h;
+} VdoPair32u;
+
+typedef struct {
+    guint32 width;
+    guint32 height;
+} VdoResolution;
+
+typedef struct {
+    gsize count;
+    VdoResolution resolutions[];
+} VdoResolutionSet;
+
+typedef struct _VdoMap VdoMap;
+typedef struct _VdoChannel VdoChannel;
+typedef struct _VdoStream VdoStream;
+typedef struct _VdoBuffer VdoBuffer;
+typedef VdoBuffer VdoFrame;
+
+// The objects are plain structs in the stand-in, these release them when a
+// g_autoptr goes out of scope
+void vdo_map_free(VdoMap* map);
+void vdo_channel_free(VdoChannel* channel);
+void vdo_stream_free(VdoStream* stream);
+void vdo_buffer_release(VdoBuffer* buffer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VdoMap, vdo_map_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VdoChannel, vdo_channel_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VdoStream, vdo_stream_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VdoBuffer, vdo_buffer_release)
@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file gives the parameters of the application through a stand-in of
+ * the AXParameter API. The values are read from the environment variable
+ * REPLAY_PARAMETERS, which holds Name=value pairs separated by spaces, e.g.
+ *
+ * REPLAY_PARAMETERS="ConfThresholdPercent=25 IouThresholdPercent=5"
+ *
+ * A parameter that is not given can not be read, like a parameter that is
+ * missing in the manifest. The values do not change during a replay, so the
+ * callbacks are never called.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "axsdk/axparameter.h"
+
+struct _AXParameter {
+    GHashTable* values;
+};
+
+static GQuark replay_axparameter_error_quark(void) {
+    return g_quark_from_static_string("replay-axparameter-error-quark");
+}
+
+AXParameter* ax_parameter_new(const gchar* app_name, GError** error) {
+    (void)app_name;
+    AXParameter* handle = g_new0(AXParameter, 1);
+    handle->values      = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    const gchar* parameters = g_getenv("REPLAY_PARAMETERS");
+    gchar** pairs           = g_strsplit_set(parameters ? parameters : "", " ,", -1);
+    for (gchar** pair = pairs; *pair; pair++) {
+        if (**pair == '\0') {
+            continue;
+        }
+        gchar* separator = strchr(*pair, '=');
+        if (!separator) {
+            g_set_error(error,
+                        replay_axparameter_error_quark(),
+                        0,
+                        "Invalid REPLAY_PARAMETERS entry: %s",
+                        *pair);
+            g_strfreev(pairs);
+            ax_parameter_free(handle);
+            return NULL;
+        }
+        g_hash_table_insert(handle->values,
+                            g_strndup(*pair, (gsize)(separator - *pair)),
+                            g_strdup(separator + 1));
+    }
+    g_strfreev(pairs);
+    return handle;
+}
+
+void ax_parameter_free(AXParameter* handle) {
+    if (!handle) {
+        return;
+    }
+    g_hash_table_destroy(handle->values);
+    g_free(handle);
+}
+
+gboolean ax_parameter_get(AXParameter* handle, const gchar* name, gchar** value, GError** error) {
+    const gchar* found = g_hash_table_lookup(handle->values, name);
+    if (!found) {
+        g_set_error(error,
+                    replay_axparameter_error_quark(),
+                    0,
+                    "The parameter %s is not given in REPLAY_PARAMETERS",
+                    name);
+        return FALSE;
+    }
+    *value = g_strdup(found);
+    return TRUE;
+}
+
+gboolean ax_parameter_register_callback(AXParameter* handle,
+                                        const gchar* name,
+                                        AXParameterCallback callback,
+                                        gpointer user_data,
+                                        GError** error) {
+    (void)handle, (void)name, (void)callback, (void)user_data, (void)error;
+    return TRUE;
+}
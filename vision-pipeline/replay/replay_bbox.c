@@ -0,0 +1,91 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file counts the boxes through a stand-in of the bbox API, since there
+ * is no overlay on the host. The number of commits and boxes is logged when
+ * the bbox is destroyed, so that a replay shows how often the overlay would
+ * have been updated.
+ */
+
+#include <glib.h>
+#include <syslog.h>
+
+#include "bbox.h"
+
+struct bbox {
+    guint64 nbr_commits;
+    guint64 nbr_boxes;
+    guint64 nbr_pending_boxes;
+};
+
+bbox_t* bbox_view_new(uint32_t view) {
+    (void)view;
+    return g_new0(bbox_t, 1);
+}
+
+void bbox_destroy(bbox_t* self) {
+    if (!self) {
+        return;
+    }
+    syslog(LOG_INFO,
+           "The overlay was committed %llu times with %llu boxes",
+           (unsigned long long)self->nbr_commits,
+           (unsigned long long)self->nbr_boxes);
+    g_free(self);
+}
+
+bool bbox_clear(bbox_t* self) {
+    self->nbr_pending_boxes = 0;
+    return true;
+}
+
+bool bbox_style_outline(bbox_t* self) {
+    (void)self;
+    return true;
+}
+
+bool bbox_thickness_thin(bbox_t* self) {
+    (void)self;
+    return true;
+}
+
+bool bbox_color(bbox_t* self, bbox_color_t color) {
+    (void)self, (void)color;
+    return true;
+}
+
+bbox_color_t bbox_color_from_rgb(uint8_t r, uint8_t g, uint8_t b) {
+    return ((bbox_color_t)r << 16) | ((bbox_color_t)g << 8) | b;
+}
+
+bool bbox_coordinates_frame_normalized(bbox_t* self) {
+    (void)self;
+    return true;
+}
+
+bool bbox_rectangle(bbox_t* self, float x1, float y1, float x2, float y2) {
+    (void)x1, (void)y1, (void)x2, (void)y2;
+    self->nbr_pending_boxes++;
+    return true;
+}
+
+bool bbox_commit(bbox_t* self, int64_t when_us) {
+    (void)when_us;
+    self->nbr_commits++;
+    self->nbr_boxes += self->nbr_pending_boxes;
+    return true;
+}
@@ -0,0 +1,1414 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file runs larod jobs on the host CPU through a stand-in of the larod
+ * API.
+ *
+ * The device cpu-tflite runs TensorFlow Lite models with the TensorFlow Lite
+ * C API and the device cpu-proc converts and scales images like the libyuv
+ * preprocessing of larod. The tensors are backed by memfd buffers so that the
+ * application can map them like on a device. Asynchronous jobs are run in
+ * order by one worker thread per device, so preprocessing of one frame can
+ * overlap the inference of another frame just like on a device.
+ *
+ * REPLAY_TFLITE_THREADS sets the number of threads used by TensorFlow Lite,
+ * default is the number of processors.
+ */
+
+#include <errno.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "larod.h"
+#include <tensorflow/lite/c/c_api.h>
+
+#define MAX_NBR_MAP_ENTRIES 16
+
+typedef enum {
+    DEVICE_TFLITE,
+    DEVICE_PROC,
+    NBR_DEVICES
+} device_index_t;
+
+struct larodDevice {
+    const char* name;
+    device_index_t index;
+};
+
+static const larodDevice devices[NBR_DEVICES] = {
+    [DEVICE_TFLITE] = {.name = "cpu-tflite", .index = DEVICE_TFLITE},
+    [DEVICE_PROC]   = {.name = "cpu-proc", .index = DEVICE_PROC},
+};
+
+static const larodDevice* device_list[NBR_DEVICES] = {
+    &devices[DEVICE_TFLITE],
+    &devices[DEVICE_PROC],
+};
+
+typedef enum {
+    MAP_VALUE_STR,
+    MAP_VALUE_INT,
+    MAP_VALUE_INT_ARR2,
+    MAP_VALUE_INT_ARR4,
+} map_value_type_t;
+
+typedef struct map_entry {
+    char* key;
+    map_value_type_t type;
+    char* str;
+    int64_t ints[4];
+} map_entry_t;
+
+struct larodMap {
+    map_entry_t entries[MAX_NBR_MAP_ENTRIES];
+    size_t nbr_entries;
+};
+
+typedef enum {
+    IMAGE_FORMAT_NV12,
+    IMAGE_FORMAT_RGB_INTERLEAVED,
+    IMAGE_FORMAT_RGB_PLANAR,
+} image_format_t;
+
+typedef struct image_params {
+    image_format_t format;
+    size_t width;
+    size_t height;
+    size_t row_pitch;
+} image_params_t;
+
+// The area of the input image that a cpu-proc job scales to the output
+typedef struct image_crop {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+} image_crop_t;
+
+struct larodTensor {
+    larodTensorDataType data_type;
+    larodTensorLayout layout;
+    larodTensorDims dims;
+    larodTensorPitches pitches;
+    int fd;
+    // Only fds allocated by larod are closed when the tensor is destroyed
+    bool owns_fd;
+    int64_t fd_offset;
+    size_t fd_size;
+    uint32_t fd_props;
+    // The fd is mapped the first time the tensor is used in a job
+    uint8_t* map_data;
+    size_t map_size;
+};
+
+struct larodModel {
+    uint64_t id;
+    char* name;
+    const larodDevice* device;
+    larodAccess access;
+    // A model runs one job at a time
+    GMutex mutex;
+
+    // cpu-tflite
+    void* model_data;
+    TfLiteModel* tflite_model;
+    TfLiteInterpreter* interpreter;
+
+    // cpu-proc
+    image_params_t input;
+    image_params_t output;
+    // The input column of each output column
+    size_t* x_map;
+
+    larodModel* next;
+};
+
+struct larodJobRequest {
+    larodModel* model;
+    larodTensor** inputs;
+    size_t nbr_inputs;
+    larodTensor** outputs;
+    size_t nbr_outputs;
+    // Set from image.input.crop, the whole image is used if not set
+    bool has_crop;
+    image_crop_t crop;
+};
+
+typedef struct job {
+    larodJobRequest req;
+    larodRunJobCallback callback;
+    void* user_data;
+} job_t;
+
+typedef struct worker {
+    GThread* thread;
+    GMutex mutex;
+    GCond cond;
+    GQueue* jobs;
+    bool stopping;
+} worker_t;
+
+struct larodConnection {
+    larodModel* models;
+    uint64_t next_model_id;
+    worker_t workers[NBR_DEVICES];
+};
+
+// The message is kept together with the error so that it is freed with it
+typedef struct replay_error {
+    larodError error;
+    char msg[256];
+} replay_error_t;
+
+// Protects the mapping of the tensors which can be used by several workers
+static GMutex map_mutex;
+
+__attribute__((format(printf, 3, 4))) static void
+set_error(larodError** error, larodErrorCode code, const char* format, ...) {
+    if (!error || *error) {
+        return;
+    }
+    replay_error_t* replay_error = calloc(1, sizeof(replay_error_t));
+    if (!replay_error) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(replay_error->msg, sizeof(replay_error->msg), format, args);
+    va_end(args);
+    replay_error->error.code = code;
+    replay_error->error.msg  = replay_error->msg;
+    *error                   = &replay_error->error;
+}
+
+void larodClearError(larodError** error) {
+    if (!error || !*error) {
+        return;
+    }
+    // The error is the first member of replay_error_t
+    free(*error);
+    *error = NULL;
+}
+
+static void free_model(larodModel* model) {
+    if (model->interpreter) {
+        TfLiteInterpreterDelete(model->interpreter);
+    }
+    if (model->tflite_model) {
+        TfLiteModelDelete(model->tflite_model);
+    }
+    free(model->model_data);
+    free(model->x_map);
+    free(model->name);
+    g_mutex_clear(&model->mutex);
+    free(model);
+}
+
+bool larodConnect(larodConnection** conn, larodError** error) {
+    *conn = calloc(1, sizeof(larodConnection));
+    if (!*conn) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate connection");
+        return false;
+    }
+    return true;
+}
+
+// The workers finish the queued jobs before they stop
+static void stop_worker(worker_t* worker) {
+    if (!worker->thread) {
+        return;
+    }
+    g_mutex_lock(&worker->mutex);
+    worker->stopping = true;
+    g_cond_signal(&worker->cond);
+    g_mutex_unlock(&worker->mutex);
+    g_thread_join(worker->thread);
+    g_queue_free(worker->jobs);
+    g_cond_clear(&worker->cond);
+    g_mutex_clear(&worker->mutex);
+}
+
+bool larodDisconnect(larodConnection** conn, larodError** error) {
+    (void)error;
+    if (!conn || !*conn) {
+        return true;
+    }
+    for (size_t i = 0; i < NBR_DEVICES; i++) {
+        stop_worker(&(*conn)->workers[i]);
+    }
+    // Like larod all models of the session are released at disconnect
+    while ((*conn)->models) {
+        larodModel* model = (*conn)->models;
+        (*conn)->models   = model->next;
+        free_model(model);
+    }
+    free(*conn);
+    *conn = NULL;
+    return true;
+}
+
+const larodDevice**
+larodListDevices(larodConnection* conn, size_t* numDevices, larodError** error) {
+    (void)conn;
+    (void)error;
+    *numDevices = NBR_DEVICES;
+    return device_list;
+}
+
+const larodDevice* larodGetDevice(const larodConnection* conn,
+                                  const char* name,
+                                  const uint32_t instance,
+                                  larodError** error) {
+    (void)conn;
+    for (size_t i = 0; i < NBR_DEVICES && instance == 0; i++) {
+        if (!g_strcmp0(devices[i].name, name)) {
+            return &devices[i];
+        }
+    }
+    set_error(error, LAROD_ERROR_INVALID_CHIP_ID, "No device %s with instance %u", name, instance);
+    return NULL;
+}
+
+const char* larodGetDeviceName(const larodDevice* dev, larodError** error) {
+    if (!dev) {
+        set_error(error, LAROD_ERROR_INVALID_CHIP_ID, "Invalid device");
+        return NULL;
+    }
+    return dev->name;
+}
+
+static unsigned int get_tflite_threads(void) {
+    const char* threads_str = g_getenv("REPLAY_TFLITE_THREADS");
+    if (threads_str) {
+        guint64 threads = g_ascii_strtoull(threads_str, NULL, 10);
+        if (threads > 0 && threads <= G_MAXINT) {
+            return (unsigned int)threads;
+        }
+        syslog(LOG_WARNING, "Ignoring invalid REPLAY_TFLITE_THREADS %s", threads_str);
+    }
+    return g_get_num_processors();
+}
+
+static bool load_tflite_model(larodModel* model, int fd, larodError** error) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+        set_error(error, LAROD_ERROR_FD, "Unable to get the model size: %s", strerror(errno));
+        return false;
+    }
+    size_t model_size = (size_t)file_stat.st_size;
+    model->model_data = malloc(model_size);
+    if (!model->model_data) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate %zu bytes for model", model_size);
+        return false;
+    }
+    // The model must be kept in memory as long as the interpreter is used
+    size_t offset = 0;
+    while (offset < model_size) {
+        ssize_t nbr_read = pread(fd,
+                                 (uint8_t*)model->model_data + offset,
+                                 model_size - offset,
+                                 (off_t)offset);
+        if (nbr_read <= 0) {
+            set_error(error, LAROD_ERROR_FD, "Unable to read model: %s", strerror(errno));
+            return false;
+        }
+        offset += (size_t)nbr_read;
+    }
+    model->tflite_model = TfLiteModelCreate(model->model_data, model_size);
+    if (!model->tflite_model) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Not a TensorFlow Lite model");
+        return false;
+    }
+    TfLiteInterpreterOptions* options = TfLiteInterpreterOptionsCreate();
+    unsigned int nbr_threads          = get_tflite_threads();
+    TfLiteInterpreterOptionsSetNumThreads(options, (int32_t)nbr_threads);
+    model->interpreter = TfLiteInterpreterCreate(model->tflite_model, options);
+    TfLiteInterpreterOptionsDelete(options);
+    if (!model->interpreter) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Unable to create TensorFlow Lite interpreter");
+        return false;
+    }
+    if (TfLiteInterpreterAllocateTensors(model->interpreter) != kTfLiteOk) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Unable to allocate TensorFlow Lite tensors");
+        return false;
+    }
+    syslog(LOG_INFO, "Running TensorFlow Lite with %u threads", nbr_threads);
+    return true;
+}
+
+static const map_entry_t*
+find_map_entry(const larodMap* map, const char* key, map_value_type_t type) {
+    for (size_t i = 0; map && i < map->nbr_entries; i++) {
+        if (!g_strcmp0(map->entries[i].key, key) && map->entries[i].type == type) {
+            return &map->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t get_image_size(const image_params_t* params) {
+    switch (params->format) {
+        case IMAGE_FORMAT_NV12:
+            return params->row_pitch * params->height * 3 / 2;
+        case IMAGE_FORMAT_RGB_PLANAR:
+            return params->row_pitch * params->height * 3;
+        case IMAGE_FORMAT_RGB_INTERLEAVED:
+        default:
+            return params->row_pitch * params->height;
+    }
+}
+
+// Read image.input.* or image.output.* from the parameters of the model
+static bool parse_image_params(const larodMap* map,
+                               const char* prefix,
+                               image_params_t* params,
+                               larodError** error) {
+    char key[64];
+
+    snprintf(key, sizeof(key), "%s.format", prefix);
+    const map_entry_t* format = find_map_entry(map, key, MAP_VALUE_STR);
+    if (!format) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Missing %s", key);
+        return false;
+    }
+    if (!g_strcmp0(format->str, "nv12")) {
+        params->format = IMAGE_FORMAT_NV12;
+    } else if (!g_strcmp0(format->str, "rgb-interleaved")) {
+        params->format = IMAGE_FORMAT_RGB_INTERLEAVED;
+    } else if (!g_strcmp0(format->str, "rgb-planar")) {
+        params->format = IMAGE_FORMAT_RGB_PLANAR;
+    } else {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Unsupported %s %s", key, format->str);
+        return false;
+    }
+
+    snprintf(key, sizeof(key), "%s.size", prefix);
+    const map_entry_t* size = find_map_entry(map, key, MAP_VALUE_INT_ARR2);
+    if (!size || size->ints[0] <= 0 || size->ints[1] <= 0) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Missing or invalid %s", key);
+        return false;
+    }
+    params->width  = (size_t)size->ints[0];
+    params->height = (size_t)size->ints[1];
+
+    snprintf(key, sizeof(key), "%s.row-pitch", prefix);
+    const map_entry_t* row_pitch = find_map_entry(map, key, MAP_VALUE_INT);
+    if (row_pitch && row_pitch->ints[0] > 0) {
+        params->row_pitch = (size_t)row_pitch->ints[0];
+    } else if (params->format == IMAGE_FORMAT_RGB_INTERLEAVED) {
+        params->row_pitch = params->width * 3;
+    } else {
+        params->row_pitch = params->width;
+    }
+    return true;
+}
+
+static bool load_proc_model(larodModel* model, const larodMap* params, larodError** error) {
+    if (!parse_image_params(params, "image.input", &model->input, error) ||
+        !parse_image_params(params, "image.output", &model->output, error)) {
+        return false;
+    }
+    if (model->input.format == IMAGE_FORMAT_RGB_PLANAR ||
+        model->output.format == IMAGE_FORMAT_NV12) {
+        set_error(error,
+                  LAROD_ERROR_LOAD_MODEL,
+                  "Only nv12 or rgb-interleaved to rgb conversion is supported");
+        return false;
+    }
+    model->x_map = calloc(model->output.width, sizeof(size_t));
+    if (!model->x_map) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate scaling map");
+        return false;
+    }
+    for (size_t x = 0; x < model->output.width; x++) {
+        model->x_map[x] = x * model->input.width / model->output.width;
+    }
+    return true;
+}
+
+larodModel* larodLoadModel(larodConnection* conn,
+                           const int fd,
+                           const larodDevice* dev,
+                           const larodAccess access,
+                           const char* name,
+                           const larodMap* params,
+                           larodError** error) {
+    if (!conn || !dev) {
+        set_error(error, LAROD_ERROR_LOAD_MODEL, "Invalid connection or device");
+        return NULL;
+    }
+    larodModel* model = calloc(1, sizeof(larodModel));
+    if (!model) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate model");
+        return NULL;
+    }
+    g_mutex_init(&model->mutex);
+    model->id     = ++conn->next_model_id;
+    model->name   = strdup(name ? name : "");
+    model->device = dev;
+    model->access = access;
+    if (!model->name) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate model name");
+        free_model(model);
+        return NULL;
+    }
+
+    bool loaded = false;
+    if (dev->index == DEVICE_TFLITE) {
+        loaded = load_tflite_model(model, fd, error);
+    } else {
+        loaded = load_proc_model(model, params, error);
+    }
+    if (!loaded) {
+        free_model(model);
+        return NULL;
+    }
+    model->next  = conn->models;
+    conn->models = model;
+    return model;
+}
+
+larodModel* larodGetModel(larodConnection* conn, const uint64_t modelId, larodError** error) {
+    for (larodModel* model = conn->models; model; model = model->next) {
+        if (model->id == modelId) {
+            return model;
+        }
+    }
+    set_error(error,
+              LAROD_ERROR_MODEL_NOT_FOUND,
+              "No model with id %llu",
+              (unsigned long long)modelId);
+    return NULL;
+}
+
+// A host process never finds models loaded by an earlier run
+larodModel** larodGetModels(larodConnection* conn, size_t* numModels, larodError** error) {
+    (void)conn;
+    *numModels          = 0;
+    larodModel** models = calloc(1, sizeof(larodModel*));
+    if (!models) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate model list");
+    }
+    return models;
+}
+
+bool larodDeleteModel(larodConnection* conn, larodModel* model, larodError** error) {
+    for (larodModel** link = &conn->models; *link; link = &(*link)->next) {
+        if (*link == model) {
+            *link = model->next;
+            free_model(model);
+            return true;
+        }
+    }
+    set_error(error, LAROD_ERROR_DELETE_MODEL, "Model is not loaded");
+    return false;
+}
+
+// Only the handle is released, the model is kept loaded until disconnect
+void larodDestroyModel(larodModel** model) {
+    if (model) {
+        *model = NULL;
+    }
+}
+
+void larodDestroyModels(larodModel*** models, size_t numModels) {
+    (void)numModels;
+    if (models) {
+        free(*models);
+        *models = NULL;
+    }
+}
+
+uint64_t larodGetModelId(const larodModel* model, larodError** error) {
+    if (!model) {
+        set_error(error, LAROD_ERROR_MODEL_NOT_FOUND, "Invalid model");
+        return 0;
+    }
+    return model->id;
+}
+
+const char* larodGetModelName(const larodModel* model, larodError** error) {
+    if (!model) {
+        set_error(error, LAROD_ERROR_MODEL_NOT_FOUND, "Invalid model");
+        return NULL;
+    }
+    return model->name;
+}
+
+const larodDevice* larodGetModelDevice(const larodModel* model, larodError** error) {
+    if (!model) {
+        set_error(error, LAROD_ERROR_MODEL_NOT_FOUND, "Invalid model");
+        return NULL;
+    }
+    return model->device;
+}
+
+larodTensor** larodCreateTensors(const size_t numTensors, larodError** error) {
+    if (numTensors == 0) {
+        set_error(error, LAROD_ERROR_ALLOC, "No tensors to create");
+        return NULL;
+    }
+    larodTensor** tensors = calloc(numTensors, sizeof(larodTensor*));
+    if (!tensors) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate tensors");
+        return NULL;
+    }
+    for (size_t i = 0; i < numTensors; i++) {
+        tensors[i] = calloc(1, sizeof(larodTensor));
+        if (!tensors[i]) {
+            larodDestroyTensors(NULL, &tensors, i, NULL);
+            set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate tensor");
+            return NULL;
+        }
+        tensors[i]->data_type = LAROD_TENSOR_DATA_TYPE_UNSPECIFIED;
+        tensors[i]->layout    = LAROD_TENSOR_LAYOUT_UNSPECIFIED;
+        tensors[i]->fd        = LAROD_INVALID_FD;
+    }
+    return tensors;
+}
+
+static void unmap_tensor(larodTensor* tensor) {
+    g_mutex_lock(&map_mutex);
+    if (tensor->map_data) {
+        munmap(tensor->map_data, tensor->map_size);
+    }
+    tensor->map_data = NULL;
+    tensor->map_size = 0;
+    g_mutex_unlock(&map_mutex);
+}
+
+bool larodDestroyTensors(larodConnection* conn,
+                         larodTensor*** tensors,
+                         const size_t numTensors,
+                         larodError** error) {
+    (void)conn;
+    (void)error;
+    if (!tensors || !*tensors) {
+        return true;
+    }
+    for (size_t i = 0; i < numTensors; i++) {
+        larodTensor* tensor = (*tensors)[i];
+        if (!tensor) {
+            continue;
+        }
+        unmap_tensor(tensor);
+        if (tensor->owns_fd && tensor->fd >= 0) {
+            close(tensor->fd);
+        }
+        free(tensor);
+    }
+    free(*tensors);
+    *tensors = NULL;
+    return true;
+}
+
+// Nothing is cached between jobs except the mapping of the fd
+bool larodTrackTensor(larodConnection* conn, larodTensor* tensor, larodError** error) {
+    (void)conn;
+    (void)tensor;
+    (void)error;
+    return true;
+}
+
+// The pitch of a dimension is the byte size of the dimension and all
+// following dimensions
+static void build_packed_pitches(larodTensor* tensor, size_t element_size) {
+    tensor->pitches.len = tensor->dims.len;
+    size_t pitch        = element_size;
+    for (size_t i = tensor->dims.len; i > 0; i--) {
+        pitch *= tensor->dims.dims[i - 1];
+        tensor->pitches.pitches[i - 1] = pitch;
+    }
+}
+
+static larodTensorDataType get_data_type(TfLiteType type) {
+    switch (type) {
+        case kTfLiteBool:
+            return LAROD_TENSOR_DATA_TYPE_BOOL;
+        case kTfLiteUInt8:
+            return LAROD_TENSOR_DATA_TYPE_UINT8;
+        case kTfLiteInt8:
+            return LAROD_TENSOR_DATA_TYPE_INT8;
+        case kTfLiteUInt16:
+            return LAROD_TENSOR_DATA_TYPE_UINT16;
+        case kTfLiteInt16:
+            return LAROD_TENSOR_DATA_TYPE_INT16;
+        case kTfLiteUInt32:
+            return LAROD_TENSOR_DATA_TYPE_UINT32;
+        case kTfLiteInt32:
+            return LAROD_TENSOR_DATA_TYPE_INT32;
+        case kTfLiteUInt64:
+            return LAROD_TENSOR_DATA_TYPE_UINT64;
+        case kTfLiteInt64:
+            return LAROD_TENSOR_DATA_TYPE_INT64;
+        case kTfLiteFloat16:
+            return LAROD_TENSOR_DATA_TYPE_FLOAT16;
+        case kTfLiteFloat32:
+            return LAROD_TENSOR_DATA_TYPE_FLOAT32;
+        case kTfLiteFloat64:
+            return LAROD_TENSOR_DATA_TYPE_FLOAT64;
+        default:
+            return LAROD_TENSOR_DATA_TYPE_UNSPECIFIED;
+    }
+}
+
+static bool
+describe_tflite_tensor(larodTensor* tensor, const TfLiteTensor* tflite_tensor, larodError** error) {
+    int32_t nbr_dims = TfLiteTensorNumDims(tflite_tensor);
+    if (nbr_dims <= 0 || nbr_dims > LAROD_TENSOR_MAX_LEN) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Unsupported number of dims %d", nbr_dims);
+        return false;
+    }
+    size_t nbr_elements = 1;
+    tensor->dims.len    = (size_t)nbr_dims;
+    for (int32_t i = 0; i < nbr_dims; i++) {
+        int32_t dim          = TfLiteTensorDim(tflite_tensor, i);
+        tensor->dims.dims[i] = dim > 0 ? (size_t)dim : 1;
+        nbr_elements *= tensor->dims.dims[i];
+    }
+    size_t byte_size  = TfLiteTensorByteSize(tflite_tensor);
+    TfLiteType type   = TfLiteTensorType(tflite_tensor);
+    tensor->data_type = get_data_type(type);
+    tensor->layout    = nbr_dims == 4 ? LAROD_TENSOR_LAYOUT_NHWC : LAROD_TENSOR_LAYOUT_UNSPECIFIED;
+    build_packed_pitches(tensor, byte_size / nbr_elements);
+    return true;
+}
+
+static void describe_image_tensor(larodTensor* tensor, const image_params_t* params) {
+    tensor->data_type    = LAROD_TENSOR_DATA_TYPE_UINT8;
+    tensor->dims.len     = 4;
+    tensor->dims.dims[0] = 1;
+    if (params->format == IMAGE_FORMAT_RGB_PLANAR) {
+        tensor->layout       = LAROD_TENSOR_LAYOUT_NCHW;
+        tensor->dims.dims[1] = 3;
+        tensor->dims.dims[2] = params->height;
+        tensor->dims.dims[3] = params->width;
+    } else {
+        tensor->layout       = LAROD_TENSOR_LAYOUT_NHWC;
+        tensor->dims.dims[1] = params->height;
+        tensor->dims.dims[2] = params->width;
+        tensor->dims.dims[3] = 3;
+    }
+    larodBuildTensorPitches(tensor, tensor->layout, params->row_pitch, params->height, 3, NULL);
+}
+
+static bool alloc_tensor_fd(larodTensor* tensor, uint32_t fd_props, larodError** error) {
+    size_t size = tensor->pitches.len > 0 ? tensor->pitches.pitches[0] : 0;
+    int fd      = memfd_create("replay-tensor", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate tensor: %s", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    tensor->fd       = fd;
+    tensor->owns_fd  = true;
+    tensor->fd_size  = size;
+    tensor->fd_props = fd_props;
+    return true;
+}
+
+static larodTensor** alloc_model_tensors(const larodModel* model,
+                                         bool inputs,
+                                         uint32_t fd_props,
+                                         size_t* num_tensors,
+                                         larodError** error) {
+    size_t count = 1;
+    if (model->device->index == DEVICE_TFLITE && inputs) {
+        count = (size_t)TfLiteInterpreterGetInputTensorCount(model->interpreter);
+    } else if (model->device->index == DEVICE_TFLITE) {
+        count = (size_t)TfLiteInterpreterGetOutputTensorCount(model->interpreter);
+    } else if (inputs) {
+        set_error(error, LAROD_ERROR_ALLOC, "Inputs of %s are not supported", model->device->name);
+        return NULL;
+    }
+    larodTensor** tensors = larodCreateTensors(count, error);
+    if (!tensors) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bool described = true;
+        if (model->device->index == DEVICE_PROC) {
+            describe_image_tensor(tensors[i], &model->output);
+        } else if (inputs) {
+            described = describe_tflite_tensor(
+                tensors[i],
+                TfLiteInterpreterGetInputTensor(model->interpreter, (int32_t)i),
+                error);
+        } else {
+            described = describe_tflite_tensor(
+                tensors[i],
+                TfLiteInterpreterGetOutputTensor(model->interpreter, (int32_t)i),
+                error);
+        }
+        if (!described || !alloc_tensor_fd(tensors[i], fd_props, error)) {
+            larodDestroyTensors(NULL, &tensors, count, NULL);
+            return NULL;
+        }
+    }
+    *num_tensors = count;
+    return tensors;
+}
+
+larodTensor** larodAllocModelInputs(larodConnection* conn,
+                                    const larodModel* model,
+                                    const uint32_t fdPropFlags,
+                                    size_t* numTensors,
+                                    larodMap* params,
+                                    larodError** error) {
+    (void)conn;
+    (void)params;
+    return alloc_model_tensors(model, true, fdPropFlags, numTensors, error);
+}
+
+larodTensor** larodAllocModelOutputs(larodConnection* conn,
+                                     const larodModel* model,
+                                     const uint32_t fdPropFlags,
+                                     size_t* numTensors,
+                                     larodMap* params,
+                                     larodError** error) {
+    (void)conn;
+    (void)params;
+    return alloc_model_tensors(model, false, fdPropFlags, numTensors, error);
+}
+
+const larodTensorDims* larodGetTensorDims(const larodTensor* tensor, larodError** error) {
+    if (!tensor || tensor->dims.len == 0) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Tensor has no dims");
+        return NULL;
+    }
+    return &tensor->dims;
+}
+
+const larodTensorPitches* larodGetTensorPitches(const larodTensor* tensor, larodError** error) {
+    if (!tensor || tensor->pitches.len == 0) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Tensor has no pitches");
+        return NULL;
+    }
+    return &tensor->pitches;
+}
+
+larodTensorDataType larodGetTensorDataType(const larodTensor* tensor, larodError** error) {
+    if (!tensor) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Invalid tensor");
+        return LAROD_TENSOR_DATA_TYPE_INVALID;
+    }
+    return tensor->data_type;
+}
+
+bool larodGetTensorByteSize(const larodTensor* tensor, size_t* byteSize, larodError** error) {
+    if (!tensor || tensor->pitches.len == 0) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Tensor has no pitches");
+        return false;
+    }
+    *byteSize = tensor->pitches.pitches[0];
+    return true;
+}
+
+int larodGetTensorFd(const larodTensor* tensor, larodError** error) {
+    if (!tensor || tensor->fd < 0) {
+        set_error(error, LAROD_ERROR_FD, "Tensor has no fd");
+        return LAROD_INVALID_FD;
+    }
+    return tensor->fd;
+}
+
+bool larodGetTensorFdSize(const larodTensor* tensor, size_t* size, larodError** error) {
+    if (!tensor || tensor->fd < 0) {
+        set_error(error, LAROD_ERROR_FD, "Tensor has no fd");
+        return false;
+    }
+    *size = tensor->fd_size;
+    return true;
+}
+
+bool larodSetTensorDataType(larodTensor* tensor,
+                            const larodTensorDataType dataType,
+                            larodError** error) {
+    (void)error;
+    tensor->data_type = dataType;
+    return true;
+}
+
+bool larodSetTensorLayout(larodTensor* tensor, const larodTensorLayout layout, larodError** error) {
+    (void)error;
+    tensor->layout = layout;
+    return true;
+}
+
+bool larodBuildTensorDims(larodTensor* tensor,
+                          larodTensorLayout layout,
+                          size_t width,
+                          size_t height,
+                          size_t channels,
+                          larodError** error) {
+    tensor->dims.len     = 4;
+    tensor->dims.dims[0] = 1;
+    if (layout == LAROD_TENSOR_LAYOUT_NHWC) {
+        tensor->dims.dims[1] = height;
+        tensor->dims.dims[2] = width;
+        tensor->dims.dims[3] = channels;
+    } else if (layout == LAROD_TENSOR_LAYOUT_NCHW || layout == LAROD_TENSOR_LAYOUT_420SP) {
+        tensor->dims.dims[1] = channels;
+        tensor->dims.dims[2] = height;
+        tensor->dims.dims[3] = width;
+    } else {
+        tensor->dims.len = 0;
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Unsupported layout %d", layout);
+        return false;
+    }
+    return true;
+}
+
+bool larodBuildTensorPitches(larodTensor* tensor,
+                             larodTensorLayout layout,
+                             size_t rowPitch,
+                             size_t height,
+                             size_t channels,
+                             larodError** error) {
+    tensor->pitches.len = 4;
+    if (layout == LAROD_TENSOR_LAYOUT_NHWC) {
+        tensor->pitches.pitches[3] = channels;
+        tensor->pitches.pitches[2] = rowPitch;
+        tensor->pitches.pitches[1] = rowPitch * height;
+    } else if (layout == LAROD_TENSOR_LAYOUT_NCHW) {
+        tensor->pitches.pitches[3] = rowPitch;
+        tensor->pitches.pitches[2] = rowPitch * height;
+        tensor->pitches.pitches[1] = rowPitch * height * channels;
+    } else if (layout == LAROD_TENSOR_LAYOUT_420SP) {
+        // The interleaved UV plane has half the height of the Y plane
+        tensor->pitches.pitches[3] = rowPitch;
+        tensor->pitches.pitches[2] = rowPitch * height;
+        tensor->pitches.pitches[1] = rowPitch * height * 3 / 2;
+    } else {
+        tensor->pitches.len = 0;
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Unsupported layout %d", layout);
+        return false;
+    }
+    tensor->pitches.pitches[0] = tensor->pitches.pitches[1];
+    return true;
+}
+
+bool larodSetTensorFd(larodTensor* tensor, const int fd, larodError** error) {
+    (void)error;
+    unmap_tensor(tensor);
+    if (tensor->owns_fd && tensor->fd >= 0) {
+        close(tensor->fd);
+    }
+    tensor->fd      = fd;
+    tensor->owns_fd = false;
+    return true;
+}
+
+bool larodSetTensorFdSize(larodTensor* tensor, const size_t size, larodError** error) {
+    (void)error;
+    tensor->fd_size = size;
+    return true;
+}
+
+bool larodSetTensorFdOffset(larodTensor* tensor, const int64_t offset, larodError** error) {
+    if (offset < 0) {
+        set_error(error, LAROD_ERROR_FD, "Invalid offset %lld", (long long)offset);
+        return false;
+    }
+    tensor->fd_offset = offset;
+    return true;
+}
+
+bool larodSetTensorFdProps(larodTensor* tensor, const uint32_t fdPropFlags, larodError** error) {
+    (void)error;
+    tensor->fd_props = fdPropFlags;
+    return true;
+}
+
+int larodConvertVmemFdToDmabuf(int fd, int64_t offset, larodError** error) {
+    (void)offset;
+    int new_fd = dup(fd);
+    if (new_fd < 0) {
+        set_error(error, LAROD_ERROR_FD, "Unable to dup fd: %s", strerror(errno));
+        return LAROD_INVALID_FD;
+    }
+    return new_fd;
+}
+
+larodMap* larodCreateMap(larodError** error) {
+    larodMap* map = calloc(1, sizeof(larodMap));
+    if (!map) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate map");
+    }
+    return map;
+}
+
+void larodDestroyMap(larodMap** map) {
+    if (!map || !*map) {
+        return;
+    }
+    for (size_t i = 0; i < (*map)->nbr_entries; i++) {
+        free((*map)->entries[i].key);
+        free((*map)->entries[i].str);
+    }
+    free(*map);
+    *map = NULL;
+}
+
+static map_entry_t* set_map_entry(larodMap* map,
+                                  const char* key,
+                                  map_value_type_t type,
+                                  larodError** error) {
+    map_entry_t* entry = NULL;
+    for (size_t i = 0; i < map->nbr_entries; i++) {
+        if (!g_strcmp0(map->entries[i].key, key)) {
+            entry = &map->entries[i];
+            break;
+        }
+    }
+    if (!entry) {
+        if (map->nbr_entries == MAX_NBR_MAP_ENTRIES) {
+            set_error(error, LAROD_ERROR_ALLOC, "Too many map entries for %s", key);
+            return NULL;
+        }
+        entry      = &map->entries[map->nbr_entries++];
+        entry->key = strdup(key);
+    }
+    free(entry->str);
+    entry->str  = NULL;
+    entry->type = type;
+    return entry;
+}
+
+bool larodMapSetStr(larodMap* map, const char* key, const char* value, larodError** error) {
+    map_entry_t* entry = set_map_entry(map, key, MAP_VALUE_STR, error);
+    if (!entry) {
+        return false;
+    }
+    entry->str = strdup(value);
+    return true;
+}
+
+bool larodMapSetInt(larodMap* map, const char* key, const int64_t value, larodError** error) {
+    map_entry_t* entry = set_map_entry(map, key, MAP_VALUE_INT, error);
+    if (!entry) {
+        return false;
+    }
+    entry->ints[0] = value;
+    return true;
+}
+
+bool larodMapSetIntArr2(larodMap* map,
+                        const char* key,
+                        const int64_t value0,
+                        const int64_t value1,
+                        larodError** error) {
+    map_entry_t* entry = set_map_entry(map, key, MAP_VALUE_INT_ARR2, error);
+    if (!entry) {
+        return false;
+    }
+    entry->ints[0] = value0;
+    entry->ints[1] = value1;
+    return true;
+}
+
+bool larodMapSetIntArr4(larodMap* map,
+                        const char* key,
+                        const int64_t value0,
+                        const int64_t value1,
+                        const int64_t value2,
+                        const int64_t value3,
+                        larodError** error) {
+    map_entry_t* entry = set_map_entry(map, key, MAP_VALUE_INT_ARR4, error);
+    if (!entry) {
+        return false;
+    }
+    entry->ints[0] = value0;
+    entry->ints[1] = value1;
+    entry->ints[2] = value2;
+    entry->ints[3] = value3;
+    return true;
+}
+
+// Get the data of a tensor, the whole fd is mapped the first time
+static uint8_t* map_tensor(larodTensor* tensor, size_t size, larodError** error) {
+    uint8_t* data = NULL;
+
+    g_mutex_lock(&map_mutex);
+    if (!tensor->map_data && tensor->fd >= 0) {
+        struct stat fd_stat;
+        if (fstat(tensor->fd, &fd_stat) == 0 && fd_stat.st_size > 0) {
+            void* map_data = mmap(NULL,
+                                  (size_t)fd_stat.st_size,
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED,
+                                  tensor->fd,
+                                  0);
+            if (map_data != MAP_FAILED) {
+                tensor->map_data = map_data;
+                tensor->map_size = (size_t)fd_stat.st_size;
+            }
+        }
+    }
+    if (!tensor->map_data) {
+        set_error(error, LAROD_ERROR_FD, "Unable to map tensor fd %d", tensor->fd);
+    } else if ((size_t)tensor->fd_offset + size > tensor->map_size) {
+        set_error(error,
+                  LAROD_ERROR_TENSOR_MISMATCH,
+                  "Tensor fd has %zu bytes but %zu are needed",
+                  tensor->map_size - (size_t)tensor->fd_offset,
+                  size);
+    } else {
+        data = tensor->map_data + tensor->fd_offset;
+    }
+    g_mutex_unlock(&map_mutex);
+    return data;
+}
+
+static bool run_tflite_job(larodModel* model, const larodJobRequest* req, larodError** error) {
+    size_t nbr_inputs  = (size_t)TfLiteInterpreterGetInputTensorCount(model->interpreter);
+    size_t nbr_outputs = (size_t)TfLiteInterpreterGetOutputTensorCount(model->interpreter);
+    if (req->nbr_inputs != nbr_inputs || req->nbr_outputs != nbr_outputs) {
+        set_error(error,
+                  LAROD_ERROR_TENSOR_MISMATCH,
+                  "Model has %zu inputs and %zu outputs, job has %zu and %zu",
+                  nbr_inputs,
+                  nbr_outputs,
+                  req->nbr_inputs,
+                  req->nbr_outputs);
+        return false;
+    }
+    for (size_t i = 0; i < nbr_inputs; i++) {
+        TfLiteTensor* tensor = TfLiteInterpreterGetInputTensor(model->interpreter, (int32_t)i);
+        size_t size          = TfLiteTensorByteSize(tensor);
+        uint8_t* data        = map_tensor(req->inputs[i], size, error);
+        if (!data) {
+            return false;
+        }
+        if (TfLiteTensorCopyFromBuffer(tensor, data, size) != kTfLiteOk) {
+            set_error(error, LAROD_ERROR_JOB, "Unable to copy input %zu", i);
+            return false;
+        }
+    }
+    if (TfLiteInterpreterInvoke(model->interpreter) != kTfLiteOk) {
+        set_error(error, LAROD_ERROR_JOB, "TensorFlow Lite inference failed");
+        return false;
+    }
+    for (size_t i = 0; i < nbr_outputs; i++) {
+        const TfLiteTensor* tensor =
+            TfLiteInterpreterGetOutputTensor(model->interpreter, (int32_t)i);
+        size_t size   = TfLiteTensorByteSize(tensor);
+        uint8_t* data = map_tensor(req->outputs[i], size, error);
+        if (!data) {
+            return false;
+        }
+        if (TfLiteTensorCopyToBuffer(tensor, data, size) != kTfLiteOk) {
+            set_error(error, LAROD_ERROR_JOB, "Unable to copy output %zu", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t clamp_to_uint8(int value) {
+    if (value < 0) {
+        return 0;
+    }
+    return value > 255 ? 255 : (uint8_t)value;
+}
+
+// BT.601 with limited range, the same conversion as libyuv uses for NV12
+static void yuv_to_rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t* rgb) {
+    int c = 298 * ((int)y - 16);
+    int d = (int)u - 128;
+    int e = (int)v - 128;
+
+    rgb[0] = clamp_to_uint8((c + (409 * e) + 128) >> 8);
+    rgb[1] = clamp_to_uint8((c - (100 * d) - (208 * e) + 128) >> 8);
+    rgb[2] = clamp_to_uint8((c + (516 * d) + 128) >> 8);
+}
+
+// Convert to RGB and scale the cropped area with nearest neighbour
+static bool run_proc_job(larodModel* model, const larodJobRequest* req, larodError** error) {
+    const image_params_t* in  = &model->input;
+    const image_params_t* out = &model->output;
+    image_crop_t area         = {0, 0, in->width, in->height};
+
+    if (req->has_crop) {
+        area = req->crop;
+    }
+
+    if (req->nbr_inputs != 1 || req->nbr_outputs != 1) {
+        set_error(error, LAROD_ERROR_TENSOR_MISMATCH, "Image conversion needs one tensor each");
+        return false;
+    }
+    const uint8_t* src = map_tensor(req->inputs[0], get_image_size(in), error);
+    uint8_t* dst       = map_tensor(req->outputs[0], get_image_size(out), error);
+    if (!src || !dst) {
+        return false;
+    }
+    size_t plane_size = out->row_pitch * out->height;
+    for (size_t y = 0; y < out->height; y++) {
+        size_t src_y          = area.y + (y * area.height / out->height);
+        const uint8_t* in_row = src + (src_y * in->row_pitch);
+        // The interleaved UV plane follows the Y plane and has half the height
+        const uint8_t* uv_row = src + (in->row_pitch * in->height) + ((src_y / 2) * in->row_pitch);
+        uint8_t* out_row      = dst + (y * out->row_pitch);
+
+        for (size_t x = 0; x < out->width; x++) {
+            size_t src_x = req->has_crop ? area.x + (x * area.width / out->width)
+                                         : model->x_map[x];
+            uint8_t rgb[3];
+            if (in->format == IMAGE_FORMAT_NV12) {
+                size_t uv_x = src_x & ~(size_t)1;
+                yuv_to_rgb(in_row[src_x], uv_row[uv_x], uv_row[uv_x + 1], rgb);
+            } else {
+                memcpy(rgb, in_row + (src_x * 3), 3);
+            }
+            if (out->format == IMAGE_FORMAT_RGB_PLANAR) {
+                out_row[x]                    = rgb[0];
+                out_row[plane_size + x]       = rgb[1];
+                out_row[(2 * plane_size) + x] = rgb[2];
+            } else {
+                memcpy(out_row + (x * 3), rgb, 3);
+            }
+        }
+    }
+    return true;
+}
+
+static bool run_job(const larodJobRequest* req, larodError** error) {
+    larodModel* model = req->model;
+
+    g_mutex_lock(&model->mutex);
+    bool success = model->device->index == DEVICE_TFLITE ? run_tflite_job(model, req, error)
+                                                         : run_proc_job(model, req, error);
+    g_mutex_unlock(&model->mutex);
+    return success;
+}
+
+static larodTensor** copy_tensor_list(larodTensor** tensors, size_t nbr_tensors) {
+    larodTensor** copy = calloc(nbr_tensors > 0 ? nbr_tensors : 1, sizeof(larodTensor*));
+    if (copy && nbr_tensors > 0) {
+        memcpy(copy, tensors, nbr_tensors * sizeof(larodTensor*));
+    }
+    return copy;
+}
+
+// The tensor lists are copied so that the request can be changed while a job
+// that was started from it is still queued
+static bool copy_job_request(larodJobRequest* copy, const larodJobRequest* req) {
+    copy->model       = req->model;
+    copy->has_crop    = req->has_crop;
+    copy->crop        = req->crop;
+    copy->nbr_inputs  = req->nbr_inputs;
+    copy->nbr_outputs = req->nbr_outputs;
+    copy->inputs      = copy_tensor_list(req->inputs, req->nbr_inputs);
+    copy->outputs     = copy_tensor_list(req->outputs, req->nbr_outputs);
+    return copy->inputs && copy->outputs;
+}
+
+static void clear_job_request(larodJobRequest* req) {
+    free(req->inputs);
+    free(req->outputs);
+    req->inputs  = NULL;
+    req->outputs = NULL;
+}
+
+// Read image.input.crop from the parameters of a job, the only job parameter
+// that is supported
+static bool parse_job_params(larodJobRequest* req, const larodMap* params, larodError** error) {
+    req->has_crop = false;
+    if (!params) {
+        return true;
+    }
+    const map_entry_t* crop = find_map_entry(params, "image.input.crop", MAP_VALUE_INT_ARR4);
+    if (!crop) {
+        return true;
+    }
+    if (req->model->device->index != DEVICE_PROC) {
+        set_error(error, LAROD_ERROR_JOB, "Only cpu-proc jobs can crop");
+        return false;
+    }
+    const image_params_t* in = &req->model->input;
+    if (crop->ints[0] < 0 || crop->ints[1] < 0 || crop->ints[2] <= 0 || crop->ints[3] <= 0 ||
+        crop->ints[0] + crop->ints[2] > (int64_t)in->width ||
+        crop->ints[1] + crop->ints[3] > (int64_t)in->height) {
+        set_error(error, LAROD_ERROR_JOB, "Crop is outside of the input image");
+        return false;
+    }
+    req->has_crop    = true;
+    req->crop.x      = (size_t)crop->ints[0];
+    req->crop.y      = (size_t)crop->ints[1];
+    req->crop.width  = (size_t)crop->ints[2];
+    req->crop.height = (size_t)crop->ints[3];
+    return true;
+}
+
+larodJobRequest* larodCreateJobRequest(const larodModel* model,
+                                       larodTensor** inputTensors,
+                                       size_t numInputs,
+                                       larodTensor** outputTensors,
+                                       size_t numOutputs,
+                                       larodMap* params,
+                                       larodError** error) {
+    if (!model) {
+        set_error(error, LAROD_ERROR_MODEL_NOT_FOUND, "Invalid model");
+        return NULL;
+    }
+    larodJobRequest req = {
+        .model       = (larodModel*)model,
+        .inputs      = inputTensors,
+        .nbr_inputs  = numInputs,
+        .outputs     = outputTensors,
+        .nbr_outputs = numOutputs,
+    };
+    if (!parse_job_params(&req, params, error)) {
+        return NULL;
+    }
+    larodJobRequest* job_req = calloc(1, sizeof(larodJobRequest));
+    if (!job_req || !copy_job_request(job_req, &req)) {
+        larodDestroyJobRequest(&job_req);
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate job request");
+        return NULL;
+    }
+    return job_req;
+}
+
+void larodDestroyJobRequest(larodJobRequest** jobReq) {
+    if (!jobReq || !*jobReq) {
+        return;
+    }
+    clear_job_request(*jobReq);
+    free(*jobReq);
+    *jobReq = NULL;
+}
+
+bool larodSetJobRequestInputs(larodJobRequest* jobReq,
+                              larodTensor** tensors,
+                              const size_t numTensors,
+                              larodError** error) {
+    larodTensor** inputs = copy_tensor_list(tensors, numTensors);
+    if (!inputs) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate job inputs");
+        return false;
+    }
+    free(jobReq->inputs);
+    jobReq->inputs     = inputs;
+    jobReq->nbr_inputs = numTensors;
+    return true;
+}
+
+bool larodSetJobRequestOutputs(larodJobRequest* jobReq,
+                               larodTensor** tensors,
+                               const size_t numTensors,
+                               larodError** error) {
+    larodTensor** outputs = copy_tensor_list(tensors, numTensors);
+    if (!outputs) {
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate job outputs");
+        return false;
+    }
+    free(jobReq->outputs);
+    jobReq->outputs     = outputs;
+    jobReq->nbr_outputs = numTensors;
+    return true;
+}
+
+bool larodSetJobRequestParams(larodJobRequest* jobReq, const larodMap* params, larodError** error) {
+    return parse_job_params(jobReq, params, error);
+}
+
+bool larodRunJob(larodConnection* conn, const larodJobRequest* jobReq, larodError** error) {
+    (void)conn;
+    return run_job(jobReq, error);
+}
+
+// The workers leave the signals to the threads of the application
+static void block_signals(void) {
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+static gpointer run_worker(gpointer data) {
+    worker_t* worker = data;
+
+    block_signals();
+    g_mutex_lock(&worker->mutex);
+    while (true) {
+        job_t* job = g_queue_pop_head(worker->jobs);
+        if (!job) {
+            if (worker->stopping) {
+                break;
+            }
+            g_cond_wait(&worker->cond, &worker->mutex);
+            continue;
+        }
+        g_mutex_unlock(&worker->mutex);
+
+        larodError* error = NULL;
+        run_job(&job->req, &error);
+        job->callback(job->user_data, error);
+        larodClearError(&error);
+        clear_job_request(&job->req);
+        free(job);
+
+        g_mutex_lock(&worker->mutex);
+    }
+    g_mutex_unlock(&worker->mutex);
+    return NULL;
+}
+
+bool larodRunJobAsync(larodConnection* conn,
+                      const larodJobRequest* jobReq,
+                      larodRunJobCallback callback,
+                      void* userData,
+                      larodError** error) {
+    job_t* job = calloc(1, sizeof(job_t));
+    if (!job || !copy_job_request(&job->req, jobReq)) {
+        if (job) {
+            clear_job_request(&job->req);
+        }
+        free(job);
+        set_error(error, LAROD_ERROR_ALLOC, "Unable to allocate job");
+        return false;
+    }
+    job->callback  = callback;
+    job->user_data = userData;
+
+    // The worker of a device is started by the first job on the device
+    worker_t* worker = &conn->workers[jobReq->model->device->index];
+    if (!worker->thread) {
+        g_mutex_init(&worker->mutex);
+        g_cond_init(&worker->cond);
+        worker->jobs   = g_queue_new();
+        worker->thread = g_thread_new(jobReq->model->device->name, run_worker, worker);
+    }
+    g_mutex_lock(&worker->mutex);
+    g_queue_push_tail(worker->jobs, job);
+    g_cond_signal(&worker->cond);
+    g_mutex_unlock(&worker->mutex);
+    return true;
+}
@@ -0,0 +1,968 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file replays recorded frames through a stand-in of the vdo API.
+ *
+ * The frames are read from a file of raw NV12 or RGB frames, all with the
+ * same resolution. A producer thread scales each frame to the resolution of
+ * the stream and hands it to the application through the same poll and
+ * vdo_stream_get_buffer flow as on a device. The replay is configured with
+ * environment variables:
+ *
+ * REPLAY_FILE      File with the recorded frames
+ * REPLAY_FORMAT    nv12 or rgb, nv12 is default
+ * REPLAY_WIDTH     Width of the recorded frames
+ * REPLAY_HEIGHT    Height of the recorded frames
+ * REPLAY_FRAMES    Number of frames to replay, the file is looped if needed.
+ *                  Default is the number of frames in the file.
+ * REPLAY_REALTIME  Set to 1 to deliver the frames at the framerate of the
+ *                  stream. Frames are then dropped when no buffer is free.
+ *                  By default a frame is delivered as soon as a buffer is free.
+ *
+ * When all frames are replayed SIGTERM is sent so that the application stops
+ * like it does on a device.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "vdo-buffer.h"
+#include "vdo-channel.h"
+#include "vdo-error.h"
+#include "vdo-frame.h"
+#include "vdo-map.h"
+#include "vdo-stream.h"
+
+#define MAX_NBR_BUFFERS 16
+
+typedef enum {
+    MAP_VALUE_UINT32,
+    MAP_VALUE_DOUBLE,
+    MAP_VALUE_BOOLEAN,
+    MAP_VALUE_STRING,
+    MAP_VALUE_PAIR32U,
+} map_value_type_t;
+
+typedef struct map_entry {
+    gchar* name;
+    map_value_type_t type;
+    union {
+        guint32 uint32;
+        gdouble dbl;
+        gboolean boolean;
+        gchar* string;
+        VdoPair32u pair32u;
+    } value;
+} map_entry_t;
+
+struct _VdoMap {
+    map_entry_t* entries;
+    gsize nbr_entries;
+};
+
+// The recorded frames, shared by the channel and all streams
+typedef struct replay_source {
+    VdoFormat format;
+    guint width;
+    guint height;
+    gsize frame_size;
+    guint nbr_frames;
+    guint nbr_replay_frames;
+    gboolean realtime;
+    const guint8* data;
+    gsize data_size;
+} replay_source_t;
+
+struct _VdoChannel {
+    const replay_source_t* source;
+};
+
+struct _VdoBuffer {
+    VdoStream* stream;
+    gint fd;
+    guint8* data;
+    gsize capacity;
+    gsize size;
+    guint64 timestamp;
+    guint sequence_nbr;
+};
+
+struct _VdoStream {
+    const replay_source_t* source;
+    VdoMap* info;
+    guint width;
+    guint height;
+    guint pitch;
+    // The part of the recorded frames that is scaled to the stream resolution
+    guint src_x;
+    guint src_y;
+    guint src_width;
+    guint src_height;
+    // Byte offset in a source row for each column of the stream. For NV12
+    // the offsets of the interleaved UV plane follow after the luma plane.
+    guint* x_map;
+
+    VdoBuffer buffers[MAX_NBR_BUFFERS];
+    guint nbr_buffers;
+
+    GMutex mutex;
+    GCond cond;
+    GQueue* free_buffers;
+    GQueue* ready_buffers;
+    gint event_fd;
+    GThread* producer;
+    gboolean started;
+    gboolean stopping;
+    gboolean finished;
+    gdouble framerate;
+
+    guint nbr_produced;
+    guint nbr_dropped;
+    guint nbr_fetched;
+    gint64 first_fetch_us;
+    gint64 last_unref_us;
+};
+
+static replay_source_t replay_source;
+static gboolean replay_source_loaded;
+
+// Let the application log to stderr as well as to syslog
+__attribute__((constructor)) static void replay_open_log(void) {
+    openlog(NULL, LOG_PERROR, LOG_USER);
+}
+
+GQuark vdo_error_quark(void) {
+    return g_quark_from_static_string("vdo-error-quark");
+}
+
+gboolean vdo_error_is_expected(GError** error) {
+    (void)error;
+    return FALSE;
+}
+
+VdoMap* vdo_map_new(void) {
+    return g_new0(VdoMap, 1);
+}
+
+static void clear_entry(map_entry_t* entry) {
+    if (entry->type == MAP_VALUE_STRING) {
+        g_free(entry->value.string);
+    }
+}
+
+void vdo_map_free(VdoMap* map) {
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        clear_entry(&map->entries[i]);
+        g_free(map->entries[i].name);
+    }
+    g_free(map->entries);
+    g_free(map);
+}
+
+static map_entry_t* find_entry(const VdoMap* map, const gchar* name, map_value_type_t type) {
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        if (!g_strcmp0(map->entries[i].name, name)) {
+            return map->entries[i].type == type ? &map->entries[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Replace the value of an existing entry with the name or add a new entry
+static map_entry_t* set_entry(VdoMap* map, const gchar* name, map_value_type_t type) {
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        if (!g_strcmp0(map->entries[i].name, name)) {
+            clear_entry(&map->entries[i]);
+            map->entries[i].type = type;
+            return &map->entries[i];
+        }
+    }
+    map->entries       = g_renew(map_entry_t, map->entries, map->nbr_entries + 1);
+    map_entry_t* entry = &map->entries[map->nbr_entries++];
+    entry->name        = g_strdup(name);
+    entry->type        = type;
+    return entry;
+}
+
+gboolean vdo_map_contains(const VdoMap* map, const gchar* name) {
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        if (!g_strcmp0(map->entries[i].name, name)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void vdo_map_set_uint32(VdoMap* map, const gchar* name, guint32 value) {
+    set_entry(map, name, MAP_VALUE_UINT32)->value.uint32 = value;
+}
+
+guint32 vdo_map_get_uint32(const VdoMap* map, const gchar* name, guint32 def) {
+    map_entry_t* entry = find_entry(map, name, MAP_VALUE_UINT32);
+    return entry ? entry->value.uint32 : def;
+}
+
+void vdo_map_set_double(VdoMap* map, const gchar* name, gdouble value) {
+    set_entry(map, name, MAP_VALUE_DOUBLE)->value.dbl = value;
+}
+
+gdouble vdo_map_get_double(const VdoMap* map, const gchar* name, gdouble def) {
+    map_entry_t* entry = find_entry(map, name, MAP_VALUE_DOUBLE);
+    return entry ? entry->value.dbl : def;
+}
+
+void vdo_map_set_boolean(VdoMap* map, const gchar* name, gboolean value) {
+    set_entry(map, name, MAP_VALUE_BOOLEAN)->value.boolean = value;
+}
+
+gboolean vdo_map_get_boolean(const VdoMap* map, const gchar* name, gboolean def) {
+    map_entry_t* entry = find_entry(map, name, MAP_VALUE_BOOLEAN);
+    return entry ? entry->value.boolean : def;
+}
+
+void vdo_map_set_string(VdoMap* map, const gchar* name, const gchar* value) {
+    set_entry(map, name, MAP_VALUE_STRING)->value.string = g_strdup(value);
+}
+
+const gchar*
+vdo_map_get_string(const VdoMap* map, const gchar* name, gsize* size, const gchar* def) {
+    map_entry_t* entry = find_entry(map, name, MAP_VALUE_STRING);
+    const gchar* value = entry ? entry->value.string : def;
+    if (size) {
+        *size = value ? strlen(value) + 1 : 0;
+    }
+    return value;
+}
+
+void vdo_map_set_pair32u(VdoMap* map, const gchar* name, VdoPair32u value) {
+    set_entry(map, name, MAP_VALUE_PAIR32U)->value.pair32u = value;
+}
+
+VdoPair32u vdo_map_get_pair32u(const VdoMap* map, const gchar* name, VdoPair32u def) {
+    map_entry_t* entry = find_entry(map, name, MAP_VALUE_PAIR32U);
+    return entry ? entry->value.pair32u : def;
+}
+
+static VdoMap* copy_map(const VdoMap* map) {
+    VdoMap* copy = vdo_map_new();
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        const map_entry_t* entry = &map->entries[i];
+        if (entry->type == MAP_VALUE_STRING) {
+            vdo_map_set_string(copy, entry->name, entry->value.string);
+        } else {
+            set_entry(copy, entry->name, entry->type)->value = entry->value;
+        }
+    }
+    return copy;
+}
+
+void vdo_map_dump(const VdoMap* map) {
+    for (gsize i = 0; i < map->nbr_entries; i++) {
+        const map_entry_t* entry = &map->entries[i];
+        switch (entry->type) {
+            case MAP_VALUE_UINT32:
+                syslog(LOG_INFO, "%s: %u", entry->name, entry->value.uint32);
+                break;
+            case MAP_VALUE_DOUBLE:
+                syslog(LOG_INFO, "%s: %f", entry->name, entry->value.dbl);
+                break;
+            case MAP_VALUE_BOOLEAN:
+                syslog(LOG_INFO, "%s: %s", entry->name, entry->value.boolean ? "true" : "false");
+                break;
+            case MAP_VALUE_STRING:
+                syslog(LOG_INFO, "%s: %s", entry->name, entry->value.string);
+                break;
+            case MAP_VALUE_PAIR32U:
+                syslog(LOG_INFO,
+                       "%s: %ux%u",
+                       entry->name,
+                       entry->value.pair32u.w,
+                       entry->value.pair32u.h);
+                break;
+        }
+    }
+}
+
+static gboolean parse_env_uint(const gchar* name, guint def, guint* value, GError** error) {
+    const gchar* str = g_getenv(name);
+    if (!str) {
+        *value = def;
+        return TRUE;
+    }
+    gchar* end           = NULL;
+    guint64 parsed_value = g_ascii_strtoull(str, &end, 10);
+    if (end == str || *end != '\0' || parsed_value > G_MAXUINT) {
+        g_set_error(error, VDO_ERROR, VDO_ERROR_INVALID_ARGUMENT, "Invalid %s: %s", name, str);
+        return FALSE;
+    }
+    *value = (guint)parsed_value;
+    return TRUE;
+}
+
+static gboolean load_source(GError** error) {
+    replay_source_t* source = &replay_source;
+
+    if (replay_source_loaded) {
+        return TRUE;
+    }
+    const gchar* file_name = g_getenv("REPLAY_FILE");
+    if (!file_name) {
+        g_set_error(error, VDO_ERROR, VDO_ERROR_NOT_FOUND, "REPLAY_FILE is not set");
+        return FALSE;
+    }
+    const gchar* format_str = g_getenv("REPLAY_FORMAT");
+    if (!format_str || !g_strcmp0(format_str, "nv12")) {
+        source->format = VDO_FORMAT_YUV;
+    } else if (!g_strcmp0(format_str, "rgb")) {
+        source->format = VDO_FORMAT_RGB;
+    } else {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_NOT_SUPPORTED,
+                    "REPLAY_FORMAT must be nv12 or rgb, not %s",
+                    format_str);
+        return FALSE;
+    }
+    if (!parse_env_uint("REPLAY_WIDTH", 0, &source->width, error) ||
+        !parse_env_uint("REPLAY_HEIGHT", 0, &source->height, error)) {
+        return FALSE;
+    }
+    if (source->width == 0 || source->height == 0 || source->width % 2 != 0 ||
+        source->height % 2 != 0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "REPLAY_WIDTH and REPLAY_HEIGHT must be set to even values");
+        return FALSE;
+    }
+    if (source->format == VDO_FORMAT_YUV) {
+        source->frame_size = (gsize)source->width * source->height * 3 / 2;
+    } else {
+        source->frame_size = (gsize)source->width * source->height * 3;
+    }
+
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "Unable to open %s: %s",
+                    file_name,
+                    strerror(errno));
+        return FALSE;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (gsize)file_stat.st_size < source->frame_size) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "%s does not contain a frame of %zu bytes",
+                    file_name,
+                    source->frame_size);
+        close(fd);
+        return FALSE;
+    }
+    source->data_size = (gsize)file_stat.st_size;
+    // The file is mapped since a recording can be larger than the memory
+    void* data = mmap(NULL, source->data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "Unable to map %s: %s",
+                    file_name,
+                    strerror(errno));
+        return FALSE;
+    }
+    source->data       = data;
+    source->nbr_frames = (guint)(source->data_size / source->frame_size);
+    if (!parse_env_uint("REPLAY_FRAMES",
+                        source->nbr_frames,
+                        &source->nbr_replay_frames,
+                        error)) {
+        return FALSE;
+    }
+    source->realtime = !g_strcmp0(g_getenv("REPLAY_REALTIME"), "1");
+
+    syslog(LOG_INFO,
+           "Replaying %u frames%s from %s with %u frames of %ux%u",
+           source->nbr_replay_frames,
+           source->realtime ? " in realtime" : "",
+           file_name,
+           source->nbr_frames,
+           source->width,
+           source->height);
+    replay_source_loaded = TRUE;
+    return TRUE;
+}
+
+VdoChannel* vdo_channel_get(guint channel_nbr, GError** error) {
+    if (channel_nbr != 1) {
+        g_set_error(error, VDO_ERROR, VDO_ERROR_NOT_FOUND, "Channel %u not found", channel_nbr);
+        return NULL;
+    }
+    if (!load_source(error)) {
+        return NULL;
+    }
+    VdoChannel* channel = g_new0(VdoChannel, 1);
+    channel->source     = &replay_source;
+    return channel;
+}
+
+VdoChannel* vdo_channel_get_ex(VdoMap* desc, GError** error) {
+    (void)desc;
+    return vdo_channel_get(1, error);
+}
+
+void vdo_channel_free(VdoChannel* channel) {
+    g_free(channel);
+}
+
+static guint gcd(guint a, guint b) {
+    while (b != 0) {
+        guint rest = a % b;
+        a          = b;
+        b          = rest;
+    }
+    return a;
+}
+
+VdoMap* vdo_channel_get_info(VdoChannel* channel, GError** error) {
+    (void)error;
+    const replay_source_t* source = channel->source;
+    VdoMap* info                  = vdo_map_new();
+
+    guint divisor           = gcd(source->width, source->height);
+    VdoPair32u aspect_ratio = {.w = source->width / divisor, .h = source->height / divisor};
+    vdo_map_set_uint32(info, "id", 1);
+    vdo_map_set_uint32(info, "rotation", 0);
+    vdo_map_set_pair32u(info, "aspect_ratio", aspect_ratio);
+    return info;
+}
+
+// Only the format of the recording is available, from an eighth of the
+// recorded resolution up to the recorded resolution
+VdoResolutionSet*
+vdo_channel_get_resolutions(VdoChannel* channel, VdoMap* filter, GError** error) {
+    (void)error;
+    const replay_source_t* source = channel->source;
+
+    guint32 format = vdo_map_get_uint32(filter, "format", (guint32)source->format);
+    if (format != (guint32)source->format) {
+        return g_malloc0(sizeof(VdoResolutionSet));
+    }
+    VdoResolutionSet* set = g_malloc0(sizeof(VdoResolutionSet) + (2 * sizeof(VdoResolution)));
+    set->count                 = 2;
+    set->resolutions[0].width  = MAX(source->width / 8, 2);
+    set->resolutions[0].height = MAX(source->height / 8, 2);
+    set->resolutions[1].width  = source->width;
+    set->resolutions[1].height = source->height;
+    return set;
+}
+
+// Select the part of the recorded frame to use. With image.fit crop the sides
+// or the top and bottom are cut to get the aspect ratio of the stream.
+static void setup_scaling(VdoStream* stream, gboolean crop) {
+    const replay_source_t* source = stream->source;
+
+    stream->src_x      = 0;
+    stream->src_y      = 0;
+    stream->src_width  = source->width;
+    stream->src_height = source->height;
+    if (crop) {
+        if ((guint64)source->width * stream->height > (guint64)source->height * stream->width) {
+            stream->src_width =
+                (guint)((guint64)source->height * stream->width / stream->height) & ~1u;
+            stream->src_x = ((source->width - stream->src_width) / 2) & ~1u;
+        } else {
+            stream->src_height =
+                (guint)((guint64)source->width * stream->height / stream->width) & ~1u;
+            stream->src_y = ((source->height - stream->src_height) / 2) & ~1u;
+        }
+    }
+
+    if (stream->source->format == VDO_FORMAT_RGB) {
+        stream->x_map = g_new0(guint, stream->width);
+        for (guint x = 0; x < stream->width; x++) {
+            stream->x_map[x] = (stream->src_x + (x * stream->src_width / stream->width)) * 3;
+        }
+        return;
+    }
+    guint uv_width = stream->width / 2;
+    stream->x_map  = g_new0(guint, stream->width + uv_width);
+    for (guint x = 0; x < stream->width; x++) {
+        stream->x_map[x] = stream->src_x + (x * stream->src_width / stream->width);
+    }
+    for (guint x = 0; x < uv_width; x++) {
+        stream->x_map[stream->width + x] =
+            ((stream->src_x / 2) + (x * (stream->src_width / 2) / uv_width)) * 2;
+    }
+}
+
+// Nearest neighbour scaling of one plane where each pixel has pixel_size bytes
+static void scale_plane(const guint8* src,
+                        gsize src_pitch,
+                        guint src_y,
+                        guint src_height,
+                        guint8* dst,
+                        guint dst_pitch,
+                        guint dst_width,
+                        guint dst_height,
+                        const guint* x_map,
+                        guint pixel_size) {
+    for (guint y = 0; y < dst_height; y++) {
+        const guint8* src_row = src + ((src_y + (y * src_height / dst_height)) * src_pitch);
+        guint8* dst_row       = dst + ((gsize)y * dst_pitch);
+        for (guint x = 0; x < dst_width; x++) {
+            memcpy(dst_row + ((gsize)x * pixel_size), src_row + x_map[x], pixel_size);
+        }
+    }
+}
+
+static void copy_frame(VdoStream* stream, guint frame_index, VdoBuffer* buffer) {
+    const replay_source_t* source = stream->source;
+    const guint8* src             = source->data + ((gsize)frame_index * source->frame_size);
+
+    // The stream has the same size as the recording
+    if (buffer->size == source->frame_size && stream->src_width == stream->width &&
+        stream->src_height == stream->height) {
+        memcpy(buffer->data, src, buffer->size);
+        return;
+    }
+    if (source->format == VDO_FORMAT_RGB) {
+        scale_plane(src,
+                    (gsize)source->width * 3,
+                    stream->src_y,
+                    stream->src_height,
+                    buffer->data,
+                    stream->pitch,
+                    stream->width,
+                    stream->height,
+                    stream->x_map,
+                    3);
+        return;
+    }
+    scale_plane(src,
+                source->width,
+                stream->src_y,
+                stream->src_height,
+                buffer->data,
+                stream->pitch,
+                stream->width,
+                stream->height,
+                stream->x_map,
+                1);
+    scale_plane(src + ((gsize)source->width * source->height),
+                source->width,
+                stream->src_y / 2,
+                stream->src_height / 2,
+                buffer->data + ((gsize)stream->pitch * stream->height),
+                stream->pitch,
+                stream->width / 2,
+                stream->height / 2,
+                stream->x_map + stream->width,
+                2);
+}
+
+// The eventfd is readable as long as there are frames to fetch. It is only
+// written and read with the stream mutex held.
+static void signal_frames(VdoStream* stream, gboolean available) {
+    uint64_t value = 1;
+    if (available) {
+        if (write(stream->event_fd, &value, sizeof(value)) < 0) {
+            syslog(LOG_WARNING, "Unable to signal new frame: %s", strerror(errno));
+        }
+    } else if (read(stream->event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        syslog(LOG_WARNING, "Unable to clear frame signal: %s", strerror(errno));
+    }
+}
+
+// The replay is stopped like on a device when the application gets SIGTERM,
+// after the application has fetched the last frame
+static void finish_replay(VdoStream* stream) {
+    g_mutex_lock(&stream->mutex);
+    while (!stream->stopping && stream->started && !g_queue_is_empty(stream->ready_buffers)) {
+        g_cond_wait(&stream->cond, &stream->mutex);
+    }
+    stream->finished = TRUE;
+    if (g_queue_is_empty(stream->ready_buffers)) {
+        signal_frames(stream, TRUE);
+    }
+    g_mutex_unlock(&stream->mutex);
+    kill(getpid(), SIGTERM);
+}
+
+static gpointer produce_frames(gpointer data) {
+    VdoStream* stream             = data;
+    const replay_source_t* source = stream->source;
+    sigset_t signals;
+
+    // Leave the signals to the application threads
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    gint64 next_frame_us = 0;
+    for (guint i = 0; i < source->nbr_replay_frames; i++) {
+        VdoBuffer* buffer = NULL;
+
+        g_mutex_lock(&stream->mutex);
+        while (!stream->stopping && !stream->started) {
+            g_cond_wait(&stream->cond, &stream->mutex);
+            next_frame_us = 0;
+        }
+        if (source->realtime) {
+            gint64 now_us = g_get_monotonic_time();
+            if (next_frame_us == 0) {
+                next_frame_us = now_us;
+            }
+            while (!stream->stopping && now_us < next_frame_us) {
+                g_cond_wait_until(&stream->cond, &stream->mutex, next_frame_us);
+                now_us = g_get_monotonic_time();
+            }
+            next_frame_us += (gint64)(G_USEC_PER_SEC / stream->framerate);
+            buffer = g_queue_pop_head(stream->free_buffers);
+            if (!buffer && !stream->stopping) {
+                // Like on a device the frame is lost when no buffer is free
+                stream->nbr_dropped++;
+                g_mutex_unlock(&stream->mutex);
+                continue;
+            }
+        } else {
+            while (!stream->stopping && g_queue_is_empty(stream->free_buffers)) {
+                g_cond_wait(&stream->cond, &stream->mutex);
+            }
+            buffer = g_queue_pop_head(stream->free_buffers);
+        }
+        if (stream->stopping) {
+            if (buffer) {
+                g_queue_push_tail(stream->free_buffers, buffer);
+            }
+            g_mutex_unlock(&stream->mutex);
+            return NULL;
+        }
+        g_mutex_unlock(&stream->mutex);
+
+        copy_frame(stream, i % source->nbr_frames, buffer);
+
+        g_mutex_lock(&stream->mutex);
+        buffer->timestamp    = (guint64)g_get_monotonic_time();
+        buffer->sequence_nbr = i;
+        stream->nbr_produced++;
+        if (g_queue_is_empty(stream->ready_buffers)) {
+            signal_frames(stream, TRUE);
+        }
+        g_queue_push_tail(stream->ready_buffers, buffer);
+        g_mutex_unlock(&stream->mutex);
+    }
+    finish_replay(stream);
+    return NULL;
+}
+
+static gboolean create_buffer(VdoStream* stream, VdoBuffer* buffer, GError** error) {
+    buffer->stream = stream;
+    buffer->size   = stream->source->format == VDO_FORMAT_RGB
+                         ? (gsize)stream->pitch * stream->height
+                         : (gsize)stream->pitch * stream->height * 3 / 2;
+    buffer->capacity = buffer->size;
+    buffer->fd       = memfd_create("replay-frame", MFD_CLOEXEC);
+    if (buffer->fd < 0 || ftruncate(buffer->fd, (off_t)buffer->capacity) != 0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "Unable to allocate frame buffer: %s",
+                    strerror(errno));
+        return FALSE;
+    }
+    void* data =
+        mmap(NULL, buffer->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    if (data == MAP_FAILED) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "Unable to map frame buffer: %s",
+                    strerror(errno));
+        return FALSE;
+    }
+    buffer->data = data;
+    return TRUE;
+}
+
+VdoStream* vdo_stream_new(VdoMap* settings, gpointer reserved, GError** error) {
+    (void)reserved;
+
+    if (!load_source(error)) {
+        return NULL;
+    }
+    const replay_source_t* source = &replay_source;
+
+    guint32 format = vdo_map_get_uint32(settings, "format", (guint32)source->format);
+    if (format != (guint32)source->format) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_NOT_SUPPORTED,
+                    "Format %u is not the format of the recording",
+                    format);
+        return NULL;
+    }
+    VdoPair32u source_resolution = {.w = source->width, .h = source->height};
+    VdoPair32u resolution = vdo_map_get_pair32u(settings, "resolution", source_resolution);
+    if (resolution.w == 0 || resolution.h == 0 || resolution.w > source->width ||
+        resolution.h > source->height || resolution.w % 2 != 0 || resolution.h % 2 != 0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Resolution %ux%u is not supported",
+                    resolution.w,
+                    resolution.h);
+        return NULL;
+    }
+    guint nbr_buffers = vdo_map_get_uint32(settings, "buffer.count", 3);
+    if (nbr_buffers == 0 || nbr_buffers > MAX_NBR_BUFFERS) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Buffer count %u is not supported",
+                    nbr_buffers);
+        return NULL;
+    }
+    gdouble framerate = vdo_map_get_double(settings, "framerate", 30.0);
+    const gchar* fit  = vdo_map_get_string(settings, "image.fit", NULL, "scale");
+
+    g_autoptr(VdoStream) stream = g_new0(VdoStream, 1);
+    stream->source              = source;
+    stream->width               = resolution.w;
+    stream->height              = resolution.h;
+    stream->pitch               = format == VDO_FORMAT_RGB ? resolution.w * 3 : resolution.w;
+    stream->framerate           = framerate > 0.0 ? framerate : 30.0;
+    stream->event_fd            = -1;
+    stream->free_buffers        = g_queue_new();
+    stream->ready_buffers       = g_queue_new();
+    g_mutex_init(&stream->mutex);
+    g_cond_init(&stream->cond);
+    for (guint i = 0; i < MAX_NBR_BUFFERS; i++) {
+        stream->buffers[i].fd = -1;
+    }
+    setup_scaling(stream, !g_strcmp0(fit, "crop"));
+
+    for (guint i = 0; i < nbr_buffers; i++) {
+        if (!create_buffer(stream, &stream->buffers[i], error)) {
+            return NULL;
+        }
+        stream->nbr_buffers++;
+        g_queue_push_tail(stream->free_buffers, &stream->buffers[i]);
+    }
+    stream->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stream->event_fd < 0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_IO,
+                    "Unable to create eventfd: %s",
+                    strerror(errno));
+        return NULL;
+    }
+
+    guint divisor           = gcd(stream->width, stream->height);
+    VdoPair32u aspect_ratio = {.w = stream->width / divisor, .h = stream->height / divisor};
+    stream->info            = copy_map(settings);
+    vdo_map_set_uint32(stream->info, "format", format);
+    vdo_map_set_uint32(stream->info, "width", stream->width);
+    vdo_map_set_uint32(stream->info, "height", stream->height);
+    vdo_map_set_uint32(stream->info, "pitch", stream->pitch);
+    vdo_map_set_uint32(stream->info, "buffer.count", nbr_buffers);
+    vdo_map_set_string(stream->info, "buffer.type", "memfd");
+    vdo_map_set_double(stream->info, "framerate", stream->framerate);
+    vdo_map_set_pair32u(stream->info, "aspect_ratio", aspect_ratio);
+
+    stream->producer = g_thread_new("replay-producer", produce_frames, stream);
+    return g_steal_pointer(&stream);
+}
+
+void vdo_stream_free(VdoStream* stream) {
+    if (stream->producer) {
+        g_mutex_lock(&stream->mutex);
+        stream->stopping = TRUE;
+        g_cond_broadcast(&stream->cond);
+        g_mutex_unlock(&stream->mutex);
+        g_thread_join(stream->producer);
+    }
+    if (stream->nbr_fetched > 0) {
+        gdouble elapsed_s = (gdouble)(stream->last_unref_us - stream->first_fetch_us) /
+                            (gdouble)G_USEC_PER_SEC;
+        syslog(LOG_INFO,
+               "Replayed %u frames in %.2f s, %.1f frames/s, %u dropped",
+               stream->nbr_fetched,
+               elapsed_s,
+               elapsed_s > 0.0 ? stream->nbr_fetched / elapsed_s : 0.0,
+               stream->nbr_dropped);
+    }
+    for (guint i = 0; i < stream->nbr_buffers; i++) {
+        munmap(stream->buffers[i].data, stream->buffers[i].capacity);
+    }
+    for (guint i = 0; i < MAX_NBR_BUFFERS; i++) {
+        if (stream->buffers[i].fd >= 0) {
+            close(stream->buffers[i].fd);
+        }
+    }
+    if (stream->event_fd >= 0) {
+        close(stream->event_fd);
+    }
+    if (stream->info) {
+        vdo_map_free(stream->info);
+    }
+    g_queue_free(stream->free_buffers);
+    g_queue_free(stream->ready_buffers);
+    g_cond_clear(&stream->cond);
+    g_mutex_clear(&stream->mutex);
+    g_free(stream->x_map);
+    g_free(stream);
+}
+
+VdoMap* vdo_stream_get_info(VdoStream* stream, GError** error) {
+    (void)error;
+    g_mutex_lock(&stream->mutex);
+    VdoMap* info = copy_map(stream->info);
+    g_mutex_unlock(&stream->mutex);
+    return info;
+}
+
+gint vdo_stream_get_fd(VdoStream* stream, GError** error) {
+    (void)error;
+    return stream->event_fd;
+}
+
+gboolean vdo_stream_start(VdoStream* stream, GError** error) {
+    (void)error;
+    g_mutex_lock(&stream->mutex);
+    stream->started = TRUE;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+    return TRUE;
+}
+
+// The frames that have not been fetched are thrown away
+void vdo_stream_stop(VdoStream* stream) {
+    g_mutex_lock(&stream->mutex);
+    stream->started = FALSE;
+    if (!g_queue_is_empty(stream->ready_buffers) && !stream->finished) {
+        signal_frames(stream, FALSE);
+    }
+    while (!g_queue_is_empty(stream->ready_buffers)) {
+        g_queue_push_tail(stream->free_buffers, g_queue_pop_head(stream->ready_buffers));
+    }
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+}
+
+VdoBuffer* vdo_stream_get_buffer(VdoStream* stream, GError** error) {
+    g_mutex_lock(&stream->mutex);
+    VdoBuffer* buffer = g_queue_pop_head(stream->ready_buffers);
+    if (!buffer) {
+        g_mutex_unlock(&stream->mutex);
+        g_set_error(error, VDO_ERROR, VDO_ERROR_NO_DATA, "No frame available");
+        return NULL;
+    }
+    // Keep the eventfd readable after the last frame so that a poll returns
+    if (g_queue_is_empty(stream->ready_buffers) && !stream->finished) {
+        signal_frames(stream, FALSE);
+    }
+    if (stream->nbr_fetched == 0) {
+        stream->first_fetch_us = g_get_monotonic_time();
+    }
+    stream->nbr_fetched++;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+    return buffer;
+}
+
+gboolean vdo_stream_buffer_unref(VdoStream* stream, VdoBuffer** buffer, GError** error) {
+    if (!buffer || !*buffer || (*buffer)->stream != stream) {
+        g_set_error(error, VDO_ERROR, VDO_ERROR_INVALID_ARGUMENT, "Invalid buffer");
+        return FALSE;
+    }
+    g_mutex_lock(&stream->mutex);
+    g_queue_push_tail(stream->free_buffers, *buffer);
+    stream->last_unref_us = g_get_monotonic_time();
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+    *buffer = NULL;
+    return TRUE;
+}
+
+gboolean vdo_stream_set_framerate(VdoStream* stream, gdouble framerate, GError** error) {
+    if (framerate <= 0.0) {
+        g_set_error(error,
+                    VDO_ERROR,
+                    VDO_ERROR_INVALID_ARGUMENT,
+                    "Invalid framerate %f",
+                    framerate);
+        return FALSE;
+    }
+    g_mutex_lock(&stream->mutex);
+    stream->framerate = framerate;
+    vdo_map_set_double(stream->info, "framerate", framerate);
+    g_mutex_unlock(&stream->mutex);
+    return TRUE;
+}
+
+// The buffers are owned by the stream and handed back with
+// vdo_stream_buffer_unref, there is no reference to release
+void vdo_buffer_release(VdoBuffer* buffer) {
+    (void)buffer;
+}
+
+gint vdo_buffer_get_fd(VdoBuffer* buffer) {
+    return buffer->fd;
+}
+
+gint64 vdo_buffer_get_offset(VdoBuffer* buffer) {
+    (void)buffer;
+    return 0;
+}
+
+gsize vdo_buffer_get_capacity(VdoBuffer* buffer) {
+    return buffer->capacity;
+}
+
+gpointer vdo_buffer_get_data(VdoBuffer* buffer) {
+    return buffer->data;
+}
+
+VdoFrame* vdo_buffer_get_frame(VdoBuffer* buffer) {
+    return buffer;
+}
+
+guint64 vdo_frame_get_timestamp(VdoFrame* frame) {
+    return frame->timestamp;
+}
+
+guint vdo_frame_get_sequence_nbr(VdoFrame* frame) {
+    return frame->sequence_nbr;
+}
+
+gsize vdo_frame_get_size(VdoFrame* frame) {
+    return frame->size;
+}
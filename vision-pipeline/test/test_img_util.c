@@ -0,0 +1,279 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks how the framerate of a stream follows the analysis time.
+ *
+ * The vdo functions that img_util uses are replaced by fakes below that only
+ * record the framerate that is set on the stream. The stream can reject one
+ * framerate like a stream that does not offer it, or all framerates.
+ */
+
+#include "img_util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vdo-error.h"
+#include "vdo-map.h"
+
+struct _VdoStream {
+    double framerate;
+    double rejected_framerate;
+    bool reject_all;
+    unsigned int nbr_changes;
+    unsigned int nbr_flushes;
+};
+
+struct _VdoMap {
+    double framerate;
+};
+
+GQuark vdo_error_quark(void) {
+    return g_quark_from_static_string("vdo-error-quark");
+}
+
+gboolean vdo_error_is_expected(GError** error) {
+    (void)error;
+    return FALSE;
+}
+
+VdoMap* vdo_map_new(void) {
+    return g_new0(VdoMap, 1);
+}
+
+void vdo_map_free(VdoMap* map) {
+    g_free(map);
+}
+
+void vdo_map_set_uint32(VdoMap* map, const gchar* name, guint32 value) {
+    (void)map, (void)name, (void)value;
+}
+
+void vdo_map_set_double(VdoMap* map, const gchar* name, gdouble value) {
+    (void)map, (void)name, (void)value;
+}
+
+gdouble vdo_map_get_double(const VdoMap* map, const gchar* name, gdouble def) {
+    if (strcmp(name, "framerate") != 0) {
+        return def;
+    }
+    return map->framerate;
+}
+
+void vdo_map_set_boolean(VdoMap* map, const gchar* name, gboolean value) {
+    (void)map, (void)name, (void)value;
+}
+
+void vdo_map_set_string(VdoMap* map, const gchar* name, const gchar* value) {
+    (void)map, (void)name, (void)value;
+}
+
+void vdo_map_set_pair32u(VdoMap* map, const gchar* name, VdoPair32u value) {
+    (void)map, (void)name, (void)value;
+}
+
+void vdo_map_dump(const VdoMap* map) {
+    (void)map;
+}
+
+VdoStream* vdo_stream_new(VdoMap* settings, gpointer reserved, GError** error) {
+    (void)settings, (void)reserved, (void)error;
+    return g_new0(VdoStream, 1);
+}
+
+void vdo_stream_free(VdoStream* stream) {
+    g_free(stream);
+}
+
+gboolean vdo_stream_set_framerate(VdoStream* stream, gdouble framerate, GError** error) {
+    if (stream->reject_all || fabs(framerate - stream->rejected_framerate) < 0.01) {
+        g_set_error(error, VDO_ERROR, VDO_ERROR_NOT_SUPPORTED, "Framerate not supported");
+        return FALSE;
+    }
+    stream->framerate = framerate;
+    stream->nbr_changes++;
+    return TRUE;
+}
+
+void vdo_stream_stop(VdoStream* stream) {
+    stream->nbr_flushes++;
+}
+
+gboolean vdo_stream_start(VdoStream* stream, GError** error) {
+    (void)stream, (void)error;
+    return TRUE;
+}
+
+gboolean vdo_stream_buffer_unref(VdoStream* stream, VdoBuffer** buffer, GError** error) {
+    (void)stream, (void)error;
+    *buffer = NULL;
+    return TRUE;
+}
+
+VdoBuffer* vdo_stream_get_buffer(VdoStream* stream, GError** error) {
+    (void)stream;
+    g_set_error(error, VDO_ERROR, VDO_ERROR_NO_DATA, "No data");
+    return NULL;
+}
+
+// The stream info of a stream at 30 fps
+static void init_framerate(img_framerate_t* framerate, img_framerate_mode_t mode) {
+    VdoMap stream_info = {.framerate = 30.0};
+    img_util_init_framerate(framerate, mode, &stream_info, 30.0);
+}
+
+static void run_frames(VdoStream* stream,
+                       img_framerate_t* framerate,
+                       unsigned int analysis_time,
+                       unsigned int nbr_frames) {
+    for (unsigned int i = 0; i < nbr_frames; i++) {
+        if (img_util_update_framerate(stream, framerate, analysis_time)) {
+            VdoBuffer* buf = NULL;
+            GError* error  = NULL;
+            img_util_flush(stream, &buf, &error);
+        }
+    }
+}
+
+static int expect_framerate(VdoStream* stream, double expected, const char* when) {
+    if (stream->framerate > expected + 0.01 || stream->framerate < expected - 0.01) {
+        printf("%s: framerate is %.2f, expected %.2f\n", when, stream->framerate, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_controller(void) {
+    VdoStream* stream = vdo_stream_new(NULL, NULL, NULL);
+    img_framerate_t framerate;
+    int errors = 0;
+
+    init_framerate(&framerate, IMG_FRAMERATE_MODE_CONTROLLER);
+    stream->framerate = 30.0;
+
+    // 50 ms with 10% headroom gives 18 fps, the stream offers 15 fps below it
+    run_frames(stream, &framerate, 50, 100);
+    errors += expect_framerate(stream, 15.0, "Slow analysis");
+    unsigned int nbr_changes = stream->nbr_changes;
+
+    // 20 fps would be possible but the next offered framerate is 30 fps
+    run_frames(stream, &framerate, 40, 100);
+    errors += expect_framerate(stream, 15.0, "Slightly faster analysis");
+    if (stream->nbr_changes != nbr_changes) {
+        printf("The framerate was changed within the hysteresis\n");
+        errors++;
+    }
+
+    // Faster analysis raises the framerate up to the wanted framerate
+    run_frames(stream, &framerate, 10, 100);
+    errors += expect_framerate(stream, 30.0, "Fast analysis");
+
+    if (stream->nbr_flushes != 0) {
+        printf("The stream was flushed %u times by the controller\n", stream->nbr_flushes);
+        errors++;
+    }
+    vdo_stream_free(stream);
+    return errors;
+}
+
+static int check_rejected(void) {
+    VdoStream* stream = vdo_stream_new(NULL, NULL, NULL);
+    img_framerate_t framerate;
+    int errors = 0;
+
+    init_framerate(&framerate, IMG_FRAMERATE_MODE_CONTROLLER);
+    stream->framerate          = 30.0;
+    stream->rejected_framerate = 15.0;
+
+    // The current framerate is kept when 15 fps is rejected, the next lower
+    // offered framerate is chosen when the average has settled again
+    run_frames(stream, &framerate, 50, 10);
+    errors += expect_framerate(stream, 30.0, "Rejected framerate");
+    run_frames(stream, &framerate, 50, 10);
+    errors += expect_framerate(stream, 10.0, "Framerate after a rejected framerate");
+
+    vdo_stream_free(stream);
+    return errors;
+}
+
+static int check_all_rejected(void) {
+    VdoStream* stream = vdo_stream_new(NULL, NULL, NULL);
+    img_framerate_t framerate;
+    int errors = 0;
+
+    init_framerate(&framerate, IMG_FRAMERATE_MODE_CONTROLLER);
+    stream->framerate = 30.0;
+
+    // Go to 15 fps, then the stream rejects every framerate
+    run_frames(stream, &framerate, 50, 100);
+    errors += expect_framerate(stream, 15.0, "Before all framerates are rejected");
+    unsigned int nbr_changes = stream->nbr_changes;
+    stream->reject_all       = true;
+
+    // Every lower and higher framerate is rejected in turn and the current
+    // one is kept
+    run_frames(stream, &framerate, 900, 20 * MAX_NBR_IMG_FRAMERATES);
+    run_frames(stream, &framerate, 10, 20 * MAX_NBR_IMG_FRAMERATES);
+    run_frames(stream, &framerate, 900, 100);
+    errors += expect_framerate(stream, 15.0, "All framerates rejected");
+    if (framerate.nbr_framerates != 1 || fabs(framerate.framerates[0] - 15.0) > 0.01) {
+        printf("%u framerates are offered after all were rejected, expected only 15 fps\n",
+               framerate.nbr_framerates);
+        errors++;
+    }
+    if (stream->nbr_changes != nbr_changes) {
+        printf("The framerate was changed by a stream that rejects all framerates\n");
+        errors++;
+    }
+    vdo_stream_free(stream);
+    return errors;
+}
+
+static int check_steps(void) {
+    VdoStream* stream = vdo_stream_new(NULL, NULL, NULL);
+    img_framerate_t framerate;
+    int errors = 0;
+
+    init_framerate(&framerate, IMG_FRAMERATE_MODE_STEPS);
+    stream->framerate = 30.0;
+
+    run_frames(stream, &framerate, 60, 10);
+    errors += expect_framerate(stream, 15.0, "Slow analysis with steps");
+    if (stream->nbr_flushes != 1) {
+        printf("The stream was flushed %u times, expected once\n", stream->nbr_flushes);
+        errors++;
+    }
+    vdo_stream_free(stream);
+    return errors;
+}
+
+int main(void) {
+    int errors = 0;
+
+    errors += check_controller();
+    errors += check_rejected();
+    errors += check_all_rejected();
+    errors += check_steps();
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks that the label files of the object detection examples are
+ * read with and without the "n/a" labels.
+ */
+
+#include "labelparse.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* label_file = "test_labels.txt";
+
+// The start of the COCO labels that the examples use
+static const char* labels[] = {"person", "bicycle", "car", "n/a", "motorcycle", "n/a", "bus"};
+
+#define NBR_LABELS (sizeof(labels) / sizeof(labels[0]))
+
+static int check_labels(bool skip_unavailable) {
+    char** parsed      = NULL;
+    char* buffer       = NULL;
+    size_t nbr_parsed  = 0;
+    size_t nbr_checked = 0;
+    int errors         = 0;
+
+    parse_labels(&parsed, &buffer, label_file, &nbr_parsed, skip_unavailable);
+
+    for (size_t i = 0; i < NBR_LABELS; i++) {
+        if (skip_unavailable && strcmp(labels[i], "n/a") == 0) {
+            continue;
+        }
+        if (nbr_checked < nbr_parsed && strcmp(parsed[nbr_checked], labels[i]) != 0) {
+            printf("Label %zu is %s, expected %s\n", nbr_checked, parsed[nbr_checked], labels[i]);
+            errors++;
+        }
+        nbr_checked++;
+    }
+    if (nbr_parsed != nbr_checked) {
+        printf("%zu labels were read with skip_unavailable %d, expected %zu\n",
+               nbr_parsed,
+               skip_unavailable,
+               nbr_checked);
+        errors++;
+    }
+    free(parsed);
+    free(buffer);
+    return errors;
+}
+
+int main(void) {
+    int errors = 0;
+
+    FILE* file = fopen(label_file, "w");
+    if (!file) {
+        printf("Could not create %s\n", label_file);
+        return 1;
+    }
+    for (size_t i = 0; i < NBR_LABELS; i++) {
+        fprintf(file, "%s\n", labels[i]);
+    }
+    fclose(file);
+
+    errors += check_labels(false);
+    errors += check_labels(true);
+    remove(label_file);
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks that the input tensors of the vdo buffers are reused and
+ * that the least recently used tensor is destroyed when the cache is full.
+ *
+ * The larod and vdo functions that the cache uses are replaced by fakes below
+ * that count the tensors that are tracked and destroyed.
+ */
+
+#include "model_tensor_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// More buffers than the cache holds
+#define NBR_BUFFERS (MAX_NBR_CACHED_TENSORS + 2)
+
+struct larodTensor {
+    int fd;
+};
+
+struct _VdoBuffer {
+    int fd;
+    int64_t offset;
+    size_t capacity;
+};
+
+static unsigned int nbr_tracked;
+static unsigned int nbr_destroyed;
+
+void larodClearError(larodError** error) {
+    *error = NULL;
+}
+
+larodTensor** larodCreateTensors(const size_t numTensors, larodError** error) {
+    (void)error;
+    larodTensor** tensors = calloc(numTensors, sizeof(larodTensor*));
+    for (size_t i = 0; i < numTensors; i++) {
+        tensors[i] = calloc(1, sizeof(larodTensor));
+    }
+    return tensors;
+}
+
+bool larodDestroyTensors(larodConnection* conn,
+                         larodTensor*** tensors,
+                         const size_t numTensors,
+                         larodError** error) {
+    (void)conn, (void)error;
+    for (size_t i = 0; i < numTensors; i++) {
+        free((*tensors)[i]);
+    }
+    free(*tensors);
+    *tensors = NULL;
+    nbr_destroyed++;
+    return true;
+}
+
+bool larodTrackTensor(larodConnection* conn, larodTensor* tensor, larodError** error) {
+    (void)conn, (void)tensor, (void)error;
+    nbr_tracked++;
+    return true;
+}
+
+bool larodSetTensorDataType(larodTensor* tensor,
+                            const larodTensorDataType dataType,
+                            larodError** error) {
+    (void)tensor, (void)dataType, (void)error;
+    return true;
+}
+
+bool larodSetTensorLayout(larodTensor* tensor, const larodTensorLayout layout, larodError** error) {
+    (void)tensor, (void)layout, (void)error;
+    return true;
+}
+
+bool larodBuildTensorDims(larodTensor* tensor,
+                          larodTensorLayout layout,
+                          size_t width,
+                          size_t height,
+                          size_t channels,
+                          larodError** error) {
+    (void)tensor, (void)layout, (void)width, (void)height, (void)channels, (void)error;
+    return true;
+}
+
+bool larodBuildTensorPitches(larodTensor* tensor,
+                             larodTensorLayout layout,
+                             size_t rowPitch,
+                             size_t height,
+                             size_t channels,
+                             larodError** error) {
+    (void)tensor, (void)layout, (void)rowPitch, (void)height, (void)channels, (void)error;
+    return true;
+}
+
+bool larodSetTensorFd(larodTensor* tensor, const int fd, larodError** error) {
+    (void)error;
+    tensor->fd = fd;
+    return true;
+}
+
+bool larodSetTensorFdSize(larodTensor* tensor, const size_t size, larodError** error) {
+    (void)tensor, (void)size, (void)error;
+    return true;
+}
+
+bool larodSetTensorFdOffset(larodTensor* tensor, const int64_t offset, larodError** error) {
+    (void)tensor, (void)offset, (void)error;
+    return true;
+}
+
+bool larodSetTensorFdProps(larodTensor* tensor, const uint32_t fdPropFlags, larodError** error) {
+    (void)tensor, (void)fdPropFlags, (void)error;
+    return true;
+}
+
+int larodConvertVmemFdToDmabuf(int fd, int64_t offset, larodError** error) {
+    (void)offset, (void)error;
+    return dup(fd);
+}
+
+gint vdo_buffer_get_fd(VdoBuffer* buffer) {
+    return buffer->fd;
+}
+
+gint64 vdo_buffer_get_offset(VdoBuffer* buffer) {
+    return buffer->offset;
+}
+
+gsize vdo_buffer_get_capacity(VdoBuffer* buffer) {
+    return buffer->capacity;
+}
+
+static int expect_counts(model_tensor_cache_t* cache,
+                         unsigned int hits,
+                         unsigned int misses,
+                         unsigned int evictions,
+                         const char* when) {
+    if (cache->hits != hits || cache->misses != misses || cache->evictions != evictions ||
+        nbr_tracked != misses || nbr_destroyed != evictions) {
+        printf("%s: %llu hits %llu misses %llu evictions, %u tracked %u destroyed, expected "
+               "%u hits %u misses %u evictions\n",
+               when,
+               (unsigned long long)cache->hits,
+               (unsigned long long)cache->misses,
+               (unsigned long long)cache->evictions,
+               nbr_tracked,
+               nbr_destroyed,
+               hits,
+               misses,
+               evictions);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    VdoBuffer buffers[NBR_BUFFERS];
+    larodTensor** tensors[NBR_BUFFERS];
+    model_tensor_cache_t cache;
+    img_info_t img_info = {
+        .format = VDO_FORMAT_YUV,
+        .width  = 640,
+        .height = 360,
+        .pitch  = 640,
+        .dmabuf = true,
+    };
+    int errors = 0;
+
+    int fd = open("/dev/null", O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open /dev/null\n");
+        return 1;
+    }
+    // The buffers of a stream often share an fd and differ in offset
+    for (size_t i = 0; i < NBR_BUFFERS; i++) {
+        buffers[i].fd       = fd;
+        buffers[i].offset   = (int64_t)(i * 345600);
+        buffers[i].capacity = 345600;
+    }
+    model_tensor_cache_init(&cache, NULL, LAROD_TENSOR_LAYOUT_420SP, &img_info);
+
+    // The buffers that vdo hands out in turn are all tracked once
+    for (size_t round = 0; round < 3; round++) {
+        for (size_t i = 0; i < MAX_NBR_CACHED_TENSORS; i++) {
+            larodTensor** buffer_tensors = model_tensor_cache_get(&cache, &buffers[i]);
+            if (round == 0) {
+                tensors[i] = buffer_tensors;
+            } else if (buffer_tensors != tensors[i]) {
+                printf("Buffer %zu got a new tensor in round %zu\n", i, round);
+                errors++;
+            }
+        }
+    }
+    errors += expect_counts(&cache,
+                            2 * MAX_NBR_CACHED_TENSORS,
+                            MAX_NBR_CACHED_TENSORS,
+                            0,
+                            "Buffers that fit in the cache");
+
+    // Buffer 0 is used again so buffer 1 is the least recently used
+    model_tensor_cache_get(&cache, &buffers[0]);
+    model_tensor_cache_get(&cache, &buffers[MAX_NBR_CACHED_TENSORS]);
+    errors += expect_counts(&cache,
+                            2 * MAX_NBR_CACHED_TENSORS + 1,
+                            MAX_NBR_CACHED_TENSORS + 1,
+                            1,
+                            "A new buffer");
+    if (model_tensor_cache_get(&cache, &buffers[0]) != tensors[0]) {
+        printf("The recently used buffer 0 was evicted\n");
+        errors++;
+    }
+    model_tensor_cache_get(&cache, &buffers[1]);
+    errors += expect_counts(&cache,
+                            2 * MAX_NBR_CACHED_TENSORS + 2,
+                            MAX_NBR_CACHED_TENSORS + 2,
+                            2,
+                            "The evicted buffer");
+
+    model_tensor_cache_clear(&cache);
+    if (nbr_destroyed != MAX_NBR_CACHED_TENSORS + 2 || cache.nbr_entries != 0) {
+        printf("%u tensors were destroyed after clear, expected %u\n",
+               nbr_destroyed,
+               MAX_NBR_CACHED_TENSORS + 2);
+        errors++;
+    }
+    close(fd);
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
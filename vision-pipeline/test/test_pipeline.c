@@ -0,0 +1,348 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks the order in which the pipeline calls the stages, and that
+ * every frame is given back to the source exactly once: when larod has no
+ * power, when the inference keeps several frames, when the stream is flushed
+ * and when the loop is stopped.
+ *
+ * The stages are fakes that write what they do to a trace, e.g. "I2" when the
+ * inference is run on frame 2 and "R2" when frame 2 is given back.
+ */
+
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FRAMES 16
+#define TRACE_SIZE 512
+
+struct _VdoBuffer {
+    int id;
+};
+
+typedef struct fake {
+    VdoBuffer buffers[MAX_FRAMES + 1];
+    char trace[TRACE_SIZE];
+    volatile sig_atomic_t running;
+
+    // The source has this many frames, then it stops with the exit status
+    int nbr_frames;
+    int stop_status;
+    int nbr_fetched;
+    int nbr_released[MAX_FRAMES + 1];
+    // The fetch that finds no frame, counted from 1
+    int no_data_at;
+    int nbr_fetches;
+    // The frame after which the stream is flushed
+    int flush_at;
+
+    // The frame that the preprocessing skips
+    int skip_at;
+
+    // The number of frames that the inference runs at the same time and the
+    // frame where larod has no power
+    int nbr_slots;
+    int skip_all_at;
+    VdoBuffer* kept[MAX_FRAMES];
+    int nbr_kept;
+
+    // The sink clears running after this many frames
+    int stop_after;
+    int nbr_shown;
+} fake_t;
+
+static void add_trace(fake_t* fake, const char* event, int id) {
+    size_t len = strlen(fake->trace);
+    if (id > 0) {
+        snprintf(fake->trace + len, TRACE_SIZE - len, "%s%d ", event, id);
+    } else {
+        snprintf(fake->trace + len, TRACE_SIZE - len, "%s ", event);
+    }
+}
+
+static void fake_wait(void* ctx) {
+    (void)ctx;
+}
+
+static pipeline_status_t fake_fetch(void* ctx, VdoBuffer** buffer, int* exit_status) {
+    fake_t* fake = ctx;
+
+    fake->nbr_fetches++;
+    if (fake->nbr_fetches == fake->no_data_at) {
+        return PIPELINE_PENDING;
+    }
+    if (fake->nbr_fetched == fake->nbr_frames) {
+        *exit_status = fake->stop_status;
+        return PIPELINE_STOP;
+    }
+    fake->nbr_fetched++;
+    *buffer = &fake->buffers[fake->nbr_fetched];
+    return PIPELINE_CONTINUE;
+}
+
+static bool fake_update_framerate(void* ctx, unsigned int analysis_ms) {
+    (void)analysis_ms;
+    fake_t* fake = ctx;
+
+    return fake->nbr_shown == fake->flush_at;
+}
+
+static void fake_release(void* ctx, VdoBuffer** buffer) {
+    fake_t* fake = ctx;
+
+    add_trace(fake, "R", (*buffer)->id);
+    fake->nbr_released[(*buffer)->id]++;
+    *buffer = NULL;
+}
+
+static pipeline_status_t fake_flush(void* ctx, VdoBuffer** buffer, int* exit_status) {
+    (void)exit_status;
+    fake_t* fake = ctx;
+
+    add_trace(fake, "F", (*buffer)->id);
+    fake->nbr_released[(*buffer)->id]++;
+    *buffer = NULL;
+    return PIPELINE_CONTINUE;
+}
+
+static pipeline_status_t fake_preprocess(void* ctx, VdoBuffer* buffer) {
+    fake_t* fake = ctx;
+
+    add_trace(fake, "P", buffer->id);
+    return buffer->id == fake->skip_at ? PIPELINE_SKIP : PIPELINE_CONTINUE;
+}
+
+static void fake_reset(void* ctx) {
+    add_trace(ctx, "X", 0);
+}
+
+static pipeline_status_t fake_infer(void* ctx, VdoBuffer** buffer) {
+    fake_t* fake = ctx;
+
+    add_trace(fake, "I", (*buffer)->id);
+    if ((*buffer)->id == fake->skip_all_at) {
+        return PIPELINE_SKIP_ALL;
+    }
+    if (fake->nbr_slots <= 1) {
+        return PIPELINE_CONTINUE;
+    }
+    fake->kept[fake->nbr_kept++] = *buffer;
+    *buffer                      = NULL;
+    if (fake->nbr_kept < fake->nbr_slots) {
+        return PIPELINE_PENDING;
+    }
+    *buffer = fake->kept[0];
+    memmove(fake->kept, fake->kept + 1, --fake->nbr_kept * sizeof(VdoBuffer*));
+    return PIPELINE_CONTINUE;
+}
+
+static bool fake_drain(void* ctx, VdoBuffer** buffer) {
+    fake_t* fake = ctx;
+
+    if (fake->nbr_kept == 0) {
+        return false;
+    }
+    *buffer = fake->kept[0];
+    memmove(fake->kept, fake->kept + 1, --fake->nbr_kept * sizeof(VdoBuffer*));
+    add_trace(fake, "D", (*buffer)->id);
+    return true;
+}
+
+static void fake_postprocess(void* ctx, VdoBuffer* buffer) {
+    add_trace(ctx, "O", buffer->id);
+}
+
+static void fake_show(void* ctx) {
+    fake_t* fake = ctx;
+
+    add_trace(fake, "S", 0);
+    fake->nbr_shown++;
+    if (fake->nbr_shown == fake->stop_after) {
+        fake->running = 0;
+    }
+}
+
+static const pipeline_source_ops_t fake_source_ops = {
+    .wait             = fake_wait,
+    .fetch            = fake_fetch,
+    .update_framerate = fake_update_framerate,
+    .flush            = fake_flush,
+    .release          = fake_release,
+};
+
+static const pipeline_preprocess_ops_t fake_preprocess_ops = {
+    .run   = fake_preprocess,
+    .reset = fake_reset,
+};
+
+// One frame at a time, like model_infer_ops
+static const pipeline_infer_ops_t fake_infer_ops = {
+    .run = fake_infer,
+};
+
+// Several frames at a time without a preprocessing stage, like
+// model_infer_async_ops
+static const pipeline_infer_ops_t fake_infer_async_ops = {
+    .run   = fake_infer,
+    .drain = fake_drain,
+    .reset = fake_reset,
+};
+
+static const pipeline_postprocess_ops_t fake_postprocess_ops = {
+    .run = fake_postprocess,
+};
+
+static const pipeline_sink_ops_t fake_sink_ops = {
+    .run = fake_show,
+};
+
+static void init_fake(fake_t* fake, int nbr_frames) {
+    memset(fake, 0, sizeof(*fake));
+    for (int i = 0; i <= MAX_FRAMES; i++) {
+        fake->buffers[i].id = i;
+    }
+    fake->running    = 1;
+    fake->nbr_frames = nbr_frames;
+}
+
+static int run_pipeline(fake_t* fake, bool async) {
+    pipeline_t pipeline = {
+        .source          = &fake_source_ops,
+        .source_ctx      = fake,
+        .preprocess      = async ? NULL : &fake_preprocess_ops,
+        .preprocess_ctx  = fake,
+        .infer           = async ? &fake_infer_async_ops : &fake_infer_ops,
+        .infer_ctx       = fake,
+        .postprocess     = &fake_postprocess_ops,
+        .postprocess_ctx = fake,
+        .sink            = &fake_sink_ops,
+        .sink_ctx        = fake,
+    };
+    return pipeline_run(&pipeline, &fake->running);
+}
+
+static int expect_run(fake_t* fake,
+                      int exit_status,
+                      int expected_status,
+                      const char* expected_trace,
+                      const char* when) {
+    int errors = 0;
+
+    if (strcmp(fake->trace, expected_trace) != 0) {
+        printf("%s: the trace is\n  %s\nexpected\n  %s\n", when, fake->trace, expected_trace);
+        errors++;
+    }
+    if (exit_status != expected_status) {
+        printf("%s: exit status %d, expected %d\n", when, exit_status, expected_status);
+        errors++;
+    }
+    for (int i = 1; i <= fake->nbr_fetched; i++) {
+        if (fake->nbr_released[i] != 1) {
+            printf("%s: frame %d was given back %d times\n", when, i, fake->nbr_released[i]);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main(void) {
+    fake_t fake;
+    int errors = 0;
+    int status = 0;
+
+    // Every stage is run on a frame before the next frame is fetched
+    init_fake(&fake, 3);
+    status = run_pipeline(&fake, false);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "P1 I1 O1 S R1 P2 I2 O2 S R2 P3 I3 O3 S R3 ",
+                         "In sequence");
+
+    // A fetch without a frame is retried, a frame that is skipped is given
+    // back without being inferred
+    init_fake(&fake, 3);
+    fake.no_data_at = 2;
+    fake.skip_at    = 2;
+    status          = run_pipeline(&fake, false);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "P1 I1 O1 S R1 P2 R2 P3 I3 O3 S R3 ",
+                         "Skipped frame");
+
+    // The result of a frame comes when the next frame is inferred, and the
+    // frame that is still kept at the end is given back
+    init_fake(&fake, 5);
+    fake.nbr_slots = 2;
+    status         = run_pipeline(&fake, true);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "I1 I2 O1 S R1 I3 O2 S R2 I4 O3 S R3 I5 O4 S R4 D5 R5 ",
+                         "Several frames in inference");
+
+    // Without power the frame and the frames in inference are given back
+    init_fake(&fake, 5);
+    fake.nbr_slots   = 2;
+    fake.skip_all_at = 3;
+    status           = run_pipeline(&fake, true);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "I1 I2 O1 S R1 I3 R3 D2 R2 I4 I5 O4 S R4 D5 R5 ",
+                         "No power with several frames in inference");
+
+    // The frames in inference are given back before the flush, and the
+    // stages are reset after it
+    init_fake(&fake, 4);
+    fake.nbr_slots = 2;
+    fake.flush_at  = 2;
+    status         = run_pipeline(&fake, true);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "I1 I2 O1 S R1 I3 O2 S D3 R3 F2 X I4 D4 R4 ",
+                         "Flush");
+
+    // The exit status of the source is returned
+    init_fake(&fake, 3);
+    fake.nbr_slots   = 2;
+    fake.stop_status = 7;
+    status           = run_pipeline(&fake, true);
+    errors += expect_run(&fake, status, 7, "I1 I2 O1 S R1 I3 O2 S R2 D3 R3 ", "Stopped by the source");
+
+    // The loop stops when running is cleared, e.g. by a signal
+    init_fake(&fake, 5);
+    fake.stop_after = 2;
+    status          = run_pipeline(&fake, false);
+    errors += expect_run(&fake,
+                         status,
+                         EXIT_SUCCESS,
+                         "P1 I1 O1 S R1 P2 I2 O2 S R2 ",
+                         "Stopped by a signal");
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * Copyright (C) 2025, Axis Communications AB, Lund, Sweden
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file checks the histograms of the stage statistics against the exact
+ * percentiles of the recorded samples and checks the dump file.
+ *
+ * The stage statistics source is included so that the bucket functions can be
+ * called.
+ */
+
+#include "stage_stats.c"
+
+#define NBR_SAMPLES 10000
+
+// The buckets have 8 linear steps per power of two
+#define MAX_REL_ERROR 0.125
+
+static const char* dump_file = "test_stage_stats.json";
+
+static uint32_t random_state = 2463534242u;
+
+// xorshift32, so that the samples are the same on every host
+static uint32_t random_uint(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static int compare_uint64(const void* a, const void* b) {
+    uint64_t value_a = *(const uint64_t*)a;
+    uint64_t value_b = *(const uint64_t*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+// Every value must be in a bucket whose upper limit is at least the value
+// and at most 12.5% above it
+static int check_buckets(void) {
+    int errors = 0;
+
+    for (uint64_t value = 0; value < (1 << 20); value += 1 + value / 64) {
+        size_t index   = bucket_index(value);
+        uint64_t upper = bucket_upper_limit(index);
+        if (upper < value || (double)(upper - value) > MAX_REL_ERROR * (double)value + 1.0) {
+            printf("Value %llu is in bucket %zu with upper limit %llu\n",
+                   (unsigned long long)value,
+                   index,
+                   (unsigned long long)upper);
+            errors++;
+        }
+        if (index > 0 && bucket_upper_limit(index - 1) >= value) {
+            printf("Value %llu also fits in bucket %zu\n", (unsigned long long)value, index - 1);
+            errors++;
+        }
+    }
+    if (bucket_index(UINT64_MAX) != STAGE_HISTOGRAM_NBR_BUCKETS - 1) {
+        printf("The largest value is not in the last bucket\n");
+        errors++;
+    }
+    return errors;
+}
+
+static int check_percentiles(stage_stats_t* stats, uint64_t* samples) {
+    static const double percentiles[] = {1.0, 50.0, 90.0, 99.0, 100.0};
+    int errors                        = 0;
+
+    // Latencies between 10 us and 50 ms
+    for (size_t i = 0; i < NBR_SAMPLES; i++) {
+        samples[i] = 10000 + random_uint() % 50000000;
+        stage_stats_record(stats, STAGE_INFERENCE, samples[i]);
+    }
+    qsort(samples, NBR_SAMPLES, sizeof(uint64_t), compare_uint64);
+
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        double exact_rank = ceil(percentiles[i] / 100.0 * NBR_SAMPLES);
+        size_t rank       = (size_t)exact_rank;
+        uint64_t exact    = samples[rank - 1];
+        uint64_t value    = stage_stats_percentile(stats, STAGE_INFERENCE, percentiles[i]);
+        if (value < exact || (double)(value - exact) > MAX_REL_ERROR * (double)exact) {
+            printf("p%g is %llu ns, the samples give %llu ns\n",
+                   percentiles[i],
+                   (unsigned long long)value,
+                   (unsigned long long)exact);
+            errors++;
+        }
+    }
+    if (stage_stats_percentile(stats, STAGE_INFERENCE, 100.0) != samples[NBR_SAMPLES - 1]) {
+        printf("p100 is not the largest sample\n");
+        errors++;
+    }
+    if (stage_stats_percentile(stats, STAGE_PREPROCESSING, 50.0) != 0) {
+        printf("A stage without samples has a percentile\n");
+        errors++;
+    }
+    return errors;
+}
+
+static int check_dump(stage_stats_t* stats) {
+    char expected[128];
+    char contents[16384];
+    int errors = 0;
+
+    stage_stats_add_dropped_frames(stats, 3);
+    stage_stats_add_dropped_frames(stats, 4);
+    stage_stats_add_skipped_frames(stats, 2);
+    stage_stats_add_no_power_time(stats, 5000000);
+    stage_stats_report(stats);
+
+    FILE* file = fopen(dump_file, "r");
+    if (!file) {
+        printf("The dump file %s was not written\n", dump_file);
+        return 1;
+    }
+    size_t size    = fread(contents, 1, sizeof(contents) - 1, file);
+    contents[size] = '\0';
+    fclose(file);
+    remove(dump_file);
+
+    snprintf(expected, sizeof(expected), "\"inference\":{\"count\":%d,", NBR_SAMPLES);
+    const char* keys[] = {"{\"uptime_ns\":",
+                          "\"dropped_frames\":7,",
+                          "\"skipped_frames\":2,",
+                          "\"no_power_ns\":5000000,",
+                          expected,
+                          "\"poll_wait\":"};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (!strstr(contents, keys[i])) {
+            printf("The dump file does not contain %s\n", keys[i]);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main(void) {
+    int errors = 0;
+
+    uint64_t* samples = malloc(NBR_SAMPLES * sizeof(uint64_t));
+    if (!samples) {
+        printf("Could not allocate the samples\n");
+        return 1;
+    }
+    stage_stats_t* stats = stage_stats_new(dump_file, 10);
+
+    errors += check_buckets();
+    errors += check_percentiles(stats, samples);
+    errors += check_dump(stats);
+
+    free(stats->dump_file);
+    free(stats);
+    free(samples);
+
+    if (errors) {
+        printf("FAILED: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}